@@ -67,11 +67,8 @@ public:
         int status = EnsureGetSpace(numBytes);
         if (status > 0)
         {
-            for (unsigned int j = 0; j < size; ++j)
-            {
-                mGenIConvert->GetFromBuf(GetGetIndex(), aVec[j]);
-                IncrementGetIndex(sizeof(T));
-            }
+            mGenIConvert->GetArrayFromBuf(GetGetIndex(), aVec.data(), size);
+            IncrementGetIndex(numBytes);
             return static_cast<int>(numBytes);
         }
         else
@@ -104,11 +101,8 @@ public:
         int status = EnsureGetSpace(numBytes);
         if (status > 0)
         {
-            for (unsigned int j = 0; j < aArrayLen; ++j)
-            {
-                mGenIConvert->GetFromBuf(GetGetIndex(), aValue[j]);
-                IncrementGetIndex(sizeof(T));
-            }
+            mGenIConvert->GetArrayFromBuf(GetGetIndex(), aValue, aArrayLen);
+            IncrementGetIndex(numBytes);
             return numBytes;
         }
         else
@@ -69,11 +69,8 @@ public:
         int status = EnsurePutSpace(numBytes);
         if (status > 0)
         {
-            for (unsigned int j = 0; j < size; ++j)
-            {
-                mGenOConvert->PutToBuf(GetPutIndex(), aVec[j]);
-                IncrementPutIndex(sizeof(T));
-            }
+            mGenOConvert->PutArrayToBuf(GetPutIndex(), aVec.data(), size);
+            IncrementPutIndex(numBytes);
             return static_cast<int>(numBytes);
         }
         else
@@ -105,11 +102,8 @@ public:
         int status = EnsurePutSpace(numBytes);
         if (status > 0)
         {
-            for (unsigned int j = 0; j < aArrayLen; ++j)
-            {
-                mGenOConvert->PutToBuf(GetPutIndex(), aValue[j]);
-                IncrementPutIndex(sizeof(T));
-            }
+            mGenOConvert->PutArrayToBuf(GetPutIndex(), aValue, aArrayLen);
+            IncrementPutIndex(numBytes);
             return static_cast<int>(numBytes);
         }
         else
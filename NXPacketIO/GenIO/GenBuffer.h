@@ -6,6 +6,8 @@
 #include <algorithm>
 #include <cstring>
 
+#include "GenIO/GenSwapEndian.h"
+
 class NX_PACKETIO_EXPORT GenBuffer
 {
 public:
@@ -50,6 +52,8 @@ public:
 
     //! Disable or Enable byte swapping
     void EnableByteSwap(bool aSwapBytes) { mSwapBytes = aSwapBytes; }
+    //! Returns 'true' if values are byte swapped as they are put and got
+    bool IsByteSwapEnabled() const { return mSwapBytes; }
     //! Enable byte swapping if the local machine is little-endian
     void SetBigEndian();
     //! Disable byte swapping
@@ -163,6 +167,58 @@ public:
         GetP<sizeof(T)>(reinterpret_cast<char*>(&aVal));
     }
 
+    //! Put an array of basic types into the buffer.  This will perform a byte-swap
+    //! of each value if that option is enabled, converting the whole array at once.
+    template <typename T>
+    void PutArray(const T* aValues, size_t aCount)
+    {
+        size_t bytes = sizeof(T) * aCount;
+        CheckPutSpace(bytes);
+        if (mSwapBytes && sizeof(T) > 1)
+        {
+            GenSwapEndian::CopySwappedArray(mBuffer + mPutPos, reinterpret_cast<const char*>(aValues), aCount, sizeof(T));
+        }
+        else if (bytes > 0)
+        {
+            memcpy(mBuffer + mPutPos, aValues, bytes);
+        }
+        mPutPos += bytes;
+    }
+    //! Get an array of basic types from the buffer, see PutArray()
+    //! @return 'false' if the buffer holds fewer than aCount values; nothing is copied.
+    template <typename T>
+    bool GetArray(T* aValues, size_t aCount)
+    {
+        size_t bytes = sizeof(T) * aCount;
+        if (!CheckGetSpace(bytes))
+        {
+            return false;
+        }
+        if (mSwapBytes && sizeof(T) > 1)
+        {
+            GenSwapEndian::CopySwappedArray(reinterpret_cast<char*>(aValues), mBuffer + mGetPos, aCount, sizeof(T));
+        }
+        else if (bytes > 0)
+        {
+            memcpy(aValues, mBuffer + mGetPos, bytes);
+        }
+        mGetPos += bytes;
+        return true;
+    }
+
+    //! Returns 'true' if aGetSize bytes remain to be read.  Otherwise the get position is moved
+    //! to the put position, so a length read off the wire can't read past the data, and the
+    //! packet fails its length check.
+    bool CheckGetSpace(size_t aGetSize)
+    {
+        if (aGetSize <= GetValidBytes())
+        {
+            return true;
+        }
+        mGetPos = mPutPos;
+        return false;
+    }
+
     void CheckPutSpace(size_t aPutSize)
     {
         if (mCanGrow && (aPutSize + mPutPos >= mBytes))
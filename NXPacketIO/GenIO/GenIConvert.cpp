@@ -4,3 +4,9 @@ GenIConvert::GenIConvert() {}
 
 // Virtual
 GenIConvert::~GenIConvert() {}
+
+// Virtual
+GenIConvert::ArrayTransfer GenIConvert::GetArrayTransfer(bool /*aIsFloat*/) const
+{
+    return cARRAY_CONVERT;
+}
@@ -3,7 +3,11 @@
 
 #include "NXPacketIO_Export.h"
 
+#include <cstring>
+#include <type_traits>
+
 #include "GenIO/GenIODefs.h"
+#include "GenIO/GenSwapEndian.h"
 
 class NX_PACKETIO_EXPORT GenIConvert
 {
@@ -22,7 +26,41 @@ public:
     virtual void GetFromBuf(const unsigned char* aCurGet, float& aValue) const = 0;
     virtual void GetFromBuf(const unsigned char* aCurGet, double& aValue) const = 0;
 
+    //! How arrays are moved between the buffer and memory, see GetArrayTransfer()
+    enum ArrayTransfer
+    {
+        cARRAY_COPY,
+        cARRAY_SWAP,
+        cARRAY_CONVERT
+    };
+
+    //! Get an array of values from the buffer.  Arrays that only need their bytes
+    //! swapped are converted all at once; others are converted one value at a time.
+    template <class T>
+    void GetArrayFromBuf(const unsigned char* aCurGet, T* aValues, unsigned int aCount) const
+    {
+        switch (GetArrayTransfer(std::is_floating_point<T>::value))
+        {
+        case cARRAY_COPY:
+            memcpy(aValues, aCurGet, sizeof(T) * aCount);
+            break;
+        case cARRAY_SWAP:
+            GenSwapEndian::CopySwappedArray(reinterpret_cast<char*>(aValues), reinterpret_cast<const char*>(aCurGet), aCount, sizeof(T));
+            break;
+        default:
+            for (unsigned int i = 0; i < aCount; ++i)
+            {
+                GetFromBuf(aCurGet + i * sizeof(T), aValues[i]);
+            }
+            break;
+        }
+    }
+
 protected:
+    //! Returns how arrays of integers or floating point values are got.
+    //! The default converts each value with GetFromBuf().
+    virtual ArrayTransfer GetArrayTransfer(bool aIsFloat) const;
+
     // Constructor
     GenIConvert();
 
@@ -347,3 +347,24 @@ void GenIConvertBigEndian::GetFromBuf(const unsigned char* aCurGet, double& aVal
 #endif
     }
 }
+
+// Arrays that need only a byte swap are converted all at once
+// Virtual
+GenIConvert::ArrayTransfer GenIConvertBigEndian::GetArrayTransfer(bool aIsFloat) const
+{
+#if defined(GENIO_VAX_G_FLOAT)
+    if (aIsFloat)
+    {
+        return cARRAY_CONVERT;
+    }
+#else
+    static_cast<void>(aIsFloat);
+#endif
+#if defined(GENIO_BIG_ENDIAN)
+    return cARRAY_COPY;
+#elif defined(GENIO_LIT_ENDIAN)
+    return cARRAY_SWAP;
+#else
+    return cARRAY_CONVERT;
+#endif
+}
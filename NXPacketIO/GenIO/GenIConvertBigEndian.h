@@ -27,6 +27,9 @@ public:
     void GetFromBuf(const unsigned char* aCurGet, GENIO_INT64& aValue) const override;
     void GetFromBuf(const unsigned char* aCurGet, float& aValue) const override;
     void GetFromBuf(const unsigned char* aCurGet, double& aValue) const override;
+
+protected:
+    ArrayTransfer GetArrayTransfer(bool aIsFloat) const override;
 };
 
 #endif
@@ -199,3 +199,22 @@ void GenIConvertLitEndian::GetFromBuf(const unsigned char* aCurGet, double& aVal
 #endif
     }
 }
+
+// Arrays that need only a byte swap are converted all at once
+// Virtual
+GenIConvert::ArrayTransfer GenIConvertLitEndian::GetArrayTransfer(bool aIsFloat) const
+{
+    if (!aIsFloat)
+    {
+        return GenIConvertLitEndianInt::GetArrayTransfer(aIsFloat);
+    }
+#if defined(GENIO_VAX_G_FLOAT)
+    return cARRAY_CONVERT;
+#elif defined(GENIO_LIT_ENDIAN)
+    return cARRAY_COPY;
+#elif defined(GENIO_BIG_ENDIAN)
+    return cARRAY_SWAP;
+#else
+    return cARRAY_CONVERT;
+#endif
+}
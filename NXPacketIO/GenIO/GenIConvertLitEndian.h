@@ -23,6 +23,9 @@ public:
 
     void GetFromBuf(const unsigned char* aCurGet, float& aValue) const override;
     void GetFromBuf(const unsigned char* aCurGet, double& aValue) const override;
+
+protected:
+    ArrayTransfer GetArrayTransfer(bool aIsFloat) const override;
 };
  
 #if defined(sgi) && (_COMPILER_VERSION >= 720)
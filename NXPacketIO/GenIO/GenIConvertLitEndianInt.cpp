@@ -321,3 +321,21 @@ void GenIConvertLitEndianInt::GetFromBuf(const unsigned char* aCurGet, GENIO_INT
          static_cast<GENIO_UINT64>(aCurGet[6]) << 48 | static_cast<GENIO_UINT64>(aCurGet[7]) << 56;
    }
 }
+
+// Integer arrays need at most a byte swap, so they are converted all at once.
+// Floating point values are left to the derived class.
+// Virtual
+GenIConvert::ArrayTransfer GenIConvertLitEndianInt::GetArrayTransfer(bool aIsFloat) const
+{
+    if (aIsFloat)
+    {
+        return cARRAY_CONVERT;
+    }
+#if defined(GENIO_LIT_ENDIAN)
+    return cARRAY_COPY;
+#elif defined(GENIO_BIG_ENDIAN)
+    return cARRAY_SWAP;
+#else
+    return cARRAY_CONVERT;
+#endif
+}
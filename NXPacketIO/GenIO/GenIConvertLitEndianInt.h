@@ -29,6 +29,9 @@ public:
     void GetFromBuf(const unsigned char* aCurGet, long& aValue) const override;
     void GetFromBuf(const unsigned char* aCurGet, GENIO_UINT64& aValue) const override;
     void GetFromBuf(const unsigned char* aCurGet, GENIO_INT64& aValue) const override;
+
+protected:
+    ArrayTransfer GetArrayTransfer(bool aIsFloat) const override;
 };
 
 #if defined(sgi) && (_COMPILER_VERSION >= 720)
@@ -0,0 +1,228 @@
+﻿#include "GenIO/GenMappedFile.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+GenMappedFile::GenMappedFile()
+    : mData(nullptr), mSize(0), mIsWritable(false), mFile(-1), mMappingHandle(nullptr)
+{
+}
+
+GenMappedFile::~GenMappedFile()
+{
+    Close();
+}
+
+void GenMappedFile::Close()
+{
+    Close(mSize);
+}
+
+#if defined(_WIN32)
+
+bool GenMappedFile::Create(const std::string& aPath, size_t aBytes)
+{
+    Close();
+    HANDLE file = CreateFileA(aPath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    mFile = (intptr_t)file;
+    mIsWritable = true;
+    if (!Map(aBytes))
+    {
+        Close(0);
+        return false;
+    }
+    return true;
+}
+
+bool GenMappedFile::Open(const std::string& aPath)
+{
+    Close();
+    HANDLE file = CreateFileA(aPath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER size;
+    mFile = (intptr_t)file;
+    mIsWritable = false;
+    if (!GetFileSizeEx(file, &size) || !Map((size_t)size.QuadPart))
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+//! Maps the file, extending it first if it is writable.  An empty file is not mapped.
+bool GenMappedFile::Map(size_t aBytes)
+{
+    if (aBytes == 0)
+    {
+        return false;
+    }
+    unsigned long long size = aBytes;
+    HANDLE mapping = CreateFileMappingA((HANDLE)mFile, nullptr, mIsWritable ? PAGE_READWRITE : PAGE_READONLY, (DWORD)(size >> 32), (DWORD)size, nullptr);
+    if (mapping == nullptr)
+    {
+        return false;
+    }
+    mData = (char*)MapViewOfFile(mapping, mIsWritable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, aBytes);
+    if (mData == nullptr)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+    mMappingHandle = mapping;
+    mSize = aBytes;
+    return true;
+}
+
+void GenMappedFile::Unmap()
+{
+    if (mData != nullptr)
+    {
+        UnmapViewOfFile(mData);
+        mData = nullptr;
+    }
+    if (mMappingHandle != nullptr)
+    {
+        CloseHandle((HANDLE)mMappingHandle);
+        mMappingHandle = nullptr;
+    }
+}
+
+bool GenMappedFile::Resize(size_t aBytes)
+{
+    if (!mIsWritable)
+    {
+        return false;
+    }
+    // A mapping can't outgrow its file mapping object, so both are recreated
+    FlushViewOfFile(mData, 0);
+    Unmap();
+    return Map(aBytes);
+}
+
+void GenMappedFile::Close(size_t aFileBytes)
+{
+    Unmap();
+    if (mFile != -1)
+    {
+        if (mIsWritable)
+        {
+            LARGE_INTEGER size;
+            size.QuadPart = (LONGLONG)aFileBytes;
+            SetFilePointerEx((HANDLE)mFile, size, nullptr, FILE_BEGIN);
+            SetEndOfFile((HANDLE)mFile);
+        }
+        CloseHandle((HANDLE)mFile);
+        mFile = -1;
+    }
+    mSize = 0;
+    mIsWritable = false;
+}
+
+#elif defined(__unix__) || defined(__APPLE__)
+
+bool GenMappedFile::Create(const std::string& aPath, size_t aBytes)
+{
+    Close();
+    int fd = open(aPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+    {
+        return false;
+    }
+    mFile = fd;
+    mIsWritable = true;
+    if (!Map(aBytes))
+    {
+        Close(0);
+        return false;
+    }
+    return true;
+}
+
+bool GenMappedFile::Open(const std::string& aPath)
+{
+    Close();
+    int fd = open(aPath.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        return false;
+    }
+    struct stat info;
+    mFile = fd;
+    mIsWritable = false;
+    if (fstat(fd, &info) != 0 || !Map((size_t)info.st_size))
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+//! Maps the file, extending it first if it is writable.  An empty file is not mapped.
+bool GenMappedFile::Map(size_t aBytes)
+{
+    int fd = (int)mFile;
+    if (aBytes == 0 || (mIsWritable && ftruncate(fd, (off_t)aBytes) != 0))
+    {
+        return false;
+    }
+    void* dataPtr = mmap(nullptr, aBytes, mIsWritable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    if (dataPtr == MAP_FAILED)
+    {
+        return false;
+    }
+    mData = (char*)dataPtr;
+    mSize = aBytes;
+    return true;
+}
+
+void GenMappedFile::Unmap()
+{
+    if (mData != nullptr)
+    {
+        munmap(mData, mSize);
+        mData = nullptr;
+    }
+}
+
+bool GenMappedFile::Resize(size_t aBytes)
+{
+    if (!mIsWritable)
+    {
+        return false;
+    }
+    Unmap();
+    return Map(aBytes);
+}
+
+void GenMappedFile::Close(size_t aFileBytes)
+{
+    Unmap();
+    if (mFile != -1)
+    {
+        int fd = (int)mFile;
+        if (mIsWritable)
+        {
+            (void)ftruncate(fd, (off_t)aFileBytes);
+        }
+        close(fd);
+        mFile = -1;
+    }
+    mSize = 0;
+    mIsWritable = false;
+}
+
+#endif
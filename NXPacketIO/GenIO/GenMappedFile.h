@@ -0,0 +1,55 @@
+﻿#ifndef GENMAPPEDFILE_H
+#define GENMAPPEDFILE_H
+
+#include "NXPacketIO_Export.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+//! A file mapped into memory, either read-only or for writing with a size that can grow.
+class NX_PACKETIO_EXPORT GenMappedFile
+{
+public:
+    GenMappedFile();
+    ~GenMappedFile();
+
+    //! Creates or truncates a file and maps aBytes of it for writing.
+    bool Create(const std::string& aPath, size_t aBytes);
+
+    //! Maps an existing file read-only.
+    bool Open(const std::string& aPath);
+
+    //! Changes the size of a file opened with Create().  The mapping may move.
+    bool Resize(size_t aBytes);
+
+    //! Unmaps and closes the file.  A file opened with Create() is first truncated to aFileBytes.
+    void Close(size_t aFileBytes);
+
+    void Close();
+
+    bool IsValid() const { return mData != nullptr; }
+
+    bool IsWritable() const { return mIsWritable; }
+
+    char* GetData() const { return mData; }
+
+    size_t GetSize() const { return mSize; }
+
+private:
+    GenMappedFile(const GenMappedFile&) = delete;
+    GenMappedFile& operator=(const GenMappedFile&) = delete;
+
+    bool Map(size_t aBytes);
+    void Unmap();
+
+    char* mData;
+    size_t mSize;
+    bool mIsWritable;
+    //! The file descriptor, or the file HANDLE on Windows.  -1 when closed.
+    intptr_t mFile;
+    //! The file mapping handle on Windows
+    void* mMappingHandle;
+};
+
+#endif
@@ -4,3 +4,9 @@ GenOConvert::GenOConvert() {}
 
 // Virtual
 GenOConvert::~GenOConvert() {}
+
+// Virtual
+GenOConvert::ArrayTransfer GenOConvert::GetArrayTransfer(bool /*aIsFloat*/) const
+{
+    return cARRAY_CONVERT;
+}
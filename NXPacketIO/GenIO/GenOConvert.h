@@ -5,7 +5,11 @@
 
 #include "NXPacketIO_Export.h"
 
+#include <cstring>
+#include <type_traits>
+
 #include "GenIO/GenIODefs.h"
+#include "GenIO/GenSwapEndian.h"
 
 class NX_PACKETIO_EXPORT GenOConvert
 {
@@ -24,7 +28,41 @@ public:
     virtual void PutToBuf(unsigned char* aCurPut, float aValue) const = 0;
     virtual void PutToBuf(unsigned char* aCurPut, double aValue) const = 0;
 
+    //! How arrays are moved between the buffer and memory, see GetArrayTransfer()
+    enum ArrayTransfer
+    {
+        cARRAY_COPY,
+        cARRAY_SWAP,
+        cARRAY_CONVERT
+    };
+
+    //! Put an array of values into the buffer.  Arrays that only need their bytes
+    //! swapped are converted all at once; others are converted one value at a time.
+    template <class T>
+    void PutArrayToBuf(unsigned char* aCurPut, const T* aValues, unsigned int aCount) const
+    {
+        switch (GetArrayTransfer(std::is_floating_point<T>::value))
+        {
+        case cARRAY_COPY:
+            memcpy(aCurPut, aValues, sizeof(T) * aCount);
+            break;
+        case cARRAY_SWAP:
+            GenSwapEndian::CopySwappedArray(reinterpret_cast<char*>(aCurPut), reinterpret_cast<const char*>(aValues), aCount, sizeof(T));
+            break;
+        default:
+            for (unsigned int i = 0; i < aCount; ++i)
+            {
+                PutToBuf(aCurPut + i * sizeof(T), aValues[i]);
+            }
+            break;
+        }
+    }
+
 protected:
+    //! Returns how arrays of integers or floating point values are put.
+    //! The default converts each value with PutToBuf().
+    virtual ArrayTransfer GetArrayTransfer(bool aIsFloat) const;
+
     // Constructor
     GenOConvert();
 
@@ -427,3 +427,24 @@ void GenOConvertBigEndian::PutToBuf(unsigned char* aCurPut, double aVal) const
 #endif
     }
 }
+
+// Arrays that need only a byte swap are converted all at once
+// Virtual
+GenOConvert::ArrayTransfer GenOConvertBigEndian::GetArrayTransfer(bool aIsFloat) const
+{
+#if defined(GENIO_VAX_G_FLOAT)
+    if (aIsFloat)
+    {
+        return cARRAY_CONVERT;
+    }
+#else
+    static_cast<void>(aIsFloat);
+#endif
+#if defined(GENIO_BIG_ENDIAN)
+    return cARRAY_COPY;
+#elif defined(GENIO_LIT_ENDIAN)
+    return cARRAY_SWAP;
+#else
+    return cARRAY_CONVERT;
+#endif
+}
@@ -27,6 +27,9 @@ public:
     void PutToBuf(unsigned char* aCurPut, GENIO_INT64 aValue) const override;
     void PutToBuf(unsigned char* aCurPut, float aValue) const override;
     void PutToBuf(unsigned char* aCurPut, double aValue) const override;
+
+protected:
+    ArrayTransfer GetArrayTransfer(bool aIsFloat) const override;
 };
 
 #endif
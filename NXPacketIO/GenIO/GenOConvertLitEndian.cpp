@@ -237,3 +237,22 @@ void GenOConvertLitEndian::PutToBuf(unsigned char* aCurPut, double aVal) const
 #endif
     }
 }
+
+// Arrays that need only a byte swap are converted all at once
+// Virtual
+GenOConvert::ArrayTransfer GenOConvertLitEndian::GetArrayTransfer(bool aIsFloat) const
+{
+    if (!aIsFloat)
+    {
+        return GenOConvertLitEndianInt::GetArrayTransfer(aIsFloat);
+    }
+#if defined(GENIO_VAX_G_FLOAT)
+    return cARRAY_CONVERT;
+#elif defined(GENIO_LIT_ENDIAN)
+    return cARRAY_COPY;
+#elif defined(GENIO_BIG_ENDIAN)
+    return cARRAY_SWAP;
+#else
+    return cARRAY_CONVERT;
+#endif
+}
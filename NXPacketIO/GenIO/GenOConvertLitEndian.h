@@ -23,6 +23,9 @@ public:
     // The data is not assumed to be aligned in the buffer.
     void PutToBuf(unsigned char* aCurPut, float aValue) const override;
     void PutToBuf(unsigned char* aCurPut, double aValue) const override;
+
+protected:
+    ArrayTransfer GetArrayTransfer(bool aIsFloat) const override;
 };
 
 #if defined(sgi) && (_COMPILER_VERSION >= 720)
@@ -306,3 +306,21 @@ void GenOConvertLitEndianInt::PutToBuf(unsigned char* aCurPut, GENIO_INT64 aVal)
         aCurPut[7] = static_cast<unsigned char>(*reinterpret_cast<GENIO_UINT64*>(&aVal) >> 56);
     }
 }
+
+// Integer arrays need at most a byte swap, so they are converted all at once.
+// Floating point values are left to the derived class.
+// Virtual
+GenOConvert::ArrayTransfer GenOConvertLitEndianInt::GetArrayTransfer(bool aIsFloat) const
+{
+    if (aIsFloat)
+    {
+        return cARRAY_CONVERT;
+    }
+#if defined(GENIO_LIT_ENDIAN)
+    return cARRAY_COPY;
+#elif defined(GENIO_BIG_ENDIAN)
+    return cARRAY_SWAP;
+#else
+    return cARRAY_CONVERT;
+#endif
+}
@@ -29,6 +29,9 @@ public:
     void PutToBuf(unsigned char* aCurPut, long aValue) const override;
     void PutToBuf(unsigned char* aCurPut, GENIO_UINT64 aValue) const override;
     void PutToBuf(unsigned char* aCurPut, GENIO_INT64 aValue) const override;
+
+protected:
+    ArrayTransfer GetArrayTransfer(bool aIsFloat) const override;
 };
 
 #if defined(sgi) && (_COMPILER_VERSION >= 720)
@@ -0,0 +1,182 @@
+﻿#include "GenIO/GenRingBuffer.h"
+
+#include <utility>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <atomic>
+#include <string>
+#endif
+
+GenRingBuffer::GenRingBuffer()
+    : mData(nullptr), mCapacity(0)
+{
+}
+
+GenRingBuffer::~GenRingBuffer()
+{
+    Release();
+}
+
+void GenRingBuffer::Swap(GenRingBuffer& aRhs)
+{
+    std::swap(mData, aRhs.mData);
+    std::swap(mCapacity, aRhs.mCapacity);
+}
+
+#if defined(_WIN32)
+
+// static
+size_t GenRingBuffer::GetGranularity()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+}
+
+bool GenRingBuffer::Create(size_t aBytes)
+{
+    Release();
+    size_t granularity = GetGranularity();
+    size_t capacity = (aBytes + granularity - 1) / granularity * granularity;
+    unsigned long long size = capacity;
+    HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, nullptr);
+    if (mapping == nullptr)
+    {
+        return false;
+    }
+    // Another thread may take the reserved address range before it is mapped, so retry a few times
+    for (int attempt = 0; attempt < 16 && mData == nullptr; ++attempt)
+    {
+        char* addressPtr = (char*)VirtualAlloc(nullptr, 2 * capacity, MEM_RESERVE, PAGE_NOACCESS);
+        if (addressPtr == nullptr)
+        {
+            break;
+        }
+        VirtualFree(addressPtr, 0, MEM_RELEASE);
+        void* firstPtr = MapViewOfFileEx(mapping, FILE_MAP_ALL_ACCESS, 0, 0, capacity, addressPtr);
+        void* secondPtr = nullptr;
+        if (firstPtr != nullptr)
+        {
+            secondPtr = MapViewOfFileEx(mapping, FILE_MAP_ALL_ACCESS, 0, 0, capacity, addressPtr + capacity);
+        }
+        if (secondPtr != nullptr)
+        {
+            mData = addressPtr;
+            mCapacity = capacity;
+        }
+        else if (firstPtr != nullptr)
+        {
+            UnmapViewOfFile(firstPtr);
+        }
+    }
+    // The views keep the mapping alive
+    CloseHandle(mapping);
+    return mData != nullptr;
+}
+
+void GenRingBuffer::Release()
+{
+    if (mData != nullptr)
+    {
+        UnmapViewOfFile(mData + mCapacity);
+        UnmapViewOfFile(mData);
+        mData = nullptr;
+        mCapacity = 0;
+    }
+}
+
+#elif defined(__unix__) || defined(__APPLE__)
+
+// static
+size_t GenRingBuffer::GetGranularity()
+{
+    return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+namespace
+{
+//! Returns an anonymous file descriptor that can be mapped more than once.
+int CreateAnonymousFile(size_t aBytes)
+{
+    int fd = -1;
+#if defined(__linux__)
+    fd = memfd_create("GenRingBuffer", MFD_CLOEXEC);
+#else
+    static std::atomic<unsigned> sNextId(0);
+    std::string name = "/GenRingBuffer." + std::to_string(getpid()) + "." + std::to_string(sNextId++);
+    fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0)
+    {
+        shm_unlink(name.c_str());
+    }
+#endif
+    if (fd >= 0 && ftruncate(fd, (off_t)aBytes) != 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+} // namespace
+
+bool GenRingBuffer::Create(size_t aBytes)
+{
+    Release();
+    size_t granularity = GetGranularity();
+    size_t capacity = (aBytes + granularity - 1) / granularity * granularity;
+    int fd = CreateAnonymousFile(capacity);
+    if (fd < 0)
+    {
+        return false;
+    }
+    // Reserve the whole range first, so both halves land next to each other
+    void* addressPtr = mmap(nullptr, 2 * capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addressPtr != MAP_FAILED)
+    {
+        char* basePtr = (char*)addressPtr;
+        if (mmap(basePtr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED &&
+            mmap(basePtr + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED)
+        {
+            mData = basePtr;
+            mCapacity = capacity;
+        }
+        else
+        {
+            munmap(addressPtr, 2 * capacity);
+        }
+    }
+    close(fd);
+    return mData != nullptr;
+}
+
+void GenRingBuffer::Release()
+{
+    if (mData != nullptr)
+    {
+        munmap(mData, 2 * mCapacity);
+        mData = nullptr;
+        mCapacity = 0;
+    }
+}
+
+#else
+
+// static
+size_t GenRingBuffer::GetGranularity()
+{
+    return 4096;
+}
+
+bool GenRingBuffer::Create(size_t)
+{
+    return false;
+}
+
+void GenRingBuffer::Release() {}
+
+#endif
@@ -0,0 +1,45 @@
+﻿#ifndef GENRINGBUFFER_H
+#define GENRINGBUFFER_H
+
+#include "NXPacketIO_Export.h"
+
+#include <cstddef>
+
+//! A block of memory mapped twice, back to back, in virtual memory.
+//! Byte i and byte i + GetCapacity() are the same memory, so any GetCapacity() bytes
+//! starting in the first half can be read or written as one contiguous range,
+//! and a reader never has to handle data that wraps around the end of the buffer.
+class NX_PACKETIO_EXPORT GenRingBuffer
+{
+public:
+    GenRingBuffer();
+    ~GenRingBuffer();
+
+    //! Maps a new buffer, releasing any existing one.
+    //! @param aBytes The minimum capacity, rounded up to GetGranularity().
+    //! @return 'false' if the platform does not support the mapping.
+    bool Create(size_t aBytes);
+
+    void Release();
+
+    bool IsValid() const { return mData != nullptr; }
+
+    //! Returns the start of the mapping, which is 2 * GetCapacity() bytes long.
+    char* GetData() const { return mData; }
+
+    size_t GetCapacity() const { return mCapacity; }
+
+    void Swap(GenRingBuffer& aRhs);
+
+    //! Returns the unit the capacity is rounded to.
+    static size_t GetGranularity();
+
+private:
+    GenRingBuffer(const GenRingBuffer&) = delete;
+    GenRingBuffer& operator=(const GenRingBuffer&) = delete;
+
+    char* mData;
+    size_t mCapacity;
+};
+
+#endif
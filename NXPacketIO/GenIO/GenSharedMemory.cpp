@@ -0,0 +1,207 @@
+﻿#include "GenIO/GenSharedMemory.h"
+
+#include <atomic>
+#include <chrono>
+#include <random>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+GenSharedMemory::GenSharedMemory()
+    : mData(nullptr), mSize(0), mIsLinked(false), mHandle(nullptr)
+{
+}
+
+GenSharedMemory::~GenSharedMemory()
+{
+    Release();
+}
+
+// static
+std::string GenSharedMemory::MakeUniqueName(const std::string& aPrefix)
+{
+    static std::atomic<unsigned> sNextId(0);
+    std::random_device random;
+    unsigned long long salt = ((unsigned long long)random() << 32) ^ random() ^ (unsigned long long)std::chrono::steady_clock::now().time_since_epoch().count();
+#if defined(_WIN32)
+    std::string name = "Local\\" + aPrefix + "." + std::to_string(GetCurrentProcessId());
+#else
+    std::string name = "/" + aPrefix + "." + std::to_string(getpid());
+#endif
+    return name + "." + std::to_string(sNextId++) + "." + std::to_string(salt);
+}
+
+#if defined(_WIN32)
+
+bool GenSharedMemory::Create(const std::string& aName, size_t aBytes)
+{
+    Release();
+    unsigned long long size = aBytes;
+    HANDLE handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, aName.c_str());
+    if (handle == nullptr)
+    {
+        return false;
+    }
+    if (GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        CloseHandle(handle);
+        return false;
+    }
+    mData = (char*)MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, aBytes);
+    if (mData == nullptr)
+    {
+        CloseHandle(handle);
+        return false;
+    }
+    mHandle = handle;
+    mSize = aBytes;
+    mName = aName;
+    mIsLinked = true;
+    return true;
+}
+
+bool GenSharedMemory::Open(const std::string& aName)
+{
+    Release();
+    HANDLE handle = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, aName.c_str());
+    if (handle == nullptr)
+    {
+        return false;
+    }
+    mData = (char*)MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (mData == nullptr)
+    {
+        CloseHandle(handle);
+        return false;
+    }
+    MEMORY_BASIC_INFORMATION info;
+    VirtualQuery(mData, &info, sizeof(info));
+    mHandle = handle;
+    mSize = info.RegionSize;
+    mName = aName;
+    return true;
+}
+
+void GenSharedMemory::Unlink()
+{
+    // The name goes away with the last handle, so holding on to it is all that keeps it open
+    if (mIsLinked && mHandle != nullptr)
+    {
+        CloseHandle((HANDLE)mHandle);
+        mHandle = nullptr;
+    }
+    mIsLinked = false;
+}
+
+void GenSharedMemory::Release()
+{
+    if (mData != nullptr)
+    {
+        UnmapViewOfFile(mData);
+        mData = nullptr;
+    }
+    if (mHandle != nullptr)
+    {
+        CloseHandle((HANDLE)mHandle);
+        mHandle = nullptr;
+    }
+    mSize = 0;
+    mIsLinked = false;
+}
+
+#elif defined(__unix__) || defined(__APPLE__)
+
+bool GenSharedMemory::Create(const std::string& aName, size_t aBytes)
+{
+    Release();
+    int fd = shm_open(aName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+    {
+        return false;
+    }
+    void* dataPtr = MAP_FAILED;
+    if (ftruncate(fd, (off_t)aBytes) == 0)
+    {
+        dataPtr = mmap(nullptr, aBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (dataPtr == MAP_FAILED)
+    {
+        shm_unlink(aName.c_str());
+        return false;
+    }
+    mData = (char*)dataPtr;
+    mSize = aBytes;
+    mName = aName;
+    mIsLinked = true;
+    return true;
+}
+
+bool GenSharedMemory::Open(const std::string& aName)
+{
+    Release();
+    int fd = shm_open(aName.c_str(), O_RDWR, 0600);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat info;
+    void* dataPtr = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        dataPtr = mmap(nullptr, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (dataPtr == MAP_FAILED)
+    {
+        return false;
+    }
+    mData = (char*)dataPtr;
+    mSize = (size_t)info.st_size;
+    mName = aName;
+    return true;
+}
+
+void GenSharedMemory::Unlink()
+{
+    if (mIsLinked)
+    {
+        shm_unlink(mName.c_str());
+        mIsLinked = false;
+    }
+}
+
+void GenSharedMemory::Release()
+{
+    Unlink();
+    if (mData != nullptr)
+    {
+        munmap(mData, mSize);
+        mData = nullptr;
+    }
+    mSize = 0;
+}
+
+#else
+
+bool GenSharedMemory::Create(const std::string&, size_t)
+{
+    return false;
+}
+
+bool GenSharedMemory::Open(const std::string&)
+{
+    return false;
+}
+
+void GenSharedMemory::Unlink() {}
+
+void GenSharedMemory::Release() {}
+
+#endif
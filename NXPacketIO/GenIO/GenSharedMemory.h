@@ -0,0 +1,54 @@
+﻿#ifndef GENSHAREDMEMORY_H
+#define GENSHAREDMEMORY_H
+
+#include "NXPacketIO_Export.h"
+
+#include <cstddef>
+#include <string>
+
+//! A named block of memory that can be mapped by several processes on the same host.
+//! POSIX shared memory on Unix, a pagefile-backed file mapping on Windows.
+class NX_PACKETIO_EXPORT GenSharedMemory
+{
+public:
+    GenSharedMemory();
+    ~GenSharedMemory();
+
+    //! Creates and maps a new zero-filled segment.
+    //! @return 'false' if the name is already in use, or the segment can't be created.
+    bool Create(const std::string& aName, size_t aBytes);
+
+    //! Maps a segment created by another process.
+    bool Open(const std::string& aName);
+
+    //! Removes the name so no other process can open the segment.
+    //! Processes that already have it mapped are not affected.
+    void Unlink();
+
+    void Release();
+
+    bool IsValid() const { return mData != nullptr; }
+
+    char* GetData() const { return mData; }
+
+    size_t GetSize() const { return mSize; }
+
+    const std::string& GetName() const { return mName; }
+
+    //! Returns a name that is not used by any other segment on this host.
+    static std::string MakeUniqueName(const std::string& aPrefix);
+
+private:
+    GenSharedMemory(const GenSharedMemory&) = delete;
+    GenSharedMemory& operator=(const GenSharedMemory&) = delete;
+
+    char* mData;
+    size_t mSize;
+    std::string mName;
+    //! 'true' while this process created the name and has not unlinked it
+    bool mIsLinked;
+    //! The file mapping handle on Windows
+    void* mHandle;
+};
+
+#endif
@@ -1,6 +1,9 @@
 ﻿#include "GenIO/GenSocket.h"
 
+#include <algorithm>
 #include <cerrno>
+#include <chrono>
+#include <cmath>
 #include <cstdio>
 #include <cstring>
 #include <iostream>
@@ -10,6 +13,11 @@
 #ifdef __sun
 #include <sys/filio.h>
 #endif
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/uio.h>
+#endif
 
 #include "GenIO/GenInternetSocketAddress.h"
 #include "GenIO/GenSocketIncludes.h"
@@ -19,6 +27,22 @@ namespace GenSockets
 
 namespace
 {
+#ifndef _WIN32
+//! Waits up to aWaitTime seconds for aEvents on aSocket.  Returns 'true' if one occurred.
+bool PollSocket(SockFd aSocket, short aEvents, float aWaitTime)
+{
+    pollfd entry;
+    entry.fd = aSocket;
+    entry.events = aEvents;
+    entry.revents = 0;
+    // Waits too long to count in milliseconds, such as WaitUntilReceiveReady()'s default, never end
+    const float cMAX_WAIT_MS = 2.0E9f;
+    float waitMs = std::ceil(aWaitTime * 1000.0f);
+    int timeout = (waitMs >= cMAX_WAIT_MS) ? -1 : static_cast<int>(std::max(waitMs, 0.0f));
+    return poll(&entry, 1, timeout) > 0;
+}
+#endif
+
 template <typename T>
 bool SetSockOpt(SockFd aSocket, int aLevel, int aOptionName, const T& aValue)
 {
@@ -209,6 +233,17 @@ GenInternetSocketAddress GenSocket::GetBoundAddr()
     return GenInternetSocketAddress();
 }
 
+GenInternetSocketAddress GenSocket::GetPeerAddr()
+{
+    sockaddr_in addr;
+    socklen_t size = sizeof(addr);
+    if (0 == getpeername(mSocket, reinterpret_cast<sockaddr*>(&addr), &size))
+    {
+        return GenInternetSocketAddress(addr);
+    }
+    return GenInternetSocketAddress();
+}
+
 //! Binds the socket to a port and interface.
 //! @param aAddr  The local address to bind to.
 //! @return 'true' if the socket was bound successfully
@@ -398,6 +433,262 @@ int GenSocket::ReceiveFrom(char* aBuffer, int aBuffSize, GenInternetSocketAddres
     return rv;
 }
 
+namespace
+{
+//! The most datagrams handed to the OS in a single batched call.
+const int cMAX_BATCH_SIZE = 64;
+//! The most segments handed to the OS in a single gather send.
+const int cMAX_SEGMENT_COUNT = 64;
+
+int64_t GetSteadyTime()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+} // namespace
+
+//! Send several datagrams, each to its own address, with as few system calls
+//! as the platform allows (sendmmsg on Linux, otherwise one SendTo each).
+//! @param aDatagrams The datagrams to send.  mBuffer, mBufferSize and mAddressPtr must be set.
+//! @param aCount     The number of datagrams in aDatagrams.
+//! @return The number of datagrams handed to the OS, which may be less than aCount if
+//!         the socket would block.  Negative identifies an error of type Socket::Error
+int GenSocket::SendToBatch(const Datagram* aDatagrams, int aCount)
+{
+    int sent = 0;
+#if defined(__linux__)
+    mmsghdr messages[cMAX_BATCH_SIZE];
+    iovec   vectors[cMAX_BATCH_SIZE];
+    while (sent < aCount)
+    {
+        int count = std::min(aCount - sent, cMAX_BATCH_SIZE);
+        for (int i = 0; i < count; ++i)
+        {
+            const Datagram& datagram = aDatagrams[sent + i];
+            vectors[i].iov_base      = datagram.mBuffer;
+            vectors[i].iov_len       = datagram.mBufferSize;
+            memset(&messages[i], 0, sizeof(mmsghdr));
+            messages[i].msg_hdr.msg_name    = datagram.mAddressPtr->mSockAddr;
+            messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            messages[i].msg_hdr.msg_iov     = &vectors[i];
+            messages[i].msg_hdr.msg_iovlen  = 1;
+        }
+        int rv = sendmmsg(mSocket, messages, count, 0);
+        if (rv < 0)
+        {
+            if (GetLastError() == cWOULD_BLOCK)
+            {
+                break;
+            }
+            return sent > 0 ? sent : (int)cSOCKET_ERROR;
+        }
+        for (int i = 0; i < rv; ++i)
+        {
+            mTotalBytesSent += messages[i].msg_len;
+        }
+        sent += rv;
+        if (rv < count)
+        {
+            break;
+        }
+    }
+#else
+    for (; sent < aCount; ++sent)
+    {
+        const Datagram& datagram = aDatagrams[sent];
+        int             rv       = SendTo(datagram.mBuffer, datagram.mBufferSize, *datagram.mAddressPtr);
+        if (rv <= 0)
+        {
+            if (rv < 0 && sent == 0)
+            {
+                return rv;
+            }
+            break;
+        }
+    }
+#endif
+    return sent;
+}
+
+//! Receive the datagrams already waiting on the socket, up to aCount, with as few
+//! system calls as the platform allows (recvmmsg on Linux).  Never waits.
+//! @param aDatagrams The receive slots.  mBuffer and mBufferSize must be set; mBytes, mReceiveTime
+//!                   and the address pointed to by mAddressPtr (if any) are filled in.
+//!                   mReceiveTime is the kernel's time with cRECEIVE_TIMESTAMPS, otherwise
+//!                   the time of the system call.
+//! @param aCount     The number of slots in aDatagrams.
+//! @return The number of datagrams received, 0 if none are waiting.
+//!         Negative identifies an error of type Socket::Error
+int GenSocket::ReceiveFromBatch(Datagram* aDatagrams, int aCount)
+{
+    int received = 0;
+#if defined(__linux__)
+    mmsghdr messages[cMAX_BATCH_SIZE];
+    iovec   vectors[cMAX_BATCH_SIZE];
+    bool    timestamps = (mSocketOptions & cRECEIVE_TIMESTAMPS) != 0;
+    char    controls[cMAX_BATCH_SIZE][CMSG_SPACE(sizeof(timespec))];
+    while (received < aCount)
+    {
+        int count = std::min(aCount - received, cMAX_BATCH_SIZE);
+        for (int i = 0; i < count; ++i)
+        {
+            Datagram& datagram = aDatagrams[received + i];
+            vectors[i].iov_base = datagram.mBuffer;
+            vectors[i].iov_len  = datagram.mBufferSize;
+            memset(&messages[i], 0, sizeof(mmsghdr));
+            if (datagram.mAddressPtr != nullptr)
+            {
+                datagram.mAddressPtr->SetPort(mBoundPort);
+                messages[i].msg_hdr.msg_name    = datagram.mAddressPtr->mSockAddr;
+                messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            }
+            messages[i].msg_hdr.msg_iov    = &vectors[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+            if (timestamps)
+            {
+                messages[i].msg_hdr.msg_control    = controls[i];
+                messages[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+            }
+        }
+        int rv = recvmmsg(mSocket, messages, count, MSG_DONTWAIT, nullptr);
+        if (rv <= 0)
+        {
+            // Connection Reset indicates a previously sent message was not received.
+            int errorCode = GetLastError();
+            if (received == 0 && !(rv < 0 && (errorCode == cWOULD_BLOCK || errorCode == cCONNECTION_RESET)))
+            {
+                mIsConnected = false;
+                return cNOT_CONNECTED;
+            }
+            break;
+        }
+        int64_t readTime = GetSteadyTime();
+        // The kernel stamps datagrams with the real time clock, its age is carried over to the steady clock
+        int64_t realTime = 0;
+        if (timestamps)
+        {
+            timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            realTime = now.tv_sec * 1000000000LL + now.tv_nsec;
+        }
+        for (int i = 0; i < rv; ++i)
+        {
+            Datagram& datagram = aDatagrams[received + i];
+            datagram.mBytes = messages[i].msg_len;
+            datagram.mReceiveTime = readTime;
+            mTotalBytesReceived += messages[i].msg_len;
+            for (cmsghdr* cmsgPtr = timestamps ? CMSG_FIRSTHDR(&messages[i].msg_hdr) : nullptr; cmsgPtr != nullptr;
+                 cmsgPtr = CMSG_NXTHDR(&messages[i].msg_hdr, cmsgPtr))
+            {
+                if (cmsgPtr->cmsg_level == SOL_SOCKET && cmsgPtr->cmsg_type == SCM_TIMESTAMPNS)
+                {
+                    timespec stamp;
+                    memcpy(&stamp, CMSG_DATA(cmsgPtr), sizeof(stamp));
+                    int64_t age = realTime - (stamp.tv_sec * 1000000000LL + stamp.tv_nsec);
+                    datagram.mReceiveTime = readTime - std::max<int64_t>(age, 0);
+                }
+            }
+        }
+        received += rv;
+        if (rv < count)
+        {
+            break;
+        }
+    }
+#else
+    GenInternetSocketAddress sender;
+    for (; received < aCount; ++received)
+    {
+        Datagram&                 datagram = aDatagrams[received];
+        GenInternetSocketAddress& address  = datagram.mAddressPtr != nullptr ? *datagram.mAddressPtr : sender;
+        int                       rv       = ReceiveFrom(datagram.mBuffer, datagram.mBufferSize, address, 0);
+        if (rv <= 0)
+        {
+            if (rv < 0 && received == 0)
+            {
+                return rv;
+            }
+            break;
+        }
+        datagram.mBytes = rv;
+        datagram.mReceiveTime = GetSteadyTime();
+        // A blocking socket may only be read once without waiting.
+        if (!(mSocketOptions & cNON_BLOCKING))
+        {
+            ++received;
+            break;
+        }
+    }
+#endif
+    return received;
+}
+
+//! Send several blocks of data to the connected socket as one contiguous stream,
+//! without first copying them together (sendmsg on Unix, WSASend on Windows).
+//! cEMULATE_MESSAGES_ON_STREAMS is not applied; the segments are sent as raw stream data.
+//! @param aSegments The blocks to send, in order.
+//! @param aCount    The number of blocks in aSegments.  At most 64 are sent per call.
+//! @param aWaitTime The time to wait for the socket to become ready to send.
+//! @return Positive number of bytes successfully sent, which may end part way through a segment.
+//!         Negative identifies an error of type Socket::Error
+int GenSocket::SendV(const Segment* aSegments, int aCount, float aWaitTime /* = 0*/)
+{
+    if (mSocketOptions & cNON_BLOCKING && aWaitTime > 0.0f)
+    {
+        if (!SendReady(aWaitTime))
+        {
+            return 0;
+        }
+    }
+    int count = std::min(aCount, cMAX_SEGMENT_COUNT);
+#ifdef _WIN32
+    WSABUF buffers[cMAX_SEGMENT_COUNT];
+    for (int i = 0; i < count; ++i)
+    {
+        buffers[i].buf = const_cast<char*>(aSegments[i].mData);
+        buffers[i].len = aSegments[i].mBytes;
+    }
+    DWORD bytesSent = 0;
+    int rv = WSASend(mSocket, buffers, count, &bytesSent, 0, nullptr, nullptr);
+    if (rv == 0)
+    {
+        rv = (int)bytesSent;
+    }
+#else
+    iovec vectors[cMAX_SEGMENT_COUNT];
+    for (int i = 0; i < count; ++i)
+    {
+        vectors[i].iov_base = const_cast<char*>(aSegments[i].mData);
+        vectors[i].iov_len = aSegments[i].mBytes;
+    }
+    msghdr message;
+    memset(&message, 0, sizeof(msghdr));
+    message.msg_iov = vectors;
+    message.msg_iovlen = count;
+    int flags = 0;
+#ifdef MSG_NOSIGNAL
+    flags = MSG_NOSIGNAL;
+#endif
+    int rv = (int)sendmsg(mSocket, &message, flags);
+#endif
+    if (rv <= 0)
+    {
+        if (rv < 0 && GetLastError() == cWOULD_BLOCK)
+        {
+            rv = 0;
+        }
+        else
+        {
+            mIsConnected = false;
+            rv = cNOT_CONNECTED;
+        }
+    }
+    else
+    {
+        mTotalBytesSent += rv;
+    }
+    return rv;
+}
+
 //! Waits until this socket is ready to receive.  Returns when either
 //! a socket is ready to receive data, or the wait time has expired.
 //! @aWaitTime The time to wait.
@@ -418,6 +709,7 @@ bool GenSocket::WaitUntilSendReady(float aWaitTime)
 //!         'false'     if the socket would block on receive
 bool GenSocket::ReceiveReady(float aWaitTime)
 {
+#ifdef _WIN32
     fd_set readSet;
     FD_ZERO(&readSet);
     FD_SET(mSocket, &readSet);
@@ -426,6 +718,10 @@ bool GenSocket::ReceiveReady(float aWaitTime)
     timeout.tv_sec = waitSec;
     timeout.tv_usec = static_cast<long>((aWaitTime - waitSec) * 1000000.0f);
     return (select(FD_SETSIZE, &readSet, nullptr, nullptr, &timeout) > 0);
+#else
+    // FD_SET() can not hold descriptors above FD_SETSIZE, poll() has no limit
+    return PollSocket(mSocket, POLLIN, aWaitTime);
+#endif
 }
 
 //! Determines if the socket is ready to send.
@@ -434,6 +730,7 @@ bool GenSocket::ReceiveReady(float aWaitTime)
 //!         'false'  if the socket would block on send
 bool GenSocket::SendReady(float aWaitTime)
 {
+#ifdef _WIN32
     fd_set sendSet;
     FD_ZERO(&sendSet);
     FD_SET(mSocket, &sendSet);
@@ -442,6 +739,9 @@ bool GenSocket::SendReady(float aWaitTime)
     timeout.tv_sec = waitSec;
     timeout.tv_usec = static_cast<long>((aWaitTime - waitSec) * 1000000.0f);
     return (select(FD_SETSIZE, nullptr, &sendSet, nullptr, &timeout) > 0);
+#else
+    return PollSocket(mSocket, POLLOUT, aWaitTime);
+#endif
 }
 
 //! Close the socket.
@@ -522,9 +822,20 @@ void GenSocket::SetOptions(int aOptionMask, bool aOnOff)
     }
     if (aOptionMask & cTCP_NODNXY)
     {
-#ifdef _WIN32
-        SetSockOpt(mSocket, IPPROTO_TCP, cTCP_NODNXY, onOff);
-// TODO: Set on unix
+        SetSockOpt(mSocket, IPPROTO_TCP, TCP_NODELAY, (int)onOff);
+    }
+    if (aOptionMask & cTCP_CORK)
+    {
+#if defined(TCP_CORK)
+        SetSockOpt(mSocket, IPPROTO_TCP, TCP_CORK, (int)onOff);
+#elif defined(TCP_NOPUSH)
+        SetSockOpt(mSocket, IPPROTO_TCP, TCP_NOPUSH, (int)onOff);
+#endif
+    }
+    if (aOptionMask & cRECEIVE_TIMESTAMPS)
+    {
+#if defined(SO_TIMESTAMPNS)
+        SetSockOpt(mSocket, SOL_SOCKET, SO_TIMESTAMPNS, (int)onOff);
 #endif
     }
 }
@@ -3,6 +3,7 @@
 
 #include "NXPacketIO_Export.h"
 
+#include <cstdint>
 #include <list>
 
 #include "GenIO/GenOConvertBigEndian.h"
@@ -59,7 +60,13 @@ public:
         cENABLE_MULTICAST_LOOPBACK = 4,
         cDISABLE_UNIQUE_BINDING_CHECK = 8,
         cEMULATE_MESSAGES_ON_STREAMS = 0x10,
-        cTCP_NODNXY = 0x20
+        cTCP_NODNXY = 0x20,
+        //! Holds back partial segments until the option is removed.  TCP_CORK on Linux,
+        //! TCP_NOPUSH on BSD and macOS, ignored elsewhere.
+        cTCP_CORK = 0x40,
+        //! ReceiveFromBatch() reports when the kernel received each datagram (SO_TIMESTAMPNS)
+        //! instead of when it was read.  Linux only, ignored elsewhere.
+        cRECEIVE_TIMESTAMPS = 0x80
     };
     enum WaitAction
     {
@@ -67,6 +74,26 @@ public:
         cSOCKET_READY,
         cCAN_NOT_WAIT
     };
+    //! One datagram of a batched send or receive.
+    struct Datagram
+    {
+        //! The data to send, or the buffer to receive into
+        char* mBuffer;
+        //! The number of bytes to send, or the size of mBuffer when receiving
+        int mBufferSize;
+        //! The number of bytes received
+        int mBytes;
+        //! The destination address, or the sender of a received datagram
+        GenInternetSocketAddress* mAddressPtr;
+        //! When a received datagram arrived, in std::chrono::steady_clock nanoseconds
+        int64_t mReceiveTime;
+    };
+    //! One contiguous block of a scatter/gather send.
+    struct Segment
+    {
+        const char* mData;
+        int mBytes;
+    };
     GenSocket(SocketType aType);
     GenSocket(SocketType aType, bool aNoDelay);
 
@@ -88,10 +115,16 @@ public:
 
     int SendTo(const char* aBuffer, int aBuffSize, const GenInternetSocketAddress& aAddr);
 
+    int SendV(const Segment* aSegments, int aCount, float aWaitTime = 0);
+
     int Receive(char* aBuffer, int aBuffSize, float aWaitTime = 0);
 
     int ReceiveFrom(char* aBuffer, int aBuffSize, GenInternetSocketAddress& aAddr, float aWaitTime = 0);
 
+    int SendToBatch(const Datagram* aDatagrams, int aCount);
+
+    int ReceiveFromBatch(Datagram* aDatagrams, int aCount);
+
     bool WaitUntilReceiveReady(float aWaitTime = 1.0E10);
 
     bool WaitUntilSendReady(float aWaitTime = 1.0E10);
@@ -105,6 +138,10 @@ public:
     //! The Address returned will be INADDR_ANY if it is not bound.
     GenInternetSocketAddress GetBoundAddr();
 
+    //! Return the Socket Address of the peer this socket is connected to.
+    //! The Address returned will be INADDR_ANY if it is not connected.
+    GenInternetSocketAddress GetPeerAddr();
+
     //! Return the GenSocket::SocketOptions flags.
     //! @return The GenSocket::SocketOptions flags.
     int GetSocketOptions() const { return mSocketOptions; }
@@ -0,0 +1,203 @@
+﻿#include "GenIO/GenSocketPoller.h"
+
+#include <atomic>
+#include <cerrno>
+#include <iostream>
+
+#include "GenIO/GenSocket.h"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace GenSockets
+{
+namespace
+{
+#if defined(__linux__)
+const size_t cINITIAL_EVENT_COUNT = 64;
+
+//! Waits with epoll_pwait2(), whose timeout has nanosecond resolution, where the kernel has it
+//! (Linux 5.11).  epoll_wait() would round a sub-millisecond timeout up to a whole millisecond.
+//! @return The number of ready sockets, or -1 with errno set to ENOSYS if epoll_pwait2() is not available.
+int EpollWaitPrecise(int aPollFd, epoll_event* aEvents, int aMaxEvents, float aWaitTime)
+{
+#if defined(SYS_epoll_pwait2)
+    static std::atomic<bool> sUnavailable(false);
+    if (!sUnavailable.load(std::memory_order_relaxed))
+    {
+        timespec timeout;
+        timeout.tv_sec = static_cast<time_t>(aWaitTime);
+        timeout.tv_nsec = static_cast<long>((aWaitTime - static_cast<float>(timeout.tv_sec)) * 1.0e9f);
+        int readyCount = static_cast<int>(syscall(SYS_epoll_pwait2, aPollFd, aEvents, aMaxEvents, &timeout, nullptr, 0));
+        if (readyCount >= 0 || errno != ENOSYS)
+        {
+            return readyCount;
+        }
+        sUnavailable.store(true, std::memory_order_relaxed);
+    }
+#else
+    (void)aPollFd;
+    (void)aEvents;
+    (void)aMaxEvents;
+    (void)aWaitTime;
+#endif
+    errno = ENOSYS;
+    return -1;
+}
+#endif
+} // namespace
+
+GenSocketPoller::GenSocketPoller()
+    : mPollFd(-1)
+{
+#if defined(__linux__)
+    mPollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (mPollFd < 0)
+    {
+        std::cout << "GenSocketPoller: epoll_create1() failed." << std::endl;
+    }
+    mEventBuffer.resize(cINITIAL_EVENT_COUNT * sizeof(epoll_event));
+#endif
+}
+
+GenSocketPoller::~GenSocketPoller()
+{
+#if defined(__linux__)
+    if (mPollFd >= 0)
+    {
+        close(mPollFd);
+    }
+#endif
+}
+
+bool GenSocketPoller::IsSupported()
+{
+#if defined(__linux__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+//! Registers a socket for read readiness.
+//! @return 'true' if the socket was registered.
+bool GenSocketPoller::AddSocket(GenSocket* aSocket)
+{
+    bool ok = false;
+#if defined(__linux__)
+    if (mPollFd >= 0)
+    {
+        epoll_event event;
+        event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = aSocket;
+        ok = (epoll_ctl(mPollFd, EPOLL_CTL_ADD, aSocket->GetSocketFileDescriptor(), &event) == 0);
+    }
+#endif
+    if (ok)
+    {
+        GenSocketSet::AddSocket(aSocket);
+    }
+    return ok;
+}
+
+//! Adds or removes write readiness from the events reported for a registered socket.
+//! Enabling write interest reports the socket at the next Poll() if it can already be written.
+//! @return 'true' if the registration was updated.
+bool GenSocketPoller::SetWriteInterest(GenSocket* aSocket, bool aEnable)
+{
+    bool ok = false;
+#if defined(__linux__)
+    if (mPollFd >= 0)
+    {
+        epoll_event event;
+        event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+        if (aEnable)
+        {
+            event.events |= EPOLLOUT;
+        }
+        event.data.ptr = aSocket;
+        ok = (epoll_ctl(mPollFd, EPOLL_CTL_MOD, aSocket->GetSocketFileDescriptor(), &event) == 0);
+    }
+#else
+    (void)aSocket;
+    (void)aEnable;
+#endif
+    return ok;
+}
+
+//! Unregisters a socket.  Must be called before the socket is closed.
+void GenSocketPoller::RemoveSocket(GenSocket* aSocket)
+{
+#if defined(__linux__)
+    if (mPollFd >= 0)
+    {
+        epoll_event event = epoll_event();
+        epoll_ctl(mPollFd, EPOLL_CTL_DEL, aSocket->GetSocketFileDescriptor(), &event);
+    }
+#endif
+    GenSocketSet::RemoveSocket(aSocket);
+}
+
+//! Waits for registered sockets to become ready to read, or ready to write if they have write interest.
+//! @param aSignalledSocketSet The socket set filled with sockets that are ready
+//! @param aWaitTime The duration to wait in seconds.  0.0 makes this a non-blocking
+//!                  operation.  cBLOCK_FOREVER makes this block until a socket is ready.
+GenSocketSelector::SelectResult GenSocketPoller::Poll(GenSocketSet& aSignalledSocketSet, float aWaitTime)
+{
+    aSignalledSocketSet.Clear();
+    mWritableSockets.Clear();
+    GenSocketSelector::SelectResult result = GenSocketSelector::cTIMEOUT;
+#if defined(__linux__)
+    epoll_event* events = reinterpret_cast<epoll_event*>(&mEventBuffer[0]);
+    int maxEvents = static_cast<int>(mEventBuffer.size() / sizeof(epoll_event));
+    int readyCount = -1;
+    bool isTimed = aWaitTime > 0.0f && aWaitTime < GenSocketSelector::cBLOCK_FOREVER;
+    if (isTimed)
+    {
+        readyCount = EpollWaitPrecise(mPollFd, events, maxEvents, aWaitTime);
+    }
+    if (!isTimed || (readyCount < 0 && errno == ENOSYS))
+    {
+        int timeoutMs = -1;
+        if (aWaitTime < GenSocketSelector::cBLOCK_FOREVER)
+        {
+            timeoutMs = isTimed ? static_cast<int>(aWaitTime * 1000.0f + 0.999f) : 0;
+        }
+        readyCount = epoll_wait(mPollFd, events, maxEvents, timeoutMs);
+    }
+    if (readyCount > 0)
+    {
+        for (int i = 0; i < readyCount; ++i)
+        {
+            GenSocket* socketPtr = static_cast<GenSocket*>(events[i].data.ptr);
+            if (events[i].events & ~EPOLLOUT)
+            {
+                aSignalledSocketSet.AddSocket(socketPtr);
+            }
+            if (events[i].events & EPOLLOUT)
+            {
+                mWritableSockets.AddSocket(socketPtr);
+            }
+        }
+        result = GenSocketSelector::cREADY;
+        // A full batch means more sockets may be ready; make room for them next time.
+        if (readyCount == maxEvents)
+        {
+            mEventBuffer.resize(mEventBuffer.size() * 2);
+        }
+    }
+    else if (readyCount < 0 && errno != EINTR)
+    {
+        result = GenSocketSelector::cERROR;
+    }
+#else
+    (void)aWaitTime;
+#endif
+    return result;
+}
+
+} // namespace GenSockets
@@ -0,0 +1,51 @@
+﻿#ifndef GENSOCKETPOLLER_H
+#define GENSOCKETPOLLER_H
+
+#include "NXPacketIO_Export.h"
+
+#include <vector>
+
+#include "GenIO/GenSocketSelector.h"
+
+namespace GenSockets
+{
+class GenSocket;
+
+//! An event-driven alternative to GenSocketSelector.  On Linux this is backed by epoll
+//! in edge-triggered mode, so the cost of a wait is proportional to the number of ready
+//! sockets rather than the number of registered sockets, and there is no FD_SETSIZE limit.
+//! Because readiness is edge-triggered, a signalled socket must be read until it would block.
+//! Errors and hang-ups are reported as read readiness.  Write readiness is only reported
+//! for sockets given write interest, and is also edge-triggered.
+//! On other platforms IsSupported() returns false and no sockets are ever signalled.
+class NX_PACKETIO_EXPORT GenSocketPoller : public GenSocketSet
+{
+public:
+    GenSocketPoller();
+    ~GenSocketPoller();
+
+    //! Returns true if the poller is available on this platform.
+    static bool IsSupported();
+
+    bool AddSocket(GenSocket* aSocket);
+
+    void RemoveSocket(GenSocket* aSocket);
+
+    bool SetWriteInterest(GenSocket* aSocket, bool aEnable);
+
+    //! Returns the sockets with write interest that the last Poll() found ready to write.
+    const GenSocketSet& GetWritableSockets() const { return mWritableSockets; }
+
+    GenSocketSelector::SelectResult Poll(GenSocketSet& aSignalledSocketSet, float aWaitTime = GenSocketSelector::cBLOCK_FOREVER);
+
+private:
+    GenSocketPoller(const GenSocketPoller&);
+    GenSocketPoller& operator=(const GenSocketPoller&);
+
+    int mPollFd;
+    std::vector<char> mEventBuffer;
+    GenSocketSet mWritableSockets;
+};
+
+} // namespace GenSockets
+#endif
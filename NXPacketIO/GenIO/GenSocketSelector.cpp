@@ -84,19 +84,41 @@ GenSocketSelector::SelectResult GenSocketSelector::Select(GenSocketSet& aSignall
         memcpy(&exceptSet, &readSet, sizeof(readSet));
     }
 
+    // Sockets with write interest are reported separately, unless every socket is
+    // already being checked for write readiness.
+    mWritableSockets.Clear();
+    bool checkWriteInterest = (writePtr == nullptr && !mWriteSockets.empty());
+    if (checkWriteInterest)
+    {
+        writePtr = &writeSet;
+        BuildFD_Set(writeSet, mWriteSockets);
+    }
+
     int readyCount = select(FD_SETSIZE, readPtr, writePtr, exceptPtr, timeoutPtr);
 
     if (readyCount > 0)
     {
+        fd_set* signalledWritePtr = checkWriteInterest ? nullptr : writePtr;
         for (unsigned int i = 0; i < mSockets.size(); ++i)
         {
             GenSockets::SockFd fd = mSockets[i]->GetSocketFileDescriptor();
-            if ((readPtr && FD_ISSET(fd, readPtr)) || (writePtr && FD_ISSET(fd, writePtr)) || (exceptPtr && FD_ISSET(fd, exceptPtr)))
+            if ((readPtr && FD_ISSET(fd, readPtr)) || (signalledWritePtr && FD_ISSET(fd, signalledWritePtr)) || (exceptPtr && FD_ISSET(fd, exceptPtr)))
             {
                 aSignalledSocketSet.AddSocket(mSockets[i]);
                 result = cREADY;
             }
         }
+        if (checkWriteInterest)
+        {
+            for (unsigned int i = 0; i < mWriteSockets.size(); ++i)
+            {
+                if (FD_ISSET(mWriteSockets[i]->GetSocketFileDescriptor(), writePtr))
+                {
+                    mWritableSockets.AddSocket(mWriteSockets[i]);
+                    result = cREADY;
+                }
+            }
+        }
     }
     else if (readyCount < 0)
     {
@@ -105,4 +127,20 @@ GenSocketSelector::SelectResult GenSocketSelector::Select(GenSocketSet& aSignall
 
     return result;
 }
+//! Adds or removes a socket from the set waited on for write readiness.
+//! The socket does not need to be in the read set.  Sockets found ready to write
+//! are available from GetWritableSockets() after Select().
+void GenSocketSelector::SetWriteInterest(GenSocket* aSocket, bool aEnable)
+{
+    std::vector<GenSocket*>::iterator iter = std::find(mWriteSockets.begin(), mWriteSockets.end(), aSocket);
+    if (aEnable && iter == mWriteSockets.end())
+    {
+        mWriteSockets.push_back(aSocket);
+    }
+    else if (!aEnable && iter != mWriteSockets.end())
+    {
+        mWriteSockets.erase(iter);
+    }
+}
+
 } // namespace GenSockets
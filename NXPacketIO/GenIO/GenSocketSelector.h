@@ -3,6 +3,8 @@
 
 #include "NXPacketIO_Export.h"
 
+#include <vector>
+
 #include "GenIO/GenSocketSet.h"
 
 namespace GenSockets
@@ -33,6 +35,16 @@ public:
     GenSocketSelector();
     ~GenSocketSelector();
     SelectResult Select(GenSocketSet& aSignalledSocketSet, float aWaitTime = cBLOCK_FOREVER, int aSignalledEvent = cREAD);
+
+    void SetWriteInterest(GenSocket* aSocket, bool aEnable);
+
+    //! Returns the sockets with write interest that the last Select() found ready to write.
+    const GenSocketSet& GetWritableSockets() const { return mWritableSockets; }
+
+private:
+    //! Sockets waited on for write readiness, independent of aSignalledEvent
+    std::vector<GenSocket*> mWriteSockets;
+    GenSocketSet mWritableSockets;
 };
 
 } // namespace GenSockets
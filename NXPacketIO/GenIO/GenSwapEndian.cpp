@@ -0,0 +1,215 @@
+﻿#include "GenIO/GenSwapEndian.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GENSWAP_X86_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and clang need the instruction set enabled on each function that uses it.
+// MSVC allows the intrinsics anywhere.
+#if defined(GENSWAP_X86_SIMD) && !defined(_MSC_VER)
+#define GENSWAP_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define GENSWAP_TARGET_AVX2
+#endif
+
+namespace
+{
+typedef void (*ArrayKernel)(char* aDst, const char* aSrc, size_t aCount);
+
+template <size_t BYTES>
+void CopySwappedScalar(char* aDst, const char* aSrc, size_t aCount)
+{
+    for (size_t i = 0; i < aCount; ++i)
+    {
+        GenSwapEndian_Detail::SwapCopier<BYTES>::Copy(aDst + i * BYTES, aSrc + i * BYTES);
+    }
+}
+
+#ifdef GENSWAP_X86_SIMD
+// SSE2 has no byte shuffle, so values are reversed by swapping 16-bit words, then the bytes in each word.
+template <size_t BYTES>
+__m128i Swap128(__m128i aValue);
+
+template <>
+__m128i Swap128<2>(__m128i aValue)
+{
+    return _mm_or_si128(_mm_slli_epi16(aValue, 8), _mm_srli_epi16(aValue, 8));
+}
+
+template <>
+__m128i Swap128<4>(__m128i aValue)
+{
+    aValue = _mm_shufflelo_epi16(aValue, _MM_SHUFFLE(2, 3, 0, 1));
+    aValue = _mm_shufflehi_epi16(aValue, _MM_SHUFFLE(2, 3, 0, 1));
+    return Swap128<2>(aValue);
+}
+
+template <>
+__m128i Swap128<8>(__m128i aValue)
+{
+    aValue = _mm_shufflelo_epi16(aValue, _MM_SHUFFLE(0, 1, 2, 3));
+    aValue = _mm_shufflehi_epi16(aValue, _MM_SHUFFLE(0, 1, 2, 3));
+    return Swap128<2>(aValue);
+}
+
+template <size_t BYTES>
+void CopySwappedSSE2(char* aDst, const char* aSrc, size_t aCount)
+{
+    const size_t cPER_BLOCK = 16 / BYTES;
+    size_t i = 0;
+    for (; i + cPER_BLOCK <= aCount; i += cPER_BLOCK)
+    {
+        __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aSrc + i * BYTES));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(aDst + i * BYTES), Swap128<BYTES>(value));
+    }
+    CopySwappedScalar<BYTES>(aDst + i * BYTES, aSrc + i * BYTES, aCount - i);
+}
+
+// Byte indices that reverse each BYTES-sized value in a 16 byte lane
+template <size_t BYTES>
+struct LaneMask;
+
+template <>
+struct LaneMask<2>
+{
+    alignas(16) static constexpr char cINDICES[16] = {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14};
+};
+
+template <>
+struct LaneMask<4>
+{
+    alignas(16) static constexpr char cINDICES[16] = {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12};
+};
+
+template <>
+struct LaneMask<8>
+{
+    alignas(16) static constexpr char cINDICES[16] = {7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8};
+};
+
+// The remainder is handled here with VEX encoded instructions, and the upper halves of the ymm
+// registers are cleared before returning, so callers running legacy SSE code do not pay the
+// AVX to SSE transition penalty.
+template <size_t BYTES>
+GENSWAP_TARGET_AVX2 void CopySwappedAVX2(char* aDst, const char* aSrc, size_t aCount)
+{
+    const __m128i laneMask = _mm_load_si128(reinterpret_cast<const __m128i*>(LaneMask<BYTES>::cINDICES));
+    const __m256i mask = _mm256_broadcastsi128_si256(laneMask);
+    const size_t cPER_BLOCK = 32 / BYTES;
+    size_t i = 0;
+    for (; i + cPER_BLOCK <= aCount; i += cPER_BLOCK)
+    {
+        __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(aSrc + i * BYTES));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(aDst + i * BYTES), _mm256_shuffle_epi8(value, mask));
+    }
+    _mm256_zeroupper();
+    if (i + 16 / BYTES <= aCount)
+    {
+        __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aSrc + i * BYTES));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(aDst + i * BYTES), _mm_shuffle_epi8(value, laneMask));
+        i += 16 / BYTES;
+    }
+    for (; i < aCount; ++i)
+    {
+        GenSwapEndian_Detail::SwapCopier<BYTES>::Copy(aDst + i * BYTES, aSrc + i * BYTES);
+    }
+}
+
+bool HasAVX2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+        return false;
+    }
+    __cpuid(info, 1);
+    // The OS must save the AVX registers
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 0x6) != 0x6)
+    {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+// The kernels for 2, 4 and 8 byte values, chosen once for the processor we are running on
+struct ArrayKernels
+{
+    ArrayKernels()
+    {
+#ifdef GENSWAP_X86_SIMD
+        if (HasAVX2())
+        {
+            mName = "avx2";
+            mKernel[0] = &CopySwappedAVX2<2>;
+            mKernel[1] = &CopySwappedAVX2<4>;
+            mKernel[2] = &CopySwappedAVX2<8>;
+        }
+        else
+        {
+            mName = "sse2";
+            mKernel[0] = &CopySwappedSSE2<2>;
+            mKernel[1] = &CopySwappedSSE2<4>;
+            mKernel[2] = &CopySwappedSSE2<8>;
+        }
+#else
+        mName = "scalar";
+        mKernel[0] = &CopySwappedScalar<2>;
+        mKernel[1] = &CopySwappedScalar<4>;
+        mKernel[2] = &CopySwappedScalar<8>;
+#endif
+    }
+
+    const char* mName;
+    ArrayKernel mKernel[3];
+};
+
+const ArrayKernels& GetArrayKernels()
+{
+    static const ArrayKernels kernels;
+    return kernels;
+}
+} // namespace
+
+//! Copy aCount values of aBytes bytes each from aSrc to aDst, reversing the byte order of each value.
+//! aDst and aSrc must either be equal or not overlap.
+//! @param aBytes The size of each value: 1, 2, 4 or 8
+void GenSwapEndian::CopySwappedArray(char* aDst, const char* aSrc, size_t aCount, size_t aBytes)
+{
+    switch (aBytes)
+    {
+    case 2:
+        GetArrayKernels().mKernel[0](aDst, aSrc, aCount);
+        break;
+    case 4:
+        GetArrayKernels().mKernel[1](aDst, aSrc, aCount);
+        break;
+    case 8:
+        GetArrayKernels().mKernel[2](aDst, aSrc, aCount);
+        break;
+    default:
+        if (aDst != aSrc)
+        {
+            memcpy(aDst, aSrc, aCount * aBytes);
+        }
+        break;
+    }
+}
+
+//! Returns the name of the instruction set used by CopySwappedArray(): "avx2", "sse2" or "scalar"
+const char* GenSwapEndian::GetArrayKernelName()
+{
+    return GetArrayKernels().mName;
+}
@@ -4,6 +4,11 @@
 #include "NXPacketIO_Export.h"
 
 #include <algorithm>
+#include <cstdint>
+#include <cstring>
+#ifdef _MSC_VER
+#include <stdlib.h>
+#endif
 
 #include "GenIO/GenIODefs.h"
 
@@ -39,6 +44,57 @@ struct Swapper<8> {
         std::swap(aBytes[3], aBytes[4]);
     }
 };
+
+// Copies a 1,2,4 or 8 byte value, reversing its bytes with a single instruction where possible
+template <size_t BYTES>
+struct SwapCopier {
+};
+template <>
+struct SwapCopier<1> {
+    static void Copy(char* aDst, const char* aSrc) { *aDst = *aSrc; }
+};
+template <>
+struct SwapCopier<2> {
+    static void Copy(char* aDst, const char* aSrc)
+    {
+        uint16_t value;
+        memcpy(&value, aSrc, 2);
+#ifdef _MSC_VER
+        value = _byteswap_ushort(value);
+#else
+        value = __builtin_bswap16(value);
+#endif
+        memcpy(aDst, &value, 2);
+    }
+};
+template <>
+struct SwapCopier<4> {
+    static void Copy(char* aDst, const char* aSrc)
+    {
+        uint32_t value;
+        memcpy(&value, aSrc, 4);
+#ifdef _MSC_VER
+        value = _byteswap_ulong(value);
+#else
+        value = __builtin_bswap32(value);
+#endif
+        memcpy(aDst, &value, 4);
+    }
+};
+template <>
+struct SwapCopier<8> {
+    static void Copy(char* aDst, const char* aSrc)
+    {
+        uint64_t value;
+        memcpy(&value, aSrc, 8);
+#ifdef _MSC_VER
+        value = _byteswap_uint64(value);
+#else
+        value = __builtin_bswap64(value);
+#endif
+        memcpy(aDst, &value, 8);
+    }
+};
 } // namespace GenSwapEndian_Detail
 
 //! Provides swapping big->little / little->big endian byte-swapping in
@@ -92,6 +148,15 @@ public:
     static const bool cLITTLE_ENDIAN = false;
     static const bool cBIG_ENDIAN = true;
 #endif
+    //! Copy a 1,2,4 or 8 byte value from aSrc to aDst, reversing the byte order
+    template <size_t BYTES>
+    static void CopySwapped(char* aDst, const char* aSrc)
+    {
+        GenSwapEndian_Detail::SwapCopier<BYTES>::Copy(aDst, aSrc);
+    }
+    //! Copy an array of values, reversing the byte order of each.  Uses SIMD where available.
+    static void CopySwappedArray(char* aDst, const char* aSrc, size_t aCount, size_t aBytes);
+    static const char* GetArrayKernelName();
     //! Return an object that swaps big-endian to Native byte order using the '&' operator
     //! (this is a no-op if big endian is the native byte order)
     static GenBigEndianSwapper SwapBigNative() { return GenBigEndianSwapper(); }
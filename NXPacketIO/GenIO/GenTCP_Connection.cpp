@@ -154,6 +154,19 @@ int GenTCP_Connection::SendBuffer(int aWaitTimeInMicroSec, const char* aDataPtr,
     return bytesSent;
 }
 
+//! send several blocks of data across the TCP stream with a single gather write
+//! @return The number of bytes successfully sent or a negative
+//!         number of ErrorTypes
+int GenTCP_Connection::SendBufferV(int aWaitTimeInMicroSec, const GenSockets::GenSocket::Segment* aSegments, int aCount)
+{
+    int bytesSent = 0;
+    if (mSocket->IsConnected())
+    {
+        bytesSent = mSocket->SendV(aSegments, aCount, aWaitTimeInMicroSec * 1.0E-6F);
+    }
+    return bytesSent;
+}
+
 //! Return the address of the computer we are connected to
 //! @return The address of the computer we are connected to
 GenSockets::GenInternetSocketAddress GenTCP_Connection::GetSenderAddress() const
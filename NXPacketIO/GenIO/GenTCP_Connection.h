@@ -25,6 +25,8 @@ public:
 
     int SendBuffer(int aWaitTimeInMicroSec, const char* aDataPtr, int aBytes);
 
+    int SendBufferV(int aWaitTimeInMicroSec, const GenSockets::GenSocket::Segment* aSegments, int aCount);
+
     int ReceiveBuffer(int aWaitTimeInMicroSec, char* aBuffer, int aMaxBytes);
 
     int ReceiveBuffer(int aWaitTimeInMicroSec, GenBuffer& aBuffer, int aMaxBytes = 0);
@@ -28,6 +28,10 @@ GenUDP_Connection::~GenUDP_Connection()
     }
     delete mSendAddress;
     delete mLastSender;
+    for (auto* addressPtr : mAdditionalSendAddresses)
+    {
+        delete addressPtr;
+    }
 }
 
 //! Initialize and enable sending and receiving.
@@ -240,7 +244,113 @@ int GenUDP_Connection::SendBuffer(const char* aBuffer, int aBytes)
         return cNOT_INITIALIZED;
     }
     mHasSentMessages = true;
-    return mSendSocket->SendTo(aBuffer, aBytes, *mSendAddress);
+    if (mAdditionalSendAddresses.empty())
+    {
+        return mSendSocket->SendTo(aBuffer, aBytes, *mSendAddress);
+    }
+    // Fan out to every destination with one batched send
+    mSendBatch.resize(mAdditionalSendAddresses.size() + 1);
+    for (size_t i = 0; i < mSendBatch.size(); ++i)
+    {
+        GenSockets::GenSocket::Datagram& datagram = mSendBatch[i];
+        datagram.mBuffer = const_cast<char*>(aBuffer);
+        datagram.mBufferSize = aBytes;
+        datagram.mBytes = 0;
+        datagram.mAddressPtr = (i == 0) ? mSendAddress : mAdditionalSendAddresses[i - 1];
+    }
+    int sent = mSendSocket->SendToBatch(mSendBatch.data(), (int)mSendBatch.size());
+    return sent > 0 ? aBytes : sent;
+}
+
+//! Add another destination for SendBuffer().  Every buffer sent is delivered to the
+//! primary send address and to each additional address, using a single batched
+//! system call where the platform supports it.
+//! @param aSendAddress The IP address or host name of the destination.
+//! @param aSendToPort  The destination port.
+//! @return 'true' if the address was added.
+bool GenUDP_Connection::AddSendAddress(const std::string& aSendAddress, int aSendToPort)
+{
+    if (!mSendAddress)
+    {
+        std::cout << "GenUDP_Connection not initialized for sending." << std::endl;
+        return false;
+    }
+    GenSockets::GenIP ipaddr(aSendAddress);
+    if (ipaddr.IsValidForm())
+    {
+        mAdditionalSendAddresses.push_back(new GenSockets::GenInternetSocketAddress(GenSockets::GenInternetAddress(ipaddr), aSendToPort));
+    }
+    else
+    {
+        GenSockets::GenHostName hName(aSendAddress);
+        mAdditionalSendAddresses.push_back(new GenSockets::GenInternetSocketAddress(GenSockets::GenInternetAddress(hName), aSendToPort));
+    }
+    return true;
+}
+
+//! Receive every datagram already waiting, up to aCount, without waiting.
+//! Datagrams sent by this connection are dropped as in ReceiveBuffer(), and the
+//! remaining datagrams are packed to the front of aDatagrams.
+//! @param aDatagrams The receive slots.  Each must have a buffer and a sender address.
+//! @param aCount     The number of slots in aDatagrams.
+//! @return The number of datagrams received.  Negative is an error; see ErrorTypes.
+int GenUDP_Connection::ReceiveBatch(GenSockets::GenSocket::Datagram* aDatagrams, int aCount)
+{
+    if (mReadSocket->GetBoundPort() == -1)
+    {
+        std::cout << "GenUDP_Connection not initialized for receiving. " << std::endl;
+        return cNOT_INITIALIZED;
+    }
+    int received;
+    int kept;
+    do
+    {
+        received = mReadSocket->ReceiveFromBatch(aDatagrams, aCount);
+        if (received <= 0)
+        {
+            return received;
+        }
+        kept = received;
+        if (mHasSentMessages && mIgnoreLocalBroadcastPackets)
+        {
+            kept = 0;
+            for (int i = 0; i < received; ++i)
+            {
+                bool fromUs = false;
+                GenSockets::GenInternetSocketAddress& sender = *aDatagrams[i].mAddressPtr;
+                if (sender.GetPort() == mLocalPort)
+                {
+                    unsigned long senderAddr = sender.GetAddress().GetInAddr()->s_addr;
+                    for (unsigned j = 0; j < mLocalIps.size(); ++j)
+                    {
+                        if (mLocalIps[j].GetAddress() == senderAddr)
+                        {
+                            if (j != 0)
+                            {
+                                std::swap(mLocalIps[0], mLocalIps[j]);
+                            }
+                            fromUs = true;
+                            break;
+                        }
+                    }
+                }
+                if (!fromUs)
+                {
+                    if (kept != i)
+                    {
+                        std::swap(aDatagrams[kept], aDatagrams[i]);
+                    }
+                    ++kept;
+                }
+            }
+        }
+        // Keep reading if a full batch held nothing but our own datagrams
+    } while (kept == 0 && received == aCount);
+    if (kept > 0)
+    {
+        *mLastSender = *aDatagrams[kept - 1].mAddressPtr;
+    }
+    return kept;
 }
 
 //! Become a member of a multicast group.  The default interface is used.
@@ -8,12 +8,12 @@
 
 #include "GenIO/GenBuffer.h"
 #include "GenIO/GenIP.h"
+#include "GenIO/GenSocket.h"
 #include "GenIO/GenSocketConnection.h"
 
 namespace GenSockets
 {
 class GenInternetSocketAddress;
-class GenSocket;
 } // namespace GenSockets
 
 //! A UDP 'connection'
@@ -39,6 +39,10 @@ public:
     virtual int ReceiveBuffer(int aWaitTimeInMicroSec, char* aBuffer, int aBytes);
     virtual int SendBuffer(const char* aBuffer, int aBytes);
 
+    int ReceiveBatch(GenSockets::GenSocket::Datagram* aDatagrams, int aCount);
+
+    bool AddSendAddress(const std::string& aSendAddress, int aSendToPort);
+
     bool AddMulticastMembership(const std::string& aMulticastAddr);
 
     bool AddMulticastMembership(const std::string& aInterfaceAddr, const std::string& aMulticastAddr);
@@ -63,6 +67,13 @@ public:
 
     int GetSendToPort() const;
 
+    //! Returns the address sent to, or null if the connection does not send
+    const GenSockets::GenInternetSocketAddress* GetSendAddress() const { return mSendAddress; }
+
+    //! Returns 'true' if datagrams are sent from a port of their own rather than the receive port,
+    //! which Init() does when the send and receive ports are the same.
+    bool HasSeparateSendPort() const { return mSendSocket != mReadSocket; }
+
     enum ErrorTypes
     {
         cSOCKET_ERROR = -1, // use GenSocketManager to get error type
@@ -80,6 +91,8 @@ private:
     std::vector<GenSockets::GenIP> mLocalIps;
     bool mHasSentMessages;
     int mLocalPort;
+    std::vector<GenSockets::GenInternetSocketAddress*> mAdditionalSendAddresses;
+    std::vector<GenSockets::GenSocket::Datagram> mSendBatch;
 
     GenSockets::GenSocket* mSendSocket;
     GenSockets::GenSocket* mReadSocket;
@@ -0,0 +1,175 @@
+﻿#include "PacketIO/PakCaptureFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+const char cFILE_MAGIC[4] = {'N', 'X', 'P', 'C'};
+const uint32_t cFILE_VERSION = 1;
+const size_t cINITIAL_FILE_BYTES = 1 << 20;
+const size_t cMAXIMUM_GROWTH_BYTES = 256 << 20;
+
+//! Starts the file.  Values are in the byte order of the host that wrote the capture.
+struct FileHeader
+{
+    char mMagic[4];
+    uint32_t mVersion;
+    //! Wall clock time the capture was created, in nanoseconds since 1970
+    int64_t mCreationTime;
+};
+
+//! Precedes each frame.  Frames are padded to a multiple of 8 bytes.
+struct FrameHeader
+{
+    int64_t mTime;
+    //! Zero marks the end of the frames
+    uint32_t mBytes;
+    uint32_t mReserved;
+};
+
+size_t PaddedSize(size_t aBytes)
+{
+    return (aBytes + 7) & ~(size_t)7;
+}
+} // namespace
+
+PakCaptureFile::PakCaptureFile()
+    : mPosition(0), mFrameCount(0)
+{
+}
+
+PakCaptureFile::~PakCaptureFile()
+{
+    Close();
+}
+
+bool PakCaptureFile::Create(const std::string& aPath)
+{
+    Close();
+    if (!mFile.Create(aPath, cINITIAL_FILE_BYTES))
+    {
+        std::cout << "PakCaptureFile: Could not create " << aPath << std::endl;
+        return false;
+    }
+    FileHeader header;
+    memcpy(header.mMagic, cFILE_MAGIC, sizeof(cFILE_MAGIC));
+    header.mVersion = cFILE_VERSION;
+    header.mCreationTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    memcpy(mFile.GetData(), &header, sizeof(header));
+    mPosition = sizeof(FileHeader);
+    mFrameCount = 0;
+    mStartTime = std::chrono::steady_clock::now();
+    return true;
+}
+
+bool PakCaptureFile::Open(const std::string& aPath)
+{
+    Close();
+    if (!mFile.Open(aPath))
+    {
+        std::cout << "PakCaptureFile: Could not open " << aPath << std::endl;
+        return false;
+    }
+    FileHeader header;
+    if (mFile.GetSize() < sizeof(header))
+    {
+        header.mVersion = 0;
+    }
+    else
+    {
+        memcpy(&header, mFile.GetData(), sizeof(header));
+    }
+    if (header.mVersion != cFILE_VERSION || memcmp(header.mMagic, cFILE_MAGIC, sizeof(cFILE_MAGIC)) != 0)
+    {
+        std::cout << "PakCaptureFile: Not a capture file. " << aPath << std::endl;
+        mFile.Close();
+        return false;
+    }
+    Rewind();
+    return true;
+}
+
+void PakCaptureFile::Close()
+{
+    std::lock_guard<std::mutex> guard(mWriteMutex);
+    mFile.Close(mPosition);
+    mPosition = 0;
+    mFrameCount = 0;
+}
+
+//! Makes room for aBytes more at mPosition, plus the zero end marker.
+//! mWriteMutex must be held.
+bool PakCaptureFile::Reserve(size_t aBytes)
+{
+    size_t required = mPosition + aBytes + sizeof(FrameHeader);
+    if (required <= mFile.GetSize())
+    {
+        return true;
+    }
+    size_t size = mFile.GetSize();
+    while (size < required)
+    {
+        size += std::min(size, cMAXIMUM_GROWTH_BYTES);
+    }
+    if (!mFile.Resize(size))
+    {
+        std::cout << "PakCaptureFile: Could not grow the file to " << size << " bytes.  Capture stopped." << std::endl;
+        mFile.Close(mPosition);
+        return false;
+    }
+    return true;
+}
+
+//! Appends a frame, timestamped now.  The frame is given in two parts so the caller need not join them.
+void PakCaptureFile::Write(const char* aHeaderPtr, size_t aHeaderBytes, const char* aBodyPtr, size_t aBodyBytes)
+{
+    FrameHeader header;
+    header.mBytes = (uint32_t)(aHeaderBytes + aBodyBytes);
+    header.mReserved = 0;
+    std::lock_guard<std::mutex> guard(mWriteMutex);
+    if (header.mBytes == 0 || !mFile.IsWritable() || !Reserve(sizeof(FrameHeader) + PaddedSize(header.mBytes)))
+    {
+        return;
+    }
+    header.mTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - mStartTime).count();
+    char* framePtr = mFile.GetData() + mPosition + sizeof(FrameHeader);
+    memcpy(framePtr, aHeaderPtr, aHeaderBytes);
+    memcpy(framePtr + aHeaderBytes, aBodyPtr, aBodyBytes);
+    // The size is written last, so a partly written frame reads as the end of the file
+    memcpy(mFile.GetData() + mPosition, &header, sizeof(header));
+    mPosition += sizeof(FrameHeader) + PaddedSize(header.mBytes);
+    ++mFrameCount;
+}
+
+//! Reads the next frame.
+//! @return 'false' at the end of the file.
+bool PakCaptureFile::Read(Record& aRecord)
+{
+    FrameHeader header;
+    if (mFile.IsWritable() || mPosition + sizeof(FrameHeader) > mFile.GetSize())
+    {
+        return false;
+    }
+    memcpy(&header, mFile.GetData() + mPosition, sizeof(header));
+    if (header.mBytes == 0 || mPosition + sizeof(FrameHeader) + header.mBytes > mFile.GetSize())
+    {
+        return false;
+    }
+    aRecord.mTime = header.mTime;
+    aRecord.mFramePtr = mFile.GetData() + mPosition + sizeof(FrameHeader);
+    aRecord.mBytes = header.mBytes;
+    mPosition += sizeof(FrameHeader) + PaddedSize(header.mBytes);
+    ++mFrameCount;
+    return true;
+}
+
+void PakCaptureFile::Rewind()
+{
+    if (!mFile.IsWritable())
+    {
+        mPosition = sizeof(FileHeader);
+        mFrameCount = 0;
+    }
+}
@@ -0,0 +1,75 @@
+﻿#ifndef PAKCAPTUREFILE_H
+#define PAKCAPTUREFILE_H
+
+#include "NXPacketIO_Export.h"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "GenIO/GenMappedFile.h"
+
+//! An append-only file of timestamped packet frames, header included, as they were received.
+//! Attach one to an IO with PakSocketIO::SetCapture(), and play it back with PakReplayIO.
+//!
+//! The file is memory-mapped and grows in steps, so writing a frame is a copy and no system call.
+//! Several IOs may write to one capture from different threads.  The unused end of the file
+//! is zero-filled, so a capture cut short by a crash can still be read up to its last whole frame.
+class NX_PACKETIO_EXPORT PakCaptureFile
+{
+public:
+    //! A frame read back from the file
+    struct Record
+    {
+        //! Nanoseconds since the capture was created
+        int64_t mTime;
+        //! The frame, valid until the file is closed
+        const char* mFramePtr;
+        size_t mBytes;
+    };
+
+    PakCaptureFile();
+    ~PakCaptureFile();
+
+    //! Creates a new capture file for writing, replacing any file at aPath.
+    bool Create(const std::string& aPath);
+
+    //! Opens a capture file for reading.
+    bool Open(const std::string& aPath);
+
+    //! Trims the file to the frames written and closes it.
+    void Close();
+
+    bool IsOpen() const { return mFile.IsValid(); }
+
+    bool IsWritable() const { return mFile.IsWritable(); }
+
+    void Write(const char* aHeaderPtr, size_t aHeaderBytes, const char* aBodyPtr, size_t aBodyBytes);
+
+    bool Read(Record& aRecord);
+
+    //! Reads again from the first frame.
+    void Rewind();
+
+    //! Returns the number of frames written, or read since the last Rewind().
+    size_t GetFrameCount() const { return mFrameCount; }
+
+    //! Returns the number of bytes of the file in use.
+    size_t GetBytes() const { return mPosition; }
+
+private:
+    PakCaptureFile(const PakCaptureFile&) = delete;
+    PakCaptureFile& operator=(const PakCaptureFile&) = delete;
+
+    bool Reserve(size_t aBytes);
+
+    GenMappedFile mFile;
+    //! Where the next frame is written or read
+    size_t mPosition;
+    size_t mFrameCount;
+    std::chrono::steady_clock::time_point mStartTime;
+    std::mutex mWriteMutex;
+};
+
+#endif
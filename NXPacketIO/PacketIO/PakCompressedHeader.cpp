@@ -0,0 +1,57 @@
+﻿#include "PacketIO/PakCompressedHeader.h"
+
+PakCompressedHeader::PakCompressedHeader(PakHeader* aHeaderPtr /*= new PakDefaultHeader*/, size_t aThreshold /*= cDEFAULT_THRESHOLD*/)
+    : mHeaderPtr(aHeaderPtr), mThreshold(0)
+{
+    SetThreshold(aThreshold);
+}
+
+PakCompressedHeader::PakCompressedHeader(const PakCompressedHeader& aSrc)
+    : mHeaderPtr(aSrc.mHeaderPtr->Clone()), mThreshold(aSrc.mThreshold)
+{
+}
+
+// virtual
+PakCompressedHeader::~PakCompressedHeader()
+{
+    delete mHeaderPtr;
+}
+
+// virtual
+PakHeader* PakCompressedHeader::Clone() const
+{
+    return new PakCompressedHeader(*this);
+}
+
+// virtual
+void PakCompressedHeader::WriteHeader(GenBuffer& aIO, int aPacketID, int aPacketLength)
+{
+    WriteHeader(aIO, aPacketID, aPacketLength, 0);
+}
+
+// virtual
+bool PakCompressedHeader::ReadHeader(GenBuffer& aIO, int& aPacketID, int& aPacketLength)
+{
+    uint32_t bodyLength;
+    return ReadHeader(aIO, aPacketID, aPacketLength, bodyLength);
+}
+
+//! @param aPacketLength The length of the packet as sent, including this header.
+void PakCompressedHeader::WriteHeader(GenBuffer& aIO, int aPacketID, int aPacketLength, uint32_t aBodyLength)
+{
+    mHeaderPtr->WriteHeader(aIO, aPacketID, aPacketLength);
+    aIO.putValue(aBodyLength);
+}
+
+bool PakCompressedHeader::ReadHeader(GenBuffer& aIO, int& aPacketID, int& aPacketLength, uint32_t& aBodyLength)
+{
+    bool isValid = mHeaderPtr->ReadHeader(aIO, aPacketID, aPacketLength);
+    aIO.getValue(aBodyLength);
+    return isValid;
+}
+
+// virtual
+int PakCompressedHeader::GetHeaderSize()
+{
+    return mHeaderPtr->GetHeaderSize() + (int)sizeof(uint32_t);
+}
@@ -0,0 +1,50 @@
+﻿#ifndef PakCompressedHeader_H
+#define PakCompressedHeader_H
+
+#include "NXPacketIO_Export.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#include "GenIO/GenBuffer.h"
+#include "PacketIO/PakDefaultHeader.h"
+#include "PacketIO/PakHeader.h"
+
+//! A header that lets packet bodies be compressed with UtLZ_Codec.
+//! It wraps another header and appends the decompressed size of the body, which is zero for a
+//! body sent as is.  PakTCP_IO and PakUDP_IO compress the body of each packet type registered
+//! with PakProcessor::cCOMPRESSIBLE once it reaches the threshold, unless that would not make it
+//! smaller, and decompress received bodies before they are read.  Both ends must use this header.
+class NX_PACKETIO_EXPORT PakCompressedHeader : public PakHeader
+{
+public:
+    //! @param aHeaderPtr  The header to wrap, which is owned by this object.
+    //! @param aThreshold  Bodies smaller than this many bytes are never compressed.
+    explicit PakCompressedHeader(PakHeader* aHeaderPtr = new PakDefaultHeader, size_t aThreshold = cDEFAULT_THRESHOLD);
+    PakCompressedHeader(const PakCompressedHeader& aSrc);
+    ~PakCompressedHeader() override;
+
+    PakHeader* Clone() const override;
+
+    void WriteHeader(GenBuffer& aIO, int aPacketID, int aPacketLength) override;
+    bool ReadHeader(GenBuffer& aIO, int& aPacketID, int& aPacketLength) override;
+
+    //! Writes the header of a packet whose body decompresses to aBodyLength bytes, zero if not compressed.
+    void WriteHeader(GenBuffer& aIO, int aPacketID, int aPacketLength, uint32_t aBodyLength);
+    bool ReadHeader(GenBuffer& aIO, int& aPacketID, int& aPacketLength, uint32_t& aBodyLength);
+
+    int GetHeaderSize() override;
+
+    size_t GetThreshold() const { return mThreshold; }
+    //! An empty body is never compressed, whatever the threshold.
+    void SetThreshold(size_t aThreshold) { mThreshold = aThreshold > 0 ? aThreshold : 1; }
+
+    static const size_t cDEFAULT_THRESHOLD = 256;
+
+private:
+    PakCompressedHeader& operator=(const PakCompressedHeader&);
+
+    PakHeader* mHeaderPtr;
+    size_t mThreshold;
+};
+#endif
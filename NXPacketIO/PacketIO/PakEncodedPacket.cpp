@@ -0,0 +1,94 @@
+﻿#include "PacketIO/PakEncodedPacket.h"
+
+#include <cassert>
+#include <cstring>
+
+#include "PacketIO/PakCompressedHeader.h"
+#include "PacketIO/PakHeader.h"
+#include "PacketIO/PakO.h"
+#include "PacketIO/PakPacket.h"
+#include "PacketIO/PakProcessor.h"
+#include "Util/UtLZ_Codec.h"
+
+PakEncodedPacket::PakEncodedPacket(const PakPacket& aPkt)
+    : mPacket(aPkt), mIsEncoded(false), mIsCompressed(false)
+{
+    mBody.SetBigEndian();
+    mHeader.SetBigEndian();
+}
+
+PakEncodedPacket::~PakEncodedPacket()
+{
+    for (size_t i = 0; i < mFrames.size(); ++i)
+    {
+        delete mFrames[i].mBufferPtr;
+    }
+}
+
+//! Returns the packet framed with aHeaderPtr, ready to write to a socket.
+//! The packet is serialized the first time this is called.  A frame is built once
+//! for each distinct header, so IOs with equivalent headers share one frame.
+//! With a PakCompressedHeader, the body of a compressible packet type is compressed the first time it is needed.
+//! @param aHeaderPtr    The header type of the destination IO.  May be null.
+//! @param aProcessorPtr The processor the packet is registered with.
+//! @return A buffer holding the framed packet between its get and put positions.
+const GenBuffer& PakEncodedPacket::GetFrame(PakHeader* aHeaderPtr, PakProcessor* aProcessorPtr)
+{
+    if (!mIsEncoded)
+    {
+        PakProcessor::PacketInfo* info = aProcessorPtr->GetPacketInfo(mPacket.ID());
+        assert(info); // assert that packet is registered
+        PakO writer(&mBody);
+        // This should be a const operation for the packet
+        (*info->mWriteFn)(const_cast<PakPacket&>(mPacket), writer);
+        mIsEncoded = true;
+    }
+
+    const char* bodyPtr = mBody.GetBuffer();
+    size_t bodyBytes = mBody.GetPutPos();
+    PakCompressedHeader* compressedHeaderPtr = dynamic_cast<PakCompressedHeader*>(aHeaderPtr);
+    if (compressedHeaderPtr != nullptr && bodyBytes >= compressedHeaderPtr->GetThreshold() &&
+        aProcessorPtr->IsCompressible(mPacket.ID()))
+    {
+        if (!mIsCompressed)
+        {
+            mCompressedBody.resize(bodyBytes);
+            mCompressedBody.resize(UtLZ_Codec::Compress(bodyPtr, bodyBytes, mCompressedBody.data(), bodyBytes - 1));
+            mIsCompressed = true;
+        }
+        if (!mCompressedBody.empty())
+        {
+            bodyPtr = mCompressedBody.data();
+            bodyBytes = mCompressedBody.size();
+        }
+    }
+
+    int headerSize = (aHeaderPtr != nullptr) ? aHeaderPtr->GetHeaderSize() : 0;
+    mHeader.Reset();
+    if (compressedHeaderPtr != nullptr)
+    {
+        uint32_t bodyLength = (bodyPtr != mBody.GetBuffer()) ? (uint32_t)mBody.GetPutPos() : 0;
+        compressedHeaderPtr->WriteHeader(mHeader, mPacket.ID(), headerSize + (int)bodyBytes, bodyLength);
+    }
+    else if (aHeaderPtr != nullptr)
+    {
+        aHeaderPtr->WriteHeader(mHeader, mPacket.ID(), headerSize + (int)bodyBytes);
+    }
+    size_t headerBytes = mHeader.GetPutPos();
+    for (size_t i = 0; i < mFrames.size(); ++i)
+    {
+        const std::vector<char>& cached = mFrames[i].mHeaderBytes;
+        if (cached.size() == headerBytes && (headerBytes == 0 || memcmp(&cached[0], mHeader.GetBuffer(), headerBytes) == 0))
+        {
+            return *mFrames[i].mBufferPtr;
+        }
+    }
+
+    Frame frame;
+    frame.mHeaderBytes.assign(mHeader.GetBuffer(), mHeader.GetBuffer() + headerBytes);
+    frame.mBufferPtr = new GenBuffer((int)(headerBytes + bodyBytes));
+    frame.mBufferPtr->PutRaw(mHeader.GetBuffer(), headerBytes);
+    frame.mBufferPtr->PutRaw(bodyPtr, bodyBytes);
+    mFrames.push_back(frame);
+    return *frame.mBufferPtr;
+}
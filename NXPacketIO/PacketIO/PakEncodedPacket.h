@@ -0,0 +1,56 @@
+﻿#ifndef PAKENCODEDPACKET_H
+#define PAKENCODEDPACKET_H
+
+#include "NXPacketIO_Export.h"
+
+#include <vector>
+
+#include "GenIO/GenBuffer.h"
+
+class PakHeader;
+class PakPacket;
+class PakProcessor;
+
+//! A packet serialized once for sending to many IOs.
+//! The body is serialized on first use, and the framed bytes (header + body) are
+//! cached for each distinct header, so sending to N connections serializes the
+//! packet once instead of N times.  For a PakCompressedHeader the body is also compressed
+//! once, see PakProcessor::cCOMPRESSIBLE.  Every IO it is sent through must use the same
+//! PakProcessor registration for the packet.
+//! The referenced packet must outlive this object, and must not change while it is in use.
+class NX_PACKETIO_EXPORT PakEncodedPacket
+{
+public:
+    explicit PakEncodedPacket(const PakPacket& aPkt);
+    ~PakEncodedPacket();
+
+    //! Returns the packet being encoded.
+    const PakPacket& GetPacket() const { return mPacket; }
+
+    const GenBuffer& GetFrame(PakHeader* aHeaderPtr, PakProcessor* aProcessorPtr);
+
+    //! Returns the size of the serialized body before compression, once GetFrame() has been called.
+    size_t GetBodySize() const { return mBody.GetPutPos(); }
+
+private:
+    PakEncodedPacket(const PakEncodedPacket&);
+    PakEncodedPacket& operator=(const PakEncodedPacket&);
+
+    struct Frame
+    {
+        std::vector<char> mHeaderBytes;
+        GenBuffer* mBufferPtr;
+    };
+
+    const PakPacket& mPacket;
+    bool mIsEncoded;
+    bool mIsCompressed;
+    GenBuffer mBody;
+    //! mBody compressed, empty if that did not make it smaller
+    std::vector<char> mCompressedBody;
+    //! Scratch buffer used to write a header for comparison with cached frames
+    GenBuffer mHeader;
+    std::vector<Frame> mFrames;
+};
+
+#endif
@@ -0,0 +1,243 @@
+#ifndef PAKFIXEDLAYOUT_H
+#define PAKFIXEDLAYOUT_H
+
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+#include "GenIO/GenBuffer.h"
+#include "GenIO/GenSwapEndian.h"
+#include "GenIO/GenUniqueId.h"
+#include "PacketIO/PakSerialize.h"
+
+namespace PakFixedLayoutDetail
+{
+template <typename MEMBER_PTR>
+struct MemberType {
+};
+template <typename CLASS, typename T>
+struct MemberType<T CLASS::*> {
+    typedef T Type;
+};
+
+// Reads and writes a basic type member
+template <typename T>
+struct Field {
+    static_assert(std::is_arithmetic<T>::value, "PakFixedLayout members must be basic types, bool, GenUniqueId, or arrays of basic types");
+    static const size_t cBYTES = sizeof(T);
+
+    template <bool SWAP>
+    static void Put(char*& aOut, const T& aValue)
+    {
+        if (SWAP)
+        {
+            GenSwapEndian::CopySwapped<sizeof(T)>(aOut, reinterpret_cast<const char*>(&aValue));
+        }
+        else
+        {
+            memcpy(aOut, &aValue, sizeof(T));
+        }
+        aOut += sizeof(T);
+    }
+
+    template <bool SWAP>
+    static void Get(const char*& aIn, T& aValue)
+    {
+        if (SWAP)
+        {
+            GenSwapEndian::CopySwapped<sizeof(T)>(reinterpret_cast<char*>(&aValue), aIn);
+        }
+        else
+        {
+            memcpy(&aValue, aIn, sizeof(T));
+        }
+        aIn += sizeof(T);
+    }
+
+    template <typename AR>
+    static void Serialize(AR& aAr, T& aValue)
+    {
+        aAr & aValue;
+    }
+};
+
+// Boolean values are sent as a char
+template <>
+struct Field<bool> {
+    static const size_t cBYTES = 1;
+
+    template <bool SWAP>
+    static void Put(char*& aOut, const bool& aValue)
+    {
+        *aOut++ = aValue ? 1 : 0;
+    }
+
+    template <bool SWAP>
+    static void Get(const char*& aIn, bool& aValue)
+    {
+        aValue = (*aIn++ != 0);
+    }
+
+    template <typename AR>
+    static void Serialize(AR& aAr, bool& aValue)
+    {
+        aAr & aValue;
+    }
+};
+
+// Arrays are sent as with PakSerialization::Array()
+template <typename T, size_t N>
+struct Field<T[N]> {
+    static_assert(std::is_arithmetic<T>::value && !std::is_same<T, bool>::value, "PakFixedLayout arrays must hold basic types");
+    static const size_t cBYTES = sizeof(T) * N;
+    // Arrays shorter than one 32 byte vector are swapped inline, the call to the array kernel costs more
+    static const bool cSWAP_INLINE = cBYTES < 32;
+
+    template <bool SWAP>
+    static void Put(char*& aOut, const T (&aValue)[N])
+    {
+        if (SWAP && sizeof(T) > 1 && cSWAP_INLINE)
+        {
+            for (size_t i = 0; i < N; ++i)
+            {
+                GenSwapEndian::CopySwapped<sizeof(T)>(aOut + i * sizeof(T), reinterpret_cast<const char*>(aValue + i));
+            }
+        }
+        else if (SWAP && sizeof(T) > 1)
+        {
+            GenSwapEndian::CopySwappedArray(aOut, reinterpret_cast<const char*>(aValue), N, sizeof(T));
+        }
+        else
+        {
+            memcpy(aOut, aValue, cBYTES);
+        }
+        aOut += cBYTES;
+    }
+
+    template <bool SWAP>
+    static void Get(const char*& aIn, T (&aValue)[N])
+    {
+        if (SWAP && sizeof(T) > 1 && cSWAP_INLINE)
+        {
+            for (size_t i = 0; i < N; ++i)
+            {
+                GenSwapEndian::CopySwapped<sizeof(T)>(reinterpret_cast<char*>(aValue + i), aIn + i * sizeof(T));
+            }
+        }
+        else if (SWAP && sizeof(T) > 1)
+        {
+            GenSwapEndian::CopySwappedArray(reinterpret_cast<char*>(aValue), aIn, N, sizeof(T));
+        }
+        else
+        {
+            memcpy(aValue, aIn, cBYTES);
+        }
+        aIn += cBYTES;
+    }
+
+    template <typename AR>
+    static void Serialize(AR& aAr, T (&aValue)[N])
+    {
+        aAr & PakSerialization::Array(aValue, (int)N);
+    }
+};
+
+// A GenUniqueId is sent as its three words
+template <>
+struct Field<GenUniqueId> {
+    static const size_t cBYTES = 3 * sizeof(unsigned int);
+
+    template <bool SWAP>
+    static void Put(char*& aOut, const GenUniqueId& aValue)
+    {
+        const unsigned int words[3] = {aValue.GetData(0), aValue.GetData(1), aValue.GetData(2)};
+        Field<unsigned int[3]>::Put<SWAP>(aOut, words);
+    }
+
+    template <bool SWAP>
+    static void Get(const char*& aIn, GenUniqueId& aValue)
+    {
+        unsigned int words[3];
+        Field<unsigned int[3]>::Get<SWAP>(aIn, words);
+        aValue = GenUniqueId(words[0], words[1], words[2]);
+    }
+
+    template <typename AR>
+    static void Serialize(AR& aAr, GenUniqueId& aValue)
+    {
+        aAr & aValue;
+    }
+};
+
+template <auto MEMBER>
+struct FieldOf : Field<typename MemberType<decltype(MEMBER)>::Type> {
+};
+} // namespace PakFixedLayoutDetail
+
+//! Describes a packet (or struct) that is serialized as a fixed list of members.
+//! Members may be basic types, bool, GenUniqueId, or arrays of basic types, and may belong
+//! to a base class.  The wire format is the
+//! same as serializing the members in order with operator&, but a packet that defines
+//! a FixedLayout typedef for itself is read and written by PakProcessor with a single
+//! space check and no per-field dispatch.
+//! Usage:
+//! @code
+//!     typedef PakFixedLayout<MyPkt, &MyPkt::mCount, &MyPkt::mValue, &MyPkt::mData> FixedLayout;
+//!     template <typename T>
+//!     void Serialize(T& aBuff) { FixedLayout::Serialize(aBuff, *this); }
+//! @endcode
+template <typename CLASS, auto... MEMBERS>
+class PakFixedLayout
+{
+public:
+    typedef CLASS ObjectType;
+
+    //! The number of bytes the members occupy when serialized
+    static constexpr size_t cWIRE_SIZE = (PakFixedLayoutDetail::FieldOf<MEMBERS>::cBYTES + ... + 0);
+
+    //! Serialize the members one at a time with any archive
+    template <typename AR>
+    static void Serialize(AR& aAr, CLASS& aObject)
+    {
+        (PakFixedLayoutDetail::FieldOf<MEMBERS>::Serialize(aAr, aObject.*MEMBERS), ...);
+    }
+
+    //! Write the members to aBuffer at its put position
+    static void Write(const CLASS& aObject, GenBuffer& aBuffer)
+    {
+        aBuffer.CheckPutSpace(cWIRE_SIZE);
+        char* out = aBuffer.GetBuffer() + aBuffer.GetPutPos();
+        if (aBuffer.IsByteSwapEnabled())
+        {
+            (PakFixedLayoutDetail::FieldOf<MEMBERS>::template Put<true>(out, aObject.*MEMBERS), ...);
+        }
+        else
+        {
+            (PakFixedLayoutDetail::FieldOf<MEMBERS>::template Put<false>(out, aObject.*MEMBERS), ...);
+        }
+        aBuffer.SetPutPos(aBuffer.GetPutPos() + cWIRE_SIZE);
+    }
+
+    //! Read the members from aBuffer at its get position.  If fewer than cWIRE_SIZE bytes
+    //! remain, nothing is read and the rest of the buffer is skipped, so the packet fails
+    //! its length check.
+    static void Read(CLASS& aObject, GenBuffer& aBuffer)
+    {
+        if (!aBuffer.CheckGetSpace(cWIRE_SIZE))
+        {
+            return;
+        }
+        const char* in = aBuffer.GetBuffer() + aBuffer.GetGetPos();
+        if (aBuffer.IsByteSwapEnabled())
+        {
+            (PakFixedLayoutDetail::FieldOf<MEMBERS>::template Get<true>(in, aObject.*MEMBERS), ...);
+        }
+        else
+        {
+            (PakFixedLayoutDetail::FieldOf<MEMBERS>::template Get<false>(in, aObject.*MEMBERS), ...);
+        }
+        aBuffer.SetGetPos(aBuffer.GetGetPos() + cWIRE_SIZE);
+    }
+};
+
+#endif
@@ -29,6 +29,13 @@ public:
         mBufferPtr->getValue(aVal);
     }
 
+    //! Serialize an array of basic types in one operation
+    template <typename T>
+    void SerializeArray(T* aArray, int aSize)
+    {
+        mBufferPtr->GetArray(aArray, aSize);
+    }
+
     void SerializeBuffer(char* aBuffer, int aSize) { mBufferPtr->GetRaw(aBuffer, aSize); }
 
     void SerializeString(std::string& aString, int aBytes);
@@ -1,10 +1,31 @@
 ﻿#include "PacketIO/PakO.h"
 
 PakO::PakO(GenBuffer* aBufferPtr)
-    : mBufferPtr(aBufferPtr)
+    : mBufferPtr(aBufferPtr), mExternalDataPtr(nullptr)
 {
 }
 
+//! Serializes a block of raw data.  If an external data list is set and the
+//! block is large, the block is referenced rather than copied, and must stay
+//! valid until the output is sent.
+//! @param aData The data to serialize
+//! @param aBytes The number of bytes in aData
+void PakO::SerializeExternal(const char* aData, int aBytes)
+{
+    if (mExternalDataPtr != nullptr && aBytes >= cMIN_EXTERNAL_BYTES)
+    {
+        ExternalData data;
+        data.mOffset = mBufferPtr->GetPutPos();
+        data.mData = aData;
+        data.mBytes = aBytes;
+        mExternalDataPtr->push_back(data);
+    }
+    else
+    {
+        mBufferPtr->PutRaw(aData, aBytes);
+    }
+}
+
 // virtual
 //! Serializes a fixed-sized string.
 //! @param aString The text to serialize
@@ -4,6 +4,7 @@
 #include "NXPacketIO_Export.h"
 
 #include <string>
+#include <vector>
 
 #include "GenIO/GenBuffer.h"
 class PakI;
@@ -16,10 +17,29 @@ public:
     typedef PakO OutputArchive;
     typedef PakI InputArchive;
 
+    //! A block of caller memory referenced by the output instead of copied into the buffer.
+    //! The block belongs in the stream at mOffset bytes into the buffer.
+    struct ExternalData
+    {
+        size_t mOffset;
+        const char* mData;
+        int mBytes;
+    };
+    typedef std::vector<ExternalData> ExternalDataList;
+
+    //! Blocks smaller than this are always copied
+    static const int cMIN_EXTERNAL_BYTES = 1024;
+
     PakO(GenBuffer* aBufferPtr);
 
     GenBuffer* GetBuffer() { return mBufferPtr; }
 
+    //! Allow SerializeExternal() to reference memory rather than copy it.
+    //! @param aListPtr Receives the referenced blocks; null copies everything
+    void SetExternalDataList(ExternalDataList* aListPtr) { mExternalDataPtr = aListPtr; }
+
+    void SerializeExternal(const char* aData, int aBytes);
+
     void IgnoreBytes(int aNumBytes)
     {
         mBufferPtr->CheckPutSpace(aNumBytes);
@@ -32,12 +52,20 @@ public:
         mBufferPtr->putValue(aVal);
     }
 
+    //! Serialize an array of basic types in one operation
+    template <typename T>
+    void SerializeArray(const T* aArray, int aSize)
+    {
+        mBufferPtr->PutArray(aArray, aSize);
+    }
+
     void SerializeBuffer(char* aBuffer, int aSize) { mBufferPtr->PutRaw(aBuffer, aSize); }
 
     void SerializeString(std::string& aString, int aBytes);
 
 protected:
     GenBuffer* mBufferPtr;
+    ExternalDataList* mExternalDataPtr;
 };
 
 #endif
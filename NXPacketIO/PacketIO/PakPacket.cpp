@@ -3,6 +3,6 @@
 //! Constructor
 //! @param aPacketID ID of the packet
 PakPacket::PakPacket(int aPacketID)
-    : mPacketID(aPacketID), mConnectionPtr(nullptr)
+    : mPacketID(aPacketID), mConnectionPtr(nullptr), mReceiveTime(0)
 {
 }
@@ -3,6 +3,8 @@
 
 #include "NXPacketIO_Export.h"
 
+#include <cstdint>
+
 #include "PacketIO/PakIntTypes.h"
 
 class PakConnection;
@@ -24,11 +26,18 @@ public:
     unsigned short GetOriginatorPort() const { return mOriginatorPort; }
     void SetOriginatorPort(unsigned short aAddr) { mOriginatorPort = aAddr; }
 
+    //! Returns when the packet was received, see PakProcessor::GetMetricsTime().
+    //! This is when the kernel received the datagram, when a PakUDP_IO has it, when its last bytes
+    //! were read from the socket, or otherwise when it was decoded.
+    int64_t GetReceiveTime() const { return mReceiveTime; }
+    void SetReceiveTime(int64_t aTime) { mReceiveTime = aTime; }
+
 protected:
     int mPacketID;
     PakConnection* mConnectionPtr;
     unsigned int mOriginatorAddress;
     unsigned short mOriginatorPort;
+    int64_t mReceiveTime;
 };
 
 #endif
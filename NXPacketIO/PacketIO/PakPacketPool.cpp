@@ -0,0 +1,169 @@
+﻿#include "PacketIO/PakPacketPool.h"
+
+#include <algorithm>
+
+#include "PacketIO/PakPacket.h"
+
+namespace
+{
+//! Number of packets moved between a thread's free list and the depot at once
+const size_t cBATCH_SIZE = 32;
+
+std::atomic<size_t> sNextPoolId(0);
+
+struct ThreadFreeLists;
+
+//! The free lists of every thread, so a pool can delete the packets cached by other threads.
+struct FreeListRegistry
+{
+    std::mutex mLock;
+    std::vector<ThreadFreeLists*> mThreads;
+};
+
+FreeListRegistry& GetRegistry()
+{
+    static FreeListRegistry registry;
+    return registry;
+}
+
+//! Per-thread free lists, indexed by pool ID.
+//! Packets still cached when the thread exits are deleted.
+struct ThreadFreeLists
+{
+    ThreadFreeLists()
+    {
+        FreeListRegistry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mLock);
+        registry.mThreads.push_back(this);
+    }
+    ~ThreadFreeLists()
+    {
+        FreeListRegistry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mLock);
+        registry.mThreads.erase(std::find(registry.mThreads.begin(), registry.mThreads.end(), this));
+        for (size_t i = 0; i < mFreeLists.size(); ++i)
+        {
+            for (size_t j = 0; j < mFreeLists[i].size(); ++j)
+            {
+                delete mFreeLists[i][j];
+            }
+        }
+    }
+    //! Guards the size of mFreeLists, which a pool's destructor reads from another thread
+    std::mutex mLock;
+    std::vector<std::vector<PakPacket*>> mFreeLists;
+};
+
+thread_local ThreadFreeLists tFreeLists;
+} // namespace
+
+//! @param aNewFn Function which allocates a new packet of the pooled type.
+//! @param aMaxPooledPackets The maximum number of idle packets kept in the shared depot.
+PakPacketPool::PakPacketPool(NewFnPtr aNewFn, size_t aMaxPooledPackets /*= 4096*/)
+    : mPoolId(sNextPoolId++), mNewFn(aNewFn), mTypePtr(nullptr), mMaxPooledPackets(aMaxPooledPackets), mHits(0), mMisses(0), mReleases(0), mDiscards(0)
+{
+    PakPacket* prototypePtr = (*mNewFn)();
+    mTypePtr = &typeid(*prototypePtr);
+    mDepot.push_back(prototypePtr);
+}
+
+//! Deletes the pooled packets, including those cached by other threads.
+//! No thread may use the pool while it is destroyed.
+PakPacketPool::~PakPacketPool()
+{
+    {
+        FreeListRegistry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mLock);
+        for (ThreadFreeLists* threadPtr : registry.mThreads)
+        {
+            std::lock_guard<std::mutex> threadLock(threadPtr->mLock);
+            if (mPoolId < threadPtr->mFreeLists.size())
+            {
+                std::vector<PakPacket*>& freeList = threadPtr->mFreeLists[mPoolId];
+                for (size_t i = 0; i < freeList.size(); ++i)
+                {
+                    delete freeList[i];
+                }
+                std::vector<PakPacket*>().swap(freeList);
+            }
+        }
+    }
+    for (size_t i = 0; i < mDepot.size(); ++i)
+    {
+        delete mDepot[i];
+    }
+}
+
+std::vector<PakPacket*>& PakPacketPool::GetLocalFreeList()
+{
+    std::vector<std::vector<PakPacket*>>& freeLists = tFreeLists.mFreeLists;
+    if (freeLists.size() <= mPoolId)
+    {
+        std::lock_guard<std::mutex> lock(tFreeLists.mLock);
+        freeLists.resize(mPoolId + 1);
+    }
+    return freeLists[mPoolId];
+}
+
+//! Returns a packet from the pool, or a new packet if the pool is empty.
+PakPacket* PakPacketPool::Acquire()
+{
+    std::vector<PakPacket*>& freeList = GetLocalFreeList();
+    if (freeList.empty())
+    {
+        std::lock_guard<std::mutex> lock(mDepotLock);
+        size_t count = std::min(cBATCH_SIZE, mDepot.size());
+        freeList.insert(freeList.end(), mDepot.end() - count, mDepot.end());
+        mDepot.resize(mDepot.size() - count);
+    }
+    if (freeList.empty())
+    {
+        mMisses.fetch_add(1, std::memory_order_relaxed);
+        return (*mNewFn)();
+    }
+    mHits.fetch_add(1, std::memory_order_relaxed);
+    PakPacket* pktPtr = freeList.back();
+    freeList.pop_back();
+    pktPtr->SetSender(nullptr);
+    pktPtr->SetOriginatorAddress(0);
+    pktPtr->SetOriginatorPort(0);
+    return pktPtr;
+}
+
+//! Returns a packet to the pool.  ReceiveCleanup() must already have been called.
+//! Packets which are not of the pooled type are deleted.
+void PakPacketPool::Release(PakPacket* aPktPtr)
+{
+    if (typeid(*aPktPtr) != *mTypePtr)
+    {
+        delete aPktPtr;
+        return;
+    }
+    mReleases.fetch_add(1, std::memory_order_relaxed);
+    std::vector<PakPacket*>& freeList = GetLocalFreeList();
+    freeList.push_back(aPktPtr);
+    if (freeList.size() >= 2 * cBATCH_SIZE)
+    {
+        std::vector<PakPacket*>::iterator batchBegin = freeList.end() - cBATCH_SIZE;
+        std::lock_guard<std::mutex> lock(mDepotLock);
+        size_t room = (mDepot.size() < mMaxPooledPackets) ? mMaxPooledPackets - mDepot.size() : 0;
+        size_t kept = std::min(room, cBATCH_SIZE);
+        mDepot.insert(mDepot.end(), batchBegin, batchBegin + kept);
+        for (std::vector<PakPacket*>::iterator i = batchBegin + kept; i != freeList.end(); ++i)
+        {
+            delete *i;
+        }
+        mDiscards.fetch_add(cBATCH_SIZE - kept, std::memory_order_relaxed);
+        freeList.erase(batchBegin, freeList.end());
+    }
+}
+
+PakPacketPool::Stats PakPacketPool::GetStats() const
+{
+    Stats stats;
+    stats.mHits = mHits.load(std::memory_order_relaxed);
+    stats.mMisses = mMisses.load(std::memory_order_relaxed);
+    stats.mReleases = mReleases.load(std::memory_order_relaxed);
+    stats.mDiscards = mDiscards.load(std::memory_order_relaxed);
+    return stats;
+}
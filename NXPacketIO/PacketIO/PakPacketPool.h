@@ -0,0 +1,66 @@
+﻿#ifndef PAKPACKETPOOL_H
+#define PAKPACKETPOOL_H
+
+#include "NXPacketIO_Export.h"
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <typeinfo>
+#include <vector>
+
+class PakPacket;
+
+//! Recycles packets of a single type to avoid a heap allocation per received packet.
+//! Released packets stay constructed, so members such as strings and vectors keep
+//! their capacity between uses.  A pooled packet type must therefore overwrite all of
+//! its state in Serialize(), and free anything allocated while reading in ReceiveCleanup().
+//!
+//! Each thread keeps a small free list.  Batches of packets move between threads
+//! through a shared depot, so packets released by the consumer thread are reused
+//! by the reactor thread.
+class NX_PACKETIO_EXPORT PakPacketPool
+{
+public:
+    typedef PakPacket* (*NewFnPtr)();
+
+    struct Stats
+    {
+        //! Number of Acquire() calls satisfied from the pool
+        size_t mHits;
+        //! Number of Acquire() calls that allocated a new packet
+        size_t mMisses;
+        //! Number of packets returned with Release()
+        size_t mReleases;
+        //! Number of released packets deleted because the pool was full
+        size_t mDiscards;
+    };
+
+    PakPacketPool(NewFnPtr aNewFn, size_t aMaxPooledPackets = 4096);
+    ~PakPacketPool();
+
+    PakPacket* Acquire();
+
+    void Release(PakPacket* aPktPtr);
+
+    Stats GetStats() const;
+
+private:
+    PakPacketPool(const PakPacketPool&);
+    PakPacketPool& operator=(const PakPacketPool&);
+
+    std::vector<PakPacket*>& GetLocalFreeList();
+
+    size_t mPoolId;
+    NewFnPtr mNewFn;
+    const std::type_info* mTypePtr;
+    size_t mMaxPooledPackets;
+    std::mutex mDepotLock;
+    std::vector<PakPacket*> mDepot;
+    std::atomic<size_t> mHits;
+    std::atomic<size_t> mMisses;
+    std::atomic<size_t> mReleases;
+    std::atomic<size_t> mDiscards;
+};
+
+#endif
@@ -1,5 +1,6 @@
 ﻿#include "PacketIO/PakProcessor.h"
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 
@@ -10,11 +11,22 @@
 #include "PacketIO/PakSocketIO.h"
 #include "PacketIO/PakUndefinedPacket.h"
 PakProcessor::PakProcessor()
+    : mHasHighPriorityPackets(false), mMetricsEnabled(false), mMetricsReportInterval(0), mNextMetricsReportTime(0), mWaiterCount(0)
 {
     mPacketData.assign(1024, (PacketInfo*)nullptr);
 }
 PakProcessor::~PakProcessor()
 {
+    // Coroutines still waiting are destroyed without being resumed
+    for (PacketWaiter* waiterPtr : mWaiterLists)
+    {
+        while (waiterPtr != nullptr)
+        {
+            PacketWaiter* nextPtr = waiterPtr->mNextPtr;
+            (*waiterPtr->mResumeFn)(*waiterPtr, true);
+            waiterPtr = nextPtr;
+        }
+    }
     for (unsigned int i = 0; i < mPacketData.size(); ++i)
     {
         delete mPacketData[i];
@@ -30,7 +42,7 @@ PakPacket* PakProcessor::ReadPacket(PakSocketIO& aIO)
     int length;
     if (aIO.ReceiveHeader(id, length, 0))
     {
-        PacketInfo* pInfo = mPacketData[id];
+        PacketInfo* pInfo = (id >= 0 && id < (int)mPacketData.size()) ? mPacketData[id] : nullptr;
         if (pInfo == nullptr)
         {
             std::cout << "Received unknown packet. " << "ID: " << id << std::endl;
@@ -38,6 +50,8 @@ PakPacket* PakProcessor::ReadPacket(PakSocketIO& aIO)
         }
         else
         {
+            bool measure = mMetricsEnabled.load(std::memory_order_relaxed);
+            int64_t decodeStart = measure ? GetMetricsTime() : 0;
             if (pInfo->IsUndefinedPacket())
             {
                 PakUndefinedPacket* upkt = new PakUndefinedPacket;
@@ -51,9 +65,22 @@ PakPacket* PakProcessor::ReadPacket(PakSocketIO& aIO)
 
             if (!aIO.Receive(*lReturn))
             {
-                delete lReturn;
+                pInfo->ReleasePacket(lReturn, false);
                 lReturn = nullptr;
             }
+            else if (measure)
+            {
+                int64_t decodeEnd = GetMetricsTime();
+                MetricsData& metrics = pInfo->GetMetrics();
+                metrics.mPacketsReceived.fetch_add(1, std::memory_order_relaxed);
+                metrics.mBytesReceived.fetch_add(length, std::memory_order_relaxed);
+                metrics.mDecodeTime.Record(decodeEnd - decodeStart);
+                lReturn->SetReceiveTime(aIO.GetReceiveTime() != 0 ? aIO.GetReceiveTime() : decodeEnd);
+            }
+            else
+            {
+                lReturn->SetReceiveTime(aIO.GetReceiveTime() != 0 ? aIO.GetReceiveTime() : GetMetricsTime());
+            }
         }
     }
     return lReturn;
@@ -120,6 +147,16 @@ PakPacket* PakProcessor::ReadPacket(char* aBuffer)
 void PakProcessor::ProcessPacket(PakPacket* aPkt, bool aDoCleanup /*=false*/)
 {
     PacketInfo* pInfo = mPacketData[aPkt->ID()];
+    bool measure = mMetricsEnabled.load(std::memory_order_relaxed);
+    int64_t callbackStart = 0;
+    if (measure)
+    {
+        callbackStart = GetMetricsTime();
+        if (aPkt->GetReceiveTime() != 0)
+        {
+            pInfo->GetMetrics().mQueueTime.Record(callbackStart - aPkt->GetReceiveTime());
+        }
+    }
     pInfo->Call(*aPkt);
     int basePacketId = 0;
 
@@ -139,13 +176,380 @@ void PakProcessor::ProcessPacket(PakPacket* aPkt, bool aDoCleanup /*=false*/)
         }
     }
 
+    if (measure)
+    {
+        pInfo->GetMetrics().mCallbackTime.Record(GetMetricsTime() - callbackStart);
+    }
+
+    if (mWaiterCount.load(std::memory_order_acquire) != 0)
+    {
+        ResumeWaitersP(*aPkt);
+    }
+
     if (aDoCleanup)
+    {
+        pInfo->ReleasePacket(aPkt);
+    }
+}
+
+void PakProcessor::AddWaiter(PacketWaiter& aWaiter)
+{
+    // Another thread may resume the coroutine once the lock is released, after which aWaiter is gone
+    int packetId = aWaiter.mPacketId;
+    bool isFirstWait = false;
+    {
+        std::lock_guard<std::mutex> lock(mWaiterMutex);
+        size_t listIndex = packetId * 2 + (aWaiter.mMatchFn != nullptr ? 1 : 0);
+        if (listIndex >= mWaiterLists.size())
+        {
+            mWaiterLists.resize(listIndex + 1, nullptr);
+        }
+        if (packetId >= (int)mAwaitedPackets.size())
+        {
+            mAwaitedPackets.resize(packetId + 1, false);
+        }
+        // Append, so waiters for the same packet are resumed in the order they started waiting
+        PacketWaiter*& firstPtr = mWaiterLists[listIndex];
+        aWaiter.mNextPtr = nullptr;
+        aWaiter.mPrevPtr = firstPtr != nullptr ? firstPtr->mPrevPtr : &aWaiter;
+        if (firstPtr == nullptr)
+        {
+            firstPtr = &aWaiter;
+        }
+        else
+        {
+            firstPtr->mPrevPtr->mNextPtr = &aWaiter;
+            firstPtr->mPrevPtr = &aWaiter;
+        }
+        if (aWaiter.mDeadline != 0)
+        {
+            aWaiter.mHeapIndex = mTimedWaiters.size();
+            mTimedWaiters.push_back(&aWaiter);
+            SiftUpP(aWaiter.mHeapIndex);
+        }
+        mWaiterCount.fetch_add(1, std::memory_order_release);
+        isFirstWait = !mAwaitedPackets[packetId];
+        mAwaitedPackets[packetId] = true;
+    }
+    if (isFirstWait)
+    {
+        SubscriptionChanged(packetId);
+    }
+}
+
+//! Unlinks a waiter from its packet's list and the timeout heap.
+//! The first waiter's mPrevPtr points to the last, the last waiter's mNextPtr is null.
+void PakProcessor::RemoveWaiterP(PacketWaiter& aWaiter)
+{
+    PacketWaiter*& firstPtr = mWaiterLists[aWaiter.mPacketId * 2 + (aWaiter.mMatchFn != nullptr ? 1 : 0)];
+    if (&aWaiter == firstPtr)
+    {
+        firstPtr = aWaiter.mNextPtr;
+        if (firstPtr != nullptr)
+        {
+            firstPtr->mPrevPtr = aWaiter.mPrevPtr;
+        }
+    }
+    else
+    {
+        aWaiter.mPrevPtr->mNextPtr = aWaiter.mNextPtr;
+        (aWaiter.mNextPtr != nullptr ? aWaiter.mNextPtr : firstPtr)->mPrevPtr = aWaiter.mPrevPtr;
+    }
+    if (aWaiter.mDeadline != 0)
+    {
+        size_t index = aWaiter.mHeapIndex;
+        PacketWaiter* lastPtr = mTimedWaiters.back();
+        mTimedWaiters.pop_back();
+        if (lastPtr != &aWaiter)
+        {
+            mTimedWaiters[index] = lastPtr;
+            lastPtr->mHeapIndex = index;
+            SiftUpP(index);
+            SiftDownP(lastPtr->mHeapIndex);
+        }
+    }
+    mWaiterCount.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void PakProcessor::SiftUpP(size_t aIndex)
+{
+    while (aIndex > 0)
+    {
+        size_t parent = (aIndex - 1) / 2;
+        if (mTimedWaiters[parent]->mDeadline <= mTimedWaiters[aIndex]->mDeadline)
+        {
+            break;
+        }
+        std::swap(mTimedWaiters[parent], mTimedWaiters[aIndex]);
+        mTimedWaiters[aIndex]->mHeapIndex = aIndex;
+        mTimedWaiters[parent]->mHeapIndex = parent;
+        aIndex = parent;
+    }
+}
+
+void PakProcessor::SiftDownP(size_t aIndex)
+{
+    for (;;)
+    {
+        size_t smallest = aIndex;
+        for (size_t child = aIndex * 2 + 1; child <= aIndex * 2 + 2 && child < mTimedWaiters.size(); ++child)
+        {
+            if (mTimedWaiters[child]->mDeadline < mTimedWaiters[smallest]->mDeadline)
+            {
+                smallest = child;
+            }
+        }
+        if (smallest == aIndex)
+        {
+            break;
+        }
+        std::swap(mTimedWaiters[smallest], mTimedWaiters[aIndex]);
+        mTimedWaiters[aIndex]->mHeapIndex = aIndex;
+        mTimedWaiters[smallest]->mHeapIndex = smallest;
+        aIndex = smallest;
+    }
+}
+
+//! Resumes the coroutines waiting for a packet of this type or one of its base types: all
+//! those in Receive(), and the first in ReceiveMatching() whose predicate accepts the packet.
+//! The waiters are collected first, so a coroutine waiting again is not resumed by the same packet.
+void PakProcessor::ResumeWaitersP(PakPacket& aPkt)
+{
+    PacketWaiter* resumeFirstPtr = nullptr;
+    PacketWaiter* resumeLastPtr = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mWaiterMutex);
+        bool matched = false;
+        for (int packetId = aPkt.ID(); packetId != -1; packetId = mPacketData[packetId]->GetBasePacketId())
+        {
+            for (size_t listIndex = packetId * 2; listIndex < packetId * 2 + 2u && listIndex < mWaiterLists.size(); ++listIndex)
+            {
+                PacketWaiter* waiterPtr = (listIndex % 2 == 0 || !matched) ? mWaiterLists[listIndex] : nullptr;
+                while (waiterPtr != nullptr)
+                {
+                    PacketWaiter* nextPtr = waiterPtr->mNextPtr;
+                    if (waiterPtr->mMatchFn == nullptr || (!matched && (*waiterPtr->mMatchFn)(*waiterPtr, aPkt)))
+                    {
+                        if (waiterPtr->mMatchFn != nullptr)
+                        {
+                            matched = true;
+                            nextPtr = nullptr;
+                        }
+                        RemoveWaiterP(*waiterPtr);
+                        waiterPtr->mPacketPtr = &aPkt;
+                        waiterPtr->mNextPtr = nullptr;
+                        (resumeLastPtr != nullptr ? resumeLastPtr->mNextPtr : resumeFirstPtr) = waiterPtr;
+                        resumeLastPtr = waiterPtr;
+                    }
+                    waiterPtr = nextPtr;
+                }
+            }
+        }
+    }
+    while (resumeFirstPtr != nullptr)
+    {
+        PacketWaiter* nextPtr = resumeFirstPtr->mNextPtr;
+        (*resumeFirstPtr->mResumeFn)(*resumeFirstPtr, false);
+        resumeFirstPtr = nextPtr;
+    }
+}
+
+double PakProcessor::ResumeExpiredWaiters()
+{
+    if (mWaiterCount.load(std::memory_order_acquire) == 0)
+    {
+        return -1.0;
+    }
+    int64_t now = GetMetricsTime();
+    for (;;)
+    {
+        PacketWaiter* waiterPtr = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mWaiterMutex);
+            if (mTimedWaiters.empty())
+            {
+                return -1.0;
+            }
+            if (mTimedWaiters[0]->mDeadline > now)
+            {
+                return (mTimedWaiters[0]->mDeadline - now) * 1.0E-9;
+            }
+            waiterPtr = mTimedWaiters[0];
+            RemoveWaiterP(*waiterPtr);
+        }
+        waiterPtr->mPacketPtr = nullptr;
+        (*waiterPtr->mResumeFn)(*waiterPtr, false);
+    }
+}
+
+double PakProcessor::GetTimeToNextTimeout() const
+{
+    std::lock_guard<std::mutex> lock(mWaiterMutex);
+    if (mTimedWaiters.empty())
+    {
+        return -1.0;
+    }
+    return std::max<int64_t>(mTimedWaiters[0]->mDeadline - GetMetricsTime(), 0) * 1.0E-9;
+}
+
+bool PakProcessor::IsSubscribed(int aPacketId) const
+{
+    if (aPacketId < 0 || aPacketId >= (int)mPacketData.size() || mPacketData[aPacketId] == nullptr)
+    {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mWaiterMutex);
+        if (aPacketId < (int)mAwaitedPackets.size() && mAwaitedPackets[aPacketId])
+        {
+            return true;
+        }
+    }
+    for (int packetId = aPacketId; packetId != -1; packetId = mPacketData[packetId]->GetBasePacketId())
+    {
+        if (mPacketData[packetId]->HasCallbacks())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PakProcessor::GetSubscriptions(std::vector<uint32_t>& aBits) const
+{
+    aBits.assign((mPacketData.size() + 31) / 32, 0);
+    for (size_t packetId = 0; packetId < mPacketData.size(); ++packetId)
+    {
+        if (IsSubscribed((int)packetId))
+        {
+            aBits[packetId / 32] |= 1u << (packetId % 32);
+        }
+    }
+}
+
+void PakProcessor::PacketSentP(int aPacketId, size_t aBytes)
+{
+    PacketInfo* pInfo = (aPacketId >= 0 && aPacketId < (int)mPacketData.size()) ? mPacketData[aPacketId] : nullptr;
+    if (pInfo != nullptr)
+    {
+        MetricsData& metrics = pInfo->GetMetrics();
+        metrics.mPacketsSent.fetch_add(1, std::memory_order_relaxed);
+        metrics.mBytesSent.fetch_add(aBytes, std::memory_order_relaxed);
+    }
+}
+
+//! Copies the metrics of every packet type measured since the last ResetMetrics().
+void PakProcessor::GetMetrics(MetricsList& aMetrics) const
+{
+    aMetrics.clear();
+    for (PacketInfo* pInfo : mPacketData)
+    {
+        MetricsData* metricsPtr = pInfo != nullptr ? pInfo->FindMetrics() : nullptr;
+        if (metricsPtr != nullptr)
+        {
+            aMetrics.emplace_back();
+            PacketMetrics& metrics = aMetrics.back();
+            metrics.mPacketId = pInfo->GetPacketId();
+            metrics.mPacketName = pInfo->GetPacketName();
+            metrics.mPacketsReceived = metricsPtr->mPacketsReceived.load(std::memory_order_relaxed);
+            metrics.mBytesReceived = metricsPtr->mBytesReceived.load(std::memory_order_relaxed);
+            metrics.mPacketsSent = metricsPtr->mPacketsSent.load(std::memory_order_relaxed);
+            metrics.mBytesSent = metricsPtr->mBytesSent.load(std::memory_order_relaxed);
+            metricsPtr->mDecodeTime.GetSnapshot(metrics.mDecodeTime);
+            metricsPtr->mQueueTime.GetSnapshot(metrics.mQueueTime);
+            metricsPtr->mCallbackTime.GetSnapshot(metrics.mCallbackTime);
+        }
+    }
+}
+
+void PakProcessor::ResetMetrics()
+{
+    for (PacketInfo* pInfo : mPacketData)
+    {
+        MetricsData* metricsPtr = pInfo != nullptr ? pInfo->FindMetrics() : nullptr;
+        if (metricsPtr != nullptr)
+        {
+            metricsPtr->mPacketsReceived.store(0, std::memory_order_relaxed);
+            metricsPtr->mBytesReceived.store(0, std::memory_order_relaxed);
+            metricsPtr->mPacketsSent.store(0, std::memory_order_relaxed);
+            metricsPtr->mBytesSent.store(0, std::memory_order_relaxed);
+            metricsPtr->mDecodeTime.Reset();
+            metricsPtr->mQueueTime.Reset();
+            metricsPtr->mCallbackTime.Reset();
+        }
+    }
+}
+
+void PakProcessor::SetMetricsReportInterval(double aSeconds)
+{
+    mMetricsReportInterval = (int64_t)(aSeconds * 1.0E9);
+    mNextMetricsReportTime = GetMetricsTime() + mMetricsReportInterval;
+}
+
+//! Invokes MetricsReport if the report interval has passed since the last report.
+//! Call it periodically from the thread that processes packets.
+void PakProcessor::ReportMetricsIfDue()
+{
+    if (mMetricsReportInterval <= 0)
+    {
+        return;
+    }
+    int64_t now = GetMetricsTime();
+    if (now >= mNextMetricsReportTime)
+    {
+        mNextMetricsReportTime = now + mMetricsReportInterval;
+        MetricsList metrics;
+        GetMetrics(metrics);
+        MetricsReport(metrics);
+    }
+}
+
+//! Calls ReceiveCleanup() on a received packet and deletes it, or returns it to
+//! its pool if the packet type was registered with cPOOLED_ALLOCATION.
+void PakProcessor::ReleasePacket(PakPacket* aPkt)
+{
+    PacketInfo* pInfo = (aPkt->ID() >= 0 && aPkt->ID() < (int)mPacketData.size()) ? mPacketData[aPkt->ID()] : nullptr;
+    if (pInfo != nullptr)
+    {
+        pInfo->ReleasePacket(aPkt);
+    }
+    else
     {
         aPkt->ReceiveCleanup();
         delete aPkt;
     }
 }
 
+//! Retrieves the allocation statistics of a pooled packet type.
+//! @return 'false' if the packet type is not registered with cPOOLED_ALLOCATION
+bool PakProcessor::GetPoolStats(int aPacketId, PakPacketPool::Stats& aStats) const
+{
+    PacketInfo* pInfo = (aPacketId >= 0 && aPacketId < (int)mPacketData.size()) ? mPacketData[aPacketId] : nullptr;
+    if (pInfo == nullptr || pInfo->GetPool() == nullptr)
+    {
+        return false;
+    }
+    aStats = pInfo->GetPool()->GetStats();
+    return true;
+}
+
+void PakProcessor::ApplyOptions(PacketInfo* aInfoPtr, int aOptions)
+{
+    if ((aOptions & cPOOLED_ALLOCATION) && !aInfoPtr->IsUndefinedPacket())
+    {
+        aInfoPtr->EnablePooling();
+    }
+    if (aOptions & cHIGH_PRIORITY)
+    {
+        aInfoPtr->SetHighPriority(true);
+        mHasHighPriorityPackets = true;
+    }
+    if (aOptions & cCOMPRESSIBLE)
+    {
+        aInfoPtr->SetCompressible(true);
+    }
+}
+
 void PakProcessor::SubscribeP(int aPacketId, UtCallback* aCallbackPtr, bool aIsSpecific)
 {
     PacketInfo* info = mPacketData[aPacketId];
@@ -194,11 +598,12 @@ PakProcessor::PacketInfo* PakProcessor::RegisterPacketP(int aPacketId,
 
     pInfo = mPacketData[aPacketId] = new PacketInfo(aPacketId, aPacketName, aCallbackListPtr, aIsUndefined);
     pInfo->SetBasePacketId(aPacketBaseId);
+    pInfo->SetOwner(this);
     return pInfo;
 }
 
 PakProcessor::PacketInfo::PacketInfo(int aPacketId, std::string aPacketName, PacketCallbackList* aCallbackListPtr, bool aIsUndefined)
-    : mPacketID(aPacketId), mPacketName(aPacketName), mSpecificCallbackList(aCallbackListPtr)
+    : mPacketID(aPacketId), mPacketName(aPacketName), mSpecificCallbackList(aCallbackListPtr), mIsHighPriority(false), mIsCompressible(false), mPoolPtr(nullptr), mMetricsPtr(nullptr)
 {
     mPacketID = aPacketId;
     mPacketName = aPacketName;
@@ -209,6 +614,28 @@ PakProcessor::PacketInfo::PacketInfo(int aPacketId, std::string aPacketName, Pac
 PakProcessor::PacketInfo::~PacketInfo()
 {
     delete mSpecificCallbackList;
+    delete mPoolPtr;
+    delete mMetricsPtr.load();
+}
+
+//! Returns the packet type's metrics, creating them on first use.
+PakProcessor::MetricsData& PakProcessor::PacketInfo::GetMetrics()
+{
+    MetricsData* metricsPtr = mMetricsPtr.load(std::memory_order_acquire);
+    if (metricsPtr == nullptr)
+    {
+        // Several threads may measure the first packet at once
+        MetricsData* newMetricsPtr = new MetricsData;
+        if (mMetricsPtr.compare_exchange_strong(metricsPtr, newMetricsPtr, std::memory_order_acq_rel))
+        {
+            metricsPtr = newMetricsPtr;
+        }
+        else
+        {
+            delete newMetricsPtr;
+        }
+    }
+    return *metricsPtr;
 }
 
 bool PakProcessor::PacketInfo::IsUndefinedPacket()
@@ -226,11 +653,57 @@ void PakProcessor::PacketInfo::ConnectGeneric(UtCallback* aCallbackPtr)
     mGenericCallbackList.Connect((UtCallbackN<void(PakPacket&)>*)aCallbackPtr);
 }
 
+void PakProcessor::PacketInfo::SetOwner(PakProcessor* aProcessorPtr)
+{
+    mSpecificCallbackList->SetOwner(aProcessorPtr, mPacketID);
+    mGenericCallbackList.SetOwner(aProcessorPtr, mPacketID);
+}
+
+void PakProcessor::PacketCallbackList::HasCallbacksChanged()
+{
+    if (mProcessorPtr != nullptr)
+    {
+        mProcessorPtr->SubscriptionChanged(mPacketId);
+    }
+}
+
 PakPacket* PakProcessor::PacketInfo::GetNewPacket()
 {
+    if (mPoolPtr != nullptr)
+    {
+        return mPoolPtr->Acquire();
+    }
     return (*mNewFn)();
 }
 
+//! Disposes of a packet created by GetNewPacket()
+//! @param aPktPtr The packet to release.
+//! @param aDoCleanup 'true' if ReceiveCleanup() should be called.  Use 'false' if the packet was never read.
+void PakProcessor::PacketInfo::ReleasePacket(PakPacket* aPktPtr, bool aDoCleanup /*= true*/)
+{
+    if (aDoCleanup)
+    {
+        aPktPtr->ReceiveCleanup();
+    }
+    if (mPoolPtr != nullptr)
+    {
+        mPoolPtr->Release(aPktPtr);
+    }
+    else
+    {
+        delete aPktPtr;
+    }
+}
+
+//! Recycles packets of this type through a PakPacketPool
+void PakProcessor::PacketInfo::EnablePooling()
+{
+    if (mPoolPtr == nullptr)
+    {
+        mPoolPtr = new PakPacketPool(mNewFn);
+    }
+}
+
 void PakProcessor::PacketInfo::Call(PakPacket& aPkt)
 {
     mSpecificCallbackList->Call(aPkt);
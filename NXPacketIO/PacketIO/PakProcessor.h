@@ -3,13 +3,25 @@
 
 #include "NXPacketIO_Export.h"
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <list>
+#include <mutex>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "PacketIO/PakI.h"
 #include "PacketIO/PakO.h"
+#include "PacketIO/PakPacketPool.h"
 #include "Util/UtCallback.h"
+#include "Util/UtHistogram.h"
+
+#ifdef __cpp_impl_coroutine
+#include <coroutine>
+#endif
 class PakPacket;
 class PakSocketIO;
 class PakHeader;
@@ -30,6 +42,23 @@ struct SerializeBind {
     static void Serialize(PakPacket& aPkt, SER_CLASS& aBuff) { ((PKT_TYPE&)aPkt).Serialize(aBuff); }
 };
 
+// Reads and writes a packet with its PakFixedLayout
+template <typename PKT_TYPE>
+struct FixedLayoutBind {
+    static void Read(PakPacket& aPkt, PakI& aBuff) { PKT_TYPE::FixedLayout::Read((PKT_TYPE&)aPkt, *aBuff.GetBuffer()); }
+    static void Write(PakPacket& aPkt, PakO& aBuff) { PKT_TYPE::FixedLayout::Write((PKT_TYPE&)aPkt, *aBuff.GetBuffer()); }
+};
+
+// True if PKT_TYPE declares a PakFixedLayout of itself.  A layout inherited from a base packet does not count.
+template <typename PKT_TYPE, typename = void>
+struct HasFixedLayout : std::false_type {
+};
+
+template <typename PKT_TYPE>
+struct HasFixedLayout<PKT_TYPE, std::void_t<typename PKT_TYPE::FixedLayout>>
+    : std::is_same<typename PKT_TYPE::FixedLayout::ObjectType, PKT_TYPE> {
+};
+
 template <typename BASE_TYPE>
 struct PacketBaseClassId {
     static const int cPACKET_ID = BASE_TYPE::cPACKET_ID;
@@ -40,6 +69,17 @@ struct PacketBaseClassId<bool> {
     static const int cPACKET_ID = -1;
 };
 
+#ifdef __cpp_impl_coroutine
+// The predicate of PakProcessor::Receive()
+struct MatchAny {
+    template <typename PKT_TYPE>
+    bool operator()(PKT_TYPE&) const { return true; }
+};
+
+template <typename PKT_TYPE, typename PREDICATE>
+class ReceiveAwaiter;
+#endif
+
 } // namespace PakProcessorDetail
 
 class NX_PACKETIO_EXPORT PakProcessor
@@ -47,34 +87,98 @@ class NX_PACKETIO_EXPORT PakProcessor
 public:
     class PacketCallbackList : public UtCallbackList
     {
-        typedef UtCallbackN<void(PakPacket&)> GenericCallbackType;
-
     public:
-        virtual void Call(PakPacket& aPkt)
+        PacketCallbackList()
+            : mProcessorPtr(nullptr), mPacketId(0)
         {
-            for (IterType it = mCallbackList.begin(); it != mCallbackList.end();)
-            {
-                static_cast<GenericCallbackType*>(*(it++))->operator()(aPkt);
-            }
         }
+        virtual void Call(PakPacket& aPkt) { CallP<PakPacket&>(aPkt); }
         void Connect(UtCallback* aCallbackPtr) { UtCallbackList::ConnectP(aCallbackPtr); }
+        //! Reports the first callback connected and the last disconnected to the processor
+        void SetOwner(PakProcessor* aProcessorPtr, int aPacketId)
+        {
+            mProcessorPtr = aProcessorPtr;
+            mPacketId = aPacketId;
+        }
+
+    protected:
+        void HasCallbacksChanged() override;
+
+    private:
+        PakProcessor* mProcessorPtr;
+        int mPacketId;
     };
 
     template <class T>
     class TPacketCallbackList : public PacketCallbackList
     {
-        typedef UtCallbackN<void(T&)> CallbackType;
-
     public:
-        void Call(PakPacket& aPkt) override
-        {
-            for (IterType it = mCallbackList.begin(); it != mCallbackList.end();)
-            {
-                static_cast<CallbackType*>(*(it++))->operator()(static_cast<T&>(aPkt));
-            }
-        }
+        void Call(PakPacket& aPkt) override { CallP<T&>(static_cast<T&>(aPkt)); }
+    };
 
-    protected:
+    //! Options which may be combined and passed to RegisterPacket()
+    enum PacketOptions
+    {
+        cDEFAULT_OPTIONS = 0,
+        //! Received packets are recycled through a PakPacketPool rather than deleted.
+        //! See PakPacketPool for the requirements on the packet type.
+        cPOOLED_ALLOCATION = 1,
+        //! Packets are sent and received in a separate lane, ahead of other packets already
+        //! queued on the same connection.  For small control packets such as heartbeats.
+        //! Packets of one type stay in order, but may overtake packets of other types.
+        cHIGH_PRIORITY = 2,
+        //! The body may be compressed when sent through an IO with a PakCompressedHeader.
+        //! For large packets with repetitive content, such as arrays and strings.
+        cCOMPRESSIBLE = 4
+    };
+
+    //! Counters and timings of one packet type, updated without locks.  See EnableMetrics().
+    struct MetricsData
+    {
+        std::atomic<uint64_t> mPacketsReceived{0};
+        std::atomic<uint64_t> mBytesReceived{0};
+        std::atomic<uint64_t> mPacketsSent{0};
+        std::atomic<uint64_t> mBytesSent{0};
+        UtHistogram mDecodeTime;
+        UtHistogram mQueueTime;
+        UtHistogram mCallbackTime;
+    };
+
+    //! A copy of one packet type's metrics.  Times are in nanoseconds.
+    struct PacketMetrics
+    {
+        int mPacketId;
+        std::string mPacketName;
+        uint64_t mPacketsReceived;
+        uint64_t mBytesReceived;
+        uint64_t mPacketsSent;
+        uint64_t mBytesSent;
+        //! Time to create and deserialize the packet
+        UtHistogram::Snapshot mDecodeTime;
+        //! Time from the packet being received to ProcessPacket(), usually spent in a receive queue
+        UtHistogram::Snapshot mQueueTime;
+        //! Time spent in the packet's callbacks
+        UtHistogram::Snapshot mCallbackTime;
+    };
+    typedef std::vector<PacketMetrics> MetricsList;
+
+    //! A coroutine suspended until a packet arrives or its timeout expires.
+    //! Lives in the coroutine frame, see Receive().
+    struct PacketWaiter
+    {
+        int mPacketId;
+        //! Returns 'true' if the packet is the one waited for.  Null to wait for any packet of the type.
+        bool (*mMatchFn)(PacketWaiter& aWaiter, PakPacket& aPkt);
+        //! Resumes the coroutine, or destroys it if the processor is being destroyed
+        void (*mResumeFn)(PacketWaiter& aWaiter, bool aDestroy);
+        //! GetMetricsTime() at which the wait fails, or zero to wait without a timeout
+        int64_t mDeadline;
+        //! The matching packet, or null if the wait timed out
+        PakPacket* mPacketPtr;
+        PacketWaiter* mPrevPtr;
+        PacketWaiter* mNextPtr;
+        //! Position in the timeout heap
+        size_t mHeapIndex;
     };
 
     typedef void (*ReadFnPtr)(PakPacket& aPkt, PakI& aBuff);
@@ -89,14 +193,25 @@ public:
         void SetBasePacketId(int aPacketId) { mBasePacketID = aPacketId; }
         void ConnectSpecific(UtCallback* aCallback);
         void ConnectGeneric(UtCallback* aCallback);
+        void SetOwner(PakProcessor* aProcessorPtr);
+        bool HasCallbacks() const { return mSpecificCallbackList->HasCallbacks() || mGenericCallbackList.HasCallbacks(); }
         int GetBasePacketId() const { return mBasePacketID; }
 
         ~PacketInfo();
         int GetPacketId() { return mPacketID; }
         PakPacket* GetNewPacket();
+        void ReleasePacket(PakPacket* aPktPtr, bool aDoCleanup = true);
+        void EnablePooling();
+        PakPacketPool* GetPool() const { return mPoolPtr; }
         const std::string& GetPacketName() { return mPacketName; }
         void Call(PakPacket& aPkt);
         bool IsUndefinedPacket();
+        MetricsData& GetMetrics();
+        MetricsData* FindMetrics() const { return mMetricsPtr.load(std::memory_order_acquire); }
+        void SetHighPriority(bool aHighPriority) { mIsHighPriority = aHighPriority; }
+        bool IsHighPriority() const { return mIsHighPriority; }
+        void SetCompressible(bool aCompressible) { mIsCompressible = aCompressible; }
+        bool IsCompressible() const { return mIsCompressible; }
 
         ReadFnPtr mReadFn;
         WriteFnPtr mWriteFn;
@@ -109,7 +224,12 @@ public:
         PacketCallbackList* mSpecificCallbackList;
         PacketCallbackList mGenericCallbackList;
         bool mIsUndefinedPacket;
+        bool mIsHighPriority;
+        bool mIsCompressible;
         int mBasePacketID;
+        PakPacketPool* mPoolPtr;
+        //! Created when the packet type is first measured
+        std::atomic<MetricsData*> mMetricsPtr;
     };
 
     PakProcessor();
@@ -121,10 +241,105 @@ public:
 
     void ProcessPacket(PakPacket* aPkt, bool aDoCleanup = false);
 
+    void ReleasePacket(PakPacket* aPkt);
+
+#ifdef __cpp_impl_coroutine
+    //! Suspends the calling coroutine until a packet of type PKT_TYPE, or of a type derived
+    //! from it, is processed.  The result of the co_await is the packet, or null if aTimeout
+    //! seconds passed first.  A negative aTimeout waits without a timeout.
+    //! The packet is valid until the coroutine next suspends.
+    //! The coroutine resumes on the thread calling ProcessPacket().  Packets processed before it
+    //! suspends are not seen, so a coroutine sending a request and awaiting the reply should run
+    //! on that thread, e.g. be started from a packet callback.
+    template <typename PKT_TYPE>
+    PakProcessorDetail::ReceiveAwaiter<PKT_TYPE, PakProcessorDetail::MatchAny> Receive(double aTimeout = -1.0);
+
+    //! Like Receive(), but waits for a packet for which aPredicate(PKT_TYPE&) returns 'true'.
+    //! A packet resumes only the first coroutine it matches, so many coroutines may wait for
+    //! replies of one type and each resumes with its own.  Every Receive() of the type resumes too.
+    template <typename PKT_TYPE, typename PREDICATE>
+    PakProcessorDetail::ReceiveAwaiter<PKT_TYPE, PREDICATE> ReceiveMatching(PREDICATE aPredicate, double aTimeout = -1.0);
+#endif
+
+    //! Registers a coroutine waiting for a packet.  Used by Receive(), may be called from any thread.
+    void AddWaiter(PacketWaiter& aWaiter);
+
+    //! Resumes coroutines whose Receive() timed out.  ProcessPacket() resumes the others, so call
+    //! this from the same thread, e.g. PakThreadedIO::Process() does.
+    //! @return The time in seconds until the next timeout, or a negative value if none is pending.
+    double ResumeExpiredWaiters();
+
+    //! Returns the time in seconds until the next Receive() times out, or a negative value if none is pending.
+    double GetTimeToNextTimeout() const;
+
+    //! Returns 'true' if a received packet of this type would be handled: a callback is connected
+    //! to the type or one of its base types, or a coroutine has waited for it with Receive().
+    bool IsSubscribed(int aPacketId) const;
+
+    //! Sets bit (ID % 32) of aBits[ID / 32] for each subscribed packet ID, see IsSubscribed().
+    void GetSubscriptions(std::vector<uint32_t>& aBits) const;
+
+    //! Invoked with a packet ID when its first callback is connected or its last disconnected, or
+    //! a coroutine first waits for it.  The subscription of the type and of the types derived from
+    //! it may have changed.  Invoked on the thread that connected or disconnected the callback.
+    UtCallbackListN<void(int)> SubscriptionChanged;
+
+    bool GetPoolStats(int aPacketId, PakPacketPool::Stats& aStats) const;
+
+    //! Returns 'true' if the packet type was registered with cHIGH_PRIORITY.
+    bool IsHighPriority(int aPacketId) const
+    {
+        return mHasHighPriorityPackets && aPacketId >= 0 && aPacketId < (int)mPacketData.size() &&
+               mPacketData[aPacketId] != nullptr && mPacketData[aPacketId]->IsHighPriority();
+    }
+
+    //! Returns 'true' if the packet type was registered with cCOMPRESSIBLE.
+    bool IsCompressible(int aPacketId) const
+    {
+        return aPacketId >= 0 && aPacketId < (int)mPacketData.size() && mPacketData[aPacketId] != nullptr &&
+               mPacketData[aPacketId]->IsCompressible();
+    }
+
+    //! Returns 'true' if any packet type was registered with cHIGH_PRIORITY.
+    bool HasHighPriorityPackets() const { return mHasHighPriorityPackets; }
+
+    //! Starts or stops measuring packets.  Counting is a few atomic increments, timing adds
+    //! four clock reads per received packet.  Off by default.
+    void EnableMetrics(bool aEnable) { mMetricsEnabled.store(aEnable, std::memory_order_relaxed); }
+
+    bool IsMetricsEnabled() const { return mMetricsEnabled.load(std::memory_order_relaxed); }
+
+    void GetMetrics(MetricsList& aMetrics) const;
+
+    void ResetMetrics();
+
+    //! Sets how often ReportMetricsIfDue() invokes MetricsReport.  Zero, the default, never does.
+    void SetMetricsReportInterval(double aSeconds);
+
+    void ReportMetricsIfDue();
+
+    //! Invoked by ReportMetricsIfDue() with the metrics of every packet type measured so far.
+    UtCallbackListN<void(const MetricsList&)> MetricsReport;
+
+    //! Called by an IO for each packet it sends.
+    void PacketSent(int aPacketId, size_t aBytes)
+    {
+        if (mMetricsEnabled.load(std::memory_order_relaxed))
+        {
+            PacketSentP(aPacketId, aBytes);
+        }
+    }
+
+    //! The clock used for metrics, in nanoseconds.
+    static int64_t GetMetricsTime()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
     template <class C, class T>
     std::unique_ptr<UtCallbackN<void(T&)>> Connect(void (C::*aFuncPtr)(T&), C* aThisPtr)
     {
-        auto newCallback = std::make_unique<UtCallbackN<void(T&)>>(UtStd::Bind(aFuncPtr, aThisPtr));
+        auto newCallback = UtCallbackN<void(T&)>::Create(aFuncPtr, aThisPtr);
         SubscribeP(T::cPACKET_ID, newCallback.get(), true);
         return newCallback;
     }
@@ -132,7 +347,7 @@ public:
     template <typename T>
     std::unique_ptr<UtCallbackN<void(T&)>> Connect(void (*aFuncPtr)(T&))
     {
-        auto newCallback = std::make_unique<UtCallbackN<void(T&)>>(UtStd::Bind(aFuncPtr));
+        auto newCallback = UtCallbackN<void(T&)>::Create(aFuncPtr);
         SubscribeP(T::cPACKET_ID, newCallback.get(), true);
         return newCallback;
     }
@@ -140,14 +355,14 @@ public:
     template <class C>
     std::unique_ptr<UtCallbackN<void(PakPacket&)>> Connect(int aPacketId, void (C::*aFuncPtr)(PakPacket&), C* aThisPtr)
     {
-        auto newCallback = std::make_unique<UtCallbackN<void(PakPacket&)>>(UtStd::Bind(aFuncPtr, aThisPtr));
+        auto newCallback = UtCallbackN<void(PakPacket&)>::Create(aFuncPtr, aThisPtr);
         SubscribeP(aPacketId, newCallback.get(), false);
         return newCallback;
     }
 
     std::unique_ptr<UtCallbackN<void(PakPacket&)>> Connect(int aPacketId, void (*aFuncPtr)(PakPacket&))
     {
-        auto newCallback = std::make_unique<UtCallbackN<void(PakPacket&)>>(UtStd::Bind(aFuncPtr));
+        auto newCallback = UtCallbackN<void(PakPacket&)>::Create(aFuncPtr);
         SubscribeP(aPacketId, newCallback.get(), false);
         return newCallback;
     }
@@ -167,8 +382,12 @@ public:
         return newCallback;
     }
 
+    //! Registers a packet type.
+    //! @param aPacketName The name of the packet
+    //! @param aPktPtr A new instance of the packet.  Used only for type deduction, and deleted.
+    //! @param aOptions A combination of PacketOptions values
     template <class PKT_TYPE>
-    void RegisterPacket(const std::string& aPacketName, PKT_TYPE* aPktPtr)
+    void RegisterPacket(const std::string& aPacketName, PKT_TYPE* aPktPtr, int aOptions = cDEFAULT_OPTIONS)
     {
         NotAPacketTest(*aPktPtr);
         PacketInfo* info = RegisterPacketP(PKT_TYPE::cPACKET_ID,
@@ -177,11 +396,12 @@ public:
                                            false,
                                            PakProcessorDetail::PacketBaseClassId<typename PKT_TYPE::BaseType>::cPACKET_ID);
         DefinePacketFunctions(aPktPtr, info);
+        ApplyOptions(info, aOptions);
         delete aPktPtr;
     }
 
     template <class PKT_TYPE>
-    void RegisterPacket(int aPacketId, const std::string& aPacketName, PKT_TYPE* aPktPtr, bool aIsUndefined = false)
+    void RegisterPacket(int aPacketId, const std::string& aPacketName, PKT_TYPE* aPktPtr, bool aIsUndefined = false, int aOptions = cDEFAULT_OPTIONS)
     {
         NotAPacketTest(*aPktPtr);
         PacketInfo* info = RegisterPacketP(aPacketId,
@@ -190,6 +410,7 @@ public:
                                            aIsUndefined,
                                            PakProcessorDetail::PacketBaseClassId<typename PKT_TYPE::BaseType>::cPACKET_ID);
         DefinePacketFunctions(aPktPtr, info);
+        ApplyOptions(info, aOptions);
         delete aPktPtr;
     }
 
@@ -203,19 +424,123 @@ protected:
                                 int aPacketBaseTypeId);
 
     // Create function pointers for the Serialize methods, and new
+    // Packets with a PakFixedLayout skip Serialize() and use the layout directly.
     template <class PKT_TYPE>
     void DefinePacketFunctions(PKT_TYPE* /*Unused*/, PacketInfo* aInfoPtr)
     {
-        aInfoPtr->mReadFn = &PakProcessorDetail::SerializeBind<PKT_TYPE, PakI>::Serialize;
-        aInfoPtr->mWriteFn = &PakProcessorDetail::SerializeBind<PKT_TYPE, PakO>::Serialize;
+        if constexpr (PakProcessorDetail::HasFixedLayout<PKT_TYPE>::value)
+        {
+            aInfoPtr->mReadFn = &PakProcessorDetail::FixedLayoutBind<PKT_TYPE>::Read;
+            aInfoPtr->mWriteFn = &PakProcessorDetail::FixedLayoutBind<PKT_TYPE>::Write;
+        }
+        else
+        {
+            aInfoPtr->mReadFn = &PakProcessorDetail::SerializeBind<PKT_TYPE, PakI>::Serialize;
+            aInfoPtr->mWriteFn = &PakProcessorDetail::SerializeBind<PKT_TYPE, PakO>::Serialize;
+        }
         aInfoPtr->mNewFn = &PakProcessorDetail::NewBind<PKT_TYPE>::NewPacket;
     }
 
+    void ApplyOptions(PacketInfo* aInfoPtr, int aOptions);
+
     void SubscribeP(int aPacketId, UtCallback* aCallbackPtr, bool aIsSpecific);
 
+    void PacketSentP(int aPacketId, size_t aBytes);
+
+    void ResumeWaitersP(PakPacket& aPkt);
+    void RemoveWaiterP(PacketWaiter& aWaiter);
+    void SiftUpP(size_t aIndex);
+    void SiftDownP(size_t aIndex);
+
     // If this call fails, a non-packet object is being registered.
     void NotAPacketTest(PakPacket& /*aPkt*/) {}
 
     std::vector<PacketInfo*> mPacketData;
+    bool mHasHighPriorityPackets;
+    std::atomic<bool> mMetricsEnabled;
+    int64_t mMetricsReportInterval;
+    int64_t mNextMetricsReportTime;
+
+    mutable std::mutex mWaiterMutex;
+    //! Coroutines waiting for each packet ID, in the order they started waiting.  Index 2 * ID
+    //! holds those waiting in Receive(), 2 * ID + 1 those waiting in ReceiveMatching().
+    std::vector<PacketWaiter*> mWaiterLists;
+    //! Waiters with a timeout, a binary heap ordered by deadline
+    std::vector<PacketWaiter*> mTimedWaiters;
+    //! Packet IDs a coroutine has waited for.  They stay subscribed, so replies keep arriving
+    //! between one Receive() and the next.
+    std::vector<bool> mAwaitedPackets;
+    std::atomic<size_t> mWaiterCount;
 };
+
+#ifdef __cpp_impl_coroutine
+namespace PakProcessorDetail
+{
+// The result of PakProcessor::Receive() and ReceiveMatching()
+template <typename PKT_TYPE, typename PREDICATE>
+class ReceiveAwaiter : public PakProcessor::PacketWaiter
+{
+public:
+    ReceiveAwaiter(PakProcessor& aProcessor, PREDICATE aPredicate, double aTimeout)
+        : mProcessorPtr(&aProcessor), mPredicate(std::move(aPredicate))
+    {
+        mPacketId = PKT_TYPE::cPACKET_ID;
+        mMatchFn = std::is_same<PREDICATE, MatchAny>::value ? nullptr : &MatchP;
+        mResumeFn = &ResumeP;
+        mDeadline = aTimeout < 0.0 ? 0 : PakProcessor::GetMetricsTime() + static_cast<int64_t>(aTimeout * 1.0E9);
+        mPacketPtr = nullptr;
+        mPrevPtr = nullptr;
+        mNextPtr = nullptr;
+        mHeapIndex = 0;
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    // Another thread may resume the coroutine as soon as the waiter is added
+    void await_suspend(std::coroutine_handle<> aCoroutine)
+    {
+        mCoroutine = aCoroutine;
+        mProcessorPtr->AddWaiter(*this);
+    }
+
+    PKT_TYPE* await_resume() const noexcept { return static_cast<PKT_TYPE*>(mPacketPtr); }
+
+private:
+    static bool MatchP(PakProcessor::PacketWaiter& aWaiter, PakPacket& aPkt)
+    {
+        return static_cast<ReceiveAwaiter&>(aWaiter).mPredicate(static_cast<PKT_TYPE&>(aPkt));
+    }
+
+    static void ResumeP(PakProcessor::PacketWaiter& aWaiter, bool aDestroy)
+    {
+        std::coroutine_handle<> coroutine = static_cast<ReceiveAwaiter&>(aWaiter).mCoroutine;
+        if (aDestroy)
+        {
+            coroutine.destroy();
+        }
+        else
+        {
+            coroutine.resume();
+        }
+    }
+
+    PakProcessor* mProcessorPtr;
+    PREDICATE mPredicate;
+    std::coroutine_handle<> mCoroutine;
+};
+} // namespace PakProcessorDetail
+
+template <typename PKT_TYPE>
+PakProcessorDetail::ReceiveAwaiter<PKT_TYPE, PakProcessorDetail::MatchAny> PakProcessor::Receive(double aTimeout)
+{
+    return PakProcessorDetail::ReceiveAwaiter<PKT_TYPE, PakProcessorDetail::MatchAny>(*this, PakProcessorDetail::MatchAny(), aTimeout);
+}
+
+template <typename PKT_TYPE, typename PREDICATE>
+PakProcessorDetail::ReceiveAwaiter<PKT_TYPE, PREDICATE> PakProcessor::ReceiveMatching(PREDICATE aPredicate, double aTimeout)
+{
+    return PakProcessorDetail::ReceiveAwaiter<PKT_TYPE, PREDICATE>(*this, std::move(aPredicate), aTimeout);
+}
+#endif
+
 #endif
@@ -0,0 +1,585 @@
+﻿#include "PacketIO/PakReliableUDP.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+#include "GenIO/GenInternetSocketAddress.h"
+#include "GenIO/GenUDP_Connection.h"
+
+namespace
+{
+//! Starts every datagram of the reliability layer.  Read as a PakDefaultHeader it is a
+//! negative length, so a PakUDP_IO without the reliability layer discards the datagram.
+const uint32_t cMAGIC = 0xF14E5852;
+//! Set in the header flags of fragments of a stream that keeps send order
+const uint8_t cORDERED = 1;
+//! A datagram this many sequence numbers before one acknowledged is presumed lost
+const uint32_t cREORDER_THRESHOLD = 3;
+const std::chrono::milliseconds cINITIAL_ROUND_TRIP(100);
+const std::chrono::milliseconds cMINIMUM_TIMEOUT(20);
+const std::chrono::milliseconds cMAXIMUM_TIMEOUT(1000);
+const std::chrono::milliseconds cINITIAL_HELLO_INTERVAL(100);
+const std::chrono::milliseconds cMAXIMUM_HELLO_INTERVAL(1000);
+
+void Put16(char* aData, uint16_t aValue)
+{
+    aData[0] = (char)(aValue >> 8);
+    aData[1] = (char)aValue;
+}
+
+void Put32(char* aData, uint32_t aValue)
+{
+    Put16(aData, (uint16_t)(aValue >> 16));
+    Put16(aData + 2, (uint16_t)aValue);
+}
+
+void Put64(char* aData, uint64_t aValue)
+{
+    Put32(aData, (uint32_t)(aValue >> 32));
+    Put32(aData + 4, (uint32_t)aValue);
+}
+
+uint16_t Get16(const char* aData)
+{
+    return (uint16_t)(((unsigned char)aData[0] << 8) | (unsigned char)aData[1]);
+}
+
+uint32_t Get32(const char* aData)
+{
+    return ((uint32_t)Get16(aData) << 16) | Get16(aData + 2);
+}
+
+uint64_t Get64(const char* aData)
+{
+    return ((uint64_t)Get32(aData) << 32) | Get32(aData + 4);
+}
+
+//! Returns the signed distance from aFrom to aTo, allowing for wrap around
+int32_t SequenceDelta(uint32_t aTo, uint32_t aFrom)
+{
+    return (int32_t)(aTo - aFrom);
+}
+
+uint64_t FrameKey(int aStream, uint32_t aMessage)
+{
+    return ((uint64_t)aStream << 32) | aMessage;
+}
+} // namespace
+
+PakReliableUDP::Options::Options()
+    : mDatagramSize(1200), mSendWindow(256), mMaximumQueuedBytes(16 * 1024 * 1024), mTestLossRate(0.0)
+{
+}
+
+PakReliableUDP::PakReliableUDP(GenUDP_Connection* aConnectionPtr, const Options& aOptions)
+    : mConnectionPtr(aConnectionPtr), mOptions(aOptions), mPeerSession(0), mPreviousPeerSession(0), mEstablished(false), mNextHello(Clock::now()), mHelloInterval(cINITIAL_HELLO_INTERVAL), mPending(256), mSmoothedRoundTrip(cINITIAL_ROUND_TRIP), mRoundTripVariance(cINITIAL_ROUND_TRIP / 2), mReceived(cRECEIVE_WINDOW)
+{
+    mOptions.mDatagramSize = std::max<size_t>(mOptions.mDatagramSize, cHEADER_SIZE + 1);
+    mOptions.mSendWindow = std::min<size_t>(std::max<size_t>(mOptions.mSendWindow, 1), cRECEIVE_WINDOW);
+    std::random_device random;
+    do
+    {
+        mSession = random();
+    } while (mSession == 0);
+    mTestLossRandom.seed(mSession);
+    memset(&mStats, 0, sizeof(mStats));
+    ResetP();
+}
+
+//! Returns 'true' if the datagram was sent by a reliability layer
+bool PakReliableUDP::IsReliableDatagram(const char* aData, int aBytes)
+{
+    return aBytes >= cHEADER_SIZE && Get32(aData) == cMAGIC;
+}
+
+//! Queues a frame for the peer, and sends as much of it as the send window allows.
+//! Before the peer's reliability layer is known the frame is sent as a plain datagram.
+//! @param aFrame The frame, including its packet header.
+//! @param aPacketId The packet's type, which selects its stream.
+//! @return 'false' if the frame was refused because the queue is full, or has too many fragments.
+bool PakReliableUDP::SendFrame(const char* aFrame, size_t aBytes, int aPacketId)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mEstablished)
+    {
+        SendBufferP(aFrame, aBytes);
+        ++mStats.mDatagramsSent;
+        ++mStats.mFramesSent;
+        return true;
+    }
+
+    size_t payloadSize = mOptions.mDatagramSize - cHEADER_SIZE;
+    size_t fragmentCount = std::max<size_t>((aBytes + payloadSize - 1) / payloadSize, 1);
+    if (fragmentCount > 0xFFFF || mQueuedBytes + aBytes > mOptions.mMaximumQueuedBytes)
+    {
+        ++mStats.mRejectedFrames;
+        return false;
+    }
+
+    Header header;
+    header.mKind = cDATA;
+    header.mStream = (uint8_t)GetStreamP(aPacketId);
+    header.mFragmentCount = (uint16_t)fragmentCount;
+    header.mFlags = (mOptions.mUnorderedStreams.count(header.mStream) != 0) ? 0 : cORDERED;
+    header.mSession = mSession;
+    header.mPeerSession = mPeerSession;
+    header.mMessage = mNextMessage[header.mStream]++;
+    header.mSequence = 0;
+    header.mAck = 0;
+    header.mAckBits = 0;
+    std::deque<Outgoing>& pending = mPending[header.mStream];
+    if (pending.empty())
+    {
+        mReadyStreams.push_back(header.mStream);
+    }
+    for (size_t i = 0; i < fragmentCount; ++i)
+    {
+        size_t offset = i * payloadSize;
+        size_t bytes = std::min(payloadSize, aBytes - offset);
+        header.mFragmentIndex = (uint16_t)i;
+        pending.emplace_back();
+        Outgoing& datagram = pending.back();
+        datagram.mData.resize(cHEADER_SIZE + bytes);
+        WriteHeaderP(datagram.mData.data(), header);
+        memcpy(datagram.mData.data() + cHEADER_SIZE, aFrame + offset, bytes);
+        datagram.mTransmissions = 0;
+        datagram.mAcked = false;
+    }
+    mQueuedBytes += aBytes;
+    ++mStats.mFramesSent;
+    TransmitP(Clock::now());
+    return true;
+}
+
+//! Handles a datagram for which IsReliableDatagram() returned 'true'.
+//! @param aSender The address the datagram came from.  Datagrams not from the peer are dropped.
+//! @param aFrames Frames that are ready to be delivered are appended here.
+void PakReliableUDP::ProcessDatagram(const char* aData, int aBytes, const GenSockets::GenInternetSocketAddress& aSender, std::vector<Frame>& aFrames)
+{
+    mDelivered.clear();
+    if (!IsReliableDatagram(aData, aBytes))
+    {
+        return;
+    }
+    if (!IsPeerAddressP(aSender))
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        ++mStats.mRejectedDatagrams;
+        return;
+    }
+    Header header;
+    header.mKind = (uint8_t)aData[4];
+    header.mStream = (uint8_t)aData[5];
+    header.mFlags = (uint8_t)aData[6];
+    header.mFragmentIndex = Get16(aData + 8);
+    header.mFragmentCount = Get16(aData + 10);
+    header.mSession = Get32(aData + 12);
+    header.mPeerSession = Get32(aData + 16);
+    header.mSequence = Get32(aData + 20);
+    header.mMessage = Get32(aData + 24);
+    header.mAck = Get32(aData + 28);
+    header.mAckBits = Get64(aData + 32);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    Clock::time_point now = Clock::now();
+    if (header.mSession != mPeerSession)
+    {
+        if (header.mSession == 0 || header.mSession == mPreviousPeerSession)
+        {
+            // Left over from before the peer restarted
+            return;
+        }
+        if (mPeerSession != 0)
+        {
+            ResetP();
+            ++mStats.mPeerResets;
+        }
+        mPreviousPeerSession = mPeerSession;
+        mPeerSession = header.mSession;
+    }
+    mEstablished = true;
+
+    if (header.mPeerSession != mSession)
+    {
+        // The peer does not know this session yet, tell it
+        mAckPending = true;
+        return;
+    }
+    if (header.mKind != cDATA)
+    {
+        ProcessAckP(header, aData + cHEADER_SIZE, aBytes - cHEADER_SIZE, now);
+        return;
+    }
+    ProcessAckP(header, nullptr, 0, now);
+
+    mAckPending = true;
+    int32_t offset = SequenceDelta(header.mSequence, mReceiveNext);
+    if (offset < 0 || offset >= (int32_t)cRECEIVE_WINDOW || mReceived[header.mSequence % cRECEIVE_WINDOW])
+    {
+        ++mStats.mDuplicates;
+        return;
+    }
+    mReceived[header.mSequence % cRECEIVE_WINDOW] = true;
+    if (SequenceDelta(header.mSequence, mReceiveEnd) >= 0)
+    {
+        mReceiveEnd = header.mSequence + 1;
+    }
+    while (mReceived[mReceiveNext % cRECEIVE_WINDOW])
+    {
+        mReceived[mReceiveNext % cRECEIVE_WINDOW] = false;
+        ++mReceiveNext;
+    }
+    if (header.mFragmentIndex >= header.mFragmentCount)
+    {
+        ++mStats.mRejectedDatagrams;
+        return;
+    }
+
+    const char* payload = aData + cHEADER_SIZE;
+    size_t payloadBytes = aBytes - cHEADER_SIZE;
+    if (header.mFragmentCount == 1)
+    {
+        DeliverP(header, payload, payloadBytes, aFrames);
+        return;
+    }
+    Reassembly& reassembly = mReassembly[FrameKey(header.mStream, header.mMessage)];
+    if (reassembly.mFragments.empty())
+    {
+        reassembly.mFragments.resize(header.mFragmentCount);
+        reassembly.mReceived = 0;
+    }
+    // Every fragment of a frame has the same count, and none is empty
+    if (header.mFragmentCount != reassembly.mFragments.size() || payloadBytes == 0 ||
+        !reassembly.mFragments[header.mFragmentIndex].empty())
+    {
+        ++mStats.mRejectedDatagrams;
+        return;
+    }
+    reassembly.mFragments[header.mFragmentIndex].assign(payload, payload + payloadBytes);
+    if (++reassembly.mReceived == reassembly.mFragments.size())
+    {
+        mDelivered.emplace_back();
+        std::vector<char>& frame = mDelivered.back();
+        for (const std::vector<char>& fragment : reassembly.mFragments)
+        {
+            frame.insert(frame.end(), fragment.begin(), fragment.end());
+        }
+        mReassembly.erase(FrameKey(header.mStream, header.mMessage));
+        DeliverP(header, frame.data(), frame.size(), aFrames);
+    }
+}
+
+//! Sends an acknowledgement if datagrams were received since the last one was sent.
+void PakReliableUDP::FlushAck()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mAckPending)
+    {
+        SendAckP();
+    }
+}
+
+//! Runs the retransmit and hello timers.  Call periodically.
+//! @return The time in seconds until the next timer expires, or a negative value if none is running.
+double PakReliableUDP::Update()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Clock::time_point now = Clock::now();
+    if (!mEstablished)
+    {
+        if (now >= mNextHello)
+        {
+            SendAckP();
+            mHelloInterval = std::min<Clock::duration>(mHelloInterval * 2, cMAXIMUM_HELLO_INTERVAL);
+            mNextHello = now + mHelloInterval;
+        }
+        return std::chrono::duration<double>(mNextHello - now).count();
+    }
+
+    if (mAckPending)
+    {
+        SendAckP();
+    }
+    Clock::time_point nextTimeout = Clock::time_point::max();
+    for (Outgoing& datagram : mSent)
+    {
+        if (!datagram.mAcked)
+        {
+            if (now >= datagram.mLastSent + RetransmitTimeoutP(datagram))
+            {
+                SendDatagramP(datagram, now);
+                ++mStats.mTimeouts;
+            }
+            nextTimeout = std::min(nextTimeout, datagram.mLastSent + RetransmitTimeoutP(datagram));
+        }
+    }
+    if (nextTimeout == Clock::time_point::max())
+    {
+        return -1.0;
+    }
+    return std::chrono::duration<double>(nextTimeout - now).count();
+}
+
+bool PakReliableUDP::IsEstablished()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mEstablished;
+}
+
+void PakReliableUDP::GetStats(Stats& aStats)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    aStats = mStats;
+    aStats.mEstablished = mEstablished;
+    aStats.mQueuedBytes = mQueuedBytes;
+    aStats.mRoundTripTime = std::chrono::duration<double>(mSmoothedRoundTrip).count();
+}
+
+//! Returns 'true' if aSender is the address of the peer, see the class description
+bool PakReliableUDP::IsPeerAddressP(const GenSockets::GenInternetSocketAddress& aSender) const
+{
+    const GenSockets::GenInternetSocketAddress* peerPtr = mConnectionPtr->GetSendAddress();
+    if (peerPtr == nullptr || !(aSender.GetAddress() == peerPtr->GetAddress()))
+    {
+        return false;
+    }
+    return mConnectionPtr->HasSeparateSendPort() || aSender.GetPort() == peerPtr->GetPort();
+}
+
+//! Sends a datagram, unless Options::mTestLossRate drops it
+void PakReliableUDP::SendBufferP(const char* aData, size_t aBytes)
+{
+    if (mOptions.mTestLossRate > 0.0 &&
+        std::uniform_real_distribution<double>(0.0, 1.0)(mTestLossRandom) < mOptions.mTestLossRate)
+    {
+        ++mStats.mTestLosses;
+        return;
+    }
+    mConnectionPtr->SendBuffer(aData, (int)aBytes);
+}
+
+//! Forgets every datagram sent to and received from the peer
+void PakReliableUDP::ResetP()
+{
+    for (std::deque<Outgoing>& pending : mPending)
+    {
+        pending.clear();
+    }
+    mReadyStreams.clear();
+    mSent.clear();
+    mSendUnacked = 0;
+    std::fill(mNextMessage, mNextMessage + 256, 0);
+    mQueuedBytes = 0;
+    mReceiveNext = 0;
+    mReceiveEnd = 0;
+    std::fill(mReceived.begin(), mReceived.end(), false);
+    mAckPending = false;
+    mReassembly.clear();
+    mHeldFrames.clear();
+    std::fill(mDeliverNext, mDeliverNext + 256, 0);
+}
+
+void PakReliableUDP::WriteHeaderP(char* aData, const Header& aHeader)
+{
+    Put32(aData, cMAGIC);
+    aData[4] = (char)aHeader.mKind;
+    aData[5] = (char)aHeader.mStream;
+    aData[6] = (char)aHeader.mFlags;
+    aData[7] = 0;
+    Put16(aData + 8, aHeader.mFragmentIndex);
+    Put16(aData + 10, aHeader.mFragmentCount);
+    Put32(aData + 12, aHeader.mSession);
+    Put32(aData + 16, aHeader.mPeerSession);
+    Put32(aData + 20, aHeader.mSequence);
+    Put32(aData + 24, aHeader.mMessage);
+    Put32(aData + 28, aHeader.mAck);
+    Put64(aData + 32, aHeader.mAckBits);
+}
+
+//! Writes the current acknowledgement of the peer's datagrams into a datagram header
+void PakReliableUDP::WriteAckP(char* aData)
+{
+    uint64_t ackBits = 0;
+    for (uint32_t i = 0; i < 64; ++i)
+    {
+        if (mReceived[(mReceiveNext + 1 + i) % cRECEIVE_WINDOW])
+        {
+            ackBits |= (uint64_t)1 << i;
+        }
+    }
+    Put32(aData + 16, mPeerSession);
+    Put32(aData + 28, mReceiveNext);
+    Put64(aData + 32, ackBits);
+    // Holes past the 64 in the header still need an acknowledgement of their own
+    mAckPending = SequenceDelta(mReceiveEnd, mReceiveNext + 1) > 64;
+}
+
+void PakReliableUDP::SendDatagramP(Outgoing& aDatagram, Clock::time_point aNow)
+{
+    WriteAckP(aDatagram.mData.data());
+    SendBufferP(aDatagram.mData.data(), aDatagram.mData.size());
+    aDatagram.mLastSent = aNow;
+    ++aDatagram.mTransmissions;
+    ++mStats.mDatagramsSent;
+}
+
+//! Sends an acknowledgement on its own, with a bitmask extended to the last datagram received
+void PakReliableUDP::SendAckP()
+{
+    Header header;
+    memset(&header, 0, sizeof(header));
+    header.mKind = cACK;
+    header.mSession = mSession;
+    int32_t moreBits = SequenceDelta(mReceiveEnd, mReceiveNext + 1) - 64;
+    size_t moreBytes = (moreBits > 0) ? (moreBits + 7) / 8 : 0;
+    mScratch.assign(cHEADER_SIZE + moreBytes, 0);
+    WriteHeaderP(mScratch.data(), header);
+    WriteAckP(mScratch.data());
+    mAckPending = false;
+    for (int32_t i = 0; i < moreBits; ++i)
+    {
+        if (mReceived[(mReceiveNext + 65 + i) % cRECEIVE_WINDOW])
+        {
+            mScratch[cHEADER_SIZE + i / 8] |= (char)(1 << (i % 8));
+        }
+    }
+    SendBufferP(mScratch.data(), mScratch.size());
+    ++mStats.mDatagramsSent;
+}
+
+//! Sends pending datagrams while the send window allows, taking one from each stream in turn
+void PakReliableUDP::TransmitP(Clock::time_point aNow)
+{
+    while (mSent.size() < mOptions.mSendWindow && !mReadyStreams.empty())
+    {
+        int stream = mReadyStreams.front();
+        mReadyStreams.pop_front();
+        std::deque<Outgoing>& pending = mPending[stream];
+        mSent.push_back(std::move(pending.front()));
+        pending.pop_front();
+        if (!pending.empty())
+        {
+            mReadyStreams.push_back(stream);
+        }
+        Outgoing& datagram = mSent.back();
+        Put32(datagram.mData.data() + 20, mSendUnacked + (uint32_t)(mSent.size() - 1));
+        SendDatagramP(datagram, aNow);
+    }
+}
+
+//! Applies an acknowledgement from the peer.
+//! @param aMoreBits Bits of the bitmask past the 64 in the header, least significant bit first.
+void PakReliableUDP::ProcessAckP(const Header& aHeader, const char* aMoreBits, size_t aMoreBytes, Clock::time_point aNow)
+{
+    int32_t acked = SequenceDelta(aHeader.mAck, mSendUnacked);
+    int32_t sent = (int32_t)mSent.size();
+    if (acked < 0 || acked > sent)
+    {
+        return;
+    }
+
+    // Time the most recent datagram acknowledged by this ack, unless it was sent more than once
+    const Outgoing* sampledPtr = nullptr;
+    for (int32_t i = 0; i < acked; ++i)
+    {
+        if (!mSent[i].mAcked)
+        {
+            sampledPtr = &mSent[i];
+        }
+    }
+    int32_t highestAcked = acked - 1;
+    int32_t bitCount = std::min<int32_t>(64 + (int32_t)aMoreBytes * 8, sent - acked - 1);
+    for (int32_t i = 0; i < bitCount; ++i)
+    {
+        bool received = (i < 64) ? ((aHeader.mAckBits >> i) & 1) != 0 : ((aMoreBits[(i - 64) / 8] >> ((i - 64) % 8)) & 1) != 0;
+        if (received)
+        {
+            Outgoing& datagram = mSent[acked + 1 + i];
+            if (!datagram.mAcked)
+            {
+                datagram.mAcked = true;
+                sampledPtr = &datagram;
+            }
+            highestAcked = acked + 1 + i;
+        }
+    }
+    if (sampledPtr != nullptr && sampledPtr->mTransmissions == 1)
+    {
+        Clock::duration sample = aNow - sampledPtr->mLastSent;
+        Clock::duration error = (sample > mSmoothedRoundTrip) ? sample - mSmoothedRoundTrip : mSmoothedRoundTrip - sample;
+        mRoundTripVariance = (mRoundTripVariance * 3 + error) / 4;
+        mSmoothedRoundTrip = (mSmoothedRoundTrip * 7 + sample) / 8;
+    }
+
+    for (int32_t i = 0; i < acked; ++i)
+    {
+        mQueuedBytes -= mSent.front().mData.size() - cHEADER_SIZE;
+        mSent.pop_front();
+    }
+    mSendUnacked = aHeader.mAck;
+    highestAcked -= acked;
+
+    // A hole well before an acknowledged datagram is a loss, unless it was sent again too recently to tell
+    for (int32_t i = 0; i + (int32_t)cREORDER_THRESHOLD <= highestAcked; ++i)
+    {
+        Outgoing& datagram = mSent[i];
+        if (!datagram.mAcked && aNow - datagram.mLastSent >= mSmoothedRoundTrip + mRoundTripVariance)
+        {
+            SendDatagramP(datagram, aNow);
+            ++mStats.mRetransmits;
+        }
+    }
+    TransmitP(aNow);
+}
+
+//! Hands a complete frame to the caller, or holds it until the frames before it on its stream arrive.
+void PakReliableUDP::DeliverP(const Header& aHeader, const char* aData, size_t aBytes, std::vector<Frame>& aFrames)
+{
+    ++mStats.mFramesReceived;
+    if ((aHeader.mFlags & cORDERED) == 0)
+    {
+        aFrames.push_back({aData, aBytes});
+        return;
+    }
+    uint32_t& deliverNext = mDeliverNext[aHeader.mStream];
+    int32_t offset = SequenceDelta(aHeader.mMessage, deliverNext);
+    if (offset > 0)
+    {
+        mHeldFrames[FrameKey(aHeader.mStream, aHeader.mMessage)].assign(aData, aData + aBytes);
+        return;
+    }
+    else if (offset < 0)
+    {
+        return;
+    }
+    aFrames.push_back({aData, aBytes});
+    ++deliverNext;
+    std::map<uint64_t, std::vector<char>>::iterator iter;
+    while ((iter = mHeldFrames.find(FrameKey(aHeader.mStream, deliverNext))) != mHeldFrames.end())
+    {
+        mDelivered.emplace_back();
+        mDelivered.back().swap(iter->second);
+        mHeldFrames.erase(iter);
+        aFrames.push_back({mDelivered.back().data(), mDelivered.back().size()});
+        ++deliverNext;
+    }
+}
+
+PakReliableUDP::Clock::duration PakReliableUDP::RetransmitTimeoutP(const Outgoing& aDatagram) const
+{
+    Clock::duration timeout = std::max<Clock::duration>(mSmoothedRoundTrip + mRoundTripVariance * 4, cMINIMUM_TIMEOUT);
+    // Back off each time the same datagram times out
+    timeout *= (1 << std::min(aDatagram.mTransmissions - 1, 5U));
+    return std::min<Clock::duration>(timeout, cMAXIMUM_TIMEOUT);
+}
+
+int PakReliableUDP::GetStreamP(int aPacketId) const
+{
+    std::map<int, int>::const_iterator iter = mOptions.mPacketStreams.find(aPacketId);
+    if (iter == mOptions.mPacketStreams.end())
+    {
+        return 0;
+    }
+    return std::min(std::max(iter->second, 0), 255);
+}
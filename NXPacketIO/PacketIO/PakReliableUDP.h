@@ -0,0 +1,219 @@
+﻿#ifndef PAKRELIABLEUDP_H
+#define PAKRELIABLEUDP_H
+
+#include "NXPacketIO_Export.h"
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <vector>
+
+class GenUDP_Connection;
+namespace GenSockets
+{
+class GenInternetSocketAddress;
+} // namespace GenSockets
+
+//! Sequencing, acknowledgement and fragmentation of frames sent over UDP to one peer.
+//! Used by PakUDP_IO, see PakUDP_IO::SetReliable().
+//!
+//! Every datagram starts with a header holding the sender's session, its sequence number and an
+//! acknowledgement of the peer's datagrams: the next sequence number expected, and a bitmask of
+//! the 64 after it that were received.  Acknowledgements sent on their own extend the bitmask to
+//! the last datagram received.  A hole in the bitmask is a negative acknowledgement, the missing
+//! datagram is sent again once a datagram three or more after it is acknowledged.
+//! Datagrams that are not acknowledged at all are sent again when their retransmit timer expires.
+//!
+//! Frames larger than a datagram are fragmented.  Each packet type is sent on a stream, and a
+//! stream delivers its frames either in the order they were sent or as soon as they are reassembled.
+//! Streams take turns at the send window, so a small frame does not wait for a large one to be sent.
+//!
+//! Until a datagram arrives from the peer's reliability layer, frames are sent as plain datagrams
+//! so a peer without one still receives the packets that fit in a datagram.  A new peer session
+//! means the peer restarted, and every frame that is not acknowledged is discarded.
+//!
+//! Only datagrams from the connection's send address are accepted.  If the connection sends from
+//! a port of its own, see GenUDP_Connection::HasSeparateSendPort(), the peer is presumed to do the
+//! same and only its IP address is checked.
+//!
+//!@note There is no congestion control.  Options::mSendWindow bounds the data in flight.
+class NX_PACKETIO_EXPORT PakReliableUDP
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    //! Size of the header starting every datagram
+    static const int cHEADER_SIZE = 40;
+
+    struct Options
+    {
+        Options();
+        //! Largest datagram sent, including the header.  The default of 1200 bytes fits the
+        //! path MTU of any common network, larger frames are fragmented.
+        size_t mDatagramSize;
+        //! Most datagrams sent and not yet acknowledged, at most cRECEIVE_WINDOW
+        size_t mSendWindow;
+        //! Most bytes of frames queued or waiting for acknowledgement.  Frames beyond it are refused.
+        size_t mMaximumQueuedBytes;
+        //! The stream, 0 to 255, used by each packet type.  Types not listed use stream 0.
+        std::map<int, int> mPacketStreams;
+        //! Streams that deliver a frame as soon as it is reassembled.  Other streams keep send order.
+        std::set<int> mUnorderedStreams;
+        //! Fraction of datagrams, 0 to 1, dropped on purpose instead of being sent.  For testing
+        //! behaviour on a lossy network.  The default of 0 drops none.
+        double mTestLossRate;
+    };
+
+    struct Stats
+    {
+        //! 'true' once a datagram arrived from the peer's reliability layer
+        bool mEstablished;
+        uint64_t mFramesSent;
+        uint64_t mFramesReceived;
+        //! Datagrams sent, including retransmissions and acknowledgements
+        uint64_t mDatagramsSent;
+        //! Datagrams sent again after a negative acknowledgement
+        uint64_t mRetransmits;
+        //! Datagrams sent again after their retransmit timer expired
+        uint64_t mTimeouts;
+        //! Datagrams received more than once
+        uint64_t mDuplicates;
+        //! Frames refused because mMaximumQueuedBytes was reached
+        uint64_t mRejectedFrames;
+        //! Times the peer restarted
+        uint64_t mPeerResets;
+        //! Datagrams dropped because they did not come from the peer's address, or were malformed
+        uint64_t mRejectedDatagrams;
+        //! Datagrams dropped because of Options::mTestLossRate
+        uint64_t mTestLosses;
+        //! Bytes of frames queued or waiting for acknowledgement
+        size_t mQueuedBytes;
+        //! Smoothed round trip time in seconds
+        double mRoundTripTime;
+    };
+
+    //! A received frame.  Valid until the next call to ProcessDatagram().
+    struct Frame
+    {
+        const char* mData;
+        size_t mBytes;
+    };
+
+    PakReliableUDP(GenUDP_Connection* aConnectionPtr, const Options& aOptions);
+
+    static bool IsReliableDatagram(const char* aData, int aBytes);
+
+    bool SendFrame(const char* aFrame, size_t aBytes, int aPacketId);
+
+    void ProcessDatagram(const char* aData, int aBytes, const GenSockets::GenInternetSocketAddress& aSender, std::vector<Frame>& aFrames);
+
+    void FlushAck();
+
+    double Update();
+
+    bool IsEstablished();
+
+    void GetStats(Stats& aStats);
+
+private:
+    //! Number of sequence numbers past the next expected one that are accepted
+    static const uint32_t cRECEIVE_WINDOW = 4096;
+
+    enum Kind
+    {
+        cDATA = 1,
+        cACK = 2
+    };
+
+    struct Header
+    {
+        uint8_t mKind;
+        uint8_t mStream;
+        uint16_t mFragmentIndex;
+        uint16_t mFragmentCount;
+        uint8_t mFlags;
+        uint32_t mSession;
+        uint32_t mPeerSession;
+        uint32_t mSequence;
+        uint32_t mMessage;
+        uint32_t mAck;
+        uint64_t mAckBits;
+    };
+
+    //! A datagram waiting to be sent or acknowledged
+    struct Outgoing
+    {
+        std::vector<char> mData;
+        Clock::time_point mLastSent;
+        unsigned int mTransmissions;
+        bool mAcked;
+    };
+
+    //! The fragments received of a frame
+    struct Reassembly
+    {
+        std::vector<std::vector<char>> mFragments;
+        size_t mReceived;
+    };
+
+    void ResetP();
+    bool IsPeerAddressP(const GenSockets::GenInternetSocketAddress& aSender) const;
+    void SendBufferP(const char* aData, size_t aBytes);
+    void WriteHeaderP(char* aData, const Header& aHeader);
+    void WriteAckP(char* aData);
+    void SendDatagramP(Outgoing& aDatagram, Clock::time_point aNow);
+    void SendAckP();
+    void TransmitP(Clock::time_point aNow);
+    void ProcessAckP(const Header& aHeader, const char* aMoreBits, size_t aMoreBytes, Clock::time_point aNow);
+    void DeliverP(const Header& aHeader, const char* aData, size_t aBytes, std::vector<Frame>& aFrames);
+    Clock::duration RetransmitTimeoutP(const Outgoing& aDatagram) const;
+    int GetStreamP(int aPacketId) const;
+
+    GenUDP_Connection* mConnectionPtr;
+    Options mOptions;
+    std::mutex mMutex;
+    uint32_t mSession;
+    //! Session of the peer, 0 until known
+    uint32_t mPeerSession;
+    uint32_t mPreviousPeerSession;
+    bool mEstablished;
+    Clock::time_point mNextHello;
+    Clock::duration mHelloInterval;
+
+    //! Datagrams waiting for the send window, by stream
+    std::vector<std::deque<Outgoing>> mPending;
+    //! Streams with pending datagrams, in the order they take the send window
+    std::deque<int> mReadyStreams;
+    //! Datagrams sent and not yet acknowledged.  The sequence number of each is mSendUnacked plus its index.
+    std::deque<Outgoing> mSent;
+    uint32_t mSendUnacked;
+    uint32_t mNextMessage[256];
+    size_t mQueuedBytes;
+    Clock::duration mSmoothedRoundTrip;
+    Clock::duration mRoundTripVariance;
+    std::vector<char> mScratch;
+
+    //! Next sequence number expected from the peer
+    uint32_t mReceiveNext;
+    //! One past the highest sequence number received from the peer
+    uint32_t mReceiveEnd;
+    //! Datagrams received past mReceiveNext, indexed by sequence number modulo cRECEIVE_WINDOW
+    std::vector<bool> mReceived;
+    bool mAckPending;
+    std::map<uint64_t, Reassembly> mReassembly;
+    //! Complete frames of ordered streams waiting for an earlier frame, by stream and message
+    std::map<uint64_t, std::vector<char>> mHeldFrames;
+    uint32_t mDeliverNext[256];
+    //! Backs the frames returned by ProcessDatagram()
+    std::deque<std::vector<char>> mDelivered;
+    //! Draws the datagrams dropped by Options::mTestLossRate
+    std::minstd_rand mTestLossRandom;
+
+    Stats mStats;
+};
+
+#endif
@@ -0,0 +1,166 @@
+﻿#include "PacketIO/PakReplayIO.h"
+
+#include <iostream>
+#include <thread>
+
+#include "PacketIO/PakI.h"
+#include "PacketIO/PakPacket.h"
+#include "PacketIO/PakProcessor.h"
+
+PakReplayIO::PakReplayIO(PakProcessor* aProcessorPtr, PakHeader* aHeaderType /*= new PakDefaultHeader*/)
+    : PakSocketIO(aHeaderType), mProcessorPtr(aProcessorPtr), mHasRecord(false), mAtEnd(true), mHasReadHeader(false), mHeaderPacketId(0), mHeaderPacketLength(0), mBufI(nullptr, 0), mSpeed(0.0), mIsStarted(false), mFirstRecordTime(0)
+{
+    mSerializeReader = new PakI(&mBufI);
+}
+
+PakReplayIO::~PakReplayIO()
+{
+    delete mSerializeReader;
+}
+
+bool PakReplayIO::Open(const std::string& aPath)
+{
+    mBufI.SetBuffer(nullptr, 0);
+    if (!mCaptureFile.Open(aPath))
+    {
+        mAtEnd = true;
+        return false;
+    }
+    Rewind();
+    return true;
+}
+
+void PakReplayIO::Rewind()
+{
+    mCaptureFile.Rewind();
+    mHasRecord = false;
+    mHasReadHeader = false;
+    mAtEnd = !mCaptureFile.IsOpen();
+    mIsStarted = false;
+}
+
+bool PakReplayIO::IsConnected()
+{
+    return !mAtEnd;
+}
+
+//! Reads the next frame from the file into mRecord, unless one is already waiting.
+bool PakReplayIO::ReadRecord()
+{
+    if (!mHasRecord && !mAtEnd)
+    {
+        mHasRecord = mCaptureFile.Read(mRecord);
+        mAtEnd = !mHasRecord;
+    }
+    return mHasRecord;
+}
+
+//! Reads the next packet's header.  When playing at the recorded pace, a packet that is not
+//! due yet is waited for up to aWaitTimeMicroSeconds.
+bool PakReplayIO::ReceiveHeader(int& aPacketId, int& aPacketLength, int aWaitTimeMicroSeconds)
+{
+    while (!mHasReadHeader && ReadRecord())
+    {
+        if (mSpeed > 0.0)
+        {
+            if (!mIsStarted)
+            {
+                mIsStarted = true;
+                mStartTime = std::chrono::steady_clock::now();
+                mFirstRecordTime = mRecord.mTime;
+            }
+            auto dueTime = mStartTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                            std::chrono::duration<double, std::nano>((mRecord.mTime - mFirstRecordTime) / mSpeed));
+            auto waitLimit = std::chrono::steady_clock::now() + std::chrono::microseconds(aWaitTimeMicroSeconds);
+            if (dueTime > waitLimit)
+            {
+                std::this_thread::sleep_until(waitLimit);
+                return false;
+            }
+            std::this_thread::sleep_until(dueTime);
+        }
+        mHasRecord = false;
+        mBufI.SetBuffer(const_cast<char*>(mRecord.mFramePtr), mRecord.mBytes);
+        mBufI.SetPutPos(mRecord.mBytes);
+        bool headerValid;
+        if (GetPacketHeader(mBufI, mHeaderPacketId, mHeaderPacketLength, headerValid) && headerValid &&
+            mHeaderPacketLength == (int)mRecord.mBytes)
+        {
+            mHasReadHeader = true;
+        }
+        else
+        {
+            std::cout << "PakReplayIO: Skipped a frame that does not match the header type." << std::endl;
+        }
+    }
+    aPacketId = mHeaderPacketId;
+    aPacketLength = GetDecompressedLength(mHeaderPacketLength);
+    return mHasReadHeader;
+}
+
+bool PakReplayIO::Receive(PakPacket& aPkt)
+{
+    if (!mHasReadHeader)
+    {
+        return false;
+    }
+    PakProcessor::PacketInfo* info = mProcessorPtr->GetPacketInfo(aPkt.ID());
+    mHasReadHeader = false;
+    if (!BeginInflate(mBufI, mHeaderPacketLength - GetHeaderSize()))
+    {
+        std::cout << "Could not decompress packet."
+                  << " Name: " << info->GetPacketName()
+                  << " ID: " << aPkt.ID()
+                  << std::endl;
+        return false;
+    }
+    (*info->mReadFn)(aPkt, *mSerializeReader);
+    bool isComplete = (mBufI.GetGetPos() == mBufI.GetPutPos());
+    EndInflate(mBufI);
+    if (!isComplete)
+    {
+        std::cout << "Detected error receiving packet."
+                  << " Name: " << info->GetPacketName()
+                  << " ID: " << aPkt.ID()
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void PakReplayIO::IgnorePacket()
+{
+    mHasReadHeader = false;
+}
+
+//! Processes every packet that is due, without waiting.
+//! @return The number of packets processed.
+size_t PakReplayIO::Process()
+{
+    size_t count = 0;
+    while (PakPacket* pktPtr = mProcessorPtr->ReadPacket(*this))
+    {
+        mProcessorPtr->ProcessPacket(pktPtr, true);
+        ++count;
+    }
+    return count;
+}
+
+//! Processes the rest of the file, waiting for each packet to be due.
+//! @return The number of packets processed.
+size_t PakReplayIO::Replay()
+{
+    size_t count = 0;
+    int packetId;
+    int packetLength;
+    while (ReceiveHeader(packetId, packetLength, cLARGE_WAIT_TIME) || !mAtEnd)
+    {
+        PakPacket* pktPtr = mProcessorPtr->ReadPacket(*this);
+        if (pktPtr != nullptr)
+        {
+            mProcessorPtr->ProcessPacket(pktPtr, true);
+            ++count;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,78 @@
+﻿#ifndef PAKREPLAYIO_H
+#define PAKREPLAYIO_H
+
+#include "NXPacketIO_Export.h"
+
+#include <chrono>
+#include <string>
+
+#include "GenIO/GenBuffer.h"
+#include "PacketIO/PakCaptureFile.h"
+#include "PacketIO/PakDefaultHeader.h"
+#include "PacketIO/PakSocketIO.h"
+
+class PakI;
+class PakProcessor;
+
+//! Plays back a PakCaptureFile as if its packets were being received.
+//! Packets are decoded straight from the mapped file, either at the pace they were recorded
+//! or as fast as they are read, which gives a repeatable load for timing packet callbacks.
+//! The header type must match the one used by the captured IO.  Send() does nothing.
+class NX_PACKETIO_EXPORT PakReplayIO : public PakSocketIO
+{
+public:
+    static const int cLARGE_WAIT_TIME = 100000000;
+
+    PakReplayIO(PakProcessor* aProcessorPtr, PakHeader* aHeaderType = new PakDefaultHeader);
+    ~PakReplayIO() override;
+
+    bool Open(const std::string& aPath);
+
+    //! Sets the playback speed relative to the recording.  1 plays at the recorded pace,
+    //! 0 plays as fast as possible.  The default is 0.
+    void SetSpeed(double aSpeed) { mSpeed = aSpeed; }
+
+    //! Starts again from the first packet.
+    void Rewind();
+
+    bool Send(const PakPacket& /*aPkt*/) override { return false; }
+
+    bool ReceiveHeader(int& aPacketId, int& aPacketLength, int aWaitTimeMicroSeconds) override;
+
+    bool Receive(PakPacket& aPkt) override;
+
+    void IgnorePacket() override;
+
+    PakProcessor* GetPakProcessor() const override { return mProcessorPtr; }
+
+    //! Returns 'false' once every packet has been played.
+    bool IsConnected() override;
+
+    size_t Process();
+
+    size_t Replay();
+
+    PakCaptureFile& GetCaptureFile() { return mCaptureFile; }
+
+private:
+    bool ReadRecord();
+
+    PakProcessor* mProcessorPtr;
+    PakCaptureFile mCaptureFile;
+    PakCaptureFile::Record mRecord;
+    bool mHasRecord;
+    bool mAtEnd;
+    bool mHasReadHeader;
+    int mHeaderPacketId;
+    int mHeaderPacketLength;
+    //! Refers to the current frame in the mapped file
+    GenBuffer mBufI;
+    PakI* mSerializeReader;
+    double mSpeed;
+    bool mIsStarted;
+    //! When the first packet was played, and its recorded time
+    std::chrono::steady_clock::time_point mStartTime;
+    int64_t mFirstRecordTime;
+};
+
+#endif
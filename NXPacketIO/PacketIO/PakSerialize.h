@@ -31,6 +31,14 @@ inline NX_PACKETIO_EXPORT void Serialize(PakO& aAr, PakSerializeRawData& aData)
 {
     aAr.GetBuffer()->PutRaw((char*)aData.mData, aData.mBytes);
 }
+inline NX_PACKETIO_EXPORT void Serialize(PakI& aAr, PakSerializeRawDataRef& aData)
+{
+    aAr.GetBuffer()->GetRaw((char*)aData.mData, aData.mBytes);
+}
+inline NX_PACKETIO_EXPORT void Serialize(PakO& aAr, PakSerializeRawDataRef& aData)
+{
+    aAr.SerializeExternal((const char*)aData.mData, aData.mBytes);
+}
 inline NX_PACKETIO_EXPORT void Serialize(PakI& aAr, PakSerializeFixedString& aData)
 {
     aAr.SerializeString(*aData.mStringPtr, aData.mMaxSize);
@@ -104,12 +112,20 @@ inline void Save(PakO& aAr, PakSerialization::PakSerializePtr<T>& aPtr)
 
 namespace PakSerialization
 {
+// Arrays of basic types are converted in one operation
 template <class AR, typename T>
 void Serialize(AR& aAr, PakSerializeArray<T>& aArray)
 {
-    for (int i = 0; i < aArray.mSize; ++i)
+    if constexpr (IsBasicType<T>::value)
+    {
+        aAr.SerializeArray(aArray.mArrayPtr, aArray.mSize);
+    }
+    else
     {
-        aAr & aArray.mArrayPtr[i];
+        for (int i = 0; i < aArray.mSize; ++i)
+        {
+            aAr & aArray.mArrayPtr[i];
+        }
     }
 }
 
@@ -75,6 +75,19 @@ public:
     int mBytes;
 };
 
+//! Like PakSerializeRawData, but a sender may transmit the data straight from
+//! the caller's memory instead of copying it into the send buffer.
+class PakSerializeRawDataRef
+{
+public:
+    PakSerializeRawDataRef(void* aData, int aBytes)
+        : mData(aData), mBytes(aBytes)
+    {
+    }
+    void* mData;
+    int mBytes;
+};
+
 class PakSerializeFixedString
 {
 public:
@@ -119,6 +132,16 @@ inline const PakSerializeRawData RawData(const void* aData, int aBytes)
     return PakSerializeRawData(const_cast<void*>(aData), aBytes);
 }
 
+inline const PakSerializeRawDataRef RawDataRef(void* aData, int aBytes)
+{
+    return PakSerializeRawDataRef(aData, aBytes);
+}
+
+inline const PakSerializeRawDataRef RawDataRef(const void* aData, int aBytes)
+{
+    return PakSerializeRawDataRef(const_cast<void*>(aData), aBytes);
+}
+
 inline const PakSerializeFixedString FixedString(std::string& aString, int aMaxSize)
 {
     return PakSerializeFixedString(aString, aMaxSize);
@@ -4,6 +4,8 @@
  * such as int, float, etc are separated from other types.
  */
 
+#include <type_traits>
+
 namespace PakSerialization
 {
 
@@ -51,6 +53,12 @@ DEFINE_TRAIT(const float, BasicTypeTrait)
 DEFINE_TRAIT(const unsigned long long, BasicTypeTrait)
 #undef DEFINE_TRAIT
 
+// True for types that are serialized with a single putValue/getValue
+template <typename T>
+struct IsBasicType {
+    static const bool value = std::is_same<typename SerializeTraits<T>::serialize_trait_type, BasicTypeTrait>::value;
+};
+
 template <typename T>
 struct non_const_type {
     typedef T type;
@@ -109,12 +109,20 @@ inline void Load(PakI& aAr, std::list<T, ALLOC>& aValue)
 }
 
 // std::vector
+// Vectors of basic types are converted in one operation
 template <typename T, typename ALLOC>
 inline void Save(PakO& aAr, std::vector<T, ALLOC>& aValue)
 {
     uint32_t size = (uint32_t)aValue.size();
     aAr & size;
-    SaveContainerValues(aAr, aValue);
+    if constexpr (IsBasicType<T>::value)
+    {
+        aAr.SerializeArray(aValue.data(), (int)size);
+    }
+    else
+    {
+        SaveContainerValues(aAr, aValue);
+    }
 }
 
 template <typename T, typename ALLOC>
@@ -122,10 +130,24 @@ inline void Load(PakI& aAr, std::vector<T, ALLOC>& aValue)
 {
     uint32_t size;
     aAr & size;
-    aValue.resize(size);
-    for (unsigned i = 0; i < size; ++i)
+    if constexpr (IsBasicType<T>::value)
+    {
+        // Check the length from the wire before it sizes the vector
+        if (!aAr.GetBuffer()->CheckGetSpace((size_t)size * sizeof(T)))
+        {
+            aValue.clear();
+            return;
+        }
+        aValue.resize(size);
+        aAr.SerializeArray(aValue.data(), (int)size);
+    }
+    else
     {
-        aAr& aValue[i];
+        aValue.resize(size);
+        for (unsigned i = 0; i < size; ++i)
+        {
+            aAr& aValue[i];
+        }
     }
 }
 
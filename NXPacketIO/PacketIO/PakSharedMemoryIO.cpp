@@ -0,0 +1,475 @@
+﻿#include "PacketIO/PakSharedMemoryIO.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "GenIO/GenIP.h"
+#include "GenIO/GenInternetSocketAddress.h"
+#include "GenIO/GenSocket.h"
+#include "PacketIO/PakEncodedPacket.h"
+#include "PacketIO/PakI.h"
+#include "PacketIO/PakO.h"
+#include "PacketIO/PakPacket.h"
+#include "PacketIO/PakProcessor.h"
+
+namespace
+{
+const uint32_t cSEGMENT_MAGIC = 0x4E585348; // "NXSH"
+// Version 2 added Ring::mWriterWaiting
+const uint32_t cSEGMENT_VERSION = 2;
+const size_t cCACHE_LINE = 64;
+} // namespace
+
+//! Placed at the start of the segment.
+struct PakSharedMemoryIO::SegmentHeader
+{
+    uint32_t mMagic;
+    uint32_t mVersion;
+    //! Random value passed to the peer with the name, so a stale or foreign segment is not used
+    uint64_t mNonce;
+    uint64_t mRingBytes;
+};
+
+//! The positions of one ring.  Positions only increase; the byte offset is the position modulo the ring size.
+//! The writer and reader fields are on separate cache lines.
+struct PakSharedMemoryIO::Ring
+{
+    alignas(cCACHE_LINE) std::atomic<uint64_t> mWritePos;
+    alignas(cCACHE_LINE) std::atomic<uint64_t> mReadPos;
+    //! Set by a reader that found the ring empty, cleared by the writer that rings the doorbell
+    std::atomic<uint32_t> mReaderWaiting;
+    //! Set by a writer that found the ring full, cleared by the reader that rings the doorbell
+    std::atomic<uint32_t> mWriterWaiting;
+    std::atomic<uint32_t> mClosed;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared memory rings need lock-free 64-bit atomics");
+
+PakSharedMemoryIO::PakSharedMemoryIO(PakProcessor* aProcessorPtr, PakHeader* aHeaderType)
+    : PakSocketIO(aHeaderType), mProcessorPtr(aProcessorPtr), mHeaderPtr(nullptr), mSendRingPtr(nullptr), mReceiveRingPtr(nullptr), mSendDataPtr(nullptr), mReceiveDataPtr(nullptr), mRingBytes(0), mDoorbellSocketPtr(nullptr), mNotifySocketPtr(nullptr), mPeerDoorbellPtr(nullptr), mPendingSendBytes(0), mHasReadHeader(false), mHeaderPacketId(0), mHeaderPacketLength(0)
+{
+    mHeaderSize = GetHeaderSize();
+    assert(mHeaderSize != 0);
+    mBufI.SetBigEndian();
+    mBufO.SetBigEndian();
+    mSerializeWriter = new PakO(&mBufO);
+    mSerializeReader = new PakI(&mBufI);
+}
+
+PakSharedMemoryIO::~PakSharedMemoryIO()
+{
+    Close();
+    delete mSerializeWriter;
+    delete mSerializeReader;
+    delete mDoorbellSocketPtr;
+    delete mNotifySocketPtr;
+    delete mPeerDoorbellPtr;
+}
+
+//! Creates a new segment for a peer to Open().
+//! @param aRingBytes The size of each direction's ring, rounded up to a power of 2.
+//!                   A packet larger than this can't be sent.
+//! @return null if the segment or the doorbell socket can't be created.
+// static
+PakSharedMemoryIO* PakSharedMemoryIO::Create(PakProcessor* aProcessorPtr, size_t aRingBytes, PakHeader* aHeaderType /*= new PakDefaultHeader*/)
+{
+    size_t ringBytes = 4096;
+    while (ringBytes < aRingBytes)
+    {
+        ringBytes *= 2;
+    }
+    PakSharedMemoryIO* ioPtr = new PakSharedMemoryIO(aProcessorPtr, aHeaderType);
+    size_t controlBytes = cCACHE_LINE + 2 * sizeof(Ring);
+    if (!ioPtr->mSegment.Create(GenSharedMemory::MakeUniqueName("NXPacketIO"), controlBytes + 2 * ringBytes))
+    {
+        delete ioPtr;
+        return nullptr;
+    }
+    std::random_device random;
+    SegmentHeader* headerPtr = new (ioPtr->mSegment.GetData()) SegmentHeader;
+    headerPtr->mMagic = cSEGMENT_MAGIC;
+    headerPtr->mVersion = cSEGMENT_VERSION;
+    headerPtr->mNonce = ((uint64_t)random() << 32) ^ random();
+    headerPtr->mRingBytes = ringBytes;
+    Ring* ringsPtr = new (ioPtr->mSegment.GetData() + cCACHE_LINE) Ring[2];
+    for (int i = 0; i < 2; ++i)
+    {
+        ringsPtr[i].mWritePos = 0;
+        ringsPtr[i].mReadPos = 0;
+        // Nobody reads a ring until its handler is added, so the first write must ring the doorbell
+        ringsPtr[i].mReaderWaiting = 1;
+        ringsPtr[i].mWriterWaiting = 0;
+        ringsPtr[i].mClosed = 0;
+    }
+    if (!ioPtr->Attach(true))
+    {
+        delete ioPtr;
+        return nullptr;
+    }
+    return ioPtr;
+}
+
+//! Opens a segment made by Create() in another process.
+//! @return null if the segment does not exist on this host, or its nonce does not match.
+// static
+PakSharedMemoryIO* PakSharedMemoryIO::Open(PakProcessor* aProcessorPtr, const std::string& aName, uint64_t aNonce, PakHeader* aHeaderType /*= new PakDefaultHeader*/)
+{
+    PakSharedMemoryIO* ioPtr = new PakSharedMemoryIO(aProcessorPtr, aHeaderType);
+    bool ok = ioPtr->mSegment.Open(aName) && ioPtr->mSegment.GetSize() >= cCACHE_LINE + 2 * sizeof(Ring);
+    if (ok)
+    {
+        const SegmentHeader* headerPtr = (const SegmentHeader*)ioPtr->mSegment.GetData();
+        ok = headerPtr->mMagic == cSEGMENT_MAGIC && headerPtr->mVersion == cSEGMENT_VERSION && headerPtr->mNonce == aNonce &&
+             ioPtr->mSegment.GetSize() >= cCACHE_LINE + 2 * sizeof(Ring) + 2 * headerPtr->mRingBytes;
+    }
+    if (!ok || !ioPtr->Attach(false))
+    {
+        delete ioPtr;
+        return nullptr;
+    }
+    return ioPtr;
+}
+
+//! Sets up the ring pointers and the doorbell sockets.
+//! The creator sends on ring 0 and receives on ring 1, the other side the reverse.
+bool PakSharedMemoryIO::Attach(bool aIsCreator)
+{
+    char* basePtr = mSegment.GetData();
+    mHeaderPtr = (SegmentHeader*)basePtr;
+    mRingBytes = (size_t)mHeaderPtr->mRingBytes;
+    Ring* ringsPtr = (Ring*)(basePtr + cCACHE_LINE);
+    char* dataPtr = basePtr + cCACHE_LINE + 2 * sizeof(Ring);
+    int sendIndex = aIsCreator ? 0 : 1;
+    mSendRingPtr = &ringsPtr[sendIndex];
+    mReceiveRingPtr = &ringsPtr[1 - sendIndex];
+    mSendDataPtr = dataPtr + sendIndex * mRingBytes;
+    mReceiveDataPtr = dataPtr + (1 - sendIndex) * mRingBytes;
+
+    GenSockets::GenInternetSocketAddress loopback(GenSockets::GenIP(127, 0, 0, 1), 0);
+    mDoorbellSocketPtr = new GenSockets::GenSocket(GenSockets::GenSocket::cUDP_SOCKET);
+    mNotifySocketPtr = new GenSockets::GenSocket(GenSockets::GenSocket::cUDP_SOCKET);
+    return mDoorbellSocketPtr->Bind(loopback) && mNotifySocketPtr->Bind(loopback);
+}
+
+uint64_t PakSharedMemoryIO::GetNonce() const
+{
+    return mHeaderPtr->mNonce;
+}
+
+//! Returns the port the peer should send doorbell datagrams to.
+int PakSharedMemoryIO::GetDoorbellPort() const
+{
+    return mDoorbellSocketPtr->GetBoundPort();
+}
+
+void PakSharedMemoryIO::SetPeerDoorbellPort(int aPort)
+{
+    std::lock_guard<std::mutex> guard(mDoorbellMutex);
+    delete mPeerDoorbellPtr;
+    mPeerDoorbellPtr = new GenSockets::GenInternetSocketAddress(GenSockets::GenIP(127, 0, 0, 1), aPort);
+}
+
+bool PakSharedMemoryIO::IsConnected()
+{
+    return mSendRingPtr != nullptr && mSendRingPtr->mClosed == 0 && mReceiveRingPtr->mClosed == 0;
+}
+
+void PakSharedMemoryIO::Close()
+{
+    if (mSendRingPtr != nullptr && mSendRingPtr->mClosed.exchange(1) == 0)
+    {
+        // Wake the peer, so it notices
+        RingPeerDoorbell();
+    }
+}
+
+//! Sends a datagram to the peer's doorbell socket.
+void PakSharedMemoryIO::RingPeerDoorbell()
+{
+    std::lock_guard<std::mutex> guard(mDoorbellMutex);
+    if (mPeerDoorbellPtr != nullptr)
+    {
+        char signal = 0;
+        mNotifySocketPtr->SendTo(&signal, 1, *mPeerDoorbellPtr);
+    }
+}
+
+bool PakSharedMemoryIO::Send(const PakPacket& aPkt)
+{
+    return Send(aPkt, cLARGE_WAIT_TIME);
+}
+
+//! Sends a packet, waiting for room in the ring if the peer is behind.
+//! @param aWaitTimeMicroSeconds With 0, a packet that does not fit is kept and written by a
+//!                              later Flush(), see GetPendingSendBytes().
+//! @return 'false' if the peer closed the IO, the packet is larger than the ring,
+//!         or room was not available within the wait time.
+bool PakSharedMemoryIO::Send(const PakPacket& aPkt, int aWaitTimeMicroSeconds)
+{
+    std::unique_lock<std::mutex> lock(mSendMutex);
+    mBufO.Reset();
+    mBufO.SetPutPos(mHeaderSize);
+    PakProcessor::PacketInfo* info = mProcessorPtr->GetPacketInfo(aPkt.ID());
+    assert(info); // assert that packet is registered
+    (*info->mWriteFn)(const_cast<PakPacket&>(aPkt), *mSerializeWriter);
+    size_t packetLength = mBufO.GetPutPos();
+    mBufO.SetPutPos(0);
+    SetPacketHeader(mBufO, aPkt.ID(), (int)packetLength);
+    mBufO.SetPutPos(packetLength);
+    mProcessorPtr->PacketSent(aPkt.ID(), packetLength);
+    return SendFrame(mBufO.GetBuffer(), packetLength, aWaitTimeMicroSeconds, lock);
+}
+
+bool PakSharedMemoryIO::SendEncoded(PakEncodedPacket& aPkt)
+{
+    return SendEncoded(aPkt, cLARGE_WAIT_TIME);
+}
+
+//! Sends an encoded packet, see Send(const PakPacket&, int).
+bool PakSharedMemoryIO::SendEncoded(PakEncodedPacket& aPkt, int aWaitTimeMicroSeconds)
+{
+    std::unique_lock<std::mutex> lock(mSendMutex);
+    const GenBuffer& frame = aPkt.GetFrame(GetHeaderType(), mProcessorPtr);
+    mProcessorPtr->PacketSent(aPkt.GetPacket().ID(), frame.GetPutPos());
+    return SendFrame(frame.GetBuffer(), frame.GetPutPos(), aWaitTimeMicroSeconds, lock);
+}
+
+//! Writes the frames kept by sends that did not wait, as far as the ring has room.
+//! @return 'true' if no frames are left pending.
+bool PakSharedMemoryIO::Flush()
+{
+    std::lock_guard<std::mutex> guard(mSendMutex);
+    return FlushP();
+}
+
+//! Returns the number of bytes sent without waiting that are not yet in the ring.
+size_t PakSharedMemoryIO::GetPendingSendBytes()
+{
+    std::lock_guard<std::mutex> guard(mSendMutex);
+    return mPendingSendBytes;
+}
+
+//! Returns 'true' if received data may be waiting, whether or not its doorbell arrived.
+//! Only called by the receiving thread.
+bool PakSharedMemoryIO::IsReceiveReady() const
+{
+    return mHasReadHeader || mBufI.GetValidBytes() > 0 ||
+           mReceiveRingPtr->mWritePos.load(std::memory_order_acquire) != mReceiveRingPtr->mReadPos.load(std::memory_order_relaxed);
+}
+
+//! Writes a frame after any pending frames.  aLock holds mSendMutex, and is released while
+//! waiting for room so Flush() and other senders are not held up.
+bool PakSharedMemoryIO::SendFrame(const char* aDataPtr, size_t aBytes, int aWaitTimeMicroSeconds, std::unique_lock<std::mutex>& aLock)
+{
+    if (aBytes > mRingBytes)
+    {
+        std::cout << "PakSharedMemoryIO: Packet of " << aBytes << " bytes does not fit the " << mRingBytes << " byte ring." << std::endl;
+        return false;
+    }
+    if (!IsConnected())
+    {
+        return false;
+    }
+    if (FlushP() && WriteFrame(aDataPtr, aBytes))
+    {
+        return true;
+    }
+    if (aWaitTimeMicroSeconds <= 0)
+    {
+        // Would block.  Keep the frame; the reader rings our doorbell when it makes room.
+        size_t pendingBytes = mPendingO.GetValidBytes();
+        if (mPendingO.GetGetPos() > pendingBytes)
+        {
+            // Reclaim the space of the frames already written
+            mPendingO.Move(mPendingO.GetGetPos(), mPendingO.GetPutPos(), 0);
+            mPendingO.SetGetPos(0);
+            mPendingO.SetPutPos(pendingBytes);
+        }
+        mPendingO.PutRaw((const char*)&aBytes, sizeof(aBytes));
+        mPendingO.PutRaw(aDataPtr, aBytes);
+        mPendingSendBytes += aBytes;
+        mSendRingPtr->mWriterWaiting.store(1, std::memory_order_seq_cst);
+        FlushP();
+        return true;
+    }
+    // The frame may be in a buffer another sender reuses once the lock is released
+    std::vector<char> frame(aDataPtr, aDataPtr + aBytes);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(aWaitTimeMicroSeconds);
+    std::chrono::microseconds backoff(10);
+    while (!FlushP() || !WriteFrame(frame.data(), aBytes))
+    {
+        if (!IsConnected() || std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        aLock.unlock();
+        std::this_thread::sleep_for(backoff);
+        backoff = std::min(backoff * 2, std::chrono::microseconds(1000));
+        aLock.lock();
+    }
+    return true;
+}
+
+//! Writes pending frames while they fit.  mSendMutex must be held.
+//! @return 'true' if no frames are left pending.
+bool PakSharedMemoryIO::FlushP()
+{
+    while (mPendingO.GetValidBytes() > 0)
+    {
+        // Each pending frame is preceded by its length
+        size_t frameBytes;
+        memcpy(&frameBytes, mPendingO.GetBuffer() + mPendingO.GetGetPos(), sizeof(frameBytes));
+        if (!WriteFrame(mPendingO.GetBuffer() + mPendingO.GetGetPos() + sizeof(frameBytes), frameBytes))
+        {
+            mSendRingPtr->mWriterWaiting.store(1, std::memory_order_seq_cst);
+            return false;
+        }
+        mPendingO.SetGetPos(mPendingO.GetGetPos() + sizeof(frameBytes) + frameBytes);
+        mPendingSendBytes -= frameBytes;
+    }
+    mPendingO.Reset();
+    return true;
+}
+
+//! Copies one whole frame into the send ring if it fits, then wakes the reader if it is waiting.
+//! mSendMutex must be held.
+//! @return 'false' if the ring does not have room.
+bool PakSharedMemoryIO::WriteFrame(const char* aDataPtr, size_t aBytes)
+{
+    uint64_t writePos = mSendRingPtr->mWritePos.load(std::memory_order_relaxed);
+    if (writePos + aBytes - mSendRingPtr->mReadPos.load(std::memory_order_seq_cst) > mRingBytes)
+    {
+        return false;
+    }
+    size_t offset = (size_t)(writePos & (mRingBytes - 1));
+    size_t firstBytes = std::min(aBytes, mRingBytes - offset);
+    std::copy(aDataPtr, aDataPtr + firstBytes, mSendDataPtr + offset);
+    std::copy(aDataPtr + firstBytes, aDataPtr + aBytes, mSendDataPtr);
+    // Publishing the position and then checking the flag pairs with the reader setting the flag and
+    // then checking the position, so one of the two always sees the other.
+    mSendRingPtr->mWritePos.store(writePos + aBytes, std::memory_order_seq_cst);
+    if (mSendRingPtr->mReaderWaiting.load(std::memory_order_seq_cst) != 0 && mSendRingPtr->mReaderWaiting.exchange(0) != 0)
+    {
+        RingPeerDoorbell();
+    }
+    return true;
+}
+
+//! Moves everything in the receive ring into mBufI, which must be empty.
+//! If the ring is empty, asks the writer to ring the doorbell.
+//! @return The number of bytes moved.
+size_t PakSharedMemoryIO::ReadAvailable()
+{
+    uint64_t readPos = mReceiveRingPtr->mReadPos.load(std::memory_order_relaxed);
+    uint64_t writePos = mReceiveRingPtr->mWritePos.load(std::memory_order_acquire);
+    if (writePos == readPos)
+    {
+        DrainDoorbell();
+        mReceiveRingPtr->mReaderWaiting.store(1, std::memory_order_seq_cst);
+        writePos = mReceiveRingPtr->mWritePos.load(std::memory_order_seq_cst);
+        if (writePos == readPos)
+        {
+            return 0;
+        }
+    }
+    size_t bytes = (size_t)(writePos - readPos);
+    size_t offset = (size_t)(readPos & (mRingBytes - 1));
+    size_t firstBytes = std::min(bytes, mRingBytes - offset);
+    mBufI.Reset();
+    mBufI.PutRaw(mReceiveDataPtr + offset, firstBytes);
+    mBufI.PutRaw(mReceiveDataPtr, bytes - firstBytes);
+    // As with mReaderWaiting, publishing the position and then checking the flag pairs with the
+    // writer setting the flag and then checking the position.
+    mReceiveRingPtr->mReadPos.store(writePos, std::memory_order_seq_cst);
+    if (mReceiveRingPtr->mWriterWaiting.load(std::memory_order_seq_cst) != 0 && mReceiveRingPtr->mWriterWaiting.exchange(0) != 0)
+    {
+        RingPeerDoorbell();
+    }
+    return bytes;
+}
+
+//! Reads any pending doorbell datagrams, so the socket stops reporting data.
+void PakSharedMemoryIO::DrainDoorbell()
+{
+    char signals[64];
+    while (mDoorbellSocketPtr->Receive(signals, sizeof(signals)) > 0)
+    {
+    }
+}
+
+//! Returns the next packet header.  Frames are written whole, so once a header is
+//! read the rest of the packet is available.
+//! @param aWaitTimeMicroSeconds How long to wait on the doorbell for a packet to arrive.
+bool PakSharedMemoryIO::ReceiveHeader(int& aPacketId, int& aPacketLength, int aWaitTimeMicroSeconds)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(aWaitTimeMicroSeconds);
+    while (!mHasReadHeader)
+    {
+        if (mBufI.GetValidBytes() == 0 && ReadAvailable() == 0)
+        {
+            double remaining = std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+            if (remaining <= 0.0 || !IsConnected())
+            {
+                return false;
+            }
+            // Look at the ring again even if the doorbell datagram was lost
+            mDoorbellSocketPtr->WaitUntilReceiveReady((float)std::min(remaining, cDOORBELL_RECHECK_TIME));
+            continue;
+        }
+        bool headerValid;
+        if (!GetPacketHeader(mBufI, mHeaderPacketId, mHeaderPacketLength, headerValid))
+        {
+            return false;
+        }
+        if (headerValid)
+        {
+            mHasReadHeader = true;
+            CapturePacket(mBufI, mHeaderPacketId, mHeaderPacketLength);
+        }
+        else
+        {
+            mBufI.GetGetPos() += mHeaderPacketLength - mHeaderSize;
+        }
+    }
+    aPacketId = mHeaderPacketId;
+    aPacketLength = mHeaderPacketLength;
+    return true;
+}
+
+bool PakSharedMemoryIO::Receive(PakPacket& aPkt)
+{
+    if (!mHasReadHeader)
+    {
+        return false;
+    }
+    PakProcessor::PacketInfo* info = mProcessorPtr->GetPacketInfo(aPkt.ID());
+    size_t packetEnd = mBufI.GetGetPos() + mHeaderPacketLength - mHeaderSize;
+    (*info->mReadFn)(aPkt, *mSerializeReader);
+    mHasReadHeader = false;
+    if (mBufI.GetGetPos() != packetEnd)
+    {
+        std::cout << "Detected error receiving packet."
+                  << " Name: " << info->GetPacketName()
+                  << " ID: " << aPkt.ID()
+                  << std::endl;
+        mBufI.SetGetPos(packetEnd);
+        return false;
+    }
+    return true;
+}
+
+void PakSharedMemoryIO::IgnorePacket()
+{
+    if (mHasReadHeader)
+    {
+        mBufI.GetGetPos() += mHeaderPacketLength - mHeaderSize;
+        mHasReadHeader = false;
+    }
+}
@@ -0,0 +1,135 @@
+﻿#ifndef PAKSHAREDMEMORYIO_H
+#define PAKSHAREDMEMORYIO_H
+
+#include "NXPacketIO_Export.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "GenIO/GenBuffer.h"
+#include "GenIO/GenSharedMemory.h"
+#include "PacketIO/PakDefaultHeader.h"
+#include "PacketIO/PakSocketIO.h"
+
+class PakI;
+class PakO;
+class PakProcessor;
+namespace GenSockets
+{
+class GenInternetSocketAddress;
+}
+
+//! Sends and receives packets between two processes on the same host through shared memory.
+//! The segment holds one single-producer, single-consumer ring per direction.  Packets are
+//! framed as on a TCP stream and never pass through the network stack.
+//!
+//! A reader that finds its ring empty asks to be woken, and the writer then sends one
+//! datagram to the reader's loopback doorbell socket.  GetRecvSocket() returns that socket,
+//! so the IO can be handled by PakThreadedIO like any other.  A busy stream sends no datagrams.
+//! A writer whose ring is full is woken the same way once the reader makes room.
+//! Doorbell datagrams may be lost, so a waiting reader or writer checks the rings again at
+//! least every cDOORBELL_RECHECK_TIME seconds.  PakThreadedIO does this with its timers.
+//!
+//! One side calls Create() and passes GetName(), GetNonce() and GetDoorbellPort() to the
+//! other, which calls Open().  Each side then calls SetPeerDoorbellPort().
+class NX_PACKETIO_EXPORT PakSharedMemoryIO : public PakSocketIO
+{
+public:
+    static const int cLARGE_WAIT_TIME = 100000000;
+
+    //! The longest time in seconds a waiting side relies on a doorbell datagram
+    static constexpr double cDOORBELL_RECHECK_TIME = 0.01;
+
+    static PakSharedMemoryIO* Create(PakProcessor* aProcessorPtr, size_t aRingBytes, PakHeader* aHeaderType = new PakDefaultHeader);
+
+    static PakSharedMemoryIO* Open(PakProcessor* aProcessorPtr, const std::string& aName, uint64_t aNonce, PakHeader* aHeaderType = new PakDefaultHeader);
+
+    ~PakSharedMemoryIO() override;
+
+    bool Send(const PakPacket& aPkt) override;
+
+    bool Send(const PakPacket& aPkt, int aWaitTimeMicroSeconds);
+
+    bool SendEncoded(PakEncodedPacket& aPkt) override;
+
+    bool SendEncoded(PakEncodedPacket& aPkt, int aWaitTimeMicroSeconds);
+
+    bool Flush();
+
+    size_t GetPendingSendBytes();
+
+    bool IsReceiveReady() const;
+
+    bool ReceiveHeader(int& aPacketId, int& aPacketLength, int aWaitTimeMicroSeconds) override;
+
+    bool Receive(PakPacket& aPkt) override;
+
+    void IgnorePacket() override;
+
+    GenSockets::GenSocket* GetRecvSocket() const override { return mDoorbellSocketPtr; }
+
+    PakProcessor* GetPakProcessor() const override { return mProcessorPtr; }
+
+    //! Returns 'false' once either side has closed the IO.
+    bool IsConnected() override;
+
+    //! Tells the peer no more packets will be sent or received.
+    void Close();
+
+    const std::string& GetName() const { return mSegment.GetName(); }
+
+    uint64_t GetNonce() const;
+
+    int GetDoorbellPort() const;
+
+    void SetPeerDoorbellPort(int aPort);
+
+    //! Removes the segment's name once the peer has opened it.
+    void Unlink() { mSegment.Unlink(); }
+
+private:
+    struct SegmentHeader;
+    struct Ring;
+
+    PakSharedMemoryIO(PakProcessor* aProcessorPtr, PakHeader* aHeaderType);
+    PakSharedMemoryIO(const PakSharedMemoryIO&) = delete;
+    PakSharedMemoryIO& operator=(const PakSharedMemoryIO&) = delete;
+
+    bool Attach(bool aIsCreator);
+    bool SendFrame(const char* aDataPtr, size_t aBytes, int aWaitTimeMicroSeconds, std::unique_lock<std::mutex>& aLock);
+    bool WriteFrame(const char* aDataPtr, size_t aBytes);
+    bool FlushP();
+    size_t ReadAvailable();
+    void DrainDoorbell();
+    void RingPeerDoorbell();
+
+    PakProcessor* mProcessorPtr;
+    GenSharedMemory mSegment;
+    SegmentHeader* mHeaderPtr;
+    Ring* mSendRingPtr;
+    Ring* mReceiveRingPtr;
+    char* mSendDataPtr;
+    char* mReceiveDataPtr;
+    size_t mRingBytes;
+    GenSockets::GenSocket* mDoorbellSocketPtr;
+    GenSockets::GenSocket* mNotifySocketPtr;
+    GenSockets::GenInternetSocketAddress* mPeerDoorbellPtr;
+    GenBuffer mBufO;
+    //! Frames sent without waiting that did not fit in the ring, each preceded by its length.
+    //! Guarded by mSendMutex.
+    GenBuffer mPendingO;
+    size_t mPendingSendBytes;
+    GenBuffer mBufI;
+    PakO* mSerializeWriter;
+    PakI* mSerializeReader;
+    std::mutex mSendMutex;
+    //! Guards mPeerDoorbellPtr and mNotifySocketPtr, which the reading and writing threads share
+    std::mutex mDoorbellMutex;
+    int mHeaderSize;
+    bool mHasReadHeader;
+    int mHeaderPacketId;
+    int mHeaderPacketLength;
+};
+
+#endif
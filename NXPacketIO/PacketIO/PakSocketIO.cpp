@@ -1,12 +1,31 @@
 ﻿#include "PacketIO/PakSocketIO.h"
 
+#include <cstring>
+#include <iostream>
+
+#include "PacketIO/PakCaptureFile.h"
+#include "PacketIO/PakCompressedHeader.h"
+#include "PacketIO/PakEncodedPacket.h"
 #include "PacketIO/PakHeader.h"
+#include "PacketIO/PakPacket.h"
+#include "PacketIO/PakProcessor.h"
+#include "Util/UtLZ_Codec.h"
+
+PakSocketIO::PakSocketIO(PakHeader* aHeaderType)
+    : mPacketHeaderType(aHeaderType), mCompressedHeaderPtr(dynamic_cast<PakCompressedHeader*>(aHeaderType)), mCapturePtr(nullptr), mReceiveTime(0), mBodyLength(0), mMaximumInflatedSize(256 << 20), mInflatedBytes(0), mInflateBuf(0)
+{
+}
 
 PakSocketIO::~PakSocketIO()
 {
     delete mPacketHeaderType;
 }
 
+bool PakSocketIO::SendEncoded(PakEncodedPacket& aPkt)
+{
+    return Send(aPkt.GetPacket());
+}
+
 //! Overwrites the ID and length field in the packet header.
 //! @param aIO A GenIO filled with the packet.
 //! @param aPacketID The packet's ID.
@@ -26,7 +45,14 @@ bool PakSocketIO::GetPacketHeader(GenBuffer& aBuffer, int& aPacketID, int& aPack
         size_t hsize = (size_t)mPacketHeaderType->GetHeaderSize();
         if (aBuffer.GetPutPos() - aBuffer.GetGetPos() >= hsize)
         {
-            aIsInvalid = mPacketHeaderType->ReadHeader(aBuffer, aPacketID, aPacketLength);
+            if (mCompressedHeaderPtr != nullptr)
+            {
+                aIsInvalid = mCompressedHeaderPtr->ReadHeader(aBuffer, aPacketID, aPacketLength, mBodyLength);
+            }
+            else
+            {
+                aIsInvalid = mPacketHeaderType->ReadHeader(aBuffer, aPacketID, aPacketLength);
+            }
         }
         else
         {
@@ -43,6 +69,30 @@ bool PakSocketIO::GetPacketHeader(GenBuffer& aBuffer, int& aPacketID, int& aPack
     return lReturn;
 }
 
+//! Writes a received packet to the capture file.  The header is written again from the ID
+//! and length, as the IO may have already discarded its copy.
+void PakSocketIO::CapturePacketP(const GenBuffer& aBuffer, int aPacketID, int aPacketLength)
+{
+    char headerBytes[64];
+    GenBuffer header(headerBytes, sizeof(headerBytes));
+    size_t bodyBytes = (size_t)aPacketLength - GetHeaderSize();
+    if (mPacketHeaderType == nullptr || GetHeaderSize() > (int)sizeof(headerBytes) || aPacketLength < GetHeaderSize() ||
+        aBuffer.GetValidBytes() < bodyBytes)
+    {
+        return;
+    }
+    if (mCompressedHeaderPtr != nullptr)
+    {
+        // The body is captured as received, compressed or not
+        mCompressedHeaderPtr->WriteHeader(header, aPacketID, aPacketLength, mBodyLength);
+    }
+    else
+    {
+        mPacketHeaderType->WriteHeader(header, aPacketID, aPacketLength);
+    }
+    mCapturePtr->Write(headerBytes, header.GetPutPos(), aBuffer.GetBuffer() + aBuffer.GetGetPos(), bodyBytes);
+}
+
 int PakSocketIO::GetHeaderSize()
 {
     int hSize = 0;
@@ -52,3 +102,152 @@ int PakSocketIO::GetHeaderSize()
     }
     return hSize;
 }
+
+//! Returns 'true' if packets of the type may be sent with a compressed body.
+bool PakSocketIO::IsCompressing(int aPacketId) const
+{
+    PakProcessor* processorPtr = GetPakProcessor();
+    return mCompressedHeaderPtr != nullptr && processorPtr != nullptr && processorPtr->IsCompressible(aPacketId);
+}
+
+//! Writes the header of a packet serialized in aBuffer, compressing its body first if
+//! IsCompressing() and the body reaches the threshold and shrinks.
+//! @param aPacketOffset The offset of the packet, where GetHeaderSize() bytes were left for the header.
+//! @param aPacketLength The length of the packet, including the header.  The packet must end at
+//!                      the put position if it may be compressed.
+//! @return The length of the packet as sent.  The put position is left at the end of its bytes in aBuffer.
+size_t PakSocketIO::FramePacket(GenBuffer& aBuffer, size_t aPacketOffset, size_t aPacketLength, int aPacketId)
+{
+    size_t endOffset = aBuffer.GetPutPos();
+    uint32_t bodyLength = 0;
+    size_t headerSize = (size_t)GetHeaderSize();
+    if (IsCompressing(aPacketId) && aPacketLength - headerSize >= mCompressedHeaderPtr->GetThreshold())
+    {
+        char* bodyPtr = aBuffer.GetBuffer() + aPacketOffset + headerSize;
+        size_t rawBytes = aPacketLength - headerSize;
+        if (mDeflateBuf.size() < rawBytes)
+        {
+            mDeflateBuf.resize(rawBytes);
+        }
+        // Give up as soon as the output would not be smaller
+        size_t compressedBytes = UtLZ_Codec::Compress(bodyPtr, rawBytes, mDeflateBuf.data(), rawBytes - 1);
+        CountCompressionP(rawBytes, compressedBytes);
+        if (compressedBytes != 0)
+        {
+            memcpy(bodyPtr, mDeflateBuf.data(), compressedBytes);
+            aPacketLength = headerSize + compressedBytes;
+            endOffset = aPacketOffset + aPacketLength;
+            bodyLength = (uint32_t)rawBytes;
+        }
+    }
+    aBuffer.SetPutPos(aPacketOffset);
+    if (mCompressedHeaderPtr != nullptr)
+    {
+        mCompressedHeaderPtr->WriteHeader(aBuffer, aPacketId, (int)aPacketLength, bodyLength);
+    }
+    else
+    {
+        SetPacketHeader(aBuffer, aPacketId, (int)aPacketLength);
+    }
+    aBuffer.SetPutPos(endOffset);
+    return aPacketLength;
+}
+
+//! Returns aPkt framed with this IO's header, compressed as FramePacket() would.
+const GenBuffer& PakSocketIO::GetFrame(PakEncodedPacket& aPkt)
+{
+    const GenBuffer& frame = aPkt.GetFrame(mPacketHeaderType, GetPakProcessor());
+    if (mCompressedHeaderPtr != nullptr && aPkt.GetBodySize() >= mCompressedHeaderPtr->GetThreshold() &&
+        IsCompressing(aPkt.GetPacket().ID()))
+    {
+        size_t sentBytes = frame.GetPutPos() - GetHeaderSize();
+        CountCompressionP(aPkt.GetBodySize(), sentBytes < aPkt.GetBodySize() ? sentBytes : 0);
+    }
+    return frame;
+}
+
+//! Records an attempt to compress aRawBytes, aCompressedBytes is zero if it failed.
+void PakSocketIO::CountCompressionP(size_t aRawBytes, size_t aCompressedBytes)
+{
+    if (aCompressedBytes != 0)
+    {
+        mCompressionCounters.mPacketsCompressed.fetch_add(1, std::memory_order_relaxed);
+        mCompressionCounters.mBytesBeforeCompression.fetch_add(aRawBytes, std::memory_order_relaxed);
+        mCompressionCounters.mBytesAfterCompression.fetch_add(aCompressedBytes, std::memory_order_relaxed);
+    }
+    else
+    {
+        mCompressionCounters.mPacketsNotCompressed.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+//! Returns the length of the packet whose header was read last once its body is decompressed,
+//! aPacketLength if it is not compressed.
+int PakSocketIO::GetDecompressedLength(int aPacketLength)
+{
+    return mBodyLength != 0 ? GetHeaderSize() + (int)mBodyLength : aPacketLength;
+}
+
+//! Called before reading the packet whose header was read last, with its body of aCompressedBytes
+//! at the get position of aBuffer.  A compressed body is decompressed and swapped into aBuffer,
+//! so the packet is read from aBuffer as if it had been sent as is.  EndInflate() must follow.
+//! The decompressed size comes from the peer, so a packet declared larger than SetMaximumInflatedSize()
+//! is rejected as malformed before any memory is allocated for it.
+//! @return 'false' if the body could not be decompressed.  EndInflate() is then not needed.
+bool PakSocketIO::BeginInflate(GenBuffer& aBuffer, size_t aCompressedBytes)
+{
+    if (mBodyLength == 0)
+    {
+        return true;
+    }
+    if ((size_t)GetHeaderSize() + mBodyLength > mMaximumInflatedSize)
+    {
+        std::cout << "Received compressed packet larger than the receive limit."
+                  << " Length: " << (size_t)GetHeaderSize() + mBodyLength << " bytes"
+                  << " Limit: " << mMaximumInflatedSize << " bytes"
+                  << std::endl;
+        mBodyLength = 0;
+        return false;
+    }
+    if (aCompressedBytes > aBuffer.GetValidBytes() || mBodyLength > UtLZ_Codec::GetMaximumDecompressedSize(aCompressedBytes))
+    {
+        mBodyLength = 0;
+        return false;
+    }
+    mInflateBuf.Reset();
+    mInflateBuf.Grow(mBodyLength);
+    if (!UtLZ_Codec::Decompress(aBuffer.GetBuffer() + aBuffer.GetGetPos(), aCompressedBytes, mInflateBuf.GetBuffer(), mBodyLength))
+    {
+        mBodyLength = 0;
+        return false;
+    }
+    mCompressionCounters.mPacketsDecompressed.fetch_add(1, std::memory_order_relaxed);
+    mCompressionCounters.mBytesBeforeDecompression.fetch_add(aCompressedBytes, std::memory_order_relaxed);
+    mCompressionCounters.mBytesAfterDecompression.fetch_add(mBodyLength, std::memory_order_relaxed);
+    mInflateBuf.SetPutPos(mBodyLength);
+    mInflatedBytes = aCompressedBytes;
+    aBuffer.SwapBuffer(mInflateBuf);
+    return true;
+}
+
+//! Restores aBuffer after the packet is read, with the get position past the compressed body.
+void PakSocketIO::EndInflate(GenBuffer& aBuffer)
+{
+    if (mBodyLength != 0)
+    {
+        aBuffer.SwapBuffer(mInflateBuf);
+        aBuffer.GetGetPos() += mInflatedBytes;
+        mBodyLength = 0;
+    }
+}
+
+void PakSocketIO::GetCompressionStats(CompressionStats& aStats) const
+{
+    aStats.mPacketsCompressed = mCompressionCounters.mPacketsCompressed.load(std::memory_order_relaxed);
+    aStats.mBytesBeforeCompression = mCompressionCounters.mBytesBeforeCompression.load(std::memory_order_relaxed);
+    aStats.mBytesAfterCompression = mCompressionCounters.mBytesAfterCompression.load(std::memory_order_relaxed);
+    aStats.mPacketsNotCompressed = mCompressionCounters.mPacketsNotCompressed.load(std::memory_order_relaxed);
+    aStats.mPacketsDecompressed = mCompressionCounters.mPacketsDecompressed.load(std::memory_order_relaxed);
+    aStats.mBytesBeforeDecompression = mCompressionCounters.mBytesBeforeDecompression.load(std::memory_order_relaxed);
+    aStats.mBytesAfterDecompression = mCompressionCounters.mBytesAfterDecompression.load(std::memory_order_relaxed);
+}
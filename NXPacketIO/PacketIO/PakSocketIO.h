@@ -3,13 +3,21 @@
 
 #include "NXPacketIO_Export.h"
 
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
 #include "GenIO/GenBuffer.h"
 
 class GenIO;
+class PakCaptureFile;
+class PakCompressedHeader;
 // class PakSerializeReader;
 // class PakSerializeWriter;
+class PakEncodedPacket;
 class PakHeader;
 class PakPacket;
+class PakProcessor;
 namespace GenSockets
 {
 class GenSocket;
@@ -20,19 +28,37 @@ class GenSocket;
 class NX_PACKETIO_EXPORT PakSocketIO
 {
 public:
+    //! Counters of the packet bodies compressed and decompressed by an IO with a PakCompressedHeader.
+    //! mBytesBeforeCompression / mBytesAfterCompression is the compression ratio of the packets sent.
+    struct CompressionStats
+    {
+        //! Packets sent with a compressed body, and their body bytes before and after compression
+        uint64_t mPacketsCompressed;
+        uint64_t mBytesBeforeCompression;
+        uint64_t mBytesAfterCompression;
+        //! Packets which reached the threshold, but were sent as is because compression did not make them smaller
+        uint64_t mPacketsNotCompressed;
+        //! Packets received with a compressed body, and their body bytes before and after decompression
+        uint64_t mPacketsDecompressed;
+        uint64_t mBytesBeforeDecompression;
+        uint64_t mBytesAfterDecompression;
+    };
+
     //! Constructor
     //! @param aHeaderType A pointer to the type of header to use in communication
     //!                    Can be null if no header is desired.
-    PakSocketIO(PakHeader* aHeaderType)
-        : mPacketHeaderType(aHeaderType)
-    {
-    }
+    //!                    With a PakCompressedHeader, bodies of compressible packet types are compressed.
+    PakSocketIO(PakHeader* aHeaderType);
 
     virtual ~PakSocketIO();
 
     //! send a packet
     virtual bool Send(const PakPacket& aPkt) = 0;
 
+    //! send a packet that may already be serialized for another IO.
+    //! The default implementation serializes the packet again.
+    virtual bool SendEncoded(PakEncodedPacket& aPkt);
+
     //! Receive a packet, and output the ID and Length.
     //! @param[out] aPacketId The ID of the packet
     //! @param[out] aPacketLength The length in bytes of the packet (including header)
@@ -54,16 +80,89 @@ public:
     //! Returns a pointer to the socket used for send methods
     virtual GenSockets::GenSocket* GetSendSocket() const { return nullptr; }
 
+    //! Returns the processor used to create and read received packets
+    virtual PakProcessor* GetPakProcessor() const { return nullptr; }
+
+    //! Returns 'false' once the IO can no longer send or receive
+    virtual bool IsConnected() { return true; }
+
     PakHeader* GetHeaderType() { return mPacketHeaderType; }
 
+    //! Records every packet this IO receives in aCapturePtr, which is not owned.
+    //! Null stops the capture.  Set it before the IO starts receiving.
+    void SetCapture(PakCaptureFile* aCapturePtr) { mCapturePtr = aCapturePtr; }
+
+    PakCaptureFile* GetCapture() const { return mCapturePtr; }
+
+    //! Returns when the data of the packet being received arrived, see PakProcessor::GetMetricsTime().
+    //! Zero if this IO does not record it.
+    int64_t GetReceiveTime() const { return mReceiveTime; }
+
+    void GetCompressionStats(CompressionStats& aStats) const;
+
 protected:
+    void SetReceiveTime(int64_t aTime) { mReceiveTime = aTime; }
+
     void SetPacketHeader(GenBuffer& aIO, int aPacketID, int aPacketLength);
 
     bool GetPacketHeader(GenBuffer& aIO, int& aPacketID, int& aPacketLength, bool& aIsInvalid);
 
     int GetHeaderSize();
 
+    bool IsCompressing(int aPacketId) const;
+
+    size_t FramePacket(GenBuffer& aBuffer, size_t aPacketOffset, size_t aPacketLength, int aPacketId);
+
+    const GenBuffer& GetFrame(PakEncodedPacket& aPkt);
+
+    int GetDecompressedLength(int aPacketLength);
+
+    //! Sets the largest packet, header included, that a compressed body may decompress to.
+    //! The default is 256 MB.
+    void SetMaximumInflatedSize(size_t aBytes) { mMaximumInflatedSize = aBytes; }
+
+    bool BeginInflate(GenBuffer& aBuffer, size_t aCompressedBytes);
+
+    void EndInflate(GenBuffer& aBuffer);
+
+    //! Called once a received packet's body is available at aBuffer's get position.
+    void CapturePacket(const GenBuffer& aBuffer, int aPacketID, int aPacketLength)
+    {
+        if (mCapturePtr != nullptr)
+        {
+            CapturePacketP(aBuffer, aPacketID, aPacketLength);
+        }
+    }
+
 private:
+    void CapturePacketP(const GenBuffer& aBuffer, int aPacketID, int aPacketLength);
+
+    struct CompressionCounters
+    {
+        std::atomic<uint64_t> mPacketsCompressed{0};
+        std::atomic<uint64_t> mBytesBeforeCompression{0};
+        std::atomic<uint64_t> mBytesAfterCompression{0};
+        std::atomic<uint64_t> mPacketsNotCompressed{0};
+        std::atomic<uint64_t> mPacketsDecompressed{0};
+        std::atomic<uint64_t> mBytesBeforeDecompression{0};
+        std::atomic<uint64_t> mBytesAfterDecompression{0};
+    };
+
+    void CountCompressionP(size_t aRawBytes, size_t aCompressedBytes);
+
     PakHeader* mPacketHeaderType;
+    //! mPacketHeaderType if it is a PakCompressedHeader, null otherwise
+    PakCompressedHeader* mCompressedHeaderPtr;
+    PakCaptureFile* mCapturePtr;
+    int64_t mReceiveTime;
+    //! The decompressed body size of the packet whose header was read last, zero if not compressed
+    uint32_t mBodyLength;
+    //! See SetMaximumInflatedSize()
+    size_t mMaximumInflatedSize;
+    //! The compressed body size while the packet is read from mInflateBuf
+    size_t mInflatedBytes;
+    std::vector<char> mDeflateBuf;
+    GenBuffer mInflateBuf;
+    CompressionCounters mCompressionCounters;
 };
 #endif
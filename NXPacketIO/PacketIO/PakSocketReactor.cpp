@@ -4,6 +4,7 @@
 #include <map>
 
 #include "GenIO/GenSocket.h"
+#include "GenIO/GenSocketPoller.h"
 #include "GenIO/GenSocketSelector.h"
 #include "Util/UtBinder.h"
 #include "Util/UtWallClock.h"
@@ -11,25 +12,91 @@
 class PakSocketReactorImpl
 {
 public:
-    PakSocketReactorImpl() {}
+    PakSocketReactorImpl(bool aUsePoller)
+        : mUsePoller(aUsePoller)
+    {
+    }
 
     ~PakSocketReactorImpl()
     {
         delete mNotifyReceiver;
         delete mNotifySender;
     }
+
+    void AddSocket(GenSockets::GenSocket* aSocket)
+    {
+        if (mUsePoller)
+        {
+            if (!mSocketPoller.AddSocket(aSocket))
+            {
+                std::cout << "PakSocketReactor: Unable to register socket for polling." << std::endl;
+            }
+        }
+        else
+        {
+            mSocketSelector.AddSocket(aSocket);
+        }
+    }
+
+    void RemoveSocket(GenSockets::GenSocket* aSocket)
+    {
+        if (mUsePoller)
+        {
+            mSocketPoller.RemoveSocket(aSocket);
+        }
+        else
+        {
+            mSocketSelector.RemoveSocket(aSocket);
+        }
+    }
+
+    void SetWriteInterest(GenSockets::GenSocket* aSocket, bool aEnable)
+    {
+        if (mUsePoller)
+        {
+            if (!mSocketPoller.SetWriteInterest(aSocket, aEnable))
+            {
+                std::cout << "PakSocketReactor: Unable to change write interest for socket." << std::endl;
+            }
+        }
+        else
+        {
+            mSocketSelector.SetWriteInterest(aSocket, aEnable);
+        }
+    }
+
+    const GenSockets::GenSocketSet& GetWritableSockets() const { return mUsePoller ? mSocketPoller.GetWritableSockets() : mSocketSelector.GetWritableSockets(); }
+
+    bool IsEmpty() const { return mUsePoller ? mSocketPoller.IsEmpty() : mSocketSelector.IsEmpty(); }
+
+    GenSockets::GenSocketSelector::SelectResult Wait(float aWaitTime, int aEventType)
+    {
+        if (mUsePoller)
+        {
+            return mSocketPoller.Poll(mSelectedSockets, aWaitTime);
+        }
+        return mSocketSelector.Select(mSelectedSockets, aWaitTime, aEventType);
+    }
+
+    bool mUsePoller;
     GenSockets::GenSocketSelector mSocketSelector;
+    GenSockets::GenSocketPoller mSocketPoller;
     GenSockets::GenSocketSet mSelectedSockets;
 
     GenSockets::GenSocket* mNotifyReceiver;
     GenSockets::GenSocket* mNotifySender;
 };
 
-PakSocketReactor::PakSocketReactor()
-    : mIsRunning(false), mImpl(new PakSocketReactorImpl)
+PakSocketReactor::PakSocketReactor(Backend aBackend)
+    : mBackend(aBackend), mIsRunning(false), mImpl(nullptr)
 {
+    if (mBackend == cEPOLL_BACKEND && !GenSockets::GenSocketPoller::IsSupported())
+    {
+        mBackend = cSELECT_BACKEND;
+    }
+    mImpl = new PakSocketReactorImpl(mBackend == cEPOLL_BACKEND);
     GenSockets::GenSocket::CreateSocketPair(mImpl->mNotifyReceiver, mImpl->mNotifySender);
-    mImpl->mSocketSelector.AddSocket(mImpl->mNotifyReceiver);
+    mImpl->AddSocket(mImpl->mNotifyReceiver);
     mCallbacks[mImpl->mNotifyReceiver] = new UtCallbackN<void()>(UtStd::Bind(&PakSocketReactor::HandleNotify, this));
 }
 
@@ -39,6 +106,14 @@ PakSocketReactor::~PakSocketReactor()
     {
         delete i->second;
     }
+    for (CallbackMap::iterator i = mWriteCallbacks.begin(); i != mWriteCallbacks.end(); ++i)
+    {
+        delete i->second;
+    }
+    for (size_t i = 0; i < mWriteCallbackRequests.size(); ++i)
+    {
+        delete mWriteCallbackRequests[i].second;
+    }
     delete mImpl;
 }
 
@@ -50,7 +125,7 @@ PakSocketReactor& PakSocketReactor::GetInstance()
 
 void PakSocketReactor::FinishConnect(GenSockets::GenSocket* aSocket)
 {
-    mImpl->mSocketSelector.AddSocket(aSocket);
+    mImpl->AddSocket(aSocket);
     if (mIsRunning)
     {
         Notify();
@@ -73,9 +148,24 @@ void PakSocketReactor::Disconnect(GenSockets::GenSocket* aSocket)
 
 void PakSocketReactor::CompleteDisconnects()
 {
+    if (mDeadSockets.empty())
+    {
+        return;
+    }
+    ApplyWriteInterest();
     for (size_t i = 0; i < mDeadSockets.size(); ++i)
     {
-        mImpl->mSocketSelector.RemoveSocket(mDeadSockets[i]);
+        CallbackMap::iterator writeIter = mWriteCallbacks.find(mDeadSockets[i]);
+        if (writeIter != mWriteCallbacks.end())
+        {
+            if (!mImpl->mUsePoller)
+            {
+                mImpl->SetWriteInterest(mDeadSockets[i], false);
+            }
+            delete writeIter->second;
+            mWriteCallbacks.erase(writeIter);
+        }
+        mImpl->RemoveSocket(mDeadSockets[i]);
         CallbackMap::iterator iter = mCallbacks.find(mDeadSockets[i]);
         if (iter != mCallbacks.end())
         {
@@ -86,6 +176,42 @@ void PakSocketReactor::CompleteDisconnects()
     mDeadSockets.clear();
 }
 
+//! Enables or disables the write handler of a socket added with ConnectWrite().
+//! This may be called from any thread; the change takes effect before the reactor next waits.
+void PakSocketReactor::SetWriteInterest(GenSockets::GenSocket* aSocket, bool aEnable)
+{
+    {
+        std::lock_guard<std::mutex> lock(mWriteInterestLock);
+        mWriteInterestRequests.emplace_back(aSocket, aEnable);
+    }
+    if (mIsRunning)
+    {
+        Notify();
+    }
+}
+
+//! Installs the write handlers added by ConnectWrite(), then applies the write interest changes.
+void PakSocketReactor::ApplyWriteInterest()
+{
+    std::lock_guard<std::mutex> lock(mWriteInterestLock);
+    for (size_t i = 0; i < mWriteCallbackRequests.size(); ++i)
+    {
+        UtCallbackN<void()>*& callbackPtr = mWriteCallbacks[mWriteCallbackRequests[i].first];
+        delete callbackPtr;
+        callbackPtr = mWriteCallbackRequests[i].second;
+    }
+    mWriteCallbackRequests.clear();
+    for (size_t i = 0; i < mWriteInterestRequests.size(); ++i)
+    {
+        // Ignore requests for sockets that have since been disconnected
+        if (mWriteCallbacks.find(mWriteInterestRequests[i].first) != mWriteCallbacks.end())
+        {
+            mImpl->SetWriteInterest(mWriteInterestRequests[i].first, mWriteInterestRequests[i].second);
+        }
+    }
+    mWriteInterestRequests.clear();
+}
+
 //! This is the same as Run(), except it returns after aWaitTime
 void PakSocketReactor::HandleEvents(double aWaitTime, int aEventType)
 {
@@ -119,7 +245,16 @@ void PakSocketReactor::Run(int aEventType)
     while (!mIsStopping)
     {
         CompleteDisconnects();
-        RunSelect(GenSockets::GenSocketSelector::cBLOCK_FOREVER, aEventType);
+        double waitTime = GenSockets::GenSocketSelector::cBLOCK_FOREVER;
+        if (mTimerCallback)
+        {
+            double timerWait = mTimerCallback();
+            if (timerWait >= 0.0)
+            {
+                waitTime = timerWait;
+            }
+        }
+        RunSelect(waitTime, aEventType);
         ProcessSignals();
     }
     mIsRunning = false;
@@ -135,14 +270,23 @@ void PakSocketReactor::Stop()
     }
 }
 
+void PakSocketReactor::Wakeup()
+{
+    if (mIsRunning)
+    {
+        Notify();
+    }
+}
+
 void PakSocketReactor::RunSelect(double aWaitTime, int aEventType)
 {
+    ApplyWriteInterest();
     mImpl->mSelectedSockets.Clear();
-    if (!mImpl->mSocketSelector.IsEmpty())
+    if (!mImpl->IsEmpty())
     {
-        if (GenSockets::GenSocketSelector::cERROR == mImpl->mSocketSelector.Select(mImpl->mSelectedSockets, ((float)aWaitTime), aEventType))
+        if (GenSockets::GenSocketSelector::cERROR == mImpl->Wait((float)aWaitTime, aEventType))
         {
-            if (!RemoveErrorSockets())
+            if (mImpl->mUsePoller || !RemoveErrorSockets())
             {
                 std::cout << "Unknown error on GenSocketSelector::Select()." << std::endl;
             }
@@ -150,7 +294,8 @@ void PakSocketReactor::RunSelect(double aWaitTime, int aEventType)
     }
 }
 
-//! Invokes any callbacks associated with the 'signalled' sockets.
+//! Invokes any callbacks associated with the 'signalled' sockets, then the write
+//! handlers of sockets that are ready to write.
 void PakSocketReactor::ProcessSignals()
 {
     unsigned int selectedSockets = mImpl->mSelectedSockets.GetSocketCount();
@@ -159,6 +304,16 @@ void PakSocketReactor::ProcessSignals()
         GenSockets::GenSocket* selectedSocket = mImpl->mSelectedSockets.GetSocketEntry(i);
         (*mCallbacks[selectedSocket])();
     }
+    const GenSockets::GenSocketSet& writableSockets = mImpl->GetWritableSockets();
+    unsigned int writableCount = writableSockets.GetSocketCount();
+    for (unsigned int i = 0; i < writableCount; ++i)
+    {
+        CallbackMap::iterator iter = mWriteCallbacks.find(writableSockets.GetSocketEntry(i));
+        if (iter != mWriteCallbacks.end())
+        {
+            (*iter->second)();
+        }
+    }
 }
 
 //! Wakes up the Select() call
@@ -172,8 +327,11 @@ void PakSocketReactor::Notify()
 //! Clear buffer if Notify() was called.
 void PakSocketReactor::HandleNotify()
 {
-    int data = 0;
-    mImpl->mNotifyReceiver->Receive((char*)&data, sizeof(int), 0);
+    // The epoll backend is edge-triggered, so drain everything that has been sent.
+    char data[64];
+    while (mImpl->mNotifyReceiver->Receive(data, sizeof(data), 0) == (int)sizeof(data))
+    {
+    }
 }
 
 bool PakSocketReactor::RemoveErrorSockets()
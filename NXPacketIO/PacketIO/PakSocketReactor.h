@@ -3,7 +3,10 @@
 
 #include "NXPacketIO_Export.h"
 
+#include <functional>
 #include <map>
+#include <mutex>
+#include <utility>
 #include <vector>
 
 #include "Util/UtBinder.h"
@@ -22,7 +25,18 @@ class PakSocketReactorImpl;
 class NX_PACKETIO_EXPORT PakSocketReactor
 {
 public:
-    PakSocketReactor();
+    //! The mechanism used to wait for socket events.
+    enum Backend
+    {
+        //! select(), available everywhere.  Cost grows with the number of sockets.
+        cSELECT_BACKEND,
+        //! Edge-triggered epoll.  Only ready sockets are visited, and there is no
+        //! FD_SETSIZE limit.  Callbacks must read until the socket would block.
+        //! Falls back to cSELECT_BACKEND where epoll is not available.
+        cEPOLL_BACKEND
+    };
+
+    explicit PakSocketReactor(Backend aBackend = cSELECT_BACKEND);
     ~PakSocketReactor();
 
     typedef UtCallbackN<void()> CallbackType;
@@ -45,6 +59,28 @@ public:
         Connect(aSocket, UtStd::Bind(aFuncPtr, aThisPtr));
     }
 
+    //! Adds a socket write handler.  The callback is invoked when the socket is
+    //! able to write, but only while write interest is enabled with SetWriteInterest().
+    //! The socket must also have a read handler.  This may be called from any thread,
+    //! the handler is installed by the thread running the reactor before it next waits.
+    void ConnectWrite(GenSockets::GenSocket* aSocket, const std::function<void()>& aFunc)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mWriteInterestLock);
+            mWriteCallbackRequests.emplace_back(aSocket, new UtCallbackN<void()>(aFunc));
+        }
+        Wakeup();
+    }
+
+    //! Adds a socket write handler.  See ConnectWrite() above.
+    template <typename C>
+    void ConnectWrite(GenSockets::GenSocket* aSocket, void (C::*aFuncPtr)(), C* aThisPtr)
+    {
+        ConnectWrite(aSocket, UtStd::Bind(aFuncPtr, aThisPtr));
+    }
+
+    void SetWriteInterest(GenSockets::GenSocket* aSocket, bool aEnable);
+
     void Disconnect(GenSockets::GenSocket* aSocket);
 
     enum EventType
@@ -59,8 +95,20 @@ public:
 
     void Run(int aEventType = cREAD);
 
+    //! Sets a function Run() calls before each wait for events.  It returns the longest time
+    //! in seconds Run() may wait, or a negative value to wait until a socket is ready.
+    //! Must be set before Run() is called.
+    void SetTimerCallback(const std::function<double()>& aFunc) { mTimerCallback = aFunc; }
+
     void Stop();
 
+    //! Makes Run() call the timer callback again before it next waits, for a timer started
+    //! by another thread.  May be called from any thread.
+    void Wakeup();
+
+    //! Returns the backend in use, which may differ from the one requested.
+    Backend GetBackend() const { return mBackend; }
+
     //! Allows this to be used as a singleton.  Returns the singleton instance.
     //! @note PakSocketRector may also be instanced.
     static PakSocketReactor& GetInstance();
@@ -72,6 +120,8 @@ private:
 
     void CompleteDisconnects();
 
+    void ApplyWriteInterest();
+
     void Notify();
 
     void ProcessSignals();
@@ -83,11 +133,18 @@ private:
     typedef std::vector<GenSockets::GenSocket*> SocketList;
     typedef std::map<GenSockets::GenSocket*, UtCallbackN<void()>*> CallbackMap;
 
+    Backend mBackend;
     volatile bool mIsRunning;
     volatile bool mIsStopping;
     PakSocketReactorImpl* mImpl;
     SocketList mDeadSockets;
     CallbackMap mCallbacks;
+    CallbackMap mWriteCallbacks;
+    //! Write handlers and write interest changes waiting to be applied by the thread running the reactor
+    std::mutex mWriteInterestLock;
+    std::vector<std::pair<GenSockets::GenSocket*, UtCallbackN<void()>*>> mWriteCallbackRequests;
+    std::vector<std::pair<GenSockets::GenSocket*, bool>> mWriteInterestRequests;
+    std::function<double()> mTimerCallback;
 };
 
 #endif
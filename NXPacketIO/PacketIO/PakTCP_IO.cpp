@@ -1,19 +1,27 @@
 ﻿#include "PacketIO/PakTCP_IO.h"
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 
 #include "GenIO/GenTCP_Connection.h"
+#include "PacketIO/PakEncodedPacket.h"
 #include "PacketIO/PakI.h"
 #include "PacketIO/PakO.h"
 #include "PacketIO/PakPacket.h"
 #include "PacketIO/PakProcessor.h"
 #include "PacketIO/PakSerialize.h"
 
-static std::mutex sendMutex;
-static std::mutex receiveMutex;
+namespace
+{
+int64_t GetSteadyTime()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+} // namespace
+
 PakTCP_IO::PakTCP_IO(GenTCP_Connection* aConnectionPtr, PakProcessor* aProcessor, PakHeader* aHeaderType)
-    : PakSocketIO(aHeaderType), mPakProcessorPtr(aProcessor), mConnectionPtr(aConnectionPtr), mHasReadHeader(false), mPacketReadyToRead(false), mManualFlushCount(0)
+    : PakSocketIO(aHeaderType), mPakProcessorPtr(aProcessor), mConnectionPtr(aConnectionPtr), mHasReadHeader(false), mPacketReadyToRead(false), mPacketBytesWritten(0), mLaneStats(), mFlushBytes(0), mFlushDelay(0), mBufferedSince(0), mFlushDeadline(0), mFlushStats(), mManualFlushCount(0), mReceiveBufferSize(0), mMaximumReceiveBufferSize(0)
 {
     // TCP communication requires a header
     mHeaderSize = GetHeaderSize();
@@ -25,6 +33,7 @@ PakTCP_IO::PakTCP_IO(GenTCP_Connection* aConnectionPtr, PakProcessor* aProcessor
 
     mSerializeWriter = new PakO(&mBufO);
     mSerializeReader = new PakI(&mBufI);
+    SetReceiveBufferOptions(64 << 10, 256 << 20, 10.0);
 }
 
 PakTCP_IO::~PakTCP_IO()
@@ -53,65 +62,218 @@ bool PakTCP_IO::Send(const PakPacket& aPkt)
 //!         Flush() should be called until it returns true
 bool PakTCP_IO::Send(const PakPacket& aPkt, int aWaitTimeMicroSeconds)
 {
-    std::lock_guard<std::mutex> guard(sendMutex);
+    std::lock_guard<std::mutex> guard(mSendMutex);
     size_t packetOffset = mBufO.GetPutPos();
+    bool highPriority = mPakProcessorPtr->IsHighPriority(aPkt.ID());
     // leave space for header to be inserted later
     mBufO.SetPutPos(packetOffset + mHeaderSize);
     {
         PakProcessor::PacketInfo* info = mPakProcessorPtr->GetPacketInfo(aPkt.ID());
         assert(info); // assert that packet is registered
+        // Large raw data may be referenced instead of copied, unless the stream carries message headers.
+        // High priority packets may be moved to mPriorityBufO, so they are always copied.
+        // A body which may be compressed must be complete in mBufO.
+        bool useExternalData = !highPriority && !mConnectionPtr->GetUseMessageHeaders() && !IsCompressing(aPkt.ID());
+        mSerializeWriter->SetExternalDataList(useExternalData ? &mExternalData : nullptr);
         // This should be a const operation for aPkt
         (*info->mWriteFn)(const_cast<PakPacket&>(aPkt), *mSerializeWriter);
+        mSerializeWriter->SetExternalDataList(nullptr);
     }
     size_t endOfPacketOffset = mBufO.GetPutPos();
     size_t packetLength = endOfPacketOffset - packetOffset;
-    mBufO.SetPutPos(packetOffset);
+    for (const PakO::ExternalData& data : mExternalData)
+    {
+        packetLength += data.mBytes;
+    }
 
     // now write header with correct length info.
-    SetPacketHeader(mBufO, aPkt.ID(), (int)packetLength);
-    mBufO.SetPutPos(endOfPacketOffset);
+    packetLength = FramePacket(mBufO, packetOffset, packetLength, aPkt.ID());
+    mPakProcessorPtr->PacketSent(aPkt.ID(), packetLength);
+    QueuePacketP(highPriority, packetOffset, packetLength);
 
-    bool ok = true;
-    if (mManualFlushCount != 0)
+    if (!mExternalData.empty())
     {
-        if (mMaximumPacketSize > (mSendBufferSize - (int)endOfPacketOffset))
-        {
-            ok = Flush(aWaitTimeMicroSeconds);
-        }
+        // The referenced memory is only valid until we return, so send now
+        return GatherFlushP(aWaitTimeMicroSeconds);
     }
-    else
-    {
-        ok = Flush(aWaitTimeMicroSeconds);
-    }
-    return ok;
+    return FlushIfNeededP(highPriority, aWaitTimeMicroSeconds);
 }
 
 // Method for sending a buffer of data.
 // Try to use the type-safe version of this method.
 bool PakTCP_IO::Send(char* aBuffer, int aSize, int aPacketId, int aWaitTimeMicroSeconds /* = cLARGE_WAIT_TIME*/)
 {
-    std::lock_guard<std::mutex> guard(sendMutex);
+    std::lock_guard<std::mutex> guard(mSendMutex);
+    size_t packetOffset = mBufO.GetPutPos();
     size_t totalBytes = aSize + mHeaderSize;
     mBufO.PutRaw(aBuffer, totalBytes);
     size_t endOfPacketOffset = mBufO.GetPutPos();
     SetPacketHeader(mBufO, aPacketId, (int)totalBytes);
     mBufO.SetPutPos(endOfPacketOffset);
+    bool highPriority = mPakProcessorPtr->IsHighPriority(aPacketId);
+    QueuePacketP(highPriority, packetOffset, totalBytes);
+    return FlushIfNeededP(highPriority, aWaitTimeMicroSeconds);
+}
+
+bool PakTCP_IO::SendEncoded(PakEncodedPacket& aPkt)
+{
+    return SendEncoded(aPkt, cLARGE_WAIT_TIME);
+}
+
+//! Send a packet that is serialized once and shared between IOs.
+//! The framed packet is copied into the send buffer; see Send() for the meaning of the return value.
+bool PakTCP_IO::SendEncoded(PakEncodedPacket& aPkt, int aWaitTimeMicroSeconds)
+{
+    std::lock_guard<std::mutex> guard(mSendMutex);
+    const GenBuffer& frame = GetFrame(aPkt);
+    size_t packetOffset = mBufO.GetPutPos();
+    mBufO.PutRaw(frame.GetBuffer(), frame.GetPutPos());
+    mPakProcessorPtr->PacketSent(aPkt.GetPacket().ID(), frame.GetPutPos());
+    bool highPriority = mPakProcessorPtr->IsHighPriority(aPkt.GetPacket().ID());
+    QueuePacketP(highPriority, packetOffset, frame.GetPutPos());
+    return FlushIfNeededP(highPriority, aWaitTimeMicroSeconds);
+}
 
+//! Flushes after a packet is added to the send buffer, unless a manual flush
+//! is in progress and the buffer still has room for another packet.
+//! With SetFlushPolicy(), flushes once the threshold is reached, the latency budget of the
+//! oldest buffered byte expired, or a high priority packet was added.
+//! mSendMutex must be held.
+bool PakTCP_IO::FlushIfNeededP(bool aHighPriority, int aWaitTimeInMicroSec)
+{
     bool ok = true;
     if (mManualFlushCount != 0)
     {
-        if (mMaximumPacketSize > ((int)mSendBufferSize - (int)endOfPacketOffset))
+        if (mMaximumPacketSize > (mSendBufferSize - (int)mBufO.GetPutPos()))
         {
-            ok = Flush(aWaitTimeMicroSeconds);
+            ok = FlushP(aWaitTimeInMicroSec);
         }
     }
+    else if (mFlushBytes != 0)
+    {
+        int64_t now = GetSteadyTime();
+        if (mBufferedSince == 0)
+        {
+            mBufferedSince = now;
+            mFlushDeadline.store(now + mFlushDelay, std::memory_order_relaxed);
+        }
+        if (mBufO.GetValidBytes() + mPriorityBufO.GetValidBytes() >= mFlushBytes)
+        {
+            ++mFlushStats.mThresholdFlushes;
+            ok = FlushP(aWaitTimeInMicroSec);
+        }
+        else if (now >= mFlushDeadline.load(std::memory_order_relaxed))
+        {
+            ++mFlushStats.mDeadlineFlushes;
+            ok = FlushP(aWaitTimeInMicroSec);
+        }
+        else if (aHighPriority)
+        {
+            ok = FlushP(aWaitTimeInMicroSec);
+        }
+    }
+    else
+    {
+        ok = FlushP(aWaitTimeInMicroSec);
+    }
+    return ok;
+}
+
+//! Buffers sent packets, and writes them once aFlushBytes are buffered or aMaximumDelay after the
+//! oldest was sent, whichever comes first.  High priority packets are written at once, along with
+//! the packets buffered ahead of them.  Sets TCP_NODELAY, as the packets are already batched, and
+//! corks the socket while a flush writes both lanes so they leave in full segments.
+//! The deadline is checked by Send() and FlushIfDue(), which must be called at least as often as
+//! aMaximumDelay.  With PakThreadedIO::cQUEUED_SEND the reactor writes whatever is buffered as soon
+//! as the socket is writable.
+//! Must be called before the IO is used by more than one thread.
+//! @param aFlushBytes The bytes buffered before they are written.  0 writes each packet as it is
+//!                    sent, the default.
+//! @param aMaximumDelay The latency budget, the longest time in seconds a packet is buffered.
+void PakTCP_IO::SetFlushPolicy(size_t aFlushBytes, double aMaximumDelay)
+{
+    std::lock_guard<std::mutex> guard(mSendMutex);
+    mFlushBytes = aFlushBytes;
+    mFlushDelay = (int64_t)(std::max(aMaximumDelay, 0.0) * 1.0E9);
+    if (aFlushBytes != 0)
+    {
+        GetSendSocket()->AddSocketOptions(GenSockets::GenSocket::cTCP_NODNXY);
+    }
     else
     {
-        ok = Flush(aWaitTimeMicroSeconds);
+        FlushP(cLARGE_WAIT_TIME);
+    }
+}
+
+//! Writes the buffered packets if the latency budget of SetFlushPolicy() expired.
+//! Without a flush policy, this is the same as Flush().
+//! @return 'false' if there was a problem sending the data, see Flush().
+bool PakTCP_IO::FlushIfDue(int aWaitTimeInMicroSec)
+{
+    if (mFlushBytes == 0)
+    {
+        return Flush(aWaitTimeInMicroSec);
+    }
+    int64_t deadline = mFlushDeadline.load(std::memory_order_relaxed);
+    if (deadline == 0 || GetSteadyTime() < deadline)
+    {
+        return true;
+    }
+    if (!mSendMutex.try_lock())
+    {
+        return false;
+    }
+    bool ok = true;
+    if (mBufferedSince != 0)
+    {
+        ++mFlushStats.mDeadlineFlushes;
+        ok = FlushP(aWaitTimeInMicroSec);
     }
+    mSendMutex.unlock();
     return ok;
 }
 
+//! Returns the time in seconds until FlushIfDue() writes the buffered packets, or a negative
+//! value if none are buffered.
+double PakTCP_IO::GetTimeToFlush() const
+{
+    int64_t deadline = mFlushDeadline.load(std::memory_order_relaxed);
+    if (deadline == 0)
+    {
+        return -1.0;
+    }
+    return std::max<int64_t>(deadline - GetSteadyTime(), 0) * 1.0E-9;
+}
+
+//! Returns the flush statistics.
+void PakTCP_IO::GetFlushStats(FlushStats& aStats)
+{
+    std::lock_guard<std::mutex> guard(mSendMutex);
+    aStats = mFlushStats;
+    mBufferTime.GetSnapshot(aStats.mBufferTime);
+}
+
+//! Accounts for a flush, and stops the latency budget once nothing is buffered.
+//! @param aBytesSentBefore The socket's total bytes sent when the flush started.
+void PakTCP_IO::FlushedP(size_t aBytesSentBefore)
+{
+    size_t bytes = GetSendSocket()->GetTotalBytesSent() - aBytesSentBefore;
+    if (bytes > 0)
+    {
+        ++mFlushStats.mFlushes;
+        mFlushStats.mBytes += bytes;
+        if (mBufferedSince != 0)
+        {
+            mBufferTime.Record(std::max<int64_t>(GetSteadyTime() - mBufferedSince, 0));
+        }
+    }
+    if (mBufferedSince != 0 && mBufO.GetValidBytes() + mPriorityBufO.GetValidBytes() == 0)
+    {
+        mBufferedSince = 0;
+        mFlushDeadline.store(0, std::memory_order_relaxed);
+    }
+}
+
 //! Sends any buffered packets immediately
 //! This is automatically called unless you use BeginManualFlush()
 //! @return 'false' if there was a problem sending the data
@@ -120,42 +282,244 @@ bool PakTCP_IO::Send(char* aBuffer, int aSize, int aPacketId, int aWaitTimeMicro
 //! If IsConnected() == true, call Flush() until it returns true.
 bool PakTCP_IO::Flush(int aWaitTimeInMicroSec)
 {
-    if (!sendMutex.try_lock())
+    if (!mSendMutex.try_lock())
     {
         return false;
     }
+    bool ok = FlushP(aWaitTimeInMicroSec);
+    mSendMutex.unlock();
+    return ok;
+}
+
+//! Implements Flush().  mSendMutex must be held.
+bool PakTCP_IO::FlushP(int aWaitTimeInMicroSec)
+{
+    GenSockets::GenSocket* socketPtr = GetSendSocket();
+    size_t bytesSentBefore = socketPtr->GetTotalBytesSent();
+    // Writing both lanes takes several writes, hold back the partial segments between them
+    bool cork = (mFlushBytes != 0 && mPriorityBufO.GetValidBytes() > 0 && mBufO.GetValidBytes() > 0);
+    if (cork)
+    {
+        socketPtr->AddSocketOptions(GenSockets::GenSocket::cTCP_CORK);
+    }
+    bool ok = WriteBuffersP(aWaitTimeInMicroSec);
+    if (cork)
+    {
+        socketPtr->RemoveSocketOptions(GenSockets::GenSocket::cTCP_CORK);
+    }
+    FlushedP(bytesSentBefore);
+    return ok;
+}
+
+//! Writes the high priority lane, then the normal lane.  mSendMutex must be held.
+bool PakTCP_IO::WriteBuffersP(int aWaitTimeInMicroSec)
+{
     // send the packet, loop until PakPacket is sent.
     // This can cause the program to pause if the destination
     // side is frozen -- but this behavior is useful for debugging.
-    int totalBytes = (int)mBufO.GetPutPos() - (int)mBufO.GetGetPos();
+    if (!FlushPriorityP(aWaitTimeInMicroSec))
+    {
+        return false;
+    }
+    size_t totalBytes = mBufO.GetValidBytes();
     if (totalBytes > 0)
     {
-        int bytes = mConnectionPtr->SendBuffer(aWaitTimeInMicroSec, mBufO.GetBuffer() + mBufO.GetGetPos(), totalBytes);
+        size_t bytes = WriteP(mBufO, totalBytes, aWaitTimeInMicroSec);
+        NormalBytesWrittenP(bytes);
+        CompactP(mBufO);
+        return bytes == totalBytes;
+    }
+    return true;
+}
+
+//! Writes the high priority packets, after completing the normal packet being written so
+//! they start on a packet boundary.  mSendMutex must be held.
+//! @return 'false' if any high priority packets are left unwritten.
+bool PakTCP_IO::FlushPriorityP(int aWaitTimeInMicroSec)
+{
+    size_t priorityBytes = mPriorityBufO.GetValidBytes();
+    if (priorityBytes == 0)
+    {
+        return true;
+    }
+    if (mPacketBytesWritten > 0)
+    {
+        size_t remainingBytes = mPacketSizes.front() - mPacketBytesWritten;
+        size_t bytes = WriteP(mBufO, remainingBytes, aWaitTimeInMicroSec);
+        NormalBytesWrittenP(bytes);
+        if (bytes < remainingBytes)
+        {
+            return false;
+        }
+    }
+    size_t bytes = WriteP(mPriorityBufO, priorityBytes, aWaitTimeInMicroSec);
+    CompactP(mPriorityBufO);
+    return bytes == priorityBytes;
+}
+
+//! Writes up to aBytes from aBuffer's get position, and advances it past what was written.
+//! @return The number of bytes written.
+size_t PakTCP_IO::WriteP(GenBuffer& aBuffer, size_t aBytes, int aWaitTimeInMicroSec)
+{
+    size_t written = 0;
+    do
+    {
+        int bytes = mConnectionPtr->SendBuffer(aWaitTimeInMicroSec, aBuffer.GetBuffer() + aBuffer.GetGetPos(), (int)(aBytes - written));
+        if (bytes <= 0)
+        {
+            break;
+        }
+        written += bytes;
+        aBuffer.SetGetPos(aBuffer.GetGetPos() + bytes);
+    } while (written < aBytes && mConnectionPtr->IsConnected());
+    return written;
+}
+
+//! Reclaims the written part of a send buffer.
+void PakTCP_IO::CompactP(GenBuffer& aBuffer)
+{
+    if (aBuffer.GetValidBytes() == 0)
+    {
+        aBuffer.Reset();
+    }
+    else if (aBuffer.GetGetPos() >= aBuffer.GetValidBytes())
+    {
+        // Most of the buffer has been sent; move the rest to the front so
+        // a connection that never fully drains does not keep growing it.
+        size_t beg = aBuffer.GetGetPos();
+        aBuffer.Move(beg, aBuffer.GetPutPos(), 0);
+        aBuffer.SetPutPos(aBuffer.GetPutPos() - beg);
+        aBuffer.SetGetPos(0);
+    }
+}
+
+//! Assigns the packet just framed at aPacketOffset in mBufO to its lane.  A high priority
+//! packet is moved to mPriorityBufO if anything is waiting to be written ahead of it.
+void PakTCP_IO::QueuePacketP(bool aHighPriority, size_t aPacketOffset, size_t aPacketBytes)
+{
+    LaneStats& stats = mLaneStats[aHighPriority ? 1 : 0];
+    ++stats.mPackets;
+    stats.mBytes += aPacketBytes;
+    bool normalWaiting = (aPacketOffset > mBufO.GetGetPos());
+    if (aHighPriority && (normalWaiting || mPriorityBufO.GetValidBytes() > 0))
+    {
+        if (normalWaiting)
+        {
+            ++stats.mOvertakes;
+        }
+        mPriorityBufO.PutRaw(mBufO.GetBuffer() + aPacketOffset, mBufO.GetPutPos() - aPacketOffset);
+        mBufO.SetPutPos(aPacketOffset);
+    }
+    else
+    {
+        mPacketSizes.push_back(aPacketBytes);
+    }
+}
+
+//! Tracks the packet boundaries in mBufO as its bytes are written.
+void PakTCP_IO::NormalBytesWrittenP(size_t aBytes)
+{
+    mPacketBytesWritten += aBytes;
+    while (!mPacketSizes.empty() && mPacketBytesWritten >= mPacketSizes.front())
+    {
+        mPacketBytesWritten -= mPacketSizes.front();
+        mPacketSizes.pop_front();
+    }
+}
+
+//! Returns the number of bytes accepted by Send() that have not yet been written to the socket.
+size_t PakTCP_IO::GetPendingSendBytes()
+{
+    std::lock_guard<std::mutex> guard(mSendMutex);
+    return mBufO.GetValidBytes() + mPriorityBufO.GetValidBytes();
+}
+
+//! Returns the send statistics of the normal and high priority lanes.
+void PakTCP_IO::GetLaneStats(LaneStats& aNormalLane, LaneStats& aPriorityLane)
+{
+    std::lock_guard<std::mutex> guard(mSendMutex);
+    aNormalLane = mLaneStats[0];
+    aNormalLane.mPendingBytes = mBufO.GetValidBytes();
+    aPriorityLane = mLaneStats[1];
+    aPriorityLane.mPendingBytes = mPriorityBufO.GetValidBytes();
+}
+
+//! Sends the buffered bytes interleaved with the blocks in mExternalData using
+//! gather writes.  Anything left unsent is copied into mBufO for a later Flush(),
+//! and mExternalData is cleared.  mSendMutex must be held.
+bool PakTCP_IO::GatherFlushP(int aWaitTimeInMicroSec)
+{
+    size_t bytesSentBefore = GetSendSocket()->GetTotalBytesSent();
+    if (mFlushBytes != 0 && mBufferedSince == 0)
+    {
+        mBufferedSince = GetSteadyTime();
+    }
+    // High priority packets go first, and the external data must be copied if they do not all fit
+    bool canWrite = FlushPriorityP(aWaitTimeInMicroSec);
+    mSegments.clear();
+    size_t offset = mBufO.GetGetPos();
+    for (const PakO::ExternalData& data : mExternalData)
+    {
+        if (data.mOffset > offset)
+        {
+            GenSockets::GenSocket::Segment buffered = {mBufO.GetBuffer() + offset, (int)(data.mOffset - offset)};
+            mSegments.push_back(buffered);
+            offset = data.mOffset;
+        }
+        GenSockets::GenSocket::Segment external = {data.mData, data.mBytes};
+        mSegments.push_back(external);
+    }
+    if (mBufO.GetPutPos() > offset)
+    {
+        GenSockets::GenSocket::Segment buffered = {mBufO.GetBuffer() + offset, (int)(mBufO.GetPutPos() - offset)};
+        mSegments.push_back(buffered);
+    }
+    mExternalData.clear();
+
+    size_t first = 0;
+    while (canWrite && first < mSegments.size() && mConnectionPtr->IsConnected())
+    {
+        int bytes = mConnectionPtr->SendBufferV(aWaitTimeInMicroSec, &mSegments[first], (int)(mSegments.size() - first));
+        if (bytes <= 0)
+        {
+            break;
+        }
+        NormalBytesWrittenP(bytes);
+        // Skip the segments that were sent, and trim a partly sent one
+        while (bytes > 0 && bytes >= mSegments[first].mBytes)
+        {
+            bytes -= mSegments[first].mBytes;
+            ++first;
+        }
         if (bytes > 0)
         {
-            totalBytes -= bytes;
-            mBufO.SetGetPos(mBufO.GetGetPos() + bytes);
+            mSegments[first].mData += bytes;
+            mSegments[first].mBytes -= bytes;
         }
-        while (totalBytes > 0 && mConnectionPtr->IsConnected())
+    }
+
+    bool sentAll = (first == mSegments.size());
+    if (sentAll)
+    {
+        mBufO.Reset();
+    }
+    else
+    {
+        // Copy what is left, as the referenced memory does not outlive Send()
+        GenBuffer remainder;
+        for (size_t i = first; i < mSegments.size(); ++i)
         {
-            bytes = mConnectionPtr->SendBuffer(aWaitTimeInMicroSec, mBufO.GetBuffer() + mBufO.GetGetPos(), totalBytes);
-            if (bytes > 0)
-            {
-                totalBytes -= bytes;
-                mBufO.SetGetPos(mBufO.GetGetPos() + bytes);
-            }
-            else
-            {
-                break;
-            }
+            remainder.PutRaw(mSegments[i].mData, mSegments[i].mBytes);
         }
-        if (mBufO.GetValidBytes() == 0)
+        mBufO.SwapBuffer(remainder);
+        if (mFlushBytes != 0)
         {
-            mBufO.Reset();
+            mFlushDeadline.store(mBufferedSince + mFlushDelay, std::memory_order_relaxed);
         }
     }
-    sendMutex.unlock();
-    return totalBytes == 0;
+    mSegments.clear();
+    FlushedP(bytesSentBefore);
+    return sentAll;
 }
 
 GenSockets::GenSocket* PakTCP_IO::GetRecvSocket() const
@@ -168,6 +532,121 @@ GenSockets::GenSocket* PakTCP_IO::GetSendSocket() const
     return mConnectionPtr->GetSocket();
 }
 
+//! Sets how received data is buffered.  The buffer grows for a packet larger than its
+//! current size, and returns to aInitialSize once it is empty and no large packet has
+//! arrived for aShrinkDelay.  The default is 64 KB, growing to at most 256 MB, shrinking after 10 seconds.
+//! @param aInitialSize The normal size of the receive buffer in bytes.
+//! @param aMaximumSize The largest packet accepted.  The connection is closed if a larger packet arrives,
+//!                     a compressed packet which would decompress to more is dropped.
+//! @param aShrinkDelay Seconds to keep a grown buffer.
+void PakTCP_IO::SetReceiveBufferOptions(size_t aInitialSize, size_t aMaximumSize, double aShrinkDelay)
+{
+    std::lock_guard<std::mutex> guard(mReceiveMutex);
+    mReceiveBufferSize = std::max(aInitialSize, (size_t)mHeaderSize);
+    mMaximumReceiveBufferSize = std::max(aMaximumSize, mReceiveBufferSize);
+    SetMaximumInflatedSize(mMaximumReceiveBufferSize);
+    mShrinkDelay = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(aShrinkDelay));
+    ResizeReceiveBuffer(std::max(mReceiveBufferSize, mBufI.GetValidBytes()));
+}
+
+//! Returns the current capacity of the receive buffer in bytes.
+size_t PakTCP_IO::GetReceiveBufferSize() const
+{
+    return mReceiveRing.IsValid() ? mReceiveRing.GetCapacity() : mBufI.GetBytes();
+}
+
+//! Replaces the receive buffer, keeping any unread data.
+//! Uses a GenRingBuffer if possible, otherwise a plain buffer.
+bool PakTCP_IO::ResizeReceiveBuffer(size_t aBytes)
+{
+    size_t validBytes = mBufI.GetValidBytes();
+    const char* validPtr = mBufI.GetBuffer() + mBufI.GetGetPos();
+    GenRingBuffer ring;
+    if (ring.Create(aBytes))
+    {
+        std::copy(validPtr, validPtr + validBytes, ring.GetData());
+        mBufI.SetBuffer(ring.GetData(), 2 * ring.GetCapacity(), false);
+        // The previous ring, if any, is released when 'ring' goes out of scope
+        mReceiveRing.Swap(ring);
+    }
+    else
+    {
+        char* dataPtr = new char[aBytes];
+        std::copy(validPtr, validPtr + validBytes, dataPtr);
+        mBufI.SetBuffer(dataPtr, aBytes, true);
+        mReceiveRing.Release();
+    }
+    mBufI.SetPutPos(validBytes);
+    return true;
+}
+
+//! Reads available data from the socket into the receive buffer, and records when it arrived.
+//! @return The number of bytes read.
+int PakTCP_IO::ReceiveMore(int aWaitTimeMicroSeconds)
+{
+    int bytesRead;
+    if (mReceiveRing.IsValid())
+    {
+        size_t capacity = mReceiveRing.GetCapacity();
+        if (mBufI.GetGetPos() >= capacity)
+        {
+            // The second half maps the same memory as the first, so this moves no data
+            mBufI.SetGetPos(mBufI.GetGetPos() - capacity);
+            mBufI.SetPutPos(mBufI.GetPutPos() - capacity);
+        }
+        int freeBytes = (int)(mBufI.GetGetPos() + capacity - mBufI.GetPutPos());
+        if (freeBytes <= 0)
+        {
+            return 0;
+        }
+        bytesRead = mConnectionPtr->ReceiveBuffer(aWaitTimeMicroSeconds, mBufI, freeBytes);
+    }
+    else
+    {
+        bytesRead = mConnectionPtr->ReceiveBuffer(aWaitTimeMicroSeconds, mBufI);
+    }
+    if (bytesRead > 0)
+    {
+        SetReceiveTime(GetSteadyTime());
+    }
+    return bytesRead;
+}
+
+//! Makes sure a packet of aPacketLength bytes fits in the receive buffer.
+//! @return 'false' if the packet is larger than the maximum receive buffer size.
+bool PakTCP_IO::ReserveReceiveSpace(size_t aPacketLength)
+{
+    if (aPacketLength > mReceiveBufferSize)
+    {
+        mLastLargePacketTime = std::chrono::steady_clock::now();
+    }
+    size_t capacity = GetReceiveBufferSize();
+    if (aPacketLength <= capacity)
+    {
+        return true;
+    }
+    if (aPacketLength > mMaximumReceiveBufferSize)
+    {
+        return false;
+    }
+    if (mReceiveRing.IsValid())
+    {
+        return ResizeReceiveBuffer(std::min(std::max(aPacketLength, 2 * capacity), mMaximumReceiveBufferSize));
+    }
+    mBufI.GrowBy(aPacketLength - capacity);
+    return true;
+}
+
+//! Returns a grown receive buffer to its initial size if no large packet arrived recently.
+//! Precondition: The receive buffer is empty.
+void PakTCP_IO::ShrinkIfIdle()
+{
+    if (GetReceiveBufferSize() > mReceiveBufferSize && std::chrono::steady_clock::now() - mLastLargePacketTime > mShrinkDelay)
+    {
+        ResizeReceiveBuffer(mReceiveBufferSize);
+    }
+}
+
 //! Receive a PakPacket header from the stream.
 //! @param aPacketId The ID of the incoming packet
 //! @param aPacketLength The length of the incoming packet
@@ -185,19 +664,16 @@ bool PakTCP_IO::ReceiveHeader(int& aPacketId, int& aPacketLength, int aWaitTimeM
             if (validBytes == 0)
             {
                 mBufI.Reset();
-                mConnectionPtr->ReceiveBuffer(aWaitTimeMicroSeconds, mBufI);
+                ShrinkIfIdle();
             }
-            else
+            // Not enough room in the buffer for a header
+            else if (!mReceiveRing.IsValid() && (int)mBufI.GetBytes() - (int)mBufI.GetGetPos() < mHeaderSize)
             {
-                // Not enough room in the buffer for a header
-                if ((int)mBufI.GetBytes() - (int)mBufI.GetGetPos() < mHeaderSize)
-                {
-                    mBufI.Move(mBufI.GetGetPos(), mBufI.GetPutPos(), 0);
-                    mBufI.SetPutPos(mBufI.GetPutPos() - mBufI.GetGetPos());
-                    mBufI.SetGetPos(0);
-                }
-                mConnectionPtr->ReceiveBuffer(aWaitTimeMicroSeconds, mBufI);
+                mBufI.Move(mBufI.GetGetPos(), mBufI.GetPutPos(), 0);
+                mBufI.SetPutPos(mBufI.GetPutPos() - mBufI.GetGetPos());
+                mBufI.SetGetPos(0);
             }
+            ReceiveMore(aWaitTimeMicroSeconds);
             readyToReadHeader = (mHeaderSize <= (int)mBufI.GetValidBytes());
         }
 
@@ -208,23 +684,33 @@ bool PakTCP_IO::ReceiveHeader(int& aPacketId, int& aPacketLength, int aWaitTimeM
             {
                 mBufI.GetGetPos() += mHeaderPacketLength;
             }
+            else if (!ReserveReceiveSpace(mHeaderPacketLength))
+            {
+                // The rest of the stream can't be parsed without reading this packet
+                std::cout << "Received packet larger than the receive buffer limit."
+                          << " ID: " << mHeaderPacketId
+                          << " Length: " << mHeaderPacketLength << " bytes"
+                          << " Limit: " << mMaximumReceiveBufferSize << " bytes"
+                          << std::endl;
+                mConnectionPtr->GetSocket()->Close();
+            }
             else
             {
-                int remainderSpace = (int)mBufI.GetBytes() - mHeaderPacketLength;
-                if (remainderSpace < 0)
-                {
-                    mBufI.GrowBy(-remainderSpace);
-                }
-                assert(mHeaderPacketLength <= (int)mBufI.GetBytes());
+                assert(mHeaderPacketLength <= (int)GetReceiveBufferSize());
                 mHasReadHeader = true;
             }
         }
     }
     if (mHasReadHeader)
     {
+        bool wasReadyToRead = mPacketReadyToRead;
         mPacketReadyToRead = PacketReadyToRead(aWaitTimeMicroSeconds);
+        if (mPacketReadyToRead && !wasReadyToRead)
+        {
+            CapturePacket(mBufI, mHeaderPacketId, mHeaderPacketLength);
+        }
         aPacketId = mHeaderPacketId;
-        aPacketLength = mHeaderPacketLength;
+        aPacketLength = GetDecompressedLength(mHeaderPacketLength);
     }
     return mPacketReadyToRead;
 }
@@ -234,32 +720,55 @@ bool PakTCP_IO::ReceiveHeader(int& aPacketId, int& aPacketLength, int aWaitTimeM
 //! @return 'true' if the PakPacket was successfully read.
 bool PakTCP_IO::Receive(PakPacket& aPkt)
 {
-    bool isLocked = receiveMutex.try_lock();
+    bool isLocked = mReceiveMutex.try_lock();
     bool lReturn = false;
     if (mPacketReadyToRead)
     {
+        PakProcessor::PacketInfo* info = mPakProcessorPtr->GetPacketInfo(aPkt.ID());
+        int packetLength = GetDecompressedLength(mHeaderPacketLength);
+        if (!BeginInflate(mBufI, mHeaderPacketLength - mHeaderSize))
+        {
+            std::cout << "Could not decompress packet."
+                      << " Name: " << info->GetPacketName()
+                      << " ID: " << aPkt.ID()
+                      << std::endl;
+            mBufI.GetGetPos() += mHeaderPacketLength - mHeaderSize;
+            mHasReadHeader = false;
+            mPacketReadyToRead = false;
+            if (isLocked)
+            {
+                mReceiveMutex.unlock();
+            }
+            return false;
+        }
+
         int beforeOff = (int)mBufI.GetGetPos();
 
-        PakProcessor::PacketInfo* info = mPakProcessorPtr->GetPacketInfo(aPkt.ID());
         (*info->mReadFn)(aPkt, *mSerializeReader);
 
         int afterOff = (int)mBufI.GetGetPos();
+        EndInflate(mBufI);
 
-        if (afterOff - beforeOff + mHeaderSize != mHeaderPacketLength)
+        if (afterOff - beforeOff + mHeaderSize != packetLength)
         {
             { // RAII block
                 std::cout << "Detected error receiving packet."
                           << " Name: " << info->GetPacketName()
                           << " ID: " << aPkt.ID()
                           << " Expected: " << (afterOff - beforeOff) + mHeaderSize << " bytes"
-                          << " Received: " << mHeaderPacketLength << " bytes"
+                          << " Received: " << packetLength << " bytes"
                           << std::endl;
             }
+            // The stream can't be parsed past a packet of the wrong length, so drop the connection
+            mConnectionPtr->GetSocket()->Close();
+            mBufI.Reset();
+            mHasReadHeader = false;
+            mPacketReadyToRead = false;
             if (isLocked)
             {
-                receiveMutex.unlock();
+                mReceiveMutex.unlock();
             }
-            exit(1);
+            return false;
         }
         beforeOff = afterOff = 0;
         mHasReadHeader = false;
@@ -268,7 +777,7 @@ bool PakTCP_IO::Receive(PakPacket& aPkt)
     }
     if (isLocked)
     {
-        receiveMutex.unlock();
+        mReceiveMutex.unlock();
     }
     return lReturn;
 }
@@ -276,7 +785,7 @@ bool PakTCP_IO::Receive(PakPacket& aPkt)
 // Deprecated method for receiving certain packet types
 bool PakTCP_IO::Receive(char* aBuffer, int aSize)
 {
-    std::lock_guard<std::mutex> guard(receiveMutex);
+    std::lock_guard<std::mutex> guard(mReceiveMutex);
     bool lReturn = false;
     if (mPacketReadyToRead)
     {
@@ -289,7 +798,7 @@ bool PakTCP_IO::Receive(char* aBuffer, int aSize)
 //! Returns a new received packet if one is available, null otherwise
 PakPacket* PakTCP_IO::ReceiveNew()
 {
-    std::lock_guard<std::mutex> guard(receiveMutex);
+    std::lock_guard<std::mutex> guard(mReceiveMutex);
     return mPakProcessorPtr->ReadPacket(*this);
 }
 
@@ -321,6 +830,12 @@ bool PakTCP_IO::PacketReadyToRead(int aWaitTimeMicroSeconds)
     int pktRemainingBytes = pktSize - remainingBytes;
     int bytesRead = 1;
 
+    while (pktRemainingBytes > 0 && bytesRead > 0 && mReceiveRing.IsValid())
+    {
+        // The ring always has room for the rest of the packet
+        bytesRead = ReceiveMore(aWaitTimeMicroSeconds);
+        pktRemainingBytes -= bytesRead;
+    }
     while (pktRemainingBytes > 0 && bytesRead > 0)
     {
         int unusedBytes = (int)(mBufI.GetBytes() - mBufI.GetPutPos());
@@ -336,6 +851,10 @@ bool PakTCP_IO::PacketReadyToRead(int aWaitTimeMicroSeconds)
         {
             bytesRead = mConnectionPtr->ReceiveBuffer(aWaitTimeMicroSeconds, mBufI, pktRemainingBytes);
         }
+        if (bytesRead > 0)
+        {
+            SetReceiveTime(GetSteadyTime());
+        }
         pktRemainingBytes -= bytesRead;
     }
     return pktRemainingBytes <= 0;
@@ -3,21 +3,69 @@
 
 #include "NXPacketIO_Export.h"
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "GenIO/GenRingBuffer.h"
+#include "GenIO/GenSocket.h"
 #include "PacketIO/PakDefaultHeader.h"
+#include "PacketIO/PakO.h"
 #include "PacketIO/PakSocketIO.h"
+#include "Util/UtHistogram.h"
 
 class GenTCP_Connection;
 class PakPacket;
 class PakProcessor;
-class PakO;
 class PakI;
 
 //! Sends packets via TCP.
 //! A packet's size is only limited by the size of the GenIO receive buffer
+//! Data serialized with RawDataRef() is sent straight from the packet's memory
+//! with a gather write, rather than copied into the send buffer.
+//! Received data is reassembled in a GenRingBuffer where the platform supports it,
+//! so packets are decoded in place and partial packets are never moved.
+//! Packets registered with PakProcessor::cHIGH_PRIORITY are buffered separately while
+//! other packets wait to be written, and are written as soon as the packet being written
+//! is complete.
+//! By default each packet is written as soon as it is sent.  See SetFlushPolicy() to batch
+//! packets, and BeginManualFlush() to batch them by hand.
 class NX_PACKETIO_EXPORT PakTCP_IO : public PakSocketIO
 {
 public:
     static const int cLARGE_WAIT_TIME = 100000000;
+
+    //! Send statistics for one priority lane.
+    struct LaneStats
+    {
+        //! Packets and bytes accepted by Send()
+        uint64_t mPackets;
+        uint64_t mBytes;
+        //! Bytes accepted by Send() that are not yet written to the socket
+        size_t mPendingBytes;
+        //! High priority packets queued ahead of normal packets that were waiting to be written
+        uint64_t mOvertakes;
+    };
+
+    //! Statistics of the writes to the socket, see SetFlushPolicy().
+    struct FlushStats
+    {
+        //! Flushes that wrote to the socket, and the bytes they wrote.
+        //! mBytes / mFlushes is the average bytes per flush.
+        uint64_t mFlushes;
+        uint64_t mBytes;
+        //! Flushes started because the byte threshold of SetFlushPolicy() was reached
+        uint64_t mThresholdFlushes;
+        //! Flushes started because the latency budget of SetFlushPolicy() expired
+        uint64_t mDeadlineFlushes;
+        //! How long the oldest byte of each flush waited to be written, in nanoseconds.
+        //! Only recorded while SetFlushPolicy() is in effect.
+        UtHistogram::Snapshot mBufferTime;
+    };
+
     PakTCP_IO(GenTCP_Connection* aConnectionPtr, PakProcessor* aProcessor, PakHeader* aHeaderType = new PakDefaultHeader);
     ~PakTCP_IO() override;
 
@@ -27,6 +75,10 @@ public:
 
     bool Send(char* aBuffer, int aSize, int aPacketId, int aWaitTimeMicroSeconds = cLARGE_WAIT_TIME);
 
+    bool SendEncoded(PakEncodedPacket& aPkt) override;
+
+    bool SendEncoded(PakEncodedPacket& aPkt, int aWaitTimeMicroSeconds);
+
     bool ReceiveHeader(int& aPacketId, int& aPacketLength, int aWaitTimeMicroSeconds) override;
 
     bool Receive(PakPacket& aPkt) override;
@@ -35,7 +87,7 @@ public:
 
     bool Receive(char* aBuffer, int aSize);
 
-    bool IsConnected();
+    bool IsConnected() override;
 
     void IgnorePacket() override;
 
@@ -43,6 +95,10 @@ public:
 
     void SetMaximumPacketSize(int aSize) { mMaximumPacketSize = aSize; }
 
+    void SetReceiveBufferOptions(size_t aInitialSize, size_t aMaximumSize, double aShrinkDelay);
+
+    size_t GetReceiveBufferSize() const;
+
     void BeginManualFlush() { ++mManualFlushCount; }
 
     void EndManualFlush()
@@ -57,9 +113,21 @@ public:
 
     bool Flush(int aWaitTimeInMicroSec = 100000000);
 
+    void SetFlushPolicy(size_t aFlushBytes, double aMaximumDelay);
+
+    bool FlushIfDue(int aWaitTimeInMicroSec = 100000000);
+
+    double GetTimeToFlush() const;
+
+    void GetFlushStats(FlushStats& aStats);
+
+    size_t GetPendingSendBytes();
+
+    void GetLaneStats(LaneStats& aNormalLane, LaneStats& aPriorityLane);
+
     void SetConnection(GenTCP_Connection* aConnectionPtr) { mConnectionPtr = aConnectionPtr; }
 
-    PakProcessor* GetPakProcessor() const { return mPakProcessorPtr; }
+    PakProcessor* GetPakProcessor() const override { return mPakProcessorPtr; }
 
     GenSockets::GenSocket* GetRecvSocket() const override;
 
@@ -72,6 +140,11 @@ protected:
     bool ReadMoreTCP();
     bool ReadToBoundaryTCP();
 
+    int ReceiveMore(int aWaitTimeMicroSeconds);
+    bool ReserveReceiveSpace(size_t aPacketLength);
+    void ShrinkIfIdle();
+    bool ResizeReceiveBuffer(size_t aBytes);
+
     PakProcessor* mPakProcessorPtr;
     GenTCP_Connection* mConnectionPtr;
     GenBuffer mBufO;
@@ -89,9 +162,49 @@ private:
     // prevent copying
     PakTCP_IO(const PakTCP_IO&);
     PakTCP_IO& operator=(const PakTCP_IO&);
+    bool FlushP(int aWaitTimeInMicroSec);
+    bool WriteBuffersP(int aWaitTimeInMicroSec);
+    bool FlushPriorityP(int aWaitTimeInMicroSec);
+    bool GatherFlushP(int aWaitTimeInMicroSec);
+    bool FlushIfNeededP(bool aHighPriority, int aWaitTimeInMicroSec);
+    void FlushedP(size_t aBytesSentBefore);
+    size_t WriteP(GenBuffer& aBuffer, size_t aBytes, int aWaitTimeInMicroSec);
+    void QueuePacketP(bool aHighPriority, size_t aPacketOffset, size_t aPacketBytes);
+    void NormalBytesWrittenP(size_t aBytes);
+    static void CompactP(GenBuffer& aBuffer);
+    std::mutex mSendMutex;
+    //! High priority packets waiting for the packet being written from mBufO to complete
+    GenBuffer mPriorityBufO;
+    //! Sizes of the packets in mBufO that are not completely written, oldest first
+    std::deque<size_t> mPacketSizes;
+    //! Bytes of mPacketSizes.front() already written
+    size_t mPacketBytesWritten;
+    //! Indexed by 0 for the normal lane and 1 for the high priority lane
+    LaneStats mLaneStats[2];
+    //! Bytes buffered before SetFlushPolicy() flushes, 0 if it is not in effect
+    size_t mFlushBytes;
+    //! Latency budget of SetFlushPolicy(), in nanoseconds
+    int64_t mFlushDelay;
+    //! When the oldest buffered byte was sent and when it must be written, in steady clock
+    //! nanoseconds.  0 while nothing is buffered.  The deadline is read without mSendMutex.
+    int64_t mBufferedSince;
+    std::atomic<int64_t> mFlushDeadline;
+    FlushStats mFlushStats;
+    UtHistogram mBufferTime;
+    std::mutex mReceiveMutex;
+    //! Blocks of the packet being sent that are referenced rather than copied into mBufO
+    PakO::ExternalDataList mExternalData;
+    std::vector<GenSockets::GenSocket::Segment> mSegments;
     int mHeaderSize;
     int mManualFlushCount;
     int mSendBufferSize;
     int mMaximumPacketSize;
+    //! Backs mBufI when valid.  mBufI then spans both mappings.
+    GenRingBuffer mReceiveRing;
+    size_t mReceiveBufferSize;
+    size_t mMaximumReceiveBufferSize;
+    std::chrono::steady_clock::duration mShrinkDelay;
+    //! When a packet last needed more than mReceiveBufferSize
+    std::chrono::steady_clock::time_point mLastLargePacketTime;
 };
 #endif
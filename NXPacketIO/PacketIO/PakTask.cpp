@@ -0,0 +1,67 @@
+﻿#include "PacketIO/PakTask.h"
+
+#include <new>
+#include <vector>
+
+namespace
+{
+const size_t cSIZE_STEP = 64;
+const size_t cCLASS_COUNT = PakFramePool::cMAXIMUM_POOLED_BYTES / cSIZE_STEP;
+//! Most idle frames kept by a thread in each size class
+const size_t cMAXIMUM_IDLE_FRAMES = 4096;
+
+//! Per-thread free lists, indexed by size class.
+//! Frames still cached when the thread exits are freed.
+struct ThreadFreeLists
+{
+    ~ThreadFreeLists()
+    {
+        for (size_t i = 0; i < cCLASS_COUNT; ++i)
+        {
+            for (size_t j = 0; j < mFreeLists[i].size(); ++j)
+            {
+                ::operator delete(mFreeLists[i][j]);
+            }
+        }
+    }
+    std::vector<void*> mFreeLists[cCLASS_COUNT];
+};
+
+thread_local ThreadFreeLists tFreeLists;
+} // namespace
+
+//! Returns a frame of at least aBytes, from the calling thread's free list if possible.
+void* PakFramePool::Allocate(size_t aBytes)
+{
+    if (aBytes == 0 || aBytes > cMAXIMUM_POOLED_BYTES)
+    {
+        return ::operator new(aBytes);
+    }
+    size_t sizeClass = (aBytes - 1) / cSIZE_STEP;
+    std::vector<void*>& freeList = tFreeLists.mFreeLists[sizeClass];
+    if (freeList.empty())
+    {
+        return ::operator new((sizeClass + 1) * cSIZE_STEP);
+    }
+    void* framePtr = freeList.back();
+    freeList.pop_back();
+    return framePtr;
+}
+
+//! Returns a frame from Allocate() to the calling thread's free list.
+//! @param aBytes The size passed to Allocate()
+void PakFramePool::Free(void* aPtr, size_t aBytes)
+{
+    if (aBytes == 0 || aBytes > cMAXIMUM_POOLED_BYTES)
+    {
+        ::operator delete(aPtr);
+        return;
+    }
+    std::vector<void*>& freeList = tFreeLists.mFreeLists[(aBytes - 1) / cSIZE_STEP];
+    if (freeList.size() >= cMAXIMUM_IDLE_FRAMES)
+    {
+        ::operator delete(aPtr);
+        return;
+    }
+    freeList.push_back(aPtr);
+}
@@ -0,0 +1,66 @@
+﻿#ifndef PAKTASK_H
+#define PAKTASK_H
+
+#include "NXPacketIO_Export.h"
+
+#include <cstddef>
+#include <exception>
+
+#ifdef __cpp_impl_coroutine
+#include <coroutine>
+#endif
+
+//! Recycles coroutine frames, so starting a PakTask does not allocate once the pool is warm.
+//! Frames are grouped by size in 64 byte steps.  Each thread keeps its own free lists, frames
+//! larger than cMAXIMUM_POOLED_BYTES or released to a full list go to the heap.
+class NX_PACKETIO_EXPORT PakFramePool
+{
+public:
+    static const size_t cMAXIMUM_POOLED_BYTES = 4096;
+
+    static void* Allocate(size_t aBytes);
+
+    static void Free(void* aPtr, size_t aBytes);
+};
+
+#ifdef __cpp_impl_coroutine
+
+//! The return type of a coroutine handling packets.  Calling the coroutine runs it until its
+//! first co_await, it is then resumed by the PakProcessor it awaits.  See PakProcessor::Receive().
+//! The task is not owned by the caller, its frame is released to PakFramePool when it returns.
+//!
+//! @code
+//! PakTask Query(PakProcessor& aProcessor, PakTCP_IO& aIO, int aRequestId)
+//! {
+//!     RequestPkt request;
+//!     request.mRequestId = aRequestId;
+//!     aIO.Send(request);
+//!     ReplyPkt* replyPtr = co_await aProcessor.ReceiveMatching<ReplyPkt>(
+//!         [aRequestId](ReplyPkt& aReply) { return aReply.mRequestId == aRequestId; }, 2.0);
+//!     if (replyPtr == nullptr)
+//!     {
+//!         // timed out
+//!     }
+//! }
+//! @endcode
+//!
+//!@note An exception escaping the coroutine calls std::terminate().
+class PakTask
+{
+public:
+    struct promise_type
+    {
+        PakTask get_return_object() noexcept { return PakTask(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+
+        static void* operator new(size_t aBytes) { return PakFramePool::Allocate(aBytes); }
+        static void operator delete(void* aPtr, size_t aBytes) { PakFramePool::Free(aPtr, aBytes); }
+    };
+};
+
+#endif
+
+#endif
@@ -1,30 +1,89 @@
 ﻿#include "PacketIO/PakThreadedIO.h"
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 
 #include "GenIO/GenInternetSocketAddress.h"
+#include "GenIO/GenSocket.h"
 #include "GenIO/GenTCP_IO.h"
 #include "GenIO/GenUDP_IO.h"
+#include "PacketIO/PakEncodedPacket.h"
 #include "PacketIO/PakProcessor.h"
+#include "PacketIO/PakSharedMemoryIO.h"
 #include "PacketIO/PakTCP_IO.h"
 #include "PacketIO/PakUDP_IO.h"
 
 // Split into reactor thread, and send thread...
 
-PakThreadedIO::PakThreadedIO()
-    : mStopping(false), mHandlerAccess(1)
+//! @param aBackend The reactor backend used to wait for incoming data.
+PakThreadedIO::PakThreadedIO(PakSocketReactor::Backend aBackend /*= PakSocketReactor::cSELECT_BACKEND*/)
+    : mBackend(aBackend), mShardPolicy(cLEAST_LOADED), mNextShard(0), mQueueCapacity(16384), mOverflowPolicy(cGROW), mSendMode(cBLOCKING_SEND), mHighWatermark(4 << 20), mLowWatermark(1 << 20), mWakeupPending(false)
 {
+    mShards.push_back(new Shard(this, 0, aBackend));
 }
 
 PakThreadedIO::~PakThreadedIO()
 {
-    for (size_t i = 0; i < mHandlers.size(); ++i)
+    for (size_t i = 0; i < mShards.size(); ++i)
     {
-        Handler* handlerPtr = mHandlers[i];
-        delete handlerPtr;
+        delete mShards[i];
     }
 }
 
+//! Sets the number of reactor threads that read the connections, and how connections
+//! are assigned to them.  Each connection is read by a single shard, so its packets
+//! keep their order.  Must be called before AddIO() and Start().
+//! @param aShardCount The number of reactor threads.  0 uses one per core.
+//! @param aPolicy How a new connection picks its shard.
+void PakThreadedIO::SetShardOptions(size_t aShardCount, ShardPolicy aPolicy)
+{
+    for (size_t i = 0; i < mShards.size(); ++i)
+    {
+        if (mShards[i]->mConnectionCount != 0)
+        {
+            std::cout << "PakThreadedIO: Shard options must be set before IO is added." << std::endl;
+            return;
+        }
+    }
+    if (aShardCount == 0)
+    {
+        aShardCount = std::max(UtThread::GetCoreCount(), 1U);
+    }
+    while (mShards.size() > aShardCount)
+    {
+        delete mShards.back();
+        mShards.pop_back();
+    }
+    while (mShards.size() < aShardCount)
+    {
+        mShards.push_back(new Shard(this, mShards.size(), mBackend));
+    }
+    mShardPolicy = aPolicy;
+    mNextShard = 0;
+}
+
+//! Picks the shard that reads a new connection.
+//! The other shards are running, so their connection counts are read rather than their handlers.
+PakThreadedIO::Shard* PakThreadedIO::SelectShard()
+{
+    if (mShardPolicy == cROUND_ROBIN)
+    {
+        Shard* shardPtr = mShards[mNextShard];
+        mNextShard = (mNextShard + 1) % mShards.size();
+        return shardPtr;
+    }
+    Shard* shardPtr = mShards[0];
+    for (size_t i = 1; i < mShards.size(); ++i)
+    {
+        if (mShards[i]->mConnectionCount < shardPtr->mConnectionCount)
+        {
+            shardPtr = mShards[i];
+        }
+    }
+    return shardPtr;
+}
+
 //! Precondition: PakTCP_IO is connected
 //! Handles receiving and sending for a PakTCP_IO.  PakThreadedIO gains control
 //! of the IO class, and send or receive methods should only be called through this class.
@@ -32,140 +91,423 @@ PakThreadedIO::~PakThreadedIO()
 //! @param aConnectionPtr Sets incoming packets' getSender() value to this connection
 void PakThreadedIO::AddIO(PakSocketIO* aIOPtr, PakConnection* aConnectionPtr /*= 0*/)
 {
-    Pause();
-    Handler* handler = new Handler(this, aIOPtr, aConnectionPtr);
-    mReactor.Connect(aIOPtr->GetRecvSocket(), &Handler::Handle, handler);
-    mHandlers.push_back(handler);
-    Resume();
+    Shard* shardPtr = SelectShard();
+    shardPtr->Pause();
+    Handler* handler = new Handler(this, shardPtr, aIOPtr, aConnectionPtr);
+    shardPtr->mReactor.Connect(aIOPtr->GetRecvSocket(), &Handler::Handle, handler);
+    if (handler->IsQueuedSend() && handler->IsTCP())
+    {
+        shardPtr->mReactor.ConnectWrite(aIOPtr->GetSendSocket(), &Handler::HandleWrite, handler);
+    }
+    shardPtr->mHandlers.push_back(handler);
+    ++shardPtr->mConnectionCount;
+    if (handler->HasTimers())
+    {
+        shardPtr->mTimedHandlers.push_back(handler);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mSendHandlersLock);
+        mSendHandlers[aIOPtr] = handler;
+    }
+    shardPtr->Resume();
 }
 
 //! Stops handling sending/receiving for a PakTCP_IO.
 //! @param aIOPtr The PakTCP_IO to stop handling.
 void PakThreadedIO::RemoveIO(PakSocketIO* aIOPtr)
 {
-    Pause();
-    RemoveIO_P(aIOPtr, true); // Don't notify the user
+    for (size_t i = 0; i < mShards.size(); ++i)
+    {
+        Shard* shardPtr = mShards[i];
+        shardPtr->Pause();
+        bool removed = shardPtr->RemoveIO_P(aIOPtr, true);
+        shardPtr->Resume();
+        if (removed)
+        {
+            break;
+        }
+    }
     ProcessRemovedHandlers();
-    Resume();
 }
 
-//! Pauses the reactor thread
-void PakThreadedIO::Pause()
+//! Sends a packet through the handler's send queue.  SendBudgetExceeded is invoked after
+//! mSendHandlersLock is released, so a callback may remove the IO.
+//! @param aHandled Set to 'false' if the IO is not handled by this PakThreadedIO.
+template <typename PACKET>
+bool PakThreadedIO::QueuedSend(PakSocketIO* aIOPtr, PACKET& aPacket, bool& aHandled)
 {
-    std::lock_guard<std::recursive_mutex> lock(mReactorLock);
-    mReactor.Stop();
-    mHandlerAccess.Acquire();
-}
-
-void PakThreadedIO::Resume()
-{
-    mHandlerAccess.Release();
+    bool accepted = true;
+    bool exceededBudget = false;
+    PakConnection* connectionPtr = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mSendHandlersLock);
+        std::map<PakSocketIO*, Handler*>::iterator iter = mSendHandlers.find(aIOPtr);
+        aHandled = (iter != mSendHandlers.end());
+        if (aHandled)
+        {
+            accepted = iter->second->Send(aPacket, exceededBudget);
+            connectionPtr = iter->second->GetConnection();
+        }
+    }
+    if (exceededBudget)
+    {
+        SendBudgetExceeded(aIOPtr, connectionPtr);
+    }
+    return accepted;
 }
 
-void PakThreadedIO::RemoveIO_P(PakSocketIO* aIOPtr, bool aNotifyUser)
+//! Sends a message using a PakTCP_IO.  PakThreadedIO will handle the deletion
+//! of the packet.  Sends in a blocking mode unless cQUEUED_SEND is set with SetSendOptions().
+//! @return 'false' if the packet was refused because the connection's send queue is over budget.
+bool PakThreadedIO::Send(PakSocketIO* aIOPtr, PakPacket& aPacket)
 {
-    for (size_t i = 0; i < mHandlers.size(); ++i)
+    if (mSendMode == cQUEUED_SEND)
     {
-        PakSocketIO* io = mHandlers[i]->GetIO();
-        if (io == aIOPtr)
+        bool handled;
+        bool accepted = QueuedSend(aIOPtr, aPacket, handled);
+        if (handled)
         {
-            mReactor.Disconnect(io->GetRecvSocket());
-            Handler* handlerPtr = mHandlers[i];
-            mHandlers.erase(mHandlers.begin() + i);
-            if (aNotifyUser)
-            {
-                mRemovedHandlers.push_back(handlerPtr);
-            }
-            else
-            {
-                delete handlerPtr;
-            }
-            break;
+            return accepted;
         }
     }
+    aIOPtr->Send(aPacket);
+    return true;
 }
 
-//! Sends a message using a PakTCP_IO.  PakThreadedIO will handle the deletion
-//! of the packet.  Currently just sends in a blocking mode.
-void PakThreadedIO::Send(PakSocketIO* aIOPtr, PakPacket& aPacket)
+//! Sends an encoded message, see Send(PakSocketIO*, PakPacket&).
+bool PakThreadedIO::Send(PakSocketIO* aIOPtr, PakEncodedPacket& aPacket)
 {
-    aIOPtr->Send(aPacket);
+    if (mSendMode == cQUEUED_SEND)
+    {
+        bool handled;
+        bool accepted = QueuedSend(aIOPtr, aPacket, handled);
+        if (handled)
+        {
+            return accepted;
+        }
+    }
+    aIOPtr->SendEncoded(aPacket);
+    return true;
 }
 
 //! Sends a message to multiple recipients.  PakThreadedIO will handle the deletion
-//! of the packet.  Currently just sends in a blocking mode.
+//! of the packet.  The packet is serialized once and the bytes are shared by all recipients.
+//! With cQUEUED_SEND, a slow recipient does not delay the others.
 void PakThreadedIO::Send(const std::vector<PakSocketIO*>& aIO_List, PakPacket& aPacket)
 {
+    if (aIO_List.empty())
+    {
+        return;
+    }
+    if (aIO_List.size() == 1)
+    {
+        Send(aIO_List[0], aPacket);
+        return;
+    }
+    PakEncodedPacket encoded(aPacket);
     for (size_t i = 0; i < aIO_List.size(); ++i)
     {
-        aIO_List[i]->Send(aPacket);
+        Send(aIO_List[i], encoded);
     }
 }
 
 //! Sends a message to all connections handled by PakThreadedIO
-//! Currently just sends in a blocking mode
+//! The packet is serialized once and the bytes are shared by all recipients.
+//! With cQUEUED_SEND, a slow recipient does not delay the others.
+//! The connections are listed from mSendHandlers, as the shards' reactors may be adding or
+//! removing handlers.
 void PakThreadedIO::SendToAll(PakPacket& aPacket)
 {
-    for (size_t i = 0; i < mHandlers.size(); ++i)
+    if (mSendMode == cBLOCKING_SEND)
     {
-        mHandlers[i]->GetIO()->Send(aPacket);
+        std::lock_guard<std::mutex> lock(mSendHandlersLock);
+        if (mSendHandlers.size() == 1)
+        {
+            mSendHandlers.begin()->first->Send(aPacket);
+            return;
+        }
+        PakEncodedPacket encoded(aPacket);
+        for (std::map<PakSocketIO*, Handler*>::iterator i = mSendHandlers.begin(); i != mSendHandlers.end(); ++i)
+        {
+            i->first->SendEncoded(encoded);
+        }
+        return;
+    }
+    PakEncodedPacket encoded(aPacket);
+    std::vector<std::pair<PakSocketIO*, PakConnection*>> overBudget;
+    {
+        std::lock_guard<std::mutex> lock(mSendHandlersLock);
+        for (std::map<PakSocketIO*, Handler*>::iterator i = mSendHandlers.begin(); i != mSendHandlers.end(); ++i)
+        {
+            bool exceededBudget = false;
+            i->second->Send(encoded, exceededBudget);
+            if (exceededBudget)
+            {
+                overBudget.emplace_back(i->first, i->second->GetConnection());
+            }
+        }
+    }
+    // Invoked without the lock, so a callback may remove the IO
+    for (size_t i = 0; i < overBudget.size(); ++i)
+    {
+        SendBudgetExceeded(overBudget[i].first, overBudget[i].second);
     }
 }
 
-//! Invokes callbacks associated with received packets
+//! Invokes callbacks associated with received packets.
+//! High priority packets from every connection are processed first.  Packets of one
+//! priority from one connection are processed in the order they were received.
 void PakThreadedIO::Process()
 {
-    for (size_t i = 0; i < mHandlers.size(); ++i)
+    for (bool highPriority : {true, false})
     {
-        mHandlers[i]->ProcessPackets();
+        for (size_t i = 0; i < mShards.size(); ++i)
+        {
+            const HandlerList& handlers = mShards[i]->mHandlers;
+            for (size_t j = 0; j < handlers.size(); ++j)
+            {
+                handlers[j]->ProcessPackets(highPriority);
+            }
+        }
     }
-    if (!mRemovedHandlers.empty())
+    // Connections normally share one processor, so usually this checks the timeouts once
+    PakProcessor* processorPtr = nullptr;
+    for (size_t i = 0; i < mShards.size(); ++i)
     {
-        Pause();
-        ProcessRemovedHandlers();
-        Resume();
+        const HandlerList& handlers = mShards[i]->mHandlers;
+        for (size_t j = 0; j < handlers.size(); ++j)
+        {
+            if (handlers[j]->GetProcessor() != processorPtr && handlers[j]->GetProcessor() != nullptr)
+            {
+                processorPtr = handlers[j]->GetProcessor();
+                processorPtr->ResumeExpiredWaiters();
+            }
+        }
     }
+    ProcessRemovedHandlers();
 }
 
-//! Extract a list of received packets
+//! Extract a list of received packets.
+//! High priority packets from every connection are listed first.  Packets of one
+//! priority from one connection are listed in the order they were received.
 void PakThreadedIO::Extract(PacketList& aPacketList)
 {
-    for (size_t i = 0; i < mHandlers.size(); ++i)
+    for (bool highPriority : {true, false})
+    {
+        for (size_t i = 0; i < mShards.size(); ++i)
+        {
+            const HandlerList& handlers = mShards[i]->mHandlers;
+            for (size_t j = 0; j < handlers.size(); ++j)
+            {
+                handlers[j]->ExtractPackets(aPacketList, highPriority);
+            }
+        }
+    }
+    ProcessRemovedHandlers();
+}
+
+//! Returns receive queue statistics for each handled connection.
+void PakThreadedIO::GetQueueStats(std::vector<QueueStats>& aStats) const
+{
+    aStats.clear();
+    for (size_t i = 0; i < mShards.size(); ++i)
+    {
+        const HandlerList& handlers = mShards[i]->mHandlers;
+        for (size_t j = 0; j < handlers.size(); ++j)
+        {
+            aStats.emplace_back();
+            handlers[j]->GetQueueStats(aStats.back());
+        }
+    }
+}
+
+//! Blocks the calling thread until packets are received, a connection is lost,
+//! Wakeup() is called, or the wait time expires.  Returns immediately if any of
+//! these happened since the last call.
+//! @param aMaxWaitTime The maximum time to wait in seconds.
+//! @return 'true' if woken before the wait time expired.
+bool PakThreadedIO::WaitForPackets(double aMaxWaitTime)
+{
+    std::unique_lock<std::mutex> lock(mWakeupLock);
+    if (!mWakeupPending && aMaxWaitTime > 0.0)
     {
-        PacketList packets;
-        mHandlers[i]->ExtractPackets(packets);
-        aPacketList.insert(aPacketList.end(), packets.begin(), packets.end());
+        mWakeupCondition.wait_for(lock, std::chrono::duration<double>(aMaxWaitTime), [this]() { return mWakeupPending; });
     }
-    if (!mRemovedHandlers.empty())
+    bool woken = mWakeupPending;
+    mWakeupPending = false;
+    return woken;
+}
+
+//! Wakes a thread blocked in WaitForPackets().
+void PakThreadedIO::Wakeup()
+{
     {
-        Pause();
-        ProcessRemovedHandlers();
-        Resume();
+        std::lock_guard<std::mutex> lock(mWakeupLock);
+        mWakeupPending = true;
     }
+    mWakeupCondition.notify_one();
 }
 
-//! Precondition: The reactor is paused.
+//! Notifies the user of connections removed by any shard.
+//! The reactors are running while Disconnected is invoked, so a callback may add or remove IO.
 void PakThreadedIO::ProcessRemovedHandlers()
 {
-    for (size_t i = 0; i < mRemovedHandlers.size(); ++i)
+    for (size_t i = 0; i < mShards.size(); ++i)
     {
-        Handler* handlerPtr = mRemovedHandlers[i];
-        Disconnected(handlerPtr->GetIO(), handlerPtr->GetConnection());
-        delete handlerPtr;
+        Shard* shardPtr = mShards[i];
+        if (!shardPtr->mRemovedHandlers.empty())
+        {
+            HandlerList removedHandlers;
+            shardPtr->Pause();
+            removedHandlers.swap(shardPtr->mRemovedHandlers);
+            shardPtr->Resume();
+            for (size_t j = 0; j < removedHandlers.size(); ++j)
+            {
+                Handler* handlerPtr = removedHandlers[j];
+                Disconnected(handlerPtr->GetIO(), handlerPtr->GetConnection());
+                delete handlerPtr;
+            }
+        }
     }
-    mRemovedHandlers.clear();
 }
 
 //! Signals the thread to complete.  Join() should return quickly after Stop() is called.
 void PakThreadedIO::Stop()
+{
+    for (size_t i = 0; i < mShards.size(); ++i)
+    {
+        mShards[i]->Stop();
+    }
+}
+
+// virtual
+void PakThreadedIO::Run()
+{
+    for (size_t i = 1; i < mShards.size(); ++i)
+    {
+        mShards[i]->Start();
+    }
+    mShards[0]->Run();
+    for (size_t i = 1; i < mShards.size(); ++i)
+    {
+        mShards[i]->Join();
+    }
+}
+
+PakThreadedIO::Shard::Shard(PakThreadedIO* aParentPtr, size_t aIndex, PakSocketReactor::Backend aBackend)
+    : mParentPtr(aParentPtr), mIndex(aIndex), mReactor(aBackend), mStopping(false), mPauseRequested(false), mWaitingForSpace(false), mHandlerAccess(1), mConnectionCount(0)
+{
+    mReactor.SetTimerCallback([this]() { return RunTimers(); });
+}
+
+PakThreadedIO::Shard::~Shard()
+{
+    for (size_t i = 0; i < mHandlers.size(); ++i)
+    {
+        Handler* handlerPtr = mHandlers[i];
+        delete handlerPtr;
+    }
+}
+
+//! Pauses the shard's reactor thread
+void PakThreadedIO::Shard::Pause()
+{
+    std::lock_guard<std::recursive_mutex> lock(mReactorLock);
+    mPauseRequested = true;
+    {
+        std::lock_guard<std::mutex> spaceLock(mSpaceLock);
+    }
+    mSpaceCondition.notify_all();
+    mReactor.Stop();
+    mHandlerAccess.Acquire();
+    mPauseRequested = false;
+}
+
+void PakThreadedIO::Shard::Resume()
+{
+    mHandlerAccess.Release();
+}
+
+void PakThreadedIO::Shard::Stop()
 {
     Pause();
     mStopping = true;
     Resume();
 }
 
+//! Called by the consumer after taking packets, to wake a handler waiting for room.
+void PakThreadedIO::Shard::NotifySpace()
+{
+    // Pairs with the fence in Handler::Enqueue(), so either the handler sees the room or we see it waiting
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mWaitingForSpace)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mSpaceLock);
+        }
+        mSpaceCondition.notify_all();
+    }
+}
+
+//! @return 'true' if the IO was handled by this shard.
+bool PakThreadedIO::Shard::RemoveIO_P(PakSocketIO* aIOPtr, bool aNotifyUser)
+{
+    for (size_t i = 0; i < mHandlers.size(); ++i)
+    {
+        PakSocketIO* io = mHandlers[i]->GetIO();
+        if (io == aIOPtr)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mParentPtr->mSendHandlersLock);
+                mParentPtr->mSendHandlers.erase(io);
+            }
+            mReactor.Disconnect(io->GetRecvSocket());
+            if (mHandlers[i]->IsUDP())
+            {
+                ((PakUDP_IO*)io)->SetTimerStartedCallback(nullptr);
+            }
+            Handler* handlerPtr = mHandlers[i];
+            mHandlers.erase(mHandlers.begin() + i);
+            --mConnectionCount;
+            mTimedHandlers.erase(std::remove(mTimedHandlers.begin(), mTimedHandlers.end(), handlerPtr), mTimedHandlers.end());
+            if (aNotifyUser)
+            {
+                mRemovedHandlers.push_back(handlerPtr);
+            }
+            else
+            {
+                delete handlerPtr;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+//! Runs the timers of the shard's handlers.  Called by the reactor before it waits.
+//! @return The longest time in seconds the reactor may wait, or a negative value for no limit.
+double PakThreadedIO::Shard::RunTimers()
+{
+    // Another thread's send may start a timer while the reactor waits, so never wait longer than this
+    const double cMAXIMUM_TIMER_WAIT = 0.01;
+    if (mTimedHandlers.empty())
+    {
+        return -1.0;
+    }
+    double waitTime = cMAXIMUM_TIMER_WAIT;
+    for (Handler* handlerPtr : mTimedHandlers)
+    {
+        double handlerWait = handlerPtr->Update();
+        if (handlerWait >= 0.0)
+        {
+            waitTime = std::min(waitTime, handlerWait);
+        }
+    }
+    return waitTime;
+}
+
 // virtual
-void PakThreadedIO::Run()
+void PakThreadedIO::Shard::Run()
 {
     while (!mStopping)
     {
@@ -183,102 +525,418 @@ void PakThreadedIO::Run()
         {
             RemoveIO_P(mDeadHandlers[i]->GetIO(), true);
         }
+        if (!mDeadHandlers.empty())
+        {
+            // The consumer reports the disconnect
+            mParentPtr->Wakeup();
+        }
         mDeadHandlers.clear();
         mHandlerAccess.Release();
     }
     mStopping = false;
 }
 
-PakThreadedIO::Handler::Handler(PakThreadedIO* aParentPtr, PakSocketIO* aIOPtr, PakConnection* aConnectionPtr)
-    : mConnectionPtr(aConnectionPtr), mParentPtr(aParentPtr), mIOPtr(aIOPtr), mQueueAccess(1)
+PakThreadedIO::Handler::Handler(PakThreadedIO* aParentPtr, Shard* aShardPtr, PakSocketIO* aIOPtr, PakConnection* aConnectionPtr)
+    : mConnectionPtr(aConnectionPtr), mParentPtr(aParentPtr), mShardPtr(aShardPtr), mIOPtr(aIOPtr), mProcessorPtr(nullptr), mOverflowPolicy(aParentPtr->mOverflowPolicy), mReceiveQueue(aParentPtr->mQueueCapacity), mDroppedPackets(0), mPriorityQueue(std::max<size_t>(aParentPtr->mQueueCapacity / 4, 1)), mPriorityDroppedPackets(0), mIsQueuedSend(false), mWriteInterest(false), mOverBudget(false), mHighWatermark(aParentPtr->mHighWatermark), mLowWatermark(aParentPtr->mLowWatermark), mPendingSendBytes(0), mRejectedSends(0)
 {
     mIsTCP = (dynamic_cast<PakTCP_IO*>(mIOPtr) != nullptr);
+    mIsUDP = (dynamic_cast<PakUDP_IO*>(mIOPtr) != nullptr);
+    mIsSharedMemory = (dynamic_cast<PakSharedMemoryIO*>(mIOPtr) != nullptr);
+    if (mIsUDP)
+    {
+        PakUDP_IO* udpIO = (PakUDP_IO*)mIOPtr;
+        mHasTimers = (udpIO->GetReliable() != nullptr || udpIO->IsCoalescing());
+        if (udpIO->IsCoalescing())
+        {
+            // A send on another thread starts a coalescing deadline shorter than the reactor's wait
+            PakSocketReactor* reactorPtr = &aShardPtr->mReactor;
+            udpIO->SetTimerStartedCallback([reactorPtr]() { reactorPtr->Wakeup(); });
+        }
+    }
+    else
+    {
+        // A lost doorbell datagram must not stall a shared memory IO
+        mHasTimers = mIsSharedMemory;
+    }
+    // Only TCP and shared memory sends can stall on a slow peer
+    mIsQueuedSend = ((mIsTCP || mIsSharedMemory) && aParentPtr->mSendMode == cQUEUED_SEND);
+    mProcessorPtr = mIOPtr->GetPakProcessor();
 }
 
 void PakThreadedIO::Handler::Handle()
 {
-    PacketList packets;
+    if (mIsSharedMemory && mIsQueuedSend)
+    {
+        // The doorbell also rings when the peer makes room for queued sends
+        HandleWrite();
+    }
+    bool queuedPackets = false;
+    GenSockets::GenSocket* socketPtr = mIOPtr->GetRecvSocket();
+    bool drainSocket = (mShardPtr->mReactor.GetBackend() == PakSocketReactor::cEPOLL_BACKEND);
+    if (mIsUDP)
+    {
+        // Pull whole batches of datagrams until the socket is empty
+        PakUDP_IO* udpIO = (PakUDP_IO*)mIOPtr;
+        while (udpIO->ReceiveBatch(mBatchPackets) > 0)
+        {
+            for (PakPacket* pktPtr : mBatchPackets)
+            {
+                pktPtr->SetSender(mConnectionPtr);
+                Enqueue(pktPtr);
+                queuedPackets = true;
+            }
+            mBatchPackets.clear();
+        }
+    }
+    else
+    {
+        for (;;)
+        {
+            size_t bytesReceived = socketPtr->GetTotalBytesReceived();
+            PakPacket* pktPtr = ReceivePacket();
+            if (pktPtr != nullptr)
+            {
+                Enqueue(pktPtr);
+                queuedPackets = true;
+            }
+            // An edge-triggered reactor will not signal again until new data arrives, so keep reading
+            // while the socket still yields data, even if it did not produce a packet.
+            else if (!drainSocket || !mIsTCP || socketPtr->GetTotalBytesReceived() == bytesReceived)
+            {
+                break;
+            }
+        }
+    }
+    if (queuedPackets)
+    {
+        mParentPtr->Wakeup();
+    }
+    if (!mIsUDP)
+    {
+        if (!mIOPtr->IsConnected())
+        {
+            mShardPtr->mDeadHandlers.push_back(this);
+            mShardPtr->mReactor.Stop();
+        }
+    }
+}
+
+//! Runs the IO's timers.
+//! @return The time in seconds until Update() is needed again, or a negative value if it is not.
+double PakThreadedIO::Handler::Update()
+{
+    if (mIsSharedMemory)
+    {
+        // Catch up on data and room whose doorbell datagram was lost
+        if (((PakSharedMemoryIO*)mIOPtr)->IsReceiveReady() || (mIsQueuedSend && mPendingSendBytes > 0))
+        {
+            Handle();
+        }
+        return PakSharedMemoryIO::cDOORBELL_RECHECK_TIME;
+    }
+    return ((PakUDP_IO*)mIOPtr)->Update();
+}
+
+//! Reads the next packet from the IO, or returns null if none is available.
+PakPacket* PakThreadedIO::Handler::ReceivePacket()
+{
     PakPacket* pktPtr;
     if (mIsTCP)
     {
-        PakTCP_IO* tcpIO = (PakTCP_IO*)mIOPtr;
-        while ((pktPtr = tcpIO->ReceiveNew()) != nullptr)
+        pktPtr = ((PakTCP_IO*)mIOPtr)->ReceiveNew();
+        if (pktPtr != nullptr)
+        {
+            pktPtr->SetSender(mConnectionPtr);
+        }
+    }
+    else if (!mIsUDP)
+    {
+        pktPtr = mProcessorPtr->ReadPacket(*mIOPtr);
+        if (pktPtr != nullptr)
         {
             pktPtr->SetSender(mConnectionPtr);
-            packets.push_back(pktPtr);
         }
     }
     else
     {
         PakUDP_IO* udpIO = (PakUDP_IO*)mIOPtr;
-        while ((pktPtr = udpIO->ReceiveNew()) != nullptr)
+        pktPtr = udpIO->ReceiveNew();
+        if (pktPtr != nullptr)
         {
             pktPtr->SetSender(mConnectionPtr);
             const GenSockets::GenInternetSocketAddress& socketAddr = udpIO->GetConnection().GetLastSenderAddress();
             GenSockets::GenIP ip = socketAddr.GetAddress();
             pktPtr->SetOriginatorAddress(ip.GetAddress());
             pktPtr->SetOriginatorPort(socketAddr.GetPort());
-            packets.push_back(pktPtr);
         }
     }
-    if (!packets.empty())
+    return pktPtr;
+}
+
+PakThreadedIO::Handler::~Handler()
+{
+    // Pooled packets must go back to their pool
+    PakPacket* pktPtr;
+    while (mReceiveQueue.Pop(pktPtr))
+    {
+        mProcessorPtr->ReleasePacket(pktPtr);
+    }
+    while (mPriorityQueue.Pop(pktPtr))
+    {
+        mProcessorPtr->ReleasePacket(pktPtr);
+    }
+}
+
+//! Called from the reactor thread to hand a packet to the consumer.
+void PakThreadedIO::Handler::Enqueue(PakPacket* aPktPtr)
+{
+    bool highPriority = mProcessorPtr->IsHighPriority(aPktPtr->ID());
+    PacketQueue& queue = highPriority ? mPriorityQueue : mReceiveQueue;
+    if (queue.Push(aPktPtr, mOverflowPolicy == cGROW))
+    {
+        return;
+    }
+    if (mOverflowPolicy == cDROP_OLDEST)
+    {
+        PakPacket* oldestPtr;
+        // The consumer may empty the queue between the two calls, in which case nothing is dropped
+        if (queue.Pop(oldestPtr))
+        {
+            Discard(oldestPtr, highPriority);
+        }
+        if (!queue.Push(aPktPtr, false))
+        {
+            Discard(aPktPtr, highPriority);
+        }
+    }
+    else if (mOverflowPolicy == cBLOCK)
     {
-        mQueueAccess.Acquire();
-        mReceiveQueue.insert(mReceiveQueue.end(), packets.begin(), packets.end());
-        mQueueAccess.Release();
+        // Make sure the consumer knows there is something to drain
+        mParentPtr->Wakeup();
+        std::unique_lock<std::mutex> lock(mShardPtr->mSpaceLock);
+        mShardPtr->mWaitingForSpace = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!queue.Push(aPktPtr, false))
+        {
+            // Don't hold up a Pause() or Stop(); they are waiting on this thread
+            if (mShardPtr->mPauseRequested || mShardPtr->mStopping)
+            {
+                Discard(aPktPtr, highPriority);
+                break;
+            }
+            mShardPtr->mSpaceCondition.wait(lock);
+        }
+        mShardPtr->mWaitingForSpace = false;
     }
-    if (mIsTCP)
+    else
     {
-        if (!((PakTCP_IO*)mIOPtr)->IsConnected())
+        Discard(aPktPtr, highPriority);
+    }
+}
+
+void PakThreadedIO::Handler::Discard(PakPacket* aPktPtr, bool aHighPriority)
+{
+    ++(aHighPriority ? mPriorityDroppedPackets : mDroppedPackets);
+    mProcessorPtr->ReleasePacket(aPktPtr);
+}
+
+void PakThreadedIO::Handler::ProcessPackets(bool aHighPriority)
+{
+    PacketQueue& queue = aHighPriority ? mPriorityQueue : mReceiveQueue;
+    // Only process what is queued now, so a busy connection can't starve the others
+    size_t count = queue.Size();
+    PakPacket* pktPtr;
+    for (size_t i = 0; i < count && queue.Pop(pktPtr); ++i)
+    {
+        if (i == 0)
         {
-            mParentPtr->mDeadHandlers.push_back(this);
-            mParentPtr->mReactor.Stop();
+            mShardPtr->NotifySpace();
         }
+        mProcessorPtr->ProcessPacket(pktPtr, true);
     }
 }
 
-PakThreadedIO::Handler::~Handler()
+void PakThreadedIO::Handler::ExtractPackets(PacketList& aPackets, bool aHighPriority)
 {
-    for (size_t i = 0; i < mReceiveQueue.size(); ++i)
+    PacketQueue& queue = aHighPriority ? mPriorityQueue : mReceiveQueue;
+    PakPacket* pktPtr;
+    bool extracted = false;
+    while (queue.Pop(pktPtr))
+    {
+        aPackets.push_back(pktPtr);
+        extracted = true;
+    }
+    if (extracted)
     {
-        delete mReceiveQueue[i];
+        mShardPtr->NotifySpace();
     }
 }
 
-void PakThreadedIO::Handler::ProcessPackets()
+PakThreadedIO::PacketQueue::PacketQueue(size_t aCapacity)
+    : mQueue(aCapacity), mOverflowSize(0)
+{
+}
+
+//! Called by the reactor thread.
+//! @param aGrow Keep the packet in the overflow list if the queue is full.
+//! @return 'false' if the queue is full and aGrow is not set.
+bool PakThreadedIO::PacketQueue::Push(PakPacket* aPktPtr, bool aGrow)
 {
-    if (mReceiveQueue.empty())
+    // Once packets overflow, later packets must queue behind them
+    if (mOverflowSize == 0 && mQueue.Push(aPktPtr))
     {
-        return;
+        return true;
+    }
+    if (!aGrow)
+    {
+        return false;
     }
-    PacketList packets;
-    mQueueAccess.Acquire();
-    packets.swap(mReceiveQueue);
-    mQueueAccess.Release();
+    std::lock_guard<std::mutex> lock(mOverflowLock);
+    mOverflow.push_back(aPktPtr);
+    ++mOverflowSize;
+    return true;
+}
 
-    if (mIsTCP)
+//! Removes the oldest packet.  Returns 'false' if the queue is empty.
+bool PakThreadedIO::PacketQueue::Pop(PakPacket*& aPktPtr)
+{
+    if (mQueue.Pop(aPktPtr))
+    {
+        return true;
+    }
+    if (mOverflowSize == 0)
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mOverflowLock);
+    aPktPtr = mOverflow.front();
+    mOverflow.pop_front();
+    --mOverflowSize;
+    return true;
+}
+
+void PakThreadedIO::Handler::GetQueueStats(QueueStats& aStats) const
+{
+    aStats.mIOPtr = mIOPtr;
+    aStats.mConnectionPtr = mConnectionPtr;
+    aStats.mPriorityDepth = mPriorityQueue.Size();
+    aStats.mPriorityCapacity = mPriorityQueue.Capacity();
+    aStats.mPriorityDroppedPackets = mPriorityDroppedPackets;
+    aStats.mDepth = mReceiveQueue.Size() + aStats.mPriorityDepth;
+    aStats.mCapacity = mReceiveQueue.Capacity();
+    aStats.mDroppedPackets = mDroppedPackets + aStats.mPriorityDroppedPackets;
+    aStats.mPendingSendBytes = mPendingSendBytes;
+    aStats.mRejectedSends = mRejectedSends;
+    aStats.mShardIndex = mShardPtr->mIndex;
+}
+
+//! Sends a packet to this handler's IO.  With cQUEUED_SEND the packet is written
+//! without waiting, and whatever the socket does not accept is left for HandleWrite().
+//! @param aExceededBudget Set to 'true' if the send queue just grew past the high watermark.
+//!                        The caller invokes SendBudgetExceeded.
+//! @return 'false' if the packet was refused because the send queue is over budget.
+bool PakThreadedIO::Handler::Send(PakPacket& aPacket, bool& aExceededBudget)
+{
+    return SendP(&aPacket, nullptr, aExceededBudget);
+}
+
+//! Sends a packet that is shared with other handlers, see Send(PakPacket&, bool&).
+bool PakThreadedIO::Handler::Send(PakEncodedPacket& aPacket, bool& aExceededBudget)
+{
+    return SendP(nullptr, &aPacket, aExceededBudget);
+}
+
+//! Implements Send().  Exactly one of aPacketPtr and aEncodedPtr is non-null.
+bool PakThreadedIO::Handler::SendP(PakPacket* aPacketPtr, PakEncodedPacket* aEncodedPtr, bool& aExceededBudget)
+{
+    if (!mIsQueuedSend)
     {
-        for (size_t i = 0; i < packets.size(); ++i)
+        if (aEncodedPtr != nullptr)
         {
-            ((PakTCP_IO*)mIOPtr)->GetPakProcessor()->ProcessPacket(packets[i], true);
+            mIOPtr->SendEncoded(*aEncodedPtr);
         }
+        else
+        {
+            mIOPtr->Send(*aPacketPtr);
+        }
+        return true;
     }
-    else
     {
-        for (size_t i = 0; i < packets.size(); ++i)
+        std::lock_guard<std::mutex> lock(mSendLock);
+        if (mOverBudget)
+        {
+            ++mRejectedSends;
+            return false;
+        }
+        size_t pending;
+        if (mIsSharedMemory)
         {
-            ((PakUDP_IO*)mIOPtr)->GetPakProcessor()->ProcessPacket(packets[i], true);
+            // Whatever does not fit is written when the peer rings the doorbell, see Handle()
+            PakSharedMemoryIO* sharedIO = (PakSharedMemoryIO*)mIOPtr;
+            if (aEncodedPtr != nullptr)
+            {
+                sharedIO->SendEncoded(*aEncodedPtr, 0);
+            }
+            else
+            {
+                sharedIO->Send(*aPacketPtr, 0);
+            }
+            pending = sharedIO->GetPendingSendBytes();
+        }
+        else
+        {
+            PakTCP_IO* tcpIO = (PakTCP_IO*)mIOPtr;
+            if (aEncodedPtr != nullptr)
+            {
+                tcpIO->SendEncoded(*aEncodedPtr, 0);
+            }
+            else
+            {
+                tcpIO->Send(*aPacketPtr, 0);
+            }
+            pending = tcpIO->GetPendingSendBytes();
+        }
+        mPendingSendBytes = pending;
+        if (pending > 0 && !mWriteInterest && mIsTCP)
+        {
+            mWriteInterest = true;
+            mShardPtr->mReactor.SetWriteInterest(mIOPtr->GetSendSocket(), true);
+        }
+        if (pending > mHighWatermark)
+        {
+            mOverBudget = true;
+            aExceededBudget = true;
         }
     }
+    return true;
 }
 
-void PakThreadedIO::Handler::ExtractPackets(PacketList& aPackets)
+//! Called by the reactor when the socket can be written, while sends are queued.
+void PakThreadedIO::Handler::HandleWrite()
 {
-    if (mReceiveQueue.empty())
+    std::lock_guard<std::mutex> lock(mSendLock);
+    if (mIsSharedMemory)
     {
+        PakSharedMemoryIO* sharedIO = (PakSharedMemoryIO*)mIOPtr;
+        sharedIO->Flush();
+        mPendingSendBytes = sharedIO->GetPendingSendBytes();
+        if (mOverBudget && mPendingSendBytes <= mLowWatermark)
+        {
+            mOverBudget = false;
+        }
         return;
     }
-    mQueueAccess.Acquire();
-    mReceiveQueue.swap(aPackets);
-    mQueueAccess.Release();
+    PakTCP_IO* tcpIO = (PakTCP_IO*)mIOPtr;
+    tcpIO->Flush(0);
+    size_t pending = tcpIO->GetPendingSendBytes();
+    mPendingSendBytes = pending;
+    if ((pending == 0 || !tcpIO->IsConnected()) && mWriteInterest)
+    {
+        mWriteInterest = false;
+        mShardPtr->mReactor.SetWriteInterest(mIOPtr->GetSendSocket(), false);
+    }
+    if (mOverBudget && pending <= mLowWatermark)
+    {
+        mOverBudget = false;
+    }
 }
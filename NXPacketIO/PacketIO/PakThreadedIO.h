@@ -3,6 +3,10 @@
 
 #include "NXPacketIO_Export.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
 #include <mutex>
 #include <vector>
 
@@ -10,23 +14,94 @@
 #include "PacketIO/PakSocketReactor.h"
 #include "Util/UtCallback.h"
 #include "Util/UtSemaphore.h"
+#include "Util/UtSpscQueue.h"
 #include "Util/UtThread.h"
+class PakEncodedPacket;
 class PakTCP_IO;
 class PakUDP_IO;
 class PakSocketIO;
+class PakProcessor;
 
 //! Handles receiving packets on 1 or more sockets.
 //! Being a UtThread, Start() must be called to initiate the thread.
 //! Stop() must be called prior to Join() to signal the thread to quit.
 //!
-//!@note Currently, the send() methods are pass-through to a blocking send call.
-//!      In the future, this may be changed to do threaded sends.
+//!@note By default the send() methods are pass-through to a blocking send call.
+//!      See SetSendOptions() for queued, non-blocking sends.
+//!@note By default all connections are read by one reactor thread.
+//!      See SetShardOptions() to spread connections over several reactor threads.
+//!@note Packets registered with PakProcessor::cHIGH_PRIORITY are queued separately, and
+//!      Process() and Extract() hand them out before any other packets.
+//!@note The retransmit timers of a PakUDP_IO using PakUDP_IO::SetReliable(), and the deadlines
+//!      of PakUDP_IO::SetCoalescing(), are run by the reactor thread reading it.  So are the
+//!      doorbell re-checks of a PakSharedMemoryIO.
+//!@note Process() resumes the coroutines waiting in PakProcessor::Receive(), including
+//!      those whose timeout expired.
 class NX_PACKETIO_EXPORT PakThreadedIO : public UtThread
 {
 public:
     typedef std::vector<PakPacket*> PacketList;
 
-    PakThreadedIO();
+    //! What a connection's receive queue does when it is full.
+    enum OverflowPolicy
+    {
+        //! Discard the oldest queued packet to make room.
+        cDROP_OLDEST,
+        //! Discard the packet that was just received.
+        cDROP_NEWEST,
+        //! Stop reading the socket until the consumer makes room.
+        //! All connections handled by this PakThreadedIO are stalled while waiting.
+        cBLOCK,
+        //! Keep the packets that do not fit in an unbounded overflow list.  Nothing is
+        //! dropped and the socket is never stalled, as before the queues were bounded.
+        cGROW
+    };
+
+    //! How packets are sent to TCP connections.
+    enum SendMode
+    {
+        //! Send() returns once the packet is written to the socket.
+        //! A slow peer stalls the caller, and every recipient after it.
+        cBLOCKING_SEND,
+        //! Send() writes what the socket accepts without waiting and queues the rest,
+        //! which the reactor thread writes as the socket becomes writable.
+        //! A PakSharedMemoryIO is queued the same way, and written as the peer makes room.
+        cQUEUED_SEND
+    };
+
+    //! How a new connection is assigned to a reactor shard.
+    enum ShardPolicy
+    {
+        //! Assign connections to each shard in turn.
+        cROUND_ROBIN,
+        //! Assign a connection to the shard handling the fewest connections.
+        cLEAST_LOADED
+    };
+
+    //! Receive and send queue statistics for one connection.
+    struct QueueStats
+    {
+        PakSocketIO* mIOPtr;
+        PakConnection* mConnectionPtr;
+        //! Number of packets waiting to be processed, including mPriorityDepth
+        size_t mDepth;
+        size_t mCapacity;
+        //! Number of packets discarded because the queue was full, including mPriorityDroppedPackets
+        size_t mDroppedPackets;
+        //! Number of high priority packets waiting to be processed
+        size_t mPriorityDepth;
+        size_t mPriorityCapacity;
+        //! Number of high priority packets discarded because their queue was full
+        size_t mPriorityDroppedPackets;
+        //! Number of bytes waiting to be written to the socket (cQUEUED_SEND only)
+        size_t mPendingSendBytes;
+        //! Number of packets refused because the send queue was over budget
+        size_t mRejectedSends;
+        //! Index of the reactor shard reading the connection
+        size_t mShardIndex;
+    };
+
+    explicit PakThreadedIO(PakSocketReactor::Backend aBackend = PakSocketReactor::cSELECT_BACKEND);
 
     ~PakThreadedIO() override;
 
@@ -34,7 +109,9 @@ public:
 
     void RemoveIO(PakSocketIO* aIOPtr);
 
-    void Send(PakSocketIO* aIOPtr, PakPacket& aPacket);
+    bool Send(PakSocketIO* aIOPtr, PakPacket& aPacket);
+
+    bool Send(PakSocketIO* aIOPtr, PakEncodedPacket& aPacket);
 
     void Send(const std::vector<PakSocketIO*>& aIO_List, PakPacket& aPacket);
 
@@ -43,6 +120,11 @@ public:
     //! This Callback list is invoked during Process() after a connection is broken.
     UtCallbackListN<void(PakSocketIO*, PakConnection*)> Disconnected;
 
+    //! Invoked by the sending thread when a connection's send queue grows past the high
+    //! watermark.  Packets sent to that connection are refused until the queue drains
+    //! below the low watermark.  Only used with cQUEUED_SEND.
+    UtCallbackListN<void(PakSocketIO*, PakConnection*)> SendBudgetExceeded;
+
     void Process();
 
     void Extract(PacketList& aPacketList);
@@ -51,50 +133,183 @@ public:
 
     void Run() override;
 
+    //! Sets the receive queue capacity and overflow policy for IO added after this call.
+    //! The default is 16384 packets with cGROW.  High priority packets have their own
+    //! queue, a quarter of the size.
+    void SetQueueOptions(size_t aCapacity, OverflowPolicy aPolicy)
+    {
+        mQueueCapacity = aCapacity;
+        mOverflowPolicy = aPolicy;
+    }
+
+    //! Sets the send mode and the per-connection send queue budget in bytes, for IO added
+    //! after this call.  The default is cBLOCKING_SEND, with a 4 MB high and 1 MB low watermark.
+    void SetSendOptions(SendMode aMode, size_t aHighWatermark, size_t aLowWatermark)
+    {
+        mSendMode = aMode;
+        mHighWatermark = aHighWatermark;
+        mLowWatermark = aLowWatermark;
+    }
+
+    SendMode GetSendMode() const { return mSendMode; }
+
+    void SetShardOptions(size_t aShardCount, ShardPolicy aPolicy);
+
+    size_t GetShardCount() const { return mShards.size(); }
+
+    void GetQueueStats(std::vector<QueueStats>& aStats) const;
+
+    bool WaitForPackets(double aMaxWaitTime);
+
+    void Wakeup();
+
 private:
+    class Handler;
+    typedef std::vector<Handler*> HandlerList;
+
+    //! A reactor and the connections it reads.  Shard 0 runs on the PakThreadedIO thread,
+    //! the others on their own threads.
+    class Shard : public UtThread
+    {
+    public:
+        Shard(PakThreadedIO* aParentPtr, size_t aIndex, PakSocketReactor::Backend aBackend);
+        ~Shard() override;
+        void Run() override;
+        void Pause();
+        void Resume();
+        void Stop();
+        void NotifySpace();
+        bool RemoveIO_P(PakSocketIO* aIOPtr, bool aNotifyUser);
+        double RunTimers();
+
+        PakThreadedIO* mParentPtr;
+        size_t mIndex;
+        PakSocketReactor mReactor;
+        volatile bool mStopping;
+        //! Set while Pause() waits for the reactor, so a blocked handler gives up its wait.
+        std::atomic<bool> mPauseRequested;
+        //! Wakes a handler waiting for room in a full receive queue (cBLOCK)
+        std::mutex mSpaceLock;
+        std::condition_variable mSpaceCondition;
+        std::atomic<bool> mWaitingForSpace;
+        UtSemaphore mHandlerAccess;
+        std::recursive_mutex mReactorLock;
+        //! List of handlers that are removed, and need to notify user
+        HandlerList mRemovedHandlers;
+        //! List of handlers that are waiting to be removed from reactor
+        HandlerList mDeadHandlers;
+        //! List of active handlers
+        HandlerList mHandlers;
+        //! Size of mHandlers, which other threads may read while the reactor runs
+        std::atomic<size_t> mConnectionCount;
+        //! Active handlers with timers to run
+        HandlerList mTimedHandlers;
+    };
+
+    Shard* SelectShard();
+
+    template <typename PACKET>
+    bool QueuedSend(PakSocketIO* aIOPtr, PACKET& aPacket, bool& aHandled);
+
     void ProcessRemovedHandlers();
 
-    void RemoveIO_P(PakSocketIO* aIOPtr, bool aNotifyUser);
+    //! A connection's receive queue.  With cGROW, packets that do not fit wait in an overflow
+    //! list, which is drained after the lock-free queue so the packets stay in order.
+    class PacketQueue
+    {
+    public:
+        explicit PacketQueue(size_t aCapacity);
+        bool Push(PakPacket* aPktPtr, bool aGrow);
+        bool Pop(PakPacket*& aPktPtr);
+        size_t Size() const { return mQueue.Size() + mOverflowSize; }
+        size_t Capacity() const { return mQueue.Capacity(); }
+
+    private:
+        UtSpscQueue<PakPacket*> mQueue;
+        std::mutex mOverflowLock;
+        std::deque<PakPacket*> mOverflow;
+        std::atomic<size_t> mOverflowSize;
+    };
 
     class Handler
     {
     public:
         typedef std::vector<PakPacket*> PacketList;
-        Handler(PakThreadedIO* aParentPtr, PakSocketIO* aIOPtr, PakConnection* aConnectionPtr);
+        Handler(PakThreadedIO* aParentPtr, Shard* aShardPtr, PakSocketIO* aIOPtr, PakConnection* aConnectionPtr);
         void Handle();
         ~Handler();
-        void ProcessPackets();
-        void ExtractPackets(PacketList& aPackets);
+        PakPacket* ReceivePacket();
+        void ProcessPackets(bool aHighPriority);
+        void ExtractPackets(PacketList& aPackets, bool aHighPriority);
+        void GetQueueStats(QueueStats& aStats) const;
         PakSocketIO* GetIO() const { return mIOPtr; }
         PakConnection* GetConnection() const { return mConnectionPtr; }
+        PakProcessor* GetProcessor() const { return mProcessorPtr; }
+        bool IsQueuedSend() const { return mIsQueuedSend; }
+        bool IsTCP() const { return mIsTCP; }
+        bool HasTimers() const { return mHasTimers; }
+        bool IsUDP() const { return mIsUDP; }
+        double Update();
+        bool Send(PakPacket& aPacket, bool& aExceededBudget);
+        bool Send(PakEncodedPacket& aPacket, bool& aExceededBudget);
+        void HandleWrite();
 
     private:
+        bool SendP(PakPacket* aPacketPtr, PakEncodedPacket* aEncodedPtr, bool& aExceededBudget);
+
+        void Enqueue(PakPacket* aPktPtr);
+        void Discard(PakPacket* aPktPtr, bool aHighPriority);
+
         PakConnection* mConnectionPtr;
         PakThreadedIO* mParentPtr;
+        Shard* mShardPtr;
         PakSocketIO* mIOPtr;
+        PakProcessor* mProcessorPtr;
         bool mIsTCP;
-        UtSemaphore mQueueAccess;
-        PacketList mReceiveQueue;
+        bool mIsUDP;
+        bool mIsSharedMemory;
+        bool mHasTimers;
+        OverflowPolicy mOverflowPolicy;
+        PacketQueue mReceiveQueue;
+        std::atomic<size_t> mDroppedPackets;
+        //! Received packets of high priority types
+        PacketQueue mPriorityQueue;
+        std::atomic<size_t> mPriorityDroppedPackets;
+        //! Scratch list for packets decoded from a batch of datagrams
+        PacketList mBatchPackets;
+        bool mIsQueuedSend;
+        //! Serializes queued sends with the reactor draining the queue
+        std::mutex mSendLock;
+        bool mWriteInterest;
+        bool mOverBudget;
+        size_t mHighWatermark;
+        size_t mLowWatermark;
+        std::atomic<size_t> mPendingSendBytes;
+        std::atomic<size_t> mRejectedSends;
     };
 
 public:
     friend class PakThreadedIO::Handler;
+    friend class PakThreadedIO::Shard;
 
 private:
-    void Pause();
-    void Resume();
-    typedef std::vector<Handler*> HandlerList;
-    PakSocketReactor mReactor;
-
-    volatile bool mStopping;
-    UtSemaphore mHandlerAccess;
-    std::recursive_mutex mReactorLock;
-    //! List of handlers that are removed, and need to notify user
-    HandlerList mRemovedHandlers;
-    //! List of handlers that are waiting to be removed from reactor
-    HandlerList mDeadHandlers;
-    //! List of active handlers
-    HandlerList mHandlers;
+    PakSocketReactor::Backend mBackend;
+    //! Reactor shards, shard 0 is always present.  Fixed once IO is added.
+    std::vector<Shard*> mShards;
+    ShardPolicy mShardPolicy;
+    size_t mNextShard;
+    size_t mQueueCapacity;
+    OverflowPolicy mOverflowPolicy;
+    SendMode mSendMode;
+    size_t mHighWatermark;
+    size_t mLowWatermark;
+    //! Handlers by IO, for Send() and SendToAll().  Guarded by mSendHandlersLock.
+    std::map<PakSocketIO*, Handler*> mSendHandlers;
+    std::mutex mSendHandlersLock;
+    //! Signals a consumer blocked in WaitForPackets()
+    std::mutex mWakeupLock;
+    std::condition_variable mWakeupCondition;
+    bool mWakeupPending;
 };
 
 #endif
@@ -1,10 +1,15 @@
 ﻿#include "PacketIO/PakUDP_IO.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <iostream>
 
 #include "GenIO/GenBufOManaged.h"
+#include "GenIO/GenIP.h"
 #include "GenIO/GenUDP_Connection.h"
 #include "GenIO/GenUDP_IO.h"
+#include "PacketIO/PakEncodedPacket.h"
 #include "PacketIO/PakI.h"
 #include "PacketIO/PakO.h"
 #include "PacketIO/PakPacket.h"
@@ -12,37 +17,197 @@
 #include "PacketIO/PakSerialize.h"
 
 PakUDP_IO::PakUDP_IO(GenUDP_Connection* aConnection, PakProcessor* aProcessorPtr, PakHeader* aHeaderType)
-    : PakSocketIO(aHeaderType), mConnectionPtr(aConnection), mProcessorPtr(aProcessorPtr), mSerializeWriter(new PakO(&mBufO)), mSerializeReader(new PakI(&mBufI)), mHasReadHeader(false)
+    : PakSocketIO(aHeaderType), mConnectionPtr(aConnection), mProcessorPtr(aProcessorPtr), mSerializeWriter(new PakO(&mBufO)), mSerializeReader(new PakI(&mBufI)), mHasReadHeader(false), mNextFrame(0), mReliablePtr(nullptr), mCoalesceSize(0), mCoalesceDelay(Clock::duration::zero())
 {
     mHeaderSize = GetHeaderSize();
     assert(mHeaderSize != 0);
     mBufI.SetBigEndian();
     mBufO.SetBigEndian();
+    // Packets are stamped with when the kernel received their datagram
+    if (mConnectionPtr->GetRecvSocket() != nullptr)
+    {
+        mConnectionPtr->GetRecvSocket()->AddSocketOptions(GenSockets::GenSocket::cRECEIVE_TIMESTAMPS);
+    }
 }
 
 PakUDP_IO::~PakUDP_IO()
 {
+    Flush();
     delete mSerializeWriter;
     delete mSerializeReader;
+    delete mReliablePtr;
     delete mConnectionPtr;
 }
 
+//! Sends and receives through a PakReliableUDP, which sequences, acknowledges and fragments
+//! packets so they may be larger than a datagram.  The reliability layer is used once the peer
+//! is found to have one too, until then packets are sent as plain datagrams.
+//! The connection must send to one address, which is also the only address received from.
+//! Must be called before the IO is used, and before it is added to a PakThreadedIO.
+void PakUDP_IO::SetReliable(const PakReliableUDP::Options& aOptions)
+{
+    delete mReliablePtr;
+    mReliablePtr = new PakReliableUDP(mConnectionPtr, aOptions);
+    // ReceiveHeader() passes the sender on to the reliability layer
+    mConnectionPtr->RememberSenderAddress(true);
+}
+
+//! Packs consecutive packets into one datagram, so a burst of small packets costs one system call
+//! for the sender and one for the receiver.  A datagram is sent once the next packet does not fit,
+//! or aMaximumDelay after its first packet was queued.  Packets too large to share a datagram are
+//! sent on their own, after the queued ones.  Has no effect while SetReliable() is in effect.
+//! Nothing is negotiated with the receivers, see the warning in PakUDP_IO.h.
+//! Must be called before the IO is used, and before it is added to a PakThreadedIO.
+//! @param aDatagramSize The largest datagram sent, 0 disables coalescing.  1200 bytes fits the
+//!                      path MTU of any common network.
+//! @param aMaximumDelay The longest time in seconds a packet waits for others to join it.
+//!                      The epoll backend of PakSocketReactor rounds it up to a millisecond
+//!                      on kernels older than Linux 5.11, which lack epoll_pwait2().
+void PakUDP_IO::SetCoalescing(size_t aDatagramSize, double aMaximumDelay)
+{
+    Flush();
+    mCoalesceSize = aDatagramSize;
+    mCoalesceDelay = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(std::max(aMaximumDelay, 0.0)));
+    mCoalesced.reserve(aDatagramSize);
+}
+
+//! Sends the coalesced datagram now, instead of waiting for its deadline.
+void PakUDP_IO::Flush()
+{
+    std::lock_guard<std::mutex> lock(mCoalesceMutex);
+    FlushP();
+}
+
+void PakUDP_IO::SetTimerStartedCallback(const std::function<void()>& aFunc)
+{
+    std::lock_guard<std::mutex> lock(mCoalesceMutex);
+    mTimerStartedFn = aFunc;
+}
+
+//! Runs the retransmit timers of the reliability layer and sends a coalesced datagram whose
+//! deadline passed.  PakThreadedIO calls this for the IO it reads, otherwise it must be called
+//! periodically while SetReliable() or SetCoalescing() is in effect.
+//! @return The time in seconds until Update() is needed again, or a negative value if it is not.
+double PakUDP_IO::Update()
+{
+    double waitTime = (mReliablePtr != nullptr) ? mReliablePtr->Update() : -1.0;
+    if (mCoalesceSize != 0)
+    {
+        std::lock_guard<std::mutex> lock(mCoalesceMutex);
+        if (!mCoalesced.empty())
+        {
+            Clock::duration remaining = mCoalesceDeadline - Clock::now();
+            if (remaining <= Clock::duration::zero())
+            {
+                FlushP();
+            }
+            else
+            {
+                double coalesceWait = std::chrono::duration<double>(remaining).count();
+                waitTime = (waitTime < 0.0) ? coalesceWait : std::min(waitTime, coalesceWait);
+            }
+        }
+    }
+    return waitTime;
+}
+
+//! Queues a frame, a packet and its header, in the coalesced datagram.
+//! The datagram is sent first if the frame does not fit, or if its deadline passed.
+void PakUDP_IO::CoalesceP(const char* aFrame, size_t aBytes)
+{
+    std::lock_guard<std::mutex> lock(mCoalesceMutex);
+    Clock::time_point now = Clock::now();
+    if (!mCoalesced.empty() && (mCoalesced.size() + aBytes > mCoalesceSize || now >= mCoalesceDeadline))
+    {
+        FlushP();
+    }
+    if (aBytes >= mCoalesceSize)
+    {
+        mConnectionPtr->SendBuffer(aFrame, (int)aBytes);
+        return;
+    }
+    bool timerStarted = mCoalesced.empty();
+    mCoalesced.insert(mCoalesced.end(), aFrame, aFrame + aBytes);
+    if (mCoalesced.size() + mHeaderSize >= mCoalesceSize)
+    {
+        // Not even an empty packet fits in what is left
+        FlushP();
+    }
+    else if (timerStarted)
+    {
+        mCoalesceDeadline = now + mCoalesceDelay;
+        if (mTimerStartedFn)
+        {
+            mTimerStartedFn();
+        }
+    }
+}
+
+//! Sends the coalesced datagram, if any.  mCoalesceMutex must be locked.
+void PakUDP_IO::FlushP()
+{
+    if (!mCoalesced.empty())
+    {
+        mConnectionPtr->SendBuffer(mCoalesced.data(), (int)mCoalesced.size());
+        mCoalesced.clear();
+    }
+}
+
 //! send a packet.
 //! @param aPkt The PakPacket to send.
 //! @return 'true' if successfully sent.
+//!         With SetReliable(), 'false' if the reliability layer's queue is full.
 bool PakUDP_IO::Send(const PakPacket& aPkt)
 {
+    bool sent = true;
     mBufO.GetPutPos() += mHeaderSize;
     PakProcessor::PacketInfo* info = mProcessorPtr->GetPacketInfo(aPkt.ID());
     // should be constant operation...
     (*info->mWriteFn)(const_cast<PakPacket&>(aPkt), *mSerializeWriter);
 
-    int length = (int)mBufO.GetPutPos();
-    mBufO.SetPutPos(0);
-    SetPacketHeader(mBufO, aPkt.ID(), length);
-    mBufO.SetPutPos(length);
-    mConnectionPtr->SendBuffer(mBufO.GetBuffer(), length);
+    int length = (int)FramePacket(mBufO, 0, mBufO.GetPutPos(), aPkt.ID());
+    if (mReliablePtr != nullptr)
+    {
+        sent = mReliablePtr->SendFrame(mBufO.GetBuffer(), length, aPkt.ID());
+    }
+    else if (mCoalesceSize != 0)
+    {
+        CoalesceP(mBufO.GetBuffer(), length);
+    }
+    else
+    {
+        mConnectionPtr->SendBuffer(mBufO.GetBuffer(), length);
+    }
     mBufO.Reset();
+    if (sent)
+    {
+        mProcessorPtr->PacketSent(aPkt.ID(), length);
+    }
+    return sent;
+}
+
+//! send a packet that is serialized once and shared between IOs.
+//! @param aPkt The encoded packet to send.
+//! @return 'true' if successfully sent.
+bool PakUDP_IO::SendEncoded(PakEncodedPacket& aPkt)
+{
+    const GenBuffer& frame = GetFrame(aPkt);
+    if (mReliablePtr != nullptr)
+    {
+        if (!mReliablePtr->SendFrame(frame.GetBuffer(), frame.GetPutPos(), aPkt.GetPacket().ID()))
+        {
+            return false;
+        }
+    }
+    else if (mCoalesceSize != 0)
+    {
+        CoalesceP(frame.GetBuffer(), frame.GetPutPos());
+    }
+    else
+    {
+        mConnectionPtr->SendBuffer(frame.GetBuffer(), (int)frame.GetPutPos());
+    }
+    mProcessorPtr->PacketSent(aPkt.GetPacket().ID(), frame.GetPutPos());
     return true;
 }
 
@@ -53,26 +218,74 @@ bool PakUDP_IO::Send(const PakPacket& aPkt)
 //! @return 'true' if a PakPacket header was read
 bool PakUDP_IO::ReceiveHeader(int& aPacketId, int& aPacketLength, int aWaitTimeMicroSeconds)
 {
-    if (!mHasReadHeader)
+    if (!mHasReadHeader && mNextFrame < mBufI.GetPutPos())
+    {
+        // The next packet of a coalesced datagram
+        mBufI.SetGetPos(mNextFrame);
+        ReadHeader((int)mBufI.GetPutPos());
+    }
+    if (!mHasReadHeader && mReadyFrames.empty())
     {
         mBufI.Reset();
         int bytes = mConnectionPtr->ReceiveBuffer(aWaitTimeMicroSeconds, mBufI.GetBuffer(), (int)mBufI.GetBytes());
         if (bytes > 0)
         {
-            mBufI.SetPutPos(bytes);
-            bool headerValid;
-            mHasReadHeader = GetPacketHeader(mBufI, mHeaderPacketId, mHeaderPacketLength, headerValid);
-            mHasReadHeader = mHasReadHeader && headerValid;
-            if (!mHasReadHeader)
+            SetReceiveTime(PakProcessor::GetMetricsTime());
+            if (mReliablePtr != nullptr && PakReliableUDP::IsReliableDatagram(mBufI.GetBuffer(), bytes))
             {
+                mReliablePtr->ProcessDatagram(mBufI.GetBuffer(), bytes, mConnectionPtr->GetLastSenderAddress(), mFrames);
+                mReliablePtr->FlushAck();
+                for (const PakReliableUDP::Frame& frame : mFrames)
+                {
+                    mReadyFrames.emplace_back(frame.mData, frame.mData + frame.mBytes);
+                }
+                mFrames.clear();
                 mBufI.Reset();
             }
+            else
+            {
+                ReadHeader(bytes);
+            }
         }
     }
+    if (!mHasReadHeader && !mReadyFrames.empty())
+    {
+        // A datagram may complete several frames, they are read one at a time
+        std::vector<char>& frame = mReadyFrames.front();
+        mBufI.Reset();
+        mBufI.Grow(frame.size());
+        memcpy(mBufI.GetBuffer(), frame.data(), frame.size());
+        ReadHeader((int)frame.size());
+        mReadyFrames.pop_front();
+    }
     if (mHasReadHeader)
     {
         aPacketId = mHeaderPacketId;
-        aPacketLength = mHeaderPacketLength;
+        aPacketLength = GetDecompressedLength(mHeaderPacketLength);
+    }
+    return mHasReadHeader;
+}
+
+//! Read the header of the packet at the get position of a datagram of aBytes already placed in mBufI.
+//! @return 'true' if the header is valid
+bool PakUDP_IO::ReadHeader(int aBytes)
+{
+    mBufI.SetPutPos(aBytes);
+    size_t frameStart = mBufI.GetGetPos();
+    bool headerValid;
+    mHasReadHeader = GetPacketHeader(mBufI, mHeaderPacketId, mHeaderPacketLength, headerValid);
+    // A packet never spans datagrams.  This also rejects datagrams of a PakReliableUDP.
+    mHasReadHeader = mHasReadHeader && headerValid && mHeaderPacketLength >= mHeaderSize &&
+                     (size_t)mHeaderPacketLength <= aBytes - frameStart;
+    if (!mHasReadHeader)
+    {
+        mBufI.Reset();
+        mNextFrame = 0;
+    }
+    else
+    {
+        mNextFrame = frameStart + mHeaderPacketLength;
+        CapturePacket(mBufI, mHeaderPacketId, mHeaderPacketLength);
     }
     return mHasReadHeader;
 }
@@ -86,10 +299,21 @@ bool PakUDP_IO::Receive(PakPacket& aPkt)
     if (mHasReadHeader)
     {
         PakProcessor::PacketInfo* info = mProcessorPtr->GetPacketInfo(aPkt.ID());
-        // should be constant operation...
-        (*info->mReadFn)(const_cast<PakPacket&>(aPkt), *mSerializeReader);
         mHasReadHeader = false;
-        lReturn = true;
+        if (BeginInflate(mBufI, mHeaderPacketLength - mHeaderSize))
+        {
+            // should be constant operation...
+            (*info->mReadFn)(const_cast<PakPacket&>(aPkt), *mSerializeReader);
+            EndInflate(mBufI);
+            lReturn = true;
+        }
+        else
+        {
+            std::cout << "Could not decompress packet."
+                      << " Name: " << info->GetPacketName()
+                      << " ID: " << aPkt.ID()
+                      << std::endl;
+        }
     }
     return lReturn;
 }
@@ -113,3 +337,82 @@ PakPacket* PakUDP_IO::ReceiveNew()
 {
     return mProcessorPtr->ReadPacket(*this);
 }
+
+//! Read every datagram already waiting on the socket, up to cRECEIVE_BATCH_SIZE,
+//! with as few system calls as the platform allows, and decode each into a packet.
+//! The originator address and port of each packet are set to its datagram's sender.
+//! A coalesced datagram, or one received with SetReliable(), may yield several packets.
+//! Must not be mixed with a pending ReceiveHeader().
+//! @param aPackets The decoded packets are appended here.
+//! @return The number of datagrams read.  Zero when none were waiting.
+int PakUDP_IO::ReceiveBatch(std::vector<PakPacket*>& aPackets)
+{
+    if (mBatch.empty())
+    {
+        size_t datagramSize = mBufI.GetBytes();
+        mBatchStorage.resize(datagramSize * cRECEIVE_BATCH_SIZE);
+        mBatchSenders.resize(cRECEIVE_BATCH_SIZE);
+        mBatch.resize(cRECEIVE_BATCH_SIZE);
+        for (int i = 0; i < cRECEIVE_BATCH_SIZE; ++i)
+        {
+            mBatch[i].mBuffer = &mBatchStorage[i * datagramSize];
+            mBatch[i].mBufferSize = (int)datagramSize;
+            mBatch[i].mAddressPtr = &mBatchSenders[i];
+        }
+    }
+    int count = mConnectionPtr->ReceiveBatch(mBatch.data(), cRECEIVE_BATCH_SIZE);
+    for (int i = 0; i < count; ++i)
+    {
+        char* data = mBatch[i].mBuffer;
+        int bytes = mBatch[i].mBytes;
+        const GenSockets::GenInternetSocketAddress& sender = *mBatch[i].mAddressPtr;
+        SetReceiveTime(mBatch[i].mReceiveTime);
+        if (mReliablePtr != nullptr && PakReliableUDP::IsReliableDatagram(data, bytes))
+        {
+            mReliablePtr->ProcessDatagram(data, bytes, sender, mFrames);
+            for (const PakReliableUDP::Frame& frame : mFrames)
+            {
+                ReceiveFrame(const_cast<char*>(frame.mData), (int)frame.mBytes, sender, aPackets);
+            }
+            mFrames.clear();
+        }
+        else
+        {
+            ReceiveFrame(data, bytes, sender, aPackets);
+        }
+    }
+    if (mReliablePtr != nullptr && count > 0)
+    {
+        // One acknowledgement for the whole batch
+        mReliablePtr->FlushAck();
+    }
+    return count;
+}
+
+//! Decodes the packets of a datagram, each with its header, straight out of aData.
+//! Invalid packets are skipped, and end the datagram.
+//! @param aPackets The decoded packets are appended here.
+void PakUDP_IO::ReceiveFrame(char* aData, int aBytes, const GenSockets::GenInternetSocketAddress& aSender, std::vector<PakPacket*>& aPackets)
+{
+    GenBuffer frame(aData, aBytes);
+    mBufI.SwapBuffer(frame);
+    mNextFrame = 0;
+    GenSockets::GenIP ip = aSender.GetAddress();
+    while (mNextFrame < (size_t)aBytes && ReadHeader(aBytes))
+    {
+        size_t nextFrame = mNextFrame;
+        PakPacket* pktPtr = ReceiveNew();
+        if (pktPtr != nullptr)
+        {
+            pktPtr->SetOriginatorAddress(ip.GetAddress());
+            pktPtr->SetOriginatorPort(aSender.GetPort());
+            aPackets.push_back(pktPtr);
+        }
+        mBufI.SetGetPos(nextFrame);
+        mNextFrame = nextFrame;
+    }
+    mHasReadHeader = false;
+    mBufI.SwapBuffer(frame);
+    mBufI.Reset();
+    mNextFrame = 0;
+}
@@ -3,7 +3,15 @@
 
 #include "NXPacketIO_Export.h"
 
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "GenIO/GenInternetSocketAddress.h"
+#include "GenIO/GenSocket.h"
 #include "PacketIO/PakDefaultHeader.h"
+#include "PacketIO/PakReliableUDP.h"
 #include "PacketIO/PakSocketIO.h"
 class GenUDP_Connection;
 class PakPacket;
@@ -11,7 +19,8 @@ class PakProcessor;
 class PakO;
 class PakI;
 //! Sends and receives packets via UDP.
-//! Each PakPacket must fit inside a UDP packet.
+//! Each PakPacket must fit inside a UDP packet, unless SetReliable() is used.
+//! A datagram may hold several packets back to back, each with its own header, see SetCoalescing().
 class NX_PACKETIO_EXPORT PakUDP_IO : public PakSocketIO
 {
 public:
@@ -20,6 +29,8 @@ public:
 
     bool Send(const PakPacket& aPkt) override;
 
+    bool SendEncoded(PakEncodedPacket& aPkt) override;
+
     bool ReceiveHeader(int& aPacketId, int& aPacketLength, int aWaitTimeMicroSeconds) override;
 
     bool Receive(PakPacket& aPkt) override;
@@ -34,12 +45,45 @@ public:
 
     PakPacket* ReceiveNew();
 
-    PakProcessor* GetPakProcessor() const { return mProcessorPtr; }
+    //! The most datagrams read by a single ReceiveBatch() call
+    static const int cRECEIVE_BATCH_SIZE = 16;
+
+    int ReceiveBatch(std::vector<PakPacket*>& aPackets);
+
+    PakProcessor* GetPakProcessor() const override { return mProcessorPtr; }
+
+    void SetReliable(const PakReliableUDP::Options& aOptions);
+
+    //! Returns the reliability layer, or null if SetReliable() was not called
+    PakReliableUDP* GetReliable() const { return mReliablePtr; }
+
+    //! WARNING: Both ends need coalescing support.  It is not negotiated, and a receiver built
+    //! before PakUDP_IO unpacked coalesced datagrams silently drops every packet but the first.
+    //! Only enable it when every receiver of the target runs this version or later.
+    void SetCoalescing(size_t aDatagramSize, double aMaximumDelay);
+
+    //! Returns 'true' if SetCoalescing() enabled coalescing
+    bool IsCoalescing() const { return mCoalesceSize != 0; }
+
+    void Flush();
+
+    //! Sets a function called when a send starts a timer, so the thread calling Update() can wait
+    //! less.  It is called on the sending thread.  PakThreadedIO sets this for the IO it reads,
+    //! and clears it in RemoveIO().
+    void SetTimerStartedCallback(const std::function<void()>& aFunc);
+
+    double Update();
 
 protected:
+    typedef PakReliableUDP::Clock Clock;
+
+    bool ReadHeader(int aBytes);
+    void ReceiveFrame(char* aData, int aBytes, const GenSockets::GenInternetSocketAddress& aSender, std::vector<PakPacket*>& aPackets);
     void ReadUDP();
     bool ReadMoreUDP();
     bool ReadToBoundaryUDP();
+    void CoalesceP(const char* aFrame, size_t aBytes);
+    void FlushP();
     GenUDP_Connection* mConnectionPtr;
     PakProcessor* mProcessorPtr;
     GenBuffer mBufO;
@@ -53,6 +97,25 @@ protected:
     int mHeaderPacketLength;
     char* mEmptyJunk;
     int mHeaderSize;
+    //! Offset in mBufI of the packet after the one whose header was read
+    size_t mNextFrame;
+    std::vector<char> mBatchStorage;
+    std::vector<GenSockets::GenSocket::Datagram> mBatch;
+    std::vector<GenSockets::GenInternetSocketAddress> mBatchSenders;
+    PakReliableUDP* mReliablePtr;
+    std::vector<PakReliableUDP::Frame> mFrames;
+    //! Frames received by ReceiveHeader() that are not yet read
+    std::deque<std::vector<char>> mReadyFrames;
+
+    //! Largest coalesced datagram, 0 if coalescing is disabled
+    size_t mCoalesceSize;
+    Clock::duration mCoalesceDelay;
+    //! Guards the coalesced datagram, which the sending thread and Update() both send
+    std::mutex mCoalesceMutex;
+    std::vector<char> mCoalesced;
+    //! When the coalesced datagram must be sent
+    Clock::time_point mCoalesceDeadline;
+    std::function<void()> mTimerStartedFn;
 
 private:
     void operator=(const PakUDP_IO&); // Not allowed
@@ -1,5 +1,7 @@
 ﻿#include "Util/UtCallback.h"
 
+#include <cstring>
+
 void UtCallbackLink::Merge(UtCallbackList* aOtherCallbackList)
 {
     mCallbackListPtr = aOtherCallbackList;
@@ -35,23 +37,35 @@ UtCallback::~UtCallback()
 
 void UtCallbackList::MergeP(UtCallbackList& aOtherCallbackList)
 {
-    ListType& otherCbList = aOtherCallbackList.mCallbackList;
-    ListType& otherBlockedCbList = aOtherCallbackList.mBlockedCallbackList;
-
-    for (IterType i = otherCbList.begin(); i != otherCbList.end(); ++i)
+    for (const Entry& entry : aOtherCallbackList.mCallbackList)
     {
-        UtCallback* callback = *i;
-        callback->Merge(this);
+        if (entry.mCallbackPtr != nullptr)
+        {
+            entry.mCallbackPtr->Merge(this);
+            mCallbackList.push_back(entry);
+            ++mActiveCount;
+        }
     }
-
-    for (IterType i = otherBlockedCbList.begin(); i != otherBlockedCbList.end(); ++i)
+    for (UtCallback* callback : aOtherCallbackList.mBlockedCallbackList)
     {
-        UtCallback* callback = *i;
         callback->Merge(this);
+        mBlockedCallbackList.push_back(callback);
     }
 
-    mCallbackList.splice(mCallbackList.end(), otherCbList);
-    mBlockedCallbackList.splice(mBlockedCallbackList.end(), otherBlockedCbList);
+    if (aOtherCallbackList.mDispatchDepth > 0)
+    {
+        for (Entry& entry : aOtherCallbackList.mCallbackList)
+        {
+            entry = Entry{nullptr, nullptr, {}};
+        }
+        aOtherCallbackList.mHasTombstones = !aOtherCallbackList.mCallbackList.empty();
+    }
+    else
+    {
+        aOtherCallbackList.mCallbackList.clear();
+    }
+    aOtherCallbackList.mBlockedCallbackList.clear();
+    aOtherCallbackList.mActiveCount = 0;
 }
 
 void UtCallbackList::ConnectP(UtCallback* aCallbackPtr)
@@ -59,68 +73,128 @@ void UtCallbackList::ConnectP(UtCallback* aCallbackPtr)
     // If the callback is currently connected to a list then disconnect it from that list.
     aCallbackPtr->Disconnect();
 
-    // Connect the callback if not already in the list.
-    if (std::find(mCallbackList.begin(), mCallbackList.end(), aCallbackPtr) == mCallbackList.end())
+    bool hadCallbacks = HasCallbacks();
+    aCallbackPtr->mCallbackLinkPtr = new CallbackLink(this);
+    if (aCallbackPtr->IsBlocked())
     {
-        aCallbackPtr->mCallbackLinkPtr = new CallbackLink(this);
-        if (aCallbackPtr->IsBlocked())
-        {
-            mBlockedCallbackList.push_back(aCallbackPtr);
-        }
-        else
-        {
-            mCallbackList.push_back(aCallbackPtr);
-        }
+        mBlockedCallbackList.push_back(aCallbackPtr);
+    }
+    else
+    {
+        Activate(aCallbackPtr);
+    }
+    if (!hadCallbacks)
+    {
+        HasCallbacksChanged();
     }
 }
 
 void UtCallbackList::DisconnectAll()
 {
+    bool hadCallbacks = HasCallbacks();
     // Tell each connected subscriber that they have been disconnected.
+    for (Entry& entry : mCallbackList)
     {
-        for (IterType it = mCallbackList.begin(); it != mCallbackList.end(); ++it)
+        if (entry.mCallbackPtr != nullptr)
         {
-            delete (*it)->mCallbackLinkPtr;
-            (*it)->mCallbackLinkPtr = nullptr;
+            delete entry.mCallbackPtr->mCallbackLinkPtr;
+            entry.mCallbackPtr->mCallbackLinkPtr = nullptr;
+            entry = Entry{nullptr, nullptr, {}};
+            mHasTombstones = true;
         }
     }
-    mCallbackList.clear();
+    for (UtCallback* callback : mBlockedCallbackList)
     {
-        for (IterType it = mBlockedCallbackList.begin(); it != mBlockedCallbackList.end(); ++it)
-        {
-            delete (*it)->mCallbackLinkPtr;
-            (*it)->mCallbackLinkPtr = nullptr;
-        }
+        delete callback->mCallbackLinkPtr;
+        callback->mCallbackLinkPtr = nullptr;
     }
     mBlockedCallbackList.clear();
+    mActiveCount = 0;
+    if (mDispatchDepth == 0)
+    {
+        mCallbackList.clear();
+        mHasTombstones = false;
+    }
+    if (hadCallbacks)
+    {
+        HasCallbacksChanged();
+    }
 }
 
 void UtCallbackList::Disconnect(UtCallback* aCallbackPtr)
 {
-    bool found = true;
-    IterType it = std::find(mCallbackList.begin(), mCallbackList.end(), aCallbackPtr);
-    if (it == mCallbackList.end())
+    bool found = Deactivate(aCallbackPtr);
+    if (!found)
     {
-        it = std::find(mBlockedCallbackList.begin(), mBlockedCallbackList.end(), aCallbackPtr);
-        if (it == mBlockedCallbackList.end())
-        {
-            found = false;
-        }
-        else
+        auto it = std::find(mBlockedCallbackList.begin(), mBlockedCallbackList.end(), aCallbackPtr);
+        if (it != mBlockedCallbackList.end())
         {
             mBlockedCallbackList.erase(it);
+            found = true;
         }
     }
-    else
-    {
-        mCallbackList.erase(it);
-    }
     if (found)
     {
         // the subscriber it is no longer connected.
         delete aCallbackPtr->mCallbackLinkPtr;
         aCallbackPtr->mCallbackLinkPtr = nullptr;
+        if (!HasCallbacks())
+        {
+            HasCallbacksChanged();
+        }
+    }
+}
+
+//! Appends aCallbackPtr to the active callbacks.
+void UtCallbackList::Activate(UtCallback* aCallbackPtr)
+{
+    Entry entry = {aCallbackPtr, aCallbackPtr->mInvokePtr, {}};
+    if (aCallbackPtr->mIsRelocatable)
+    {
+        // Keep the callable with the entry, so calling it does not touch the callback object.
+        std::memcpy(entry.mData, aCallbackPtr->mTargetPtr, cINLINE_SIZE);
+    }
+    else
+    {
+        std::memcpy(entry.mData, &aCallbackPtr->mTargetPtr, sizeof(void*));
     }
+    mCallbackList.push_back(entry);
+    ++mActiveCount;
+}
+
+//! Removes aCallbackPtr from the active callbacks, leaving a tombstone if the list is being called.
+//! Returns 'false' if it is not active.
+bool UtCallbackList::Deactivate(UtCallback* aCallbackPtr)
+{
+    for (auto it = mCallbackList.begin(); it != mCallbackList.end(); ++it)
+    {
+        if (it->mCallbackPtr == aCallbackPtr)
+        {
+            if (mDispatchDepth > 0)
+            {
+                *it = Entry{nullptr, nullptr, {}};
+                mHasTombstones = true;
+            }
+            else
+            {
+                mCallbackList.erase(it);
+            }
+            --mActiveCount;
+            return true;
+        }
+    }
+    return false;
+}
+
+void UtCallbackList::RemoveTombstones() const
+{
+    // Tombstones only exist in a list that callbacks were connected to, which is never a const object.
+    ListType& callbackList = const_cast<ListType&>(mCallbackList);
+    callbackList.erase(std::remove_if(callbackList.begin(),
+                                      callbackList.end(),
+                                      [](const Entry& aEntry) { return aEntry.mCallbackPtr == nullptr; }),
+                       callbackList.end());
+    mHasTombstones = false;
 }
 
 UtCallbackList::~UtCallbackList()
@@ -129,12 +203,12 @@ UtCallbackList::~UtCallbackList()
 }
 
 UtCallbackList::UtCallbackList(const UtCallbackList& /*aSrc*/)
-    : mCallbackList(), mBlockedCallbackList()
+    : mCallbackList(), mBlockedCallbackList(), mActiveCount(0), mDispatchDepth(0), mHasTombstones(false)
 {
 }
 
 UtCallbackList::UtCallbackList()
-    : mCallbackList(), mBlockedCallbackList()
+    : mCallbackList(), mBlockedCallbackList(), mActiveCount(0), mDispatchDepth(0), mHasTombstones(false)
 {
 }
 
@@ -142,12 +216,19 @@ void UtCallbackLink::Block(UtCallback* aCallbackPtr, bool aBlock)
 {
     if (aBlock)
     {
-        mCallbackListPtr->mCallbackList.remove(aCallbackPtr);
-        mCallbackListPtr->mBlockedCallbackList.push_back(aCallbackPtr);
+        if (mCallbackListPtr->Deactivate(aCallbackPtr))
+        {
+            mCallbackListPtr->mBlockedCallbackList.push_back(aCallbackPtr);
+        }
     }
     else
     {
-        mCallbackListPtr->mBlockedCallbackList.remove(aCallbackPtr);
-        mCallbackListPtr->mCallbackList.push_back(aCallbackPtr);
+        auto& blockedList = mCallbackListPtr->mBlockedCallbackList;
+        auto it = std::find(blockedList.begin(), blockedList.end(), aCallbackPtr);
+        if (it != blockedList.end())
+        {
+            blockedList.erase(it);
+            mCallbackListPtr->Activate(aCallbackPtr);
+        }
     }
 }
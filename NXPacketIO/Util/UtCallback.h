@@ -4,8 +4,10 @@
 #include "NXPacketIO_Export.h"
 
 #include <algorithm>
+#include <cstddef>
 #include <functional>
-#include <list>
+#include <tuple>
+#include <vector>
 
 #include "Util/UtBinder.h"
 class UtCallback;
@@ -34,12 +36,16 @@ class UtCallback
 public:
     friend class UtCallbackList;
 
+    //! Invokes a callback's target with its arguments held in a std::tuple of references,
+    //! see UtFunction::ArgsInvokeFunc.  Callbacks of any signature share this type.
+    using InvokeFunc = void (*)(void* aTargetPtr, void* aArgsPtr);
+
     NX_PACKETIO_EXPORT UtCallback()
-        : mCallbackLinkPtr(nullptr), mIsBlocked(false)
+        : mCallbackLinkPtr(nullptr), mIsBlocked(false), mIsRelocatable(false), mInvokePtr(nullptr), mTargetPtr(nullptr)
     {
     }
     NX_PACKETIO_EXPORT UtCallback(const UtCallback& /*aSrc*/)
-        : mCallbackLinkPtr(nullptr), mIsBlocked(false)
+        : mCallbackLinkPtr(nullptr), mIsBlocked(false), mIsRelocatable(false), mInvokePtr(nullptr), mTargetPtr(nullptr)
     {
     }
     NX_PACKETIO_EXPORT virtual ~UtCallback();
@@ -52,6 +58,19 @@ public:
     //! Returns true if this callback is currently blocked.
     bool IsBlocked() const { return mIsBlocked; }
 
+protected:
+    //! Sets how a callback list invokes this callback.  If aIsRelocatable, the list keeps a copy
+    //! of the first UtCallbackList::cINLINE_SIZE bytes at aTargetPtr, and aInvokePtr is called with
+    //! a pointer to the copy and the call's arguments.  Otherwise the list keeps a copy of aTargetPtr
+    //! itself, and aInvokePtr is called with a pointer to that void*.
+    //! It must be set before the callback is connected.
+    void SetInvoker(InvokeFunc aInvokePtr, void* aTargetPtr, bool aIsRelocatable)
+    {
+        mInvokePtr = aInvokePtr;
+        mTargetPtr = aTargetPtr;
+        mIsRelocatable = aIsRelocatable;
+    }
+
 private:
     void Merge(UtCallbackList* aOtherCallbackList) { mCallbackLinkPtr->Merge(aOtherCallbackList); }
 
@@ -59,8 +78,17 @@ private:
 
     UtCallbackLink* mCallbackLinkPtr;
     bool mIsBlocked;
+    bool mIsRelocatable;
+    InvokeFunc mInvokePtr;
+    void* mTargetPtr;
 };
 
+//! A list of callbacks, called in the order they were connected.
+//! The active callbacks are kept in a contiguous array along with how to invoke them, so
+//! calling the list does not visit the callback objects.  Callbacks may be connected,
+//! disconnected, blocked or destroyed while the list is being called, including by the
+//! callback being called: removed entries are left as tombstones until the outermost call
+//! returns, and callbacks connected during a call are called by it.
 class NX_PACKETIO_EXPORT UtCallbackList
 {
 public:
@@ -70,8 +98,21 @@ public:
 
     using cUT_SERIALIZE_IGNORE = bool;
 
-    using ListType = std::list<UtCallback*>;
-    using IterType = std::list<UtCallback*>::iterator;
+    //! Size of the callable a list entry can hold, see UtCallback::SetInvoker().
+    static const size_t cINLINE_SIZE = 3 * sizeof(void*);
+
+    //! An active callback.  mCallbackPtr and mInvokePtr are null for a callback removed
+    //! while the list is being called.  mData holds what mInvokePtr is called with, see
+    //! UtCallback::SetInvoker().
+    struct Entry
+    {
+        UtCallback* mCallbackPtr;
+        UtCallback::InvokeFunc mInvokePtr;
+        alignas(void*) unsigned char mData[cINLINE_SIZE];
+    };
+
+    using ListType = std::vector<Entry>;
+    using IterType = ListType::iterator;
 
     explicit UtCallbackList();
     explicit UtCallbackList(const UtCallbackList& /*aSrc*/);
@@ -80,17 +121,71 @@ public:
     void Disconnect(UtCallback* aCallbackPtr);
     void DisconnectAll();
 
-    bool IsEmpty() const { return mCallbackList.empty(); }
+    bool IsEmpty() const { return mActiveCount == 0; }
+
+    //! Returns 'true' if any callback is connected, including blocked callbacks.
+    bool HasCallbacks() const { return mActiveCount != 0 || !mBlockedCallbackList.empty(); }
 
 protected:
+    //! Called when the first callback is connected, or the last is disconnected.  See HasCallbacks().
+    virtual void HasCallbacksChanged() {}
+
     void ConnectP(UtCallback* aCallbackPtr);
 
     void MergeP(UtCallbackList& aOtherCallbackList);
 
+    //! Calls each active callback with aArgs.  Args must match the signature the callbacks
+    //! were created with.
+    template <typename... Args>
+    void CallP(Args... aArgs) const
+    {
+        std::tuple<Args&...> args(aArgs...);
+        DispatchGuard guard(*this);
+        // The end is re-read each time, as callbacks may connect others.  Comparing iterators
+        // rather than sizes avoids a division by sizeof(Entry) per callback.
+        for (size_t i = 0; mCallbackList.begin() + i != mCallbackList.end(); ++i)
+        {
+            const Entry& entry = mCallbackList[i];
+            if (entry.mInvokePtr != nullptr)
+            {
+                entry.mInvokePtr(const_cast<unsigned char*>(entry.mData), &args);
+            }
+        }
+    }
+
     ListType mCallbackList;
 
 private:
-    ListType mBlockedCallbackList;
+    //! Tracks nested calls, and removes tombstones once the outermost call returns.
+    class DispatchGuard
+    {
+    public:
+        explicit DispatchGuard(const UtCallbackList& aList)
+            : mList(aList)
+        {
+            ++mList.mDispatchDepth;
+        }
+        ~DispatchGuard()
+        {
+            if (--mList.mDispatchDepth == 0 && mList.mHasTombstones)
+            {
+                mList.RemoveTombstones();
+            }
+        }
+
+    private:
+        const UtCallbackList& mList;
+    };
+
+    void Activate(UtCallback* aCallbackPtr);
+    bool Deactivate(UtCallback* aCallbackPtr);
+    void RemoveTombstones() const;
+
+    std::vector<UtCallback*> mBlockedCallbackList;
+    //! Number of entries in mCallbackList that are not tombstones
+    size_t mActiveCount;
+    mutable int mDispatchDepth;
+    mutable bool mHasTombstones;
     UtCallbackList& operator=(const UtCallbackList&) = delete;
 };
 
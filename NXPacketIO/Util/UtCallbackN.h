@@ -2,9 +2,11 @@
 #define UT_CALLBACK_N_H
 
 #include <memory>
+#include <type_traits>
 #include <vector>
 
 #include "Util/UtCallback.h"
+#include "Util/UtFunction.h"
 
 template <typename Signature>
 class UtCallbackN;
@@ -22,12 +24,57 @@ public:
     UtCallbackN(const FunctionType& aFunc)
         : mFunc(aFunc)
     {
+        SetInvoker();
     }
+    //! Stores aFunc directly, rather than in a std::function.
+    template <typename F, typename = typename std::enable_if<!std::is_convertible<F, const UtCallbackN&>::value>::type>
+    explicit UtCallbackN(F&& aFunc)
+        : mFunc(std::forward<F>(aFunc))
+    {
+        SetInvoker();
+    }
+    UtCallbackN(const UtCallbackN& aSrc)
+        : UtCallback(aSrc), mFunc(aSrc.mFunc)
+    {
+        SetInvoker();
+    }
+
+    //! Creates a callback which calls a member function of aObjPtr.
+    template <typename CT>
+    static std::unique_ptr<UtCallbackN> Create(R (CT::*aFuncPtr)(Args...), CT* aObjPtr)
+    {
+        return std::make_unique<UtCallbackN>([aFuncPtr, aObjPtr](Args... args) -> R
+                                             { return (aObjPtr->*aFuncPtr)(std::forward<Args>(args)...); });
+    }
+
+    //! Creates a callback which calls a static function.
+    static std::unique_ptr<UtCallbackN> Create(R (*aFuncPtr)(Args...)) { return std::make_unique<UtCallbackN>(aFuncPtr); }
 
     R operator()(Args... args) const { return mFunc(args...); }
 
 private:
-    FunctionType mFunc;
+    void SetInvoker()
+    {
+        static_assert(UtFunction<R(Args...)>::cRELOCATABLE_SIZE <= UtCallbackList::cINLINE_SIZE, "Relocatable callables must fit a list entry");
+        if (mFunc.IsRelocatable())
+        {
+            UtCallback::SetInvoker(mFunc.GetRelocatedInvoker(), mFunc.GetTarget(), true);
+        }
+        else if (mFunc)
+        {
+            UtCallback::SetInvoker(&InvokeFunction, &mFunc, false);
+        }
+    }
+
+    //! Calls mFunc, for a callback whose target cannot be relocated.  aFuncPtrPtr points to a
+    //! void* holding the address of mFunc, see UtCallback::SetInvoker().
+    static void InvokeFunction(void* aFuncPtrPtr, void* aArgsPtr)
+    {
+        const void* funcPtr = *static_cast<void* const*>(aFuncPtrPtr);
+        UtFunction<R(Args...)>::InvokeWithArgs(*static_cast<const UtFunction<R(Args...)>*>(funcPtr), aArgsPtr);
+    }
+
+    UtFunction<R(Args...)> mFunc;
 };
 
 template <typename Signature>
@@ -40,13 +87,7 @@ class UtCallbackListN<R(Args...)> : public UtCallbackList
 public:
     using CallbackType = UtCallbackN<R(Args...)>;
 
-    void operator()(Args... args) const
-    {
-        for (auto it = mCallbackList.begin(); it != mCallbackList.end();)
-        {
-            (*static_cast<CallbackType*>(*it++))(args...);
-        }
-    }
+    void operator()(Args... args) const { CallP<Args...>(args...); }
 
     std::unique_ptr<CallbackType> Connect(const std::function<R(Args...)>& aFunc)
     {
@@ -55,6 +96,18 @@ public:
         return callbackPtr;
     }
 
+    //! Connects a lambda or other function object, which is stored without a std::function.
+    template <typename F,
+              typename = typename std::enable_if<!std::is_pointer<typename std::decay<F>::type>::value &&
+                                                 !std::is_same<typename std::decay<F>::type, std::function<R(Args...)>>::value &&
+                                                 std::is_invocable_r<R, F&, Args...>::value>::type>
+    std::unique_ptr<CallbackType> Connect(F&& aFunc)
+    {
+        auto callbackPtr = std::make_unique<CallbackType>(std::forward<F>(aFunc));
+        Connect(callbackPtr.get());
+        return callbackPtr;
+    }
+
     CallbackType* Connect(CallbackType* aCallbackPtr)
     {
         ConnectP(aCallbackPtr);
@@ -63,7 +116,7 @@ public:
 
     std::unique_ptr<CallbackType> Connect(R (*aFuncPtr)(Args...))
     {
-        auto callbackPtr = Create(UtStd::Bind(aFuncPtr));
+        auto callbackPtr = CallbackType::Create(aFuncPtr);
         Connect(callbackPtr.get());
         return callbackPtr;
     }
@@ -71,16 +124,19 @@ public:
     template <typename CT>
     std::unique_ptr<CallbackType> Connect(R (CT::*aFuncPtr)(Args...), CT* aObjPtr)
     {
-        auto callbackPtr = Create(UtStd::Bind(aFuncPtr, aObjPtr));
+        auto callbackPtr = CallbackType::Create(aFuncPtr, aObjPtr);
         Connect(callbackPtr.get());
         return callbackPtr;
     }
 
     void GetCallbacks(std::vector<CallbackType*>& aCallbacks) const
     {
-        for (const auto& callback: mCallbackList)
+        for (const auto& entry : mCallbackList)
         {
-            aCallbacks.push_back(static_cast<CallbackType*>(callback));
+            if (entry.mCallbackPtr != nullptr)
+            {
+                aCallbacks.push_back(static_cast<CallbackType*>(entry.mCallbackPtr));
+            }
         }
     }
 
@@ -0,0 +1,249 @@
+﻿#ifndef UTFUNCTION_H
+#define UTFUNCTION_H
+
+#include <cstddef>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+template <typename Signature>
+class UtFunction;
+
+//! A copyable, type-erased callable, like std::function, which stores callables of up to
+//! cBUFFER_SIZE bytes in place rather than on the heap.  That is enough for a bound member
+//! function or a lambda capturing a few pointers.
+//! GetInvoker() and GetTarget() expose the call, so that a caller such as UtCallbackList can
+//! keep them in a flat array and invoke the callable without going through this object.
+//! A relocatable callable may even be copied into that array, see IsRelocatable().
+//! Such an array may mix signatures, so GetRelocatedInvoker() takes the arguments as an ArgsTuple.
+template <typename R, typename... Args>
+class UtFunction<R(Args...)>
+{
+public:
+    using InvokeFunc = R (*)(void*, Args...);
+    //! The arguments of a call, as passed to an ArgsInvokeFunc
+    using ArgsTuple = std::tuple<Args&...>;
+    //! Calls a target with the ArgsTuple at aArgsPtr, discarding the result.
+    using ArgsInvokeFunc = void (*)(void* aTargetPtr, void* aArgsPtr);
+
+    static const size_t cBUFFER_SIZE = 4 * sizeof(void*);
+    //! Largest callable that may be relocatable
+    static const size_t cRELOCATABLE_SIZE = 3 * sizeof(void*);
+
+    UtFunction()
+        : mInvokePtr(nullptr), mManagePtr(nullptr), mRelocatedInvokePtr(nullptr), mTargetPtr(nullptr)
+    {
+    }
+
+    template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, UtFunction>::value>::type>
+    UtFunction(F&& aFunc)
+        : mInvokePtr(nullptr), mManagePtr(nullptr), mRelocatedInvokePtr(nullptr), mTargetPtr(nullptr)
+    {
+        Assign(std::forward<F>(aFunc));
+    }
+
+    UtFunction(const UtFunction& aSrc)
+        : mInvokePtr(nullptr), mManagePtr(nullptr), mRelocatedInvokePtr(nullptr), mTargetPtr(nullptr)
+    {
+        CopyFrom(aSrc);
+    }
+
+    UtFunction(UtFunction&& aSrc) noexcept
+        : mInvokePtr(nullptr), mManagePtr(nullptr), mRelocatedInvokePtr(nullptr), mTargetPtr(nullptr)
+    {
+        MoveFrom(aSrc);
+    }
+
+    ~UtFunction() { Reset(); }
+
+    UtFunction& operator=(const UtFunction& aRhs)
+    {
+        if (this != &aRhs)
+        {
+            Reset();
+            CopyFrom(aRhs);
+        }
+        return *this;
+    }
+
+    UtFunction& operator=(UtFunction&& aRhs) noexcept
+    {
+        if (this != &aRhs)
+        {
+            Reset();
+            MoveFrom(aRhs);
+        }
+        return *this;
+    }
+
+    R operator()(Args... aArgs) const { return mInvokePtr(mTargetPtr, std::forward<Args>(aArgs)...); }
+
+    explicit operator bool() const { return mInvokePtr != nullptr; }
+
+    //! Returns the function which calls the target, or null if empty.
+    InvokeFunc GetInvoker() const { return mInvokePtr; }
+
+    //! Returns the argument to pass to GetInvoker().  Valid until this function is changed or destroyed.
+    void* GetTarget() const { return mTargetPtr; }
+
+    //! Returns true if the target is at most cRELOCATABLE_SIZE bytes, trivially copyable and
+    //! callable as const, so a copy of its bytes behaves exactly like the target.
+    bool IsRelocatable() const { return mRelocatedInvokePtr != nullptr; }
+
+    //! Returns the function which calls a relocated copy of the target, or null if not relocatable.
+    //! It copies the target before calling it, so the copy's memory may be reused by the call.
+    ArgsInvokeFunc GetRelocatedInvoker() const { return mRelocatedInvokePtr; }
+
+    //! Calls aFunc with the ArgsTuple at aArgsPtr.  Arguments taken by value are copied, so the
+    //! same ArgsTuple may be passed to several calls.
+    template <typename F>
+    static void InvokeWithArgs(const F& aFunc, void* aArgsPtr)
+    {
+        InvokeWithArgsP(aFunc, *static_cast<ArgsTuple*>(aArgsPtr), std::index_sequence_for<Args...>());
+    }
+
+private:
+    enum Operation
+    {
+        cCOPY,
+        cMOVE,
+        cDESTROY
+    };
+    using ManageFunc = void (*)(Operation, UtFunction*, UtFunction*);
+
+    template <typename F>
+    struct IsLocal
+    {
+        static const bool value = sizeof(F) <= cBUFFER_SIZE && alignof(F) <= alignof(std::max_align_t) &&
+                                  std::is_nothrow_move_constructible<F>::value;
+    };
+
+    template <typename F>
+    struct IsRelocatableType
+    {
+        static const bool value = IsLocal<F>::value && sizeof(F) <= cRELOCATABLE_SIZE &&
+                                  std::is_trivially_copyable<F>::value && std::is_invocable<const F&, Args...>::value;
+    };
+
+    template <typename F>
+    static R Invoke(void* aTargetPtr, Args... aArgs)
+    {
+        return (*static_cast<F*>(aTargetPtr))(std::forward<Args>(aArgs)...);
+    }
+
+    template <typename F>
+    static void InvokeRelocated(void* aTargetPtr, void* aArgsPtr)
+    {
+        const F func = *static_cast<const F*>(aTargetPtr);
+        InvokeWithArgs(func, aArgsPtr);
+    }
+
+    template <typename F, size_t... I>
+    static void InvokeWithArgsP(const F& aFunc, ArgsTuple& aArgs, std::index_sequence<I...>)
+    {
+        aFunc(static_cast<Args>(std::get<I>(aArgs))...);
+    }
+
+    template <typename F>
+    static void ManageLocal(Operation aOperation, UtFunction* aDstPtr, UtFunction* aSrcPtr)
+    {
+        F* srcFuncPtr = static_cast<F*>(aSrcPtr->mTargetPtr);
+        switch (aOperation)
+        {
+        case cCOPY:
+            aDstPtr->mTargetPtr = new (aDstPtr->mBuffer) F(*srcFuncPtr);
+            break;
+        case cMOVE:
+            aDstPtr->mTargetPtr = new (aDstPtr->mBuffer) F(std::move(*srcFuncPtr));
+            srcFuncPtr->~F();
+            break;
+        case cDESTROY:
+            srcFuncPtr->~F();
+            break;
+        }
+    }
+
+    template <typename F>
+    static void ManageHeap(Operation aOperation, UtFunction* aDstPtr, UtFunction* aSrcPtr)
+    {
+        F* srcFuncPtr = static_cast<F*>(aSrcPtr->mTargetPtr);
+        switch (aOperation)
+        {
+        case cCOPY:
+            aDstPtr->mTargetPtr = new F(*srcFuncPtr);
+            break;
+        case cMOVE:
+            aDstPtr->mTargetPtr = srcFuncPtr;
+            break;
+        case cDESTROY:
+            delete srcFuncPtr;
+            break;
+        }
+    }
+
+    template <typename F>
+    void Assign(F&& aFunc)
+    {
+        using FuncType = typename std::decay<F>::type;
+        if (IsLocal<FuncType>::value)
+        {
+            mTargetPtr = new (mBuffer) FuncType(std::forward<F>(aFunc));
+            mManagePtr = &ManageLocal<FuncType>;
+        }
+        else
+        {
+            mTargetPtr = new FuncType(std::forward<F>(aFunc));
+            mManagePtr = &ManageHeap<FuncType>;
+        }
+        mInvokePtr = &Invoke<FuncType>;
+        mRelocatedInvokePtr = IsRelocatableType<FuncType>::value ? &InvokeRelocated<FuncType> : nullptr;
+    }
+
+    void CopyFrom(const UtFunction& aSrc)
+    {
+        if (aSrc.mManagePtr != nullptr)
+        {
+            aSrc.mManagePtr(cCOPY, this, const_cast<UtFunction*>(&aSrc));
+            mInvokePtr = aSrc.mInvokePtr;
+            mManagePtr = aSrc.mManagePtr;
+            mRelocatedInvokePtr = aSrc.mRelocatedInvokePtr;
+        }
+    }
+
+    void MoveFrom(UtFunction& aSrc)
+    {
+        if (aSrc.mManagePtr != nullptr)
+        {
+            aSrc.mManagePtr(cMOVE, this, &aSrc);
+            mInvokePtr = aSrc.mInvokePtr;
+            mManagePtr = aSrc.mManagePtr;
+            mRelocatedInvokePtr = aSrc.mRelocatedInvokePtr;
+            aSrc.mInvokePtr = nullptr;
+            aSrc.mManagePtr = nullptr;
+            aSrc.mRelocatedInvokePtr = nullptr;
+            aSrc.mTargetPtr = nullptr;
+        }
+    }
+
+    void Reset()
+    {
+        if (mManagePtr != nullptr)
+        {
+            mManagePtr(cDESTROY, nullptr, this);
+            mInvokePtr = nullptr;
+            mManagePtr = nullptr;
+            mRelocatedInvokePtr = nullptr;
+            mTargetPtr = nullptr;
+        }
+    }
+
+    InvokeFunc mInvokePtr;
+    ManageFunc mManagePtr;
+    ArgsInvokeFunc mRelocatedInvokePtr;
+    //! Points into mBuffer, or to a heap allocated callable that did not fit
+    void* mTargetPtr;
+    alignas(std::max_align_t) unsigned char mBuffer[cBUFFER_SIZE];
+};
+
+#endif
@@ -0,0 +1,189 @@
+﻿#ifndef UTHASHMAP_H
+#define UTHASHMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+//! A hash map using open addressing with linear probing.
+//! Entries live in one array, so a lookup is usually a single cache miss.  The capacity is a power
+//! of two and doubles when the map becomes half full.  Erase() shifts the following entries back
+//! instead of leaving tombstones, so lookups stay short after many inserts and erases.
+//! K and V must be default constructible.  Inserting may move entries, so pointers returned by
+//! Find() are valid until the next call to Insert() or operator[].
+template <typename K, typename V, typename Hash = std::hash<K>>
+class UtHashMap
+{
+public:
+    UtHashMap()
+        : mSlots(cMINIMUM_CAPACITY), mSize(0)
+    {
+    }
+
+    size_t Size() const { return mSize; }
+
+    bool Empty() const { return mSize == 0; }
+
+    //! Returns the value of aKey, or null if it is not in the map
+    V* Find(const K& aKey)
+    {
+        size_t index;
+        return FindIndexP(aKey, index) ? &mSlots[index].mValue : nullptr;
+    }
+
+    const V* Find(const K& aKey) const
+    {
+        size_t index;
+        return FindIndexP(aKey, index) ? &mSlots[index].mValue : nullptr;
+    }
+
+    //! Sets the value of aKey.  Returns 'true' if aKey was not in the map.
+    bool Insert(const K& aKey, const V& aValue)
+    {
+        size_t index;
+        bool inserted = InsertIndexP(aKey, index);
+        mSlots[index].mValue = aValue;
+        return inserted;
+    }
+
+    //! Returns the value of aKey, inserting a default constructed value if it is not in the map
+    V& operator[](const K& aKey)
+    {
+        size_t index;
+        InsertIndexP(aKey, index);
+        return mSlots[index].mValue;
+    }
+
+    //! Removes aKey.  Returns 'true' if it was in the map.
+    bool Erase(const K& aKey)
+    {
+        size_t index;
+        if (!FindIndexP(aKey, index))
+        {
+            return false;
+        }
+        size_t mask = mSlots.size() - 1;
+        size_t hole = index;
+        for (size_t i = (hole + 1) & mask; mSlots[i].mUsed; i = (i + 1) & mask)
+        {
+            // An entry may fill the hole if its home slot is not between the hole and the entry
+            size_t home = HomeP(mSlots[i].mKey);
+            if (((i - home) & mask) >= ((i - hole) & mask))
+            {
+                mSlots[hole].mKey = std::move(mSlots[i].mKey);
+                mSlots[hole].mValue = std::move(mSlots[i].mValue);
+                hole = i;
+            }
+        }
+        mSlots[hole] = Slot();
+        --mSize;
+        return true;
+    }
+
+    void Clear()
+    {
+        mSlots.assign(cMINIMUM_CAPACITY, Slot());
+        mSize = 0;
+    }
+
+    //! Calls aFunction(key, value) for every entry, in no particular order
+    template <typename FUNCTION>
+    void ForEach(FUNCTION aFunction)
+    {
+        for (Slot& slot : mSlots)
+        {
+            if (slot.mUsed)
+            {
+                aFunction(slot.mKey, slot.mValue);
+            }
+        }
+    }
+
+private:
+    static const size_t cMINIMUM_CAPACITY = 16;
+
+    struct Slot
+    {
+        Slot()
+            : mKey(), mValue(), mUsed(false)
+        {
+        }
+        K mKey;
+        V mValue;
+        bool mUsed;
+    };
+
+    //! Returns the first slot probed for aKey.  The hash is mixed so keys which differ only
+    //! in their high bits, such as aligned pointers, still spread over the table.
+    size_t HomeP(const K& aKey) const
+    {
+        uint64_t hash = static_cast<uint64_t>(Hash()(aKey));
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        return static_cast<size_t>(hash) & (mSlots.size() - 1);
+    }
+
+    bool FindIndexP(const K& aKey, size_t& aIndex) const
+    {
+        size_t mask = mSlots.size() - 1;
+        for (size_t i = HomeP(aKey); mSlots[i].mUsed; i = (i + 1) & mask)
+        {
+            if (mSlots[i].mKey == aKey)
+            {
+                aIndex = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool InsertIndexP(const K& aKey, size_t& aIndex)
+    {
+        if (FindIndexP(aKey, aIndex))
+        {
+            return false;
+        }
+        if ((mSize + 1) * 2 > mSlots.size())
+        {
+            GrowP();
+        }
+        size_t mask = mSlots.size() - 1;
+        size_t i = HomeP(aKey);
+        while (mSlots[i].mUsed)
+        {
+            i = (i + 1) & mask;
+        }
+        mSlots[i].mKey = aKey;
+        mSlots[i].mUsed = true;
+        ++mSize;
+        aIndex = i;
+        return true;
+    }
+
+    void GrowP()
+    {
+        std::vector<Slot> oldSlots(mSlots.size() * 2);
+        oldSlots.swap(mSlots);
+        size_t mask = mSlots.size() - 1;
+        for (Slot& slot : oldSlots)
+        {
+            if (slot.mUsed)
+            {
+                size_t i = HomeP(slot.mKey);
+                while (mSlots[i].mUsed)
+                {
+                    i = (i + 1) & mask;
+                }
+                mSlots[i] = std::move(slot);
+            }
+        }
+    }
+
+    std::vector<Slot> mSlots;
+    size_t mSize;
+};
+
+#endif
@@ -0,0 +1,105 @@
+﻿#include "Util/UtHistogram.h"
+
+#include <limits>
+
+namespace
+{
+//! Returns the index of the highest set bit.  aValue must not be zero.
+int HighestBit(uint64_t aValue)
+{
+    int bit = 0;
+    while (aValue >>= 1)
+    {
+        ++bit;
+    }
+    return bit;
+}
+} // namespace
+
+UtHistogram::UtHistogram()
+{
+    Reset();
+}
+
+// static
+int UtHistogram::GetBucketIndex(uint64_t aValue)
+{
+    const uint64_t cSUB_BUCKETS = 1 << cSUB_BUCKET_BITS;
+    if (aValue < cSUB_BUCKETS)
+    {
+        return (int)aValue;
+    }
+    if (aValue >= ((uint64_t)1 << cMAXIMUM_VALUE_BITS))
+    {
+        return cBUCKET_COUNT - 1;
+    }
+    // Values with the same highest bit share a power-of-two range, split in cSUB_BUCKETS
+    int shift = HighestBit(aValue) - cSUB_BUCKET_BITS;
+    return ((shift + 1) << cSUB_BUCKET_BITS) + (int)((aValue >> shift) - cSUB_BUCKETS);
+}
+
+// static
+uint64_t UtHistogram::GetBucketValue(int aIndex)
+{
+    const uint64_t cSUB_BUCKETS = 1 << cSUB_BUCKET_BITS;
+    int shift = (aIndex >> cSUB_BUCKET_BITS) - 1;
+    if (shift < 0)
+    {
+        return (uint64_t)aIndex;
+    }
+    uint64_t lowest = ((aIndex & (cSUB_BUCKETS - 1)) + cSUB_BUCKETS) << shift;
+    return lowest + ((uint64_t)1 << shift) - 1;
+}
+
+void UtHistogram::GetSnapshot(Snapshot& aSnapshot) const
+{
+    aSnapshot.mBuckets.resize(cBUCKET_COUNT);
+    for (int i = 0; i < cBUCKET_COUNT; ++i)
+    {
+        aSnapshot.mBuckets[i] = mBuckets[i].load(std::memory_order_relaxed);
+    }
+    aSnapshot.mCount = mCount.load(std::memory_order_relaxed);
+    aSnapshot.mSum = mSum.load(std::memory_order_relaxed);
+    aSnapshot.mMinimum = aSnapshot.mCount != 0 ? mMinimum.load(std::memory_order_relaxed) : 0;
+    aSnapshot.mMaximum = mMaximum.load(std::memory_order_relaxed);
+}
+
+void UtHistogram::Reset()
+{
+    for (std::atomic<uint64_t>& bucket : mBuckets)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    mCount.store(0, std::memory_order_relaxed);
+    mSum.store(0, std::memory_order_relaxed);
+    mMinimum.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+    mMaximum.store(0, std::memory_order_relaxed);
+}
+
+//! Returns the value below which aPercentile percent of the recorded values fall.
+uint64_t UtHistogram::Snapshot::GetPercentile(double aPercentile) const
+{
+    uint64_t total = 0;
+    for (uint64_t count : mBuckets)
+    {
+        total += count;
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(aPercentile / 100.0 * total + 0.5);
+    rank = rank < 1 ? 1 : rank;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < mBuckets.size(); ++i)
+    {
+        seen += mBuckets[i];
+        if (seen >= rank)
+        {
+            // The bucket's largest value, but never more than the largest recorded
+            uint64_t value = GetBucketValue((int)i);
+            return value < mMaximum ? value : mMaximum;
+        }
+    }
+    return mMaximum;
+}
@@ -0,0 +1,75 @@
+﻿#ifndef UTHISTOGRAM_H
+#define UTHISTOGRAM_H
+
+#include "NXPacketIO_Export.h"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+//! A histogram of non-negative integer values, such as durations in nanoseconds, that
+//! any number of threads may record into without locking.
+//! Buckets are log-linear: each power of two is split into 16 buckets, so a reported
+//! value is within about 6% of the recorded one.  Values above 2^40 are counted as 2^40.
+class NX_PACKETIO_EXPORT UtHistogram
+{
+public:
+    static const int cSUB_BUCKET_BITS = 4;
+    static const int cMAXIMUM_VALUE_BITS = 40;
+    static const int cBUCKET_COUNT = (cMAXIMUM_VALUE_BITS - cSUB_BUCKET_BITS + 1) << cSUB_BUCKET_BITS;
+
+    //! A copy of the histogram at one time
+    struct NX_PACKETIO_EXPORT Snapshot
+    {
+        uint64_t mCount = 0;
+        uint64_t mSum = 0;
+        uint64_t mMinimum = 0;
+        uint64_t mMaximum = 0;
+        std::vector<uint64_t> mBuckets;
+
+        double GetMean() const { return mCount != 0 ? (double)mSum / mCount : 0.0; }
+
+        uint64_t GetPercentile(double aPercentile) const;
+    };
+
+    UtHistogram();
+
+    UtHistogram(const UtHistogram&) = delete;
+    UtHistogram& operator=(const UtHistogram&) = delete;
+
+    void Record(uint64_t aValue)
+    {
+        mBuckets[GetBucketIndex(aValue)].fetch_add(1, std::memory_order_relaxed);
+        mCount.fetch_add(1, std::memory_order_relaxed);
+        mSum.fetch_add(aValue, std::memory_order_relaxed);
+        uint64_t minimum = mMinimum.load(std::memory_order_relaxed);
+        while (aValue < minimum && !mMinimum.compare_exchange_weak(minimum, aValue, std::memory_order_relaxed))
+        {
+        }
+        uint64_t maximum = mMaximum.load(std::memory_order_relaxed);
+        while (aValue > maximum && !mMaximum.compare_exchange_weak(maximum, aValue, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    uint64_t GetCount() const { return mCount.load(std::memory_order_relaxed); }
+
+    //! Copies the histogram.  Values recorded during the copy may be partly included.
+    void GetSnapshot(Snapshot& aSnapshot) const;
+
+    void Reset();
+
+    static int GetBucketIndex(uint64_t aValue);
+
+    //! Returns the largest value counted in a bucket
+    static uint64_t GetBucketValue(int aIndex);
+
+private:
+    std::atomic<uint64_t> mBuckets[cBUCKET_COUNT];
+    std::atomic<uint64_t> mCount;
+    std::atomic<uint64_t> mSum;
+    std::atomic<uint64_t> mMinimum;
+    std::atomic<uint64_t> mMaximum;
+};
+
+#endif
@@ -0,0 +1,245 @@
+﻿#include "Util/UtLZ_Codec.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+//! Matches are at least this long
+const size_t cMINIMUM_MATCH = 4;
+//! A block ends with at least this many literals, and no match starts within the last cMATCH_LIMIT bytes
+const size_t cLAST_LITERALS = 5;
+const size_t cMATCH_LIMIT = 12;
+const size_t cMAXIMUM_OFFSET = 65535;
+const int cMAXIMUM_HASH_BITS = 12;
+
+uint32_t Read32(const unsigned char* aPtr)
+{
+    uint32_t value;
+    memcpy(&value, aPtr, sizeof(value));
+    return value;
+}
+
+uint64_t Read64(const unsigned char* aPtr)
+{
+    uint64_t value;
+    memcpy(&value, aPtr, sizeof(value));
+    return value;
+}
+
+uint32_t Hash(uint32_t aValue, int aHashBits)
+{
+    return (aValue * 2654435761U) >> (32 - aHashBits);
+}
+
+//! Returns the number of equal bytes at aPtr and aMatchPtr, stopping at aLimitPtr
+size_t CountMatch(const unsigned char* aPtr, const unsigned char* aMatchPtr, const unsigned char* aLimitPtr)
+{
+    const unsigned char* startPtr = aPtr;
+    while (aPtr + 8 <= aLimitPtr && Read64(aPtr) == Read64(aMatchPtr))
+    {
+        aPtr += 8;
+        aMatchPtr += 8;
+    }
+    while (aPtr < aLimitPtr && *aPtr == *aMatchPtr)
+    {
+        ++aPtr;
+        ++aMatchPtr;
+    }
+    return aPtr - startPtr;
+}
+
+//! Writes the continuation bytes of a length that did not fit its 4 bit field
+unsigned char* WriteLength(unsigned char* aPtr, size_t aLength)
+{
+    while (aLength >= 255)
+    {
+        *aPtr++ = 255;
+        aLength -= 255;
+    }
+    *aPtr++ = (unsigned char)aLength;
+    return aPtr;
+}
+
+//! Reads the continuation bytes of a length whose 4 bit field was 15.
+//! @return 'false' if the block ends first.
+bool ReadLength(const unsigned char*& aPtr, const unsigned char* aEndPtr, size_t& aLength)
+{
+    unsigned char byte;
+    do
+    {
+        if (aPtr >= aEndPtr)
+        {
+            return false;
+        }
+        byte = *aPtr++;
+        aLength += byte;
+    } while (byte == 255);
+    return true;
+}
+
+//! Writes a sequence's token and literals, and its match unless aMatchLength is zero.
+//! @return The end of the sequence, or null if it does not fit before aEndPtr.
+unsigned char* WriteSequence(unsigned char* aPtr, unsigned char* aEndPtr, const unsigned char* aLiteralPtr, size_t aLiteralLength, size_t aOffset, size_t aMatchLength)
+{
+    size_t maximumBytes = 1 + aLiteralLength / 255 + 1 + aLiteralLength + 2 + aMatchLength / 255 + 1;
+    if ((size_t)(aEndPtr - aPtr) < maximumBytes)
+    {
+        return nullptr;
+    }
+    unsigned char* tokenPtr = aPtr++;
+    *tokenPtr = (unsigned char)((aLiteralLength < 15 ? aLiteralLength : 15) << 4);
+    if (aLiteralLength >= 15)
+    {
+        aPtr = WriteLength(aPtr, aLiteralLength - 15);
+    }
+    memcpy(aPtr, aLiteralPtr, aLiteralLength);
+    aPtr += aLiteralLength;
+    if (aMatchLength != 0)
+    {
+        *aPtr++ = (unsigned char)(aOffset & 0xff);
+        *aPtr++ = (unsigned char)(aOffset >> 8);
+        size_t length = aMatchLength - cMINIMUM_MATCH;
+        *tokenPtr |= (unsigned char)(length < 15 ? length : 15);
+        if (length >= 15)
+        {
+            aPtr = WriteLength(aPtr, length - 15);
+        }
+    }
+    return aPtr;
+}
+} // namespace
+
+//! Compresses aSourceBytes at aSource into aDestination.
+//! Positions are found with a single-entry hash table and matches are taken greedily,
+//! trading ratio for speed.  Runs of unmatched bytes are scanned with growing steps.
+//! @return The compressed size, or 0 if it would exceed aDestinationBytes.  Pass a smaller
+//!         aDestinationBytes than aSourceBytes to give up on data that does not compress.
+// static
+size_t UtLZ_Codec::Compress(const char* aSource, size_t aSourceBytes, char* aDestination, size_t aDestinationBytes)
+{
+    const unsigned char* basePtr = (const unsigned char*)aSource;
+    const unsigned char* endPtr = basePtr + aSourceBytes;
+    const unsigned char* anchorPtr = basePtr;
+    unsigned char* outPtr = (unsigned char*)aDestination;
+    unsigned char* outEndPtr = outPtr + aDestinationBytes;
+
+    if (aSourceBytes > cMATCH_LIMIT)
+    {
+        // Small inputs get a small table, it is cleared for every block
+        int hashBits = 8;
+        while (hashBits < cMAXIMUM_HASH_BITS && ((size_t)1 << (hashBits + 2)) < aSourceBytes)
+        {
+            ++hashBits;
+        }
+        uint32_t table[1 << cMAXIMUM_HASH_BITS];
+        memset(table, 0, sizeof(uint32_t) << hashBits);
+
+        const unsigned char* matchLimitPtr = endPtr - cLAST_LITERALS;
+        const unsigned char* lastMatchPtr = endPtr - cMATCH_LIMIT;
+        const unsigned char* ptr = basePtr + 1;
+        while (ptr <= lastMatchPtr)
+        {
+            uint32_t& entry = table[Hash(Read32(ptr), hashBits)];
+            const unsigned char* candidatePtr = basePtr + entry;
+            entry = (uint32_t)(ptr - basePtr);
+            if (candidatePtr >= ptr || (size_t)(ptr - candidatePtr) > cMAXIMUM_OFFSET || Read32(candidatePtr) != Read32(ptr))
+            {
+                ptr += 1 + ((ptr - anchorPtr) >> 6);
+                continue;
+            }
+            while (ptr > anchorPtr && candidatePtr > basePtr && ptr[-1] == candidatePtr[-1])
+            {
+                --ptr;
+                --candidatePtr;
+            }
+            size_t matchLength = cMINIMUM_MATCH + CountMatch(ptr + cMINIMUM_MATCH, candidatePtr + cMINIMUM_MATCH, matchLimitPtr);
+            outPtr = WriteSequence(outPtr, outEndPtr, anchorPtr, ptr - anchorPtr, ptr - candidatePtr, matchLength);
+            if (outPtr == nullptr)
+            {
+                return 0;
+            }
+            ptr += matchLength;
+            anchorPtr = ptr;
+            if (ptr <= lastMatchPtr)
+            {
+                table[Hash(Read32(ptr - 2), hashBits)] = (uint32_t)(ptr - 2 - basePtr);
+            }
+        }
+    }
+    outPtr = WriteSequence(outPtr, outEndPtr, anchorPtr, endPtr - anchorPtr, 0, 0);
+    return outPtr != nullptr ? outPtr - (unsigned char*)aDestination : 0;
+}
+
+//! Decompresses the block of aSourceBytes at aSource, which must decompress to exactly
+//! aDestinationBytes.  Never reads or writes outside either buffer, whatever the input.
+//! @return 'false' if the block is corrupt.
+// static
+bool UtLZ_Codec::Decompress(const char* aSource, size_t aSourceBytes, char* aDestination, size_t aDestinationBytes)
+{
+    const unsigned char* ptr = (const unsigned char*)aSource;
+    const unsigned char* endPtr = ptr + aSourceBytes;
+    unsigned char* basePtr = (unsigned char*)aDestination;
+    unsigned char* outPtr = basePtr;
+    unsigned char* outEndPtr = basePtr + aDestinationBytes;
+    for (;;)
+    {
+        if (ptr >= endPtr)
+        {
+            return false;
+        }
+        unsigned char token = *ptr++;
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !ReadLength(ptr, endPtr, literalLength))
+        {
+            return false;
+        }
+        if (literalLength > (size_t)(endPtr - ptr) || literalLength > (size_t)(outEndPtr - outPtr))
+        {
+            return false;
+        }
+        memcpy(outPtr, ptr, literalLength);
+        ptr += literalLength;
+        outPtr += literalLength;
+        if (ptr == endPtr)
+        {
+            // The last sequence has no match
+            return outPtr == outEndPtr;
+        }
+        if (endPtr - ptr < 2)
+        {
+            return false;
+        }
+        size_t offset = ptr[0] | ((size_t)ptr[1] << 8);
+        ptr += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !ReadLength(ptr, endPtr, matchLength))
+        {
+            return false;
+        }
+        matchLength += cMINIMUM_MATCH;
+        if (offset == 0 || offset > (size_t)(outPtr - basePtr) || matchLength > (size_t)(outEndPtr - outPtr))
+        {
+            return false;
+        }
+        const unsigned char* matchPtr = outPtr - offset;
+        if (offset >= matchLength)
+        {
+            memcpy(outPtr, matchPtr, matchLength);
+            outPtr += matchLength;
+        }
+        else
+        {
+            // The match overlaps the bytes it produces, e.g. a run of one byte.
+            // Each copy doubles the bytes the next one may take.
+            unsigned char* matchEndPtr = outPtr + matchLength;
+            while (outPtr < matchEndPtr)
+            {
+                size_t bytes = std::min<size_t>(outPtr - matchPtr, matchEndPtr - outPtr);
+                memcpy(outPtr, matchPtr, bytes);
+                outPtr += bytes;
+            }
+        }
+    }
+}
@@ -0,0 +1,26 @@
+﻿#ifndef UTLZ_CODEC_H
+#define UTLZ_CODEC_H
+
+#include "NXPacketIO_Export.h"
+
+#include <cstddef>
+
+//! A fast LZ77 block codec for packet bodies, in the block format of LZ4.
+//! Each sequence is a token, the literals, a 16 bit little-endian offset and the match length;
+//! the last sequence holds only literals.  Blocks are compressed and decompressed whole,
+//! with no framing, checksum or stored length, so the caller keeps the decompressed size.
+class NX_PACKETIO_EXPORT UtLZ_Codec
+{
+public:
+    //! Returns the most bytes Compress() may write for aSourceBytes of input.
+    static size_t GetMaximumCompressedSize(size_t aSourceBytes) { return aSourceBytes + aSourceBytes / 255 + 16; }
+
+    //! Returns the most bytes aCompressedBytes of a valid block may decompress to.
+    static size_t GetMaximumDecompressedSize(size_t aCompressedBytes) { return aCompressedBytes * 255; }
+
+    static size_t Compress(const char* aSource, size_t aSourceBytes, char* aDestination, size_t aDestinationBytes);
+
+    static bool Decompress(const char* aSource, size_t aSourceBytes, char* aDestination, size_t aDestinationBytes);
+};
+
+#endif
@@ -0,0 +1,86 @@
+﻿#ifndef UTSPSCQUEUE_H
+#define UTSPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+//! A bounded, lock-free queue for one producer thread and one consumer thread.
+//! The capacity is rounded up to a power of two.  T must be trivially copyable
+//! (typically a pointer).
+//! Pop() may also be called by the producer to evict the oldest entry when the
+//! queue is full; the head index is claimed with a compare-exchange so the two
+//! threads can never remove the same entry.
+template <typename T>
+class UtSpscQueue
+{
+public:
+    explicit UtSpscQueue(size_t aCapacity)
+        : mMask(RoundUpToPowerOfTwo(aCapacity) - 1), mSlots(mMask + 1), mHead(0), mTail(0)
+    {
+    }
+
+    UtSpscQueue(const UtSpscQueue&) = delete;
+    UtSpscQueue& operator=(const UtSpscQueue&) = delete;
+
+    size_t Capacity() const { return mMask + 1; }
+
+    //! Returns the number of queued entries.  Exact only when called from the producer or consumer.
+    size_t Size() const
+    {
+        size_t tail = mTail.load(std::memory_order_acquire);
+        size_t head = mHead.load(std::memory_order_acquire);
+        return tail - head;
+    }
+
+    bool Empty() const { return Size() == 0; }
+
+    //! Producer only.  Returns 'false' if the queue is full.
+    bool Push(const T& aValue)
+    {
+        size_t tail = mTail.load(std::memory_order_relaxed);
+        if (tail - mHead.load(std::memory_order_acquire) > mMask)
+        {
+            return false;
+        }
+        mSlots[tail & mMask].store(aValue, std::memory_order_relaxed);
+        mTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    //! Removes the oldest entry.  Returns 'false' if the queue is empty.
+    bool Pop(T& aValue)
+    {
+        size_t head = mHead.load(std::memory_order_acquire);
+        for (;;)
+        {
+            if (head == mTail.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+            aValue = mSlots[head & mMask].load(std::memory_order_relaxed);
+            if (mHead.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                return true;
+            }
+        }
+    }
+
+private:
+    static size_t RoundUpToPowerOfTwo(size_t aValue)
+    {
+        size_t value = 1;
+        while (value < aValue)
+        {
+            value <<= 1;
+        }
+        return value;
+    }
+
+    size_t mMask;
+    std::vector<std::atomic<T>> mSlots;
+    alignas(64) std::atomic<size_t> mHead;
+    alignas(64) std::atomic<size_t> mTail;
+};
+
+#endif
@@ -11,6 +11,8 @@ using TickCount64_FunctionPtr = ULONGLONG (*)();
 TickCount64_FunctionPtr g_TickCount64_Ptr = nullptr;
 } // namespace
 #endif
+#include <chrono>
+#include <cstring>
 #include <time.h>
 UtWallClock::UtWallClock()
 {
@@ -52,6 +54,11 @@ std::string UtWallClock::GetWallClockTime()
     return std::string(timeBuff);
 }
 
+double UtWallClock::GetMonotonicClock()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 double UtWallClock::GetCycleTime()
 {
 #ifdef _WIN32
@@ -55,6 +55,10 @@ public:
     // 返回操作系统当前运行时间
     double GetRawClock() const;
 
+    //! Returns seconds on std::chrono::steady_clock, which is not stepped when the system time is set.
+    //! Packet receive times are stamped on this clock, see PakSocketIO::GetReceiveTime().
+    static double GetMonotonicClock();
+
     /**
       Reset the base time of the wall clock.
       Subsequent calls to GetWallClock() will return the number of seconds
@@ -1,14 +1,16 @@
 ﻿#include "XIO/NXXIO_Connection.h"
 
+#include <algorithm>
 #include <iostream>
 
 #include "XIO/NXXIO_Interface.h"
 #include "XIO/NXXIO_PacketRegistry.h"
+#include "PacketIO/PakSharedMemoryIO.h"
 #include "PacketIO/PakTCP_IO.h"
 #include "PacketIO/PakUDP_IO.h"
 
 NXXIO_Connection::NXXIO_Connection(NXXIO_Interface* aInterfacePtr, PakSocketIO* aIOPtr)
-    : mInterfacePtr(aInterfacePtr), mLinkedConnectionPtr(nullptr), mIOPtr(aIOPtr), mIsServer(false), mIsInitialized(false), mDisconnecting(false), mHasClockTranslation(false), mLastTimeStamp(0.0)
+    : mInterfacePtr(aInterfacePtr), mLinkedConnectionPtr(nullptr), mIOPtr(aIOPtr), mSharedMemoryIO_Ptr(nullptr), mSharedMemorySendPtr(nullptr), mSharedMemoryReading(false), mHasSubscriptions(false), mIsServer(false), mIsInitialized(false), mDisconnecting(false), mLastTimeStamp(0.0), mHasClockTranslation(false), mClockSamples(), mClockSampleCount(0), mNextClockSample(0), mRoundTripTime(0.0), mClockOffset(0.0)
 {
     static int sUniqueConnectionId = 1;
     mConnectionId = sUniqueConnectionId++;
@@ -19,10 +21,61 @@ NXXIO_Connection::NXXIO_Connection(NXXIO_Interface* aInterfacePtr, PakSocketIO*
 
 NXXIO_Connection::~NXXIO_Connection()
 {
+    delete mSharedMemoryIO_Ptr;
     delete mIOPtr;
 }
 
+PakSocketIO& NXXIO_Connection::GetSendIO() const
+{
+    PakSharedMemoryIO* sharedMemoryIO_Ptr = mSharedMemorySendPtr;
+    if (sharedMemoryIO_Ptr != nullptr)
+    {
+        return *sharedMemoryIO_Ptr;
+    }
+    return *mIOPtr;
+}
+
+void NXXIO_Connection::setApplicationName(const std::string& aApplicationName)
+{
+    mInterfacePtr->_setApplication(this, mApplicationId, aApplicationName);
+}
+
+void NXXIO_Connection::setApplicationId(const GenUniqueId& aApplicationId)
+{
+    mInterfacePtr->_setApplication(this, aApplicationId, mApplicationName);
+}
+
 void NXXIO_Connection::send(NXXIO_Packet& aPkt)
 {
     mInterfacePtr->send(aPkt, this);
 }
+
+double NXXIO_Connection::getOneWayLatency(const NXXIO_Packet& aPkt) const
+{
+    return mInterfacePtr->getReceiveTime(aPkt) - toLocalTime(aPkt.getBaseTime());
+}
+
+//! Records a time sync exchange.  As in NTP's clock filter, the offset is taken from the exchange
+//! with the shortest round trip, whose offset error is bounded most tightly.
+void NXXIO_Connection::addClockSample(double aRoundTripTime, double aOffset)
+{
+    std::lock_guard<std::mutex> lock(mClockMutex);
+    if (mClockSampleCount == 0)
+    {
+        mHasClockTranslation = true;
+    }
+    mClockSamples[mNextClockSample] = ClockSample{std::max(aRoundTripTime, 0.0), aOffset};
+    mNextClockSample = (mNextClockSample + 1) % cCLOCK_SAMPLES;
+    mClockSampleCount = std::min(mClockSampleCount + 1, (int)cCLOCK_SAMPLES);
+
+    const ClockSample* bestPtr = &mClockSamples[0];
+    for (int i = 1; i < mClockSampleCount; ++i)
+    {
+        if (mClockSamples[i].mRoundTripTime < bestPtr->mRoundTripTime)
+        {
+            bestPtr = &mClockSamples[i];
+        }
+    }
+    mRoundTripTime = bestPtr->mRoundTripTime;
+    mClockOffset = bestPtr->mOffset;
+}
@@ -3,11 +3,16 @@
 
 #include "NXPacketIO_Export.h"
 
+#include <array>
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include "GenIO/GenUniqueId.h"
 #include "PacketIO/PakConnection.h"
+class PakSharedMemoryIO;
 class PakSocketIO;
 class PakTCP_IO;
 class PakUDP_IO;
@@ -26,6 +31,12 @@ public:
     PakSocketIO& GetIO() const { return *mIOPtr; }
     PakTCP_IO* GetTCP_IO() const { return mTCP_IO_Ptr; }
     PakUDP_IO* GetUDP_IO() const { return mUDP_IO_Ptr; }
+    //! Returns the IO used to send to this connection.  This is the shared memory IO
+    //! once it has been negotiated with a peer on the same host, otherwise GetIO().
+    PakSocketIO& GetSendIO() const;
+
+    //! Returns 'true' if packets to this connection are sent through shared memory
+    bool usesSharedMemory() const { return mSharedMemorySendPtr != nullptr; }
 
     //! Returns the associated NXXIO_Interface
     NXXIO_Interface& getInterface() { return *mInterfacePtr; }
@@ -39,11 +50,11 @@ public:
     //! Returns the name of the connected application
     const std::string& getApplicationName() const { return mApplicationName; }
 
-    //! Sets the name of the connected application
-    void setApplicationName(const std::string& aApplicationName) { mApplicationName = aApplicationName; }
+    //! Sets the name of the connected application.  The interface's lookup by name follows.
+    void setApplicationName(const std::string& aApplicationName);
 
-    //! Sets the application ID
-    void setApplicationId(GenUniqueId& aApplicationId) { mApplicationId = aApplicationId; }
+    //! Sets the application ID.  The interface's lookup by ID follows.
+    void setApplicationId(const GenUniqueId& aApplicationId);
 
     //! Returns the remote application's unique ID
     //! This is only valid for TCP connections (UDP may have multiple listeners)
@@ -52,6 +63,18 @@ public:
     //! Returns true if the connection is reliable
     bool isReliable() const { return mTCP_IO_Ptr != nullptr; }
 
+    //! Returns 'false' if the peer reported that it does not handle packets of this type.
+    //! Peers that have not reported their subscriptions, and UDP connections, are sent every packet.
+    bool isSubscribed(int aPacketId) const
+    {
+        if (!mHasSubscriptions.load(std::memory_order_acquire))
+        {
+            return true;
+        }
+        std::lock_guard<std::mutex> lock(mSubscriptionMutex);
+        return aPacketId >= 0 && aPacketId / 32 < (int)mSubscriptions.size() && (mSubscriptions[aPacketId / 32] & (1u << (aPacketId % 32))) != 0;
+    }
+
     //! Specifies that the connection is initialized
     void setInitialized() { mIsInitialized = true; }
 
@@ -63,9 +86,57 @@ public:
 
     void setDisconnecting() { mDisconnecting = true; }
 
-    //! Returns 'true' if the clock offset is configured for packet synchronization with this connection
-    bool hasClockTranslation() { return mHasClockTranslation; }
-    void setHasClockTranslation(bool aUseTranslation) { mHasClockTranslation = aUseTranslation; }
+    //! Returns 'true' if the clock offset is configured for packet synchronization with this connection.
+    //! Set once the first clock estimate is available.
+    bool hasClockTranslation()
+    {
+        std::lock_guard<std::mutex> lock(mClockMutex);
+        return mHasClockTranslation;
+    }
+    void setHasClockTranslation(bool aUseTranslation)
+    {
+        std::lock_guard<std::mutex> lock(mClockMutex);
+        mHasClockTranslation = aUseTranslation;
+    }
+
+    //! Returns 'true' once a time sync exchange with the peer has completed.
+    //! See NXXIO_Interface::setTimeSyncInterval().
+    bool hasClockEstimate() const
+    {
+        std::lock_guard<std::mutex> lock(mClockMutex);
+        return mClockSampleCount != 0;
+    }
+
+    //! Returns the round trip time in seconds of the exchange the clock offset is taken from,
+    //! the shortest of the last cCLOCK_SAMPLES exchanges, as it is the least delayed by queuing.
+    double getRoundTripTime() const
+    {
+        std::lock_guard<std::mutex> lock(mClockMutex);
+        return mRoundTripTime;
+    }
+
+    //! Returns the peer's clock minus the interface's clock, in seconds.
+    //! Accurate to within half the round trip time.
+    double getClockOffset() const
+    {
+        std::lock_guard<std::mutex> lock(mClockMutex);
+        return mClockOffset;
+    }
+
+    //! Converts a time on the peer's clock, such as NXXIO_Packet::getBaseTime(), to the interface's clock.
+    //! Returned unchanged without clock translation.
+    double toLocalTime(double aRemoteTime) const
+    {
+        std::lock_guard<std::mutex> lock(mClockMutex);
+        return mHasClockTranslation ? aRemoteTime - mClockOffset : aRemoteTime;
+    }
+
+    //! Returns the seconds between the peer sending aPkt and it being received here.
+    //! Only meaningful with clock translation.
+    double getOneWayLatency(const NXXIO_Packet& aPkt) const;
+
+    //! The number of time sync exchanges the clock offset is chosen from
+    static const int cCLOCK_SAMPLES = 8;
 
     double getLastTimeStamp() const { return mLastTimeStamp; }
     void setLastTimeStamp(double aTimeStamp) { mLastTimeStamp = aTimeStamp; }
@@ -77,6 +148,13 @@ protected:
     ~NXXIO_Connection() override;
 
 private:
+    struct ClockSample
+    {
+        double mRoundTripTime;
+        double mOffset;
+    };
+    void addClockSample(double aRoundTripTime, double aOffset);
+
     std::string mApplicationName;
     GenUniqueId mApplicationId;
     int mConnectionId;
@@ -85,11 +163,30 @@ private:
     PakSocketIO* mIOPtr;
     PakTCP_IO* mTCP_IO_Ptr;
     PakUDP_IO* mUDP_IO_Ptr;
+    //! Shared memory transport to a peer on the same host, null unless one is being negotiated or in use
+    PakSharedMemoryIO* mSharedMemoryIO_Ptr;
+    //! Set to mSharedMemoryIO_Ptr once packets are sent through it
+    std::atomic<PakSharedMemoryIO*> mSharedMemorySendPtr;
+    //! 'true' once mSharedMemoryIO_Ptr has been added to the threaded IO
+    bool mSharedMemoryReading;
+    //! The packet IDs the peer handles, one bit per ID.  Valid once mHasSubscriptions is set.
+    //! Written by the core thread and read by any thread sending, so guarded by mSubscriptionMutex.
+    std::vector<uint32_t> mSubscriptions;
+    mutable std::mutex mSubscriptionMutex;
+    std::atomic<bool> mHasSubscriptions;
     bool mIsServer;
     bool mIsInitialized;
     bool mDisconnecting;
-    bool mHasClockTranslation;
     double mLastTimeStamp;
+    //! Guards the clock estimate, which the core thread updates while any thread may read it
+    mutable std::mutex mClockMutex;
+    bool mHasClockTranslation;
+    //! The last time sync exchanges, oldest overwritten first
+    std::array<ClockSample, cCLOCK_SAMPLES> mClockSamples;
+    int mClockSampleCount;
+    int mNextClockSample;
+    double mRoundTripTime;
+    double mClockOffset;
 };
 
 #endif
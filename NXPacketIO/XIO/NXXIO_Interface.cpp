@@ -1,5 +1,6 @@
 ﻿#include "xio/NXXIO_Interface.h"
 
+#include <algorithm>
 #include <limits>
 #include <memory>
 
@@ -12,7 +13,9 @@
 #include "GenIO/GenSocket.h"
 #include "GenIO/GenTCP_IO.h"
 #include "GenIO/GenUDP_IO.h"
+#include "PacketIO/PakCompressedHeader.h"
 #include "PacketIO/PakProcessor.h"
+#include "PacketIO/PakSharedMemoryIO.h"
 #include "PacketIO/PakTCP_Connector.h"
 #include "PacketIO/PakTCP_IO.h"
 #include "PacketIO/PakUDP_IO.h"
@@ -25,10 +28,21 @@ NXXIO_Interface::NXXIO_Interface()
     mHeartbeatInterval(5.0),
     mShowTransferRate(false),
     _isInit(false),
+    _coreLoopMode(EventDriven),
+    _sharedMemoryEnabled(true),
+    _sharedMemoryRingBytes(4 << 20),
+    _subscriptionFiltering(false),
+    _tcpFlushBytes(0),
+    _tcpFlushDelay(0.0),
+    _timeSyncInterval(1.0),
+    _compressionEnabled(false),
+    _compressionThreshold(PakCompressedHeader::cDEFAULT_THRESHOLD),
+    _subscriptionsChanged(false),
     mConnectorPtr(nullptr),
     mCurrentTime(0.0),
     mPreviousHeartbeatTime(-1.0E6),
     mPreviousConnectionUpdateTime(-1.0E6),
+    mPreviousTimeSyncTime(-1.0E6),
     mConnectionUpdateInterval(0.5),
     mTotalBytesSent(0),
     mTotalBytesReceived(0),
@@ -40,6 +54,13 @@ NXXIO_Interface::NXXIO_Interface()
 
     _callbacks += Connect(&NXXIO_Interface::_handleHeartbeat, this);
     _callbacks += Connect(&NXXIO_Interface::_handleInit, this);
+    _callbacks += Connect(&NXXIO_Interface::_handleSharedMemory, this);
+    _callbacks += Connect(&NXXIO_Interface::_handleSubscription, this);
+    _callbacks += Connect(&NXXIO_Interface::_handleTimeSync, this);
+    _subscriptionCallback = SubscriptionChanged.Connect([this](int) {
+        _subscriptionsChanged = true;
+        _threadedIO.Wakeup();
+    });
     _callbacks += _threadedIO.Disconnected.Connect(&NXXIO_Interface::_handleDisconnect, this);
 }
 
@@ -85,7 +106,7 @@ void NXXIO_Interface::init(int port)
     {
         return;
     }
-    mConnectorPtr = new PakTCP_Connector(this);
+    mConnectorPtr = new PakTCP_Connector(this, _compressHeader(new PakDefaultHeader));
     if (!mConnectorPtr->Listen(port))
     {
         std::cout << "xio_interface: Could not bind to a port." << std::endl;
@@ -99,13 +120,23 @@ void NXXIO_Interface::init(int port)
     {
         _connectToTarget(target);
     }
+    _subscriptionsChanged = false;
+    GetSubscriptions(_advertisedSubscriptions);
     _threadedIO.Start();
     _isInit = true;
     std::thread updateThread([=]() {
         while (_isInit)
         {
             _executeCoreProcessor();
-            std::this_thread::sleep_for(std::chrono::microseconds(30));
+            if (_coreLoopMode == Polling)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(30));
+            }
+            else
+            {
+                // 收到数据包、连接断开或发送数据时被唤醒
+                _threadedIO.WaitForPackets(_getTimeToNextDeadline());
+            }
         }
         });
     _updateThread = std::move(updateThread);
@@ -114,6 +145,7 @@ void NXXIO_Interface::init(int port)
 void NXXIO_Interface::unInit()
 {
     _isInit = false;
+    _threadedIO.Wakeup();
     if (_updateThread.joinable())
     {
         _updateThread.join();
@@ -129,6 +161,22 @@ void NXXIO_Interface::unInit()
         delete connection;
     }
     mConnections.clear();
+    mConnectedConnections.clear();
+    mConnectionsById.Clear();
+    mConnectionSenders.Clear();
+    mSenderConnections.Clear();
+    mConnectionsByApplicationId.Clear();
+    mConnectionsByApplicationName.Clear();
+}
+
+//! Returns header wrapped in a PakCompressedHeader if compression is enabled, header otherwise.
+PakHeader* NXXIO_Interface::_compressHeader(PakHeader* header) const
+{
+    if (_compressionEnabled)
+    {
+        return new PakCompressedHeader(header, _compressionThreshold);
+    }
+    return header;
 }
 
 bool NXXIO_Interface::_connectToTarget(UDP_Target& aTarget)
@@ -170,8 +218,31 @@ bool NXXIO_Interface::_connectToTarget(UDP_Target& aTarget)
         }
         else
         {
+            if (aTarget._type == Unicast && aTarget._sendPort != 0)
+            {
+                for (const std::string& address : aTarget._additionalAddresses)
+                {
+                    udpIO->AddSendAddress(address, aTarget._sendPort);
+                }
+            }
             udpIO->RememberSenderAddress(true);
-            NXXIO_Connection* connectionPtr = new NXXIO_Connection(this, new PakUDP_IO(udpIO.release(), this, mUDP_HeaderPtr->Clone()));
+            PakUDP_IO* ioPtr = new PakUDP_IO(udpIO.release(), this, _compressHeader(mUDP_HeaderPtr->Clone()));
+            if (aTarget._reliable)
+            {
+                if (aTarget._type == Unicast && aTarget._sendPort != 0 && aTarget._additionalAddresses.empty())
+                {
+                    ioPtr->SetReliable(aTarget._reliableOptions);
+                }
+                else
+                {
+                    std::cout << "xio_interface: Reliable UDP needs a unicast target with one destination." << std::endl;
+                }
+            }
+            if (ioPtr->GetReliable() == nullptr)
+            {
+                ioPtr->SetCoalescing(aTarget._coalesceBytes, aTarget._coalesceDelay);
+            }
+            NXXIO_Connection* connectionPtr = new NXXIO_Connection(this, ioPtr);
             _threadedIO.AddIO(&connectionPtr->GetIO(), connectionPtr);
             _addConnection(connectionPtr);
             connectionPtr->setInitialized();
@@ -199,7 +270,9 @@ bool NXXIO_Interface::_connectToTarget(UDP_Target& aTarget)
 
             udpIO->RememberSenderAddress(true);
             udpIO->AddMulticastMembership(aTarget._interfaceIP, aTarget._address);
-            NXXIO_Connection* connectionPtr = new NXXIO_Connection(this, new PakUDP_IO(udpIO.release(), this, mUDP_HeaderPtr->Clone()));
+            PakUDP_IO* ioPtr = new PakUDP_IO(udpIO.release(), this, _compressHeader(mUDP_HeaderPtr->Clone()));
+            ioPtr->SetCoalescing(aTarget._coalesceBytes, aTarget._coalesceDelay);
+            NXXIO_Connection* connectionPtr = new NXXIO_Connection(this, ioPtr);
             _threadedIO.AddIO(&connectionPtr->GetIO(), connectionPtr);
             _addConnection(connectionPtr);
             connectionPtr->setInitialized();
@@ -243,6 +316,10 @@ void NXXIO_Interface::_acceptConnections()
         PakTCP_IO* ioPtr;
         while ((ioPtr = mConnectorPtr->Accept(0)) != nullptr)
         {
+            if (_tcpFlushBytes != 0)
+            {
+                ioPtr->SetFlushPolicy(_tcpFlushBytes, _tcpFlushDelay);
+            }
             NXXIO_Connection* connectionPtr = new NXXIO_Connection(this, ioPtr);
             _threadedIO.AddIO(ioPtr, connectionPtr);
             _addConnection(connectionPtr);
@@ -251,6 +328,10 @@ void NXXIO_Interface::_acceptConnections()
         GenSockets::GenInternetSocketAddress inetSockAddr;
         while (mConnectorPtr->CompleteConnect(inetSockAddr, ioPtr))
         {
+            if (_tcpFlushBytes != 0)
+            {
+                ioPtr->SetFlushPolicy(_tcpFlushBytes, _tcpFlushDelay);
+            }
             NXXIO_Connection* connectionPtr = new NXXIO_Connection(this, ioPtr);
             _threadedIO.AddIO(ioPtr, connectionPtr);
             _addConnection(connectionPtr);
@@ -268,7 +349,17 @@ void NXXIO_Interface::send(NXXIO_Packet& packet, NXXIO_Connection* connection)
 {
     packet._applicationId = _applicationId;
     packet.SetBaseTime(_clock.GetClock());
-    _threadedIO.Send(&connection->GetIO(), packet);
+    _threadedIO.Send(&connection->GetSendIO(), packet);
+    _threadedIO.Wakeup();
+}
+
+//! Sends a packet on a connection's TCP stream, even if it uses shared memory.
+void NXXIO_Interface::_sendTCP(NXXIO_Packet& packet, NXXIO_Connection* connection)
+{
+    packet._applicationId = _applicationId;
+    packet.SetBaseTime(_clock.GetClock());
+    _threadedIO.Send(connection->GetTCP_IO(), packet);
+    _threadedIO.Wakeup();
 }
 
 void NXXIO_Interface::send(NXXIO_Packet& packet, const std::vector<PakSocketIO*>& connectionVector)
@@ -276,6 +367,7 @@ void NXXIO_Interface::send(NXXIO_Packet& packet, const std::vector<PakSocketIO*>
     packet._applicationId = _applicationId;
     packet.SetBaseTime(_clock.GetClock());
     _threadedIO.Send(connectionVector, packet);
+    _threadedIO.Wakeup();
 }
 
 NXXIO_Connection* NXXIO_Interface::getSender(PakPacket& packet)
@@ -283,11 +375,31 @@ NXXIO_Connection* NXXIO_Interface::getSender(PakPacket& packet)
     return static_cast<NXXIO_Connection*>(packet.GetSender());
 }
 
+double NXXIO_Interface::getReceiveTime(const PakPacket& packet)
+{
+    double now = _clock.GetClock();
+    if (packet.GetReceiveTime() == 0)
+    {
+        return now;
+    }
+    // The receive time is on the monotonic clock, so only its age is carried over to _clock
+    return now - (UtWallClock::GetMonotonicClock() - packet.GetReceiveTime() * 1.0E-9);
+}
+
 void NXXIO_Interface::sendToAll(NXXIO_Packet& packet)
 {
     packet._applicationId = _applicationId;
     packet.SetBaseTime(_clock.GetClock());
-    _threadedIO.SendToAll(packet);
+    std::vector<PakSocketIO*> sendList;
+    for (auto& connection : mConnections)
+    {
+        if (connection->isSubscribed(packet.ID()))
+        {
+            sendList.push_back(&connection->GetSendIO());
+        }
+    }
+    _threadedIO.Send(sendList, packet);
+    _threadedIO.Wakeup();
 }
 
 void NXXIO_Interface::sendToAllUDP(NXXIO_Packet& packet)
@@ -304,6 +416,7 @@ void NXXIO_Interface::sendToAllUDP(NXXIO_Packet& packet)
         }
     }
     _threadedIO.Send(sendList, packet);
+    _threadedIO.Wakeup();
 }
 
 void NXXIO_Interface::sendToAllTCP(NXXIO_Packet& packet)
@@ -312,18 +425,20 @@ void NXXIO_Interface::sendToAllTCP(NXXIO_Packet& packet)
     std::vector<PakSocketIO*> sendList;
     for (auto& connection : mConnections)
     {
-        if (connection->GetTCP_IO())
+        if (connection->GetTCP_IO() && connection->isSubscribed(packet.ID()))
         {
-            sendList.push_back(connection->GetTCP_IO());
+            sendList.push_back(&connection->GetSendIO());
         }
     }
     _threadedIO.Send(sendList, packet);
+    _threadedIO.Wakeup();
 }
 
 void NXXIO_Interface::_addConnection(NXXIO_Connection* connection)
 {
     mConnections.push_back(connection);
-    mConnectionsById[connection->getConnectionId()] = connection;
+    mConnectionsById.Insert(connection->getConnectionId(), connection);
+    mConnectionSenders.Insert(connection, SenderAddress(0, 0));
     // 在与NXXIO_InitializePkt握手之前，TCP连接不被视为“已连接”
     if (!connection->GetTCP_IO())
     {
@@ -331,6 +446,48 @@ void NXXIO_Interface::_addConnection(NXXIO_Connection* connection)
     }
 }
 
+//! Sets the application ID and name of a connection, and indexes it by them once it has been added.
+//! The arguments are copies, as they may be the connection's own members.
+void NXXIO_Interface::_setApplication(NXXIO_Connection* connection, GenUniqueId applicationId, std::string applicationName)
+{
+    bool indexed = (mConnectionSenders.Find(connection) != nullptr);
+    if (indexed)
+    {
+        _removeApplication(connection);
+    }
+    connection->mApplicationId = applicationId;
+    connection->mApplicationName = applicationName;
+    if (indexed)
+    {
+        mConnectionsByApplicationId[applicationId].push_back(connection);
+        mConnectionsByApplicationName[applicationName].push_back(connection);
+    }
+}
+
+//! Removes a connection from the application ID and name indexes
+void NXXIO_Interface::_removeApplication(NXXIO_Connection* connection)
+{
+    GenUniqueId applicationId = connection->getApplicationId();
+    ConnectionList* idListPtr = mConnectionsByApplicationId.Find(applicationId);
+    if (idListPtr != nullptr)
+    {
+        idListPtr->erase(std::remove(idListPtr->begin(), idListPtr->end(), connection), idListPtr->end());
+        if (idListPtr->empty())
+        {
+            mConnectionsByApplicationId.Erase(applicationId);
+        }
+    }
+    ConnectionList* nameListPtr = mConnectionsByApplicationName.Find(connection->getApplicationName());
+    if (nameListPtr != nullptr)
+    {
+        nameListPtr->erase(std::remove(nameListPtr->begin(), nameListPtr->end(), connection), nameListPtr->end());
+        if (nameListPtr->empty())
+        {
+            mConnectionsByApplicationName.Erase(connection->getApplicationName());
+        }
+    }
+}
+
 std::unique_ptr<NXXIO_Interface::ConnectionCallback> NXXIO_Interface::disconnectConnect(NXXIO_Connection* aConnectionPtr, const ConnectionCallback::FunctionType& aFunction)
 {
     ConnectionCallbackList* cbListPtr = nullptr;
@@ -366,12 +523,22 @@ void NXXIO_Interface::_executeCoreProcessor()
         _acceptConnections();
     }
     _processMessages();
-    for (auto& connection : mConnections)
+    ResumeExpiredWaiters();
+    if (_subscriptionsChanged.exchange(false))
     {
-        PakTCP_IO* ioPtr = connection->GetTCP_IO();
-        if (ioPtr != nullptr)
+        _advertiseSubscriptions();
+    }
+    ReportMetricsIfDue();
+    // Queued sends are drained by the threaded IO as the sockets become writable
+    if (_threadedIO.GetSendMode() != PakThreadedIO::cQUEUED_SEND)
+    {
+        for (auto& connection : mConnections)
         {
-            ioPtr->Flush();
+            PakTCP_IO* ioPtr = connection->GetTCP_IO();
+            if (ioPtr != nullptr)
+            {
+                ioPtr->FlushIfDue();
+            }
         }
     }
     mCurrentTime = mClock.GetRawClock();
@@ -397,6 +564,45 @@ void NXXIO_Interface::_executeCoreProcessor()
             }
         }
     }
+    if (_timeSyncInterval > 0.0 && mPreviousTimeSyncTime < mCurrentTime - _timeSyncInterval)
+    {
+        mPreviousTimeSyncTime = mCurrentTime;
+        for (auto& connection : mConnectedConnections)
+        {
+            _sendTimeSync(connection);
+        }
+    }
+}
+
+//! Returns the time in seconds until the next heartbeat, connection update, time sync, Receive() timeout
+//! or TCP flush is due
+double NXXIO_Interface::_getTimeToNextDeadline()
+{
+    double nextDeadline = std::min(mPreviousHeartbeatTime + mHeartbeatInterval,
+                                   mPreviousConnectionUpdateTime + mConnectionUpdateInterval);
+    if (_timeSyncInterval > 0.0)
+    {
+        nextDeadline = std::min(nextDeadline, mPreviousTimeSyncTime + _timeSyncInterval);
+    }
+    double waitTime = std::max(0.0, nextDeadline - mClock.GetRawClock());
+    double timeoutTime = GetTimeToNextTimeout();
+    if (timeoutTime >= 0.0)
+    {
+        waitTime = std::min(waitTime, timeoutTime);
+    }
+    if (_tcpFlushBytes != 0)
+    {
+        for (auto& connection : mConnections)
+        {
+            PakTCP_IO* ioPtr = connection->GetTCP_IO();
+            double flushTime = (ioPtr != nullptr) ? ioPtr->GetTimeToFlush() : -1.0;
+            if (flushTime >= 0.0)
+            {
+                waitTime = std::min(waitTime, flushTime);
+            }
+        }
+    }
+    return waitTime;
 }
 
 void NXXIO_Interface::_processMessages()
@@ -433,7 +639,7 @@ void NXXIO_Interface::_handleHeartbeat(NXXIO_HeartbeatPkt& pkt)
     OnHeartbeatUpdate(pkt.getBaseTime(), pkt._applicationId, true);
     if (pkt._tcpPort != 0)
     {
-        if (mProcessedHeartbeats.find(pkt._applicationId) == mProcessedHeartbeats.end())
+        if (mProcessedHeartbeats.Find(pkt._applicationId) == nullptr)
         {
             if (FindConnection(pkt._applicationId) == nullptr)
             {
@@ -444,15 +650,17 @@ void NXXIO_Interface::_handleHeartbeat(NXXIO_HeartbeatPkt& pkt)
                 mConnectorPtr->BeginConnect(address, 10.0);
                 _sendHeartbeat();
             }
-            HeartbeatInfo newHeartbeat(pkt._applicationId);
-            newHeartbeat.mConnectionPtr = (NXXIO_Connection*)pkt.GetSender();
-            mProcessedHeartbeats.insert(newHeartbeat);
+            mProcessedHeartbeats.Insert(pkt._applicationId, (NXXIO_Connection*)pkt.GetSender());
 
-            for (NXXIO_Connection* connectionPtr : mConnections)
+            ConnectionList* listPtr = mConnectionsByApplicationId.Find(pkt._applicationId);
+            if (listPtr != nullptr)
             {
-                if (connectionPtr->getApplicationId() == pkt._applicationId && connectionPtr->GetTCP_IO() != nullptr)
+                for (NXXIO_Connection* connectionPtr : *listPtr)
                 {
-                    connectionPtr->SetLinkedConnection((NXXIO_Connection*)pkt.GetSender());
+                    if (connectionPtr->GetTCP_IO() != nullptr)
+                    {
+                        connectionPtr->SetLinkedConnection((NXXIO_Connection*)pkt.GetSender());
+                    }
                 }
             }
         }
@@ -462,11 +670,15 @@ void NXXIO_Interface::_handleHeartbeat(NXXIO_HeartbeatPkt& pkt)
 bool NXXIO_Interface::_checkForDuplicateConnection(NXXIO_Connection* checkedConnection)
 {
     NXXIO_Connection* duplicatePtr = nullptr;
-    for (const auto& connection : mConnections)
+    ConnectionList* listPtr = mConnectionsByApplicationId.Find(checkedConnection->getApplicationId());
+    if (listPtr != nullptr)
     {
-        if (checkedConnection != connection && checkedConnection->getApplicationId() == connection->getApplicationId())
+        for (NXXIO_Connection* connection : *listPtr)
         {
-            duplicatePtr = connection;
+            if (checkedConnection != connection)
+            {
+                duplicatePtr = connection;
+            }
         }
     }
     bool isDuplicate = false;
@@ -524,21 +736,20 @@ void NXXIO_Interface::_handleInit(NXXIO_InitializePkt& pkt)
     // NXXIO_InitializePkt作为三次握手发送3次 防止使用重复连接
     bool ok = true;
     NXXIO_Connection* connectionPtr = getSender(pkt);
-    if (std::find(mConnections.begin(), mConnections.end(), connectionPtr) == mConnections.end())
+    if (mConnectionSenders.Find(connectionPtr) == nullptr)
     {
         return;
     }
 
     if (pkt._stage <= cCONNECT_STAGE)
     {
-        connectionPtr->setApplicationId(pkt._applicationId);
-        connectionPtr->setApplicationName(pkt._applicationName);
+        _setApplication(connectionPtr, pkt._applicationId, pkt._applicationName);
 
         NXXIO_Connection* relatedConnectionPtr = nullptr;
-        std::set<HeartbeatInfo>::iterator iter = mProcessedHeartbeats.find(pkt._applicationId);
-        if (iter != mProcessedHeartbeats.end())
+        NXXIO_Connection** heartbeatPtr = mProcessedHeartbeats.Find(pkt._applicationId);
+        if (heartbeatPtr != nullptr)
         {
-            relatedConnectionPtr = iter->mConnectionPtr;
+            relatedConnectionPtr = *heartbeatPtr;
         }
         SenderAddress senderAddr(pkt.GetOriginatorAddress(), pkt.GetOriginatorPort());
         NXXIO_Connection* sendConnectionPtr = _getSendConnection(relatedConnectionPtr);
@@ -570,16 +781,259 @@ void NXXIO_Interface::_handleInit(NXXIO_InitializePkt& pkt)
             connectionPtr->setInitialized();
             mConnectedConnections.push_back(connectionPtr);
             SenderAddress senderAddr(pkt.GetOriginatorAddress(), pkt.GetOriginatorPort());
-            mSenderConnections[senderAddr] = connectionPtr;
+            mSenderConnections.Insert(senderAddr, connectionPtr);
+            mConnectionSenders.Insert(connectionPtr, senderAddr);
             std::cout << "xio_interface: Connected to application. " << "Application: " << connectionPtr->getApplicationName() << std::endl;
+            if (_subscriptionFiltering)
+            {
+                NXXIO_SubscriptionPkt subscriptions;
+                subscriptions._isComplete = 1;
+                subscriptions._packetBits = _advertisedSubscriptions;
+                _sendTCP(subscriptions, connectionPtr);
+            }
+            _sendTimeSync(connectionPtr);
             OnConnected(connectionPtr);
+            // Only one side receives the last stage, so only one side makes an offer
+            if (pkt._stage == cCONNECT_STAGE)
+            {
+                _offerSharedMemory(connectionPtr);
+            }
         }
     }
 }
 
+//! Returns 'true' if the connection's peer may be on this host.
+//! Opening the shared memory segment is the real test.
+bool NXXIO_Interface::_isLocalPeer(NXXIO_Connection* connection)
+{
+    GenSockets::GenSocket* socketPtr = connection->GetTCP_IO()->GetSendSocket();
+    GenSockets::GenIP peerIP = socketPtr->GetPeerAddr().GetAddress();
+    GenSockets::GenIP localIP = socketPtr->GetBoundAddr().GetAddress();
+    return peerIP.GetAddressPart(0) == 127 || peerIP == localIP;
+}
+
+void NXXIO_Interface::_offerSharedMemory(NXXIO_Connection* connection)
+{
+    if (!_sharedMemoryEnabled || connection->GetTCP_IO() == nullptr || connection->mSharedMemoryIO_Ptr != nullptr || !_isLocalPeer(connection))
+    {
+        return;
+    }
+    PakSharedMemoryIO* ioPtr = PakSharedMemoryIO::Create(this, _sharedMemoryRingBytes);
+    if (ioPtr == nullptr)
+    {
+        return;
+    }
+    connection->mSharedMemoryIO_Ptr = ioPtr;
+    NXXIO_SharedMemoryPkt offer;
+    offer._stage = NXXIO_SharedMemoryPkt::cOFFER;
+    offer._segmentName = ioPtr->GetName();
+    offer._nonce = ioPtr->GetNonce();
+    offer._doorbellPort = ioPtr->GetDoorbellPort();
+    _sendTCP(offer, connection);
+}
+
+//! Switches a connection to shared memory.  Each side starts reading the ring only after
+//! the other side's last TCP packet, so packets are processed in the order they were sent.
+void NXXIO_Interface::_handleSharedMemory(NXXIO_SharedMemoryPkt& pkt)
+{
+    NXXIO_Connection* connectionPtr = getSender(pkt);
+    if (mConnectionSenders.Find(connectionPtr) == nullptr || connectionPtr->GetTCP_IO() == nullptr)
+    {
+        return;
+    }
+    PakSharedMemoryIO* ioPtr = connectionPtr->mSharedMemoryIO_Ptr;
+    if (pkt._stage == NXXIO_SharedMemoryPkt::cOFFER)
+    {
+        NXXIO_SharedMemoryPkt response;
+        response._stage = NXXIO_SharedMemoryPkt::cREJECT;
+        response._nonce = pkt._nonce;
+        response._doorbellPort = 0;
+        if (_sharedMemoryEnabled && ioPtr == nullptr)
+        {
+            ioPtr = PakSharedMemoryIO::Open(this, pkt._segmentName, pkt._nonce);
+        }
+        if (ioPtr != nullptr)
+        {
+            ioPtr->SetPeerDoorbellPort(pkt._doorbellPort);
+            connectionPtr->mSharedMemoryIO_Ptr = ioPtr;
+            response._stage = NXXIO_SharedMemoryPkt::cACCEPT;
+            response._doorbellPort = ioPtr->GetDoorbellPort();
+        }
+        _sendTCP(response, connectionPtr);
+        if (ioPtr != nullptr)
+        {
+            connectionPtr->mSharedMemorySendPtr = ioPtr;
+        }
+    }
+    else if (ioPtr == nullptr || pkt._nonce != ioPtr->GetNonce())
+    {
+        return;
+    }
+    else if (pkt._stage == NXXIO_SharedMemoryPkt::cACCEPT)
+    {
+        ioPtr->Unlink();
+        ioPtr->SetPeerDoorbellPort(pkt._doorbellPort);
+        connectionPtr->mSharedMemoryReading = true;
+        _threadedIO.AddIO(ioPtr, connectionPtr);
+        NXXIO_SharedMemoryPkt switchPkt;
+        switchPkt._stage = NXXIO_SharedMemoryPkt::cSWITCH;
+        switchPkt._nonce = pkt._nonce;
+        switchPkt._doorbellPort = 0;
+        _sendTCP(switchPkt, connectionPtr);
+        connectionPtr->mSharedMemorySendPtr = ioPtr;
+        std::cout << "xio_interface: Using shared memory. " << "Application: " << connectionPtr->getApplicationName() << std::endl;
+    }
+    else if (pkt._stage == NXXIO_SharedMemoryPkt::cSWITCH && !connectionPtr->mSharedMemoryReading)
+    {
+        connectionPtr->mSharedMemoryReading = true;
+        _threadedIO.AddIO(ioPtr, connectionPtr);
+        std::cout << "xio_interface: Using shared memory. " << "Application: " << connectionPtr->getApplicationName() << std::endl;
+    }
+    else if (pkt._stage == NXXIO_SharedMemoryPkt::cREJECT)
+    {
+        connectionPtr->mSharedMemoryIO_Ptr = nullptr;
+        delete ioPtr;
+    }
+}
+
+//! Tells the connected peers which packet types gained or lost their callbacks.
+//! Peers connecting later are sent _advertisedSubscriptions in full.
+void NXXIO_Interface::_advertiseSubscriptions()
+{
+    std::vector<uint32_t> subscriptions;
+    GetSubscriptions(subscriptions);
+    if (!_subscriptionFiltering || subscriptions == _advertisedSubscriptions)
+    {
+        return;
+    }
+    NXXIO_SubscriptionPkt changes;
+    changes._isComplete = 0;
+    size_t wordCount = std::max(subscriptions.size(), _advertisedSubscriptions.size());
+    for (size_t i = 0; i < wordCount; ++i)
+    {
+        uint32_t newWord = i < subscriptions.size() ? subscriptions[i] : 0;
+        uint32_t oldWord = i < _advertisedSubscriptions.size() ? _advertisedSubscriptions[i] : 0;
+        for (uint32_t changed = newWord ^ oldWord; changed != 0; changed &= changed - 1)
+        {
+            int bit = 0;
+            while ((changed & (1u << bit)) == 0)
+            {
+                ++bit;
+            }
+            ((newWord & (1u << bit)) != 0 ? changes._subscribed : changes._unsubscribed).push_back((int32_t)(i * 32 + bit));
+        }
+    }
+    _advertisedSubscriptions = subscriptions;
+    for (NXXIO_Connection* connectionPtr : mConnectedConnections)
+    {
+        if (connectionPtr->GetTCP_IO() != nullptr)
+        {
+            _sendTCP(changes, connectionPtr);
+        }
+    }
+}
+
+void NXXIO_Interface::_handleSubscription(NXXIO_SubscriptionPkt& pkt)
+{
+    NXXIO_Connection* connectionPtr = getSender(pkt);
+    if (mConnectionSenders.Find(connectionPtr) == nullptr)
+    {
+        return;
+    }
+    // Bounds the bitset a change can make a peer allocate
+    const int32_t cMAX_SUBSCRIBED_PACKET_ID = 65535;
+    std::lock_guard<std::mutex> lock(connectionPtr->mSubscriptionMutex);
+    if (pkt._isComplete != 0)
+    {
+        connectionPtr->mSubscriptions = pkt._packetBits;
+        connectionPtr->mHasSubscriptions.store(true, std::memory_order_release);
+    }
+    else if (connectionPtr->mHasSubscriptions.load(std::memory_order_relaxed))
+    {
+        // The peer may have registered packet types since it sent the complete set
+        std::vector<uint32_t>& bits = connectionPtr->mSubscriptions;
+        for (int32_t packetId : pkt._subscribed)
+        {
+            if (packetId < 0 || packetId > cMAX_SUBSCRIBED_PACKET_ID)
+            {
+                // Not worth the memory to track; send the peer everything instead
+                connectionPtr->mHasSubscriptions.store(false, std::memory_order_release);
+                bits.clear();
+                return;
+            }
+            if (packetId / 32 >= (int)bits.size())
+            {
+                bits.resize(packetId / 32 + 1, 0);
+            }
+            bits[packetId / 32] |= 1u << (packetId % 32);
+        }
+        for (int32_t packetId : pkt._unsubscribed)
+        {
+            if (packetId >= 0 && packetId / 32 < (int)bits.size())
+            {
+                bits[packetId / 32] &= ~(1u << (packetId % 32));
+            }
+        }
+    }
+}
+
+//! Starts a time sync exchange with a connected peer, unless it reported it does not answer them
+void NXXIO_Interface::_sendTimeSync(NXXIO_Connection* connection)
+{
+    if (_timeSyncInterval > 0.0 && !connection->isDisconnecting() && connection->isSubscribed(NXXIO_TimeSyncPkt::cPACKET_ID))
+    {
+        NXXIO_TimeSyncPkt request;
+        request._isResponse = 0;
+        request._requestSendTime = 0.0;
+        request._requestReceiveTime = 0.0;
+        send(request, connection);
+    }
+}
+
+void NXXIO_Interface::_handleTimeSync(NXXIO_TimeSyncPkt& pkt)
+{
+    NXXIO_Connection* connectionPtr = getSender(pkt);
+    if (mConnectionSenders.Find(connectionPtr) == nullptr)
+    {
+        return;
+    }
+    double receiveTime = getReceiveTime(pkt);
+    if (pkt._isResponse == 0)
+    {
+        NXXIO_TimeSyncPkt response;
+        response._isResponse = 1;
+        response._requestSendTime = pkt.getBaseTime();
+        response._requestReceiveTime = receiveTime;
+        send(response, connectionPtr);
+    }
+    else
+    {
+        // The peer's time spent answering is not part of the round trip.  The offset assumes the
+        // request and the response took equally long.
+        double responseSendTime = pkt.getBaseTime();
+        double roundTripTime = (receiveTime - pkt._requestSendTime) - (responseSendTime - pkt._requestReceiveTime);
+        double offset = ((pkt._requestReceiveTime - pkt._requestSendTime) + (responseSendTime - receiveTime)) / 2.0;
+        connectionPtr->addClockSample(roundTripTime, offset);
+    }
+}
+
 void NXXIO_Interface::_handleDisconnect(PakSocketIO* socketIO, PakConnection* connection)
 {
     NXXIO_Connection* connectionPtr = static_cast<NXXIO_Connection*>(connection);
+    if (socketIO == connectionPtr->mSharedMemoryIO_Ptr)
+    {
+        // Only the shared memory path closed, the connection carries on over TCP
+        connectionPtr->mSharedMemorySendPtr = nullptr;
+        connectionPtr->mSharedMemoryReading = false;
+        connectionPtr->mSharedMemoryIO_Ptr = nullptr;
+        delete socketIO;
+        return;
+    }
+    if (connectionPtr->mSharedMemoryReading)
+    {
+        // Reports the shared memory IO's removal through this method before continuing
+        _threadedIO.RemoveIO(connectionPtr->mSharedMemoryIO_Ptr);
+    }
     connectionPtr->setDisconnecting();
     if (connectionPtr->isInitialized())
     {
@@ -602,23 +1056,22 @@ void NXXIO_Interface::_handleDisconnect(PakSocketIO* socketIO, PakConnection* co
         std::cout << "xio_interface: Disconnected from application. " << "Application: " << connectionPtr->getApplicationName() << std::endl;
     }
 
-    ConnectionList::iterator i = std::find(mConnections.begin(), mConnections.end(), connection);
-    if (i != mConnections.end())
+    SenderAddress* senderAddrPtr = mConnectionSenders.Find(connectionPtr);
+    if (senderAddrPtr != nullptr)
     {
-        mConnections.erase(i);
-        mConnectionsById.erase(connectionPtr->getConnectionId());
-        ConnectionList::iterator j = std::find(mConnectedConnections.begin(), mConnectedConnections.end(), connection);
-        if (j != mConnectedConnections.end())
+        NXXIO_Connection** senderConnectionPtr = mSenderConnections.Find(*senderAddrPtr);
+        if (senderConnectionPtr != nullptr && *senderConnectionPtr == connectionPtr)
         {
-            mConnectedConnections.erase(j);
+            mSenderConnections.Erase(*senderAddrPtr);
         }
-        for (SenderConnectionMap::iterator k = mSenderConnections.begin(); k != mSenderConnections.end(); ++k)
+        mConnectionSenders.Erase(connectionPtr);
+        mConnectionsById.Erase(connectionPtr->getConnectionId());
+        _removeApplication(connectionPtr);
+        mConnections.erase(std::find(mConnections.begin(), mConnections.end(), connectionPtr));
+        ConnectionList::iterator j = std::find(mConnectedConnections.begin(), mConnectedConnections.end(), connectionPtr);
+        if (j != mConnectedConnections.end())
         {
-            if (k->second == connection)
-            {
-                mSenderConnections.erase(k);
-                break;
-            }
+            mConnectedConnections.erase(j);
         }
     }
     delete connection;
@@ -626,39 +1079,21 @@ void NXXIO_Interface::_handleDisconnect(PakSocketIO* socketIO, PakConnection* co
 
 NXXIO_Connection* NXXIO_Interface::FindConnection(const GenUniqueId& aApplicationId)
 {
-    NXXIO_Connection* connectionPtr = nullptr;
-    for (auto& connection : mConnections)
-    {
-        if (aApplicationId == connection->getApplicationId())
-        {
-            connectionPtr = connection;
-        }
-    }
-    return connectionPtr;
+    ConnectionList* listPtr = mConnectionsByApplicationId.Find(aApplicationId);
+    return listPtr != nullptr ? listPtr->back() : nullptr;
 }
 
 //! Returns a pointer to the connection with the given ID
 NXXIO_Connection* NXXIO_Interface::FindConnection(int aConnectionIndex)
 {
-    ConnectionIdMap::iterator i = mConnectionsById.find(aConnectionIndex);
-    if (i != mConnectionsById.end())
-    {
-        return i->second;
-    }
-    return nullptr;
+    NXXIO_Connection** connectionPtr = mConnectionsById.Find(aConnectionIndex);
+    return connectionPtr != nullptr ? *connectionPtr : nullptr;
 }
 
 NXXIO_Connection* NXXIO_Interface::FindConnection(const std::string& aApplicationName)
 {
-    NXXIO_Connection* connectionPtr = nullptr;
-    for (auto& connection : mConnections)
-    {
-        if (aApplicationName == connection->getApplicationName())
-        {
-            connectionPtr = connection;
-        }
-    }
-    return connectionPtr;
+    ConnectionList* listPtr = mConnectionsByApplicationName.Find(aApplicationName);
+    return listPtr != nullptr ? listPtr->back() : nullptr;
 }
 
 void NXXIO_Interface::getBytesCommunicated(size_t& aBytesSent, size_t& aBytesReceived)
@@ -3,6 +3,7 @@
 
 #include "NXPacketIO_Export.h"
 
+#include <atomic>
 #include <deque>
 #include <queue>
 #include <set>
@@ -12,16 +13,21 @@
 #include "GenIO/GenUniqueId.h"
 #include "PacketIO/PakConnection.h"
 #include "PacketIO/PakProcessor.h"
+#include "PacketIO/PakReliableUDP.h"
 class PakTCP_Connector;
 class PakTCP_IO;
 #include "PacketIO/PakThreadedIO.h"
 #include "Util/UtCallback.h"
 #include "Util/UtCallbackHolder.h"
+#include "Util/UtHashMap.h"
 #include "Util/UtWallClock.h"
 class NXXIO_Connection;
 class NXXIO_HeartbeatPkt;
 class NXXIO_InitializePkt;
 class NXXIO_Packet;
+class NXXIO_SharedMemoryPkt;
+class NXXIO_SubscriptionPkt;
+class NXXIO_TimeSyncPkt;
 class NXXIO_UdpHeader;
 
 #define PACKET_HANDLE_FUNC_DEFINE(INTERFACE, ...) INTERFACE->addCallback(INTERFACE->Connect(__VA_ARGS__))
@@ -31,15 +37,23 @@ class NXXIO_UdpHeader;
 class NX_PACKETIO_EXPORT NXXIO_Interface : public PakProcessor
 {
 public:
+    friend class NXXIO_Connection;
+
     enum UDP_Type
     {
         Broadcast,
         Multicast,
         Unicast
     };
+    // 核心循环的调度方式
+    enum CoreLoopMode
+    {
+        Polling,    // 每30微秒轮询一次
+        EventDriven // 阻塞等待收包唤醒或心跳/连接定时器到期
+    };
     struct UDP_Target {
         UDP_Target()
-            : _sendPort(0), _recvPort(0), _connectionId(0)
+            : _sendPort(0), _recvPort(0), _connectionId(0), _reliable(false), _coalesceBytes(0), _coalesceDelay(0.0002)
         {
         }
         UDP_Type _type;
@@ -48,6 +62,20 @@ public:
         int _sendPort;
         int _recvPort;
         int _connectionId;
+        //! Unicast only: more destinations sharing this target's socket, sent to with one batched call
+        std::vector<std::string> _additionalAddresses;
+        //! Unicast only, with one destination: sequence, acknowledge and fragment packets when the
+        //! peer's target is reliable too, so packets may be larger than a datagram.
+        //! Packets are sent as plain datagrams until the peer answers.  See PakUDP_IO::SetReliable().
+        bool _reliable;
+        PakReliableUDP::Options _reliableOptions;
+        //! Not reliable only: pack packets sent close together into datagrams of up to this many
+        //! bytes, 0 sends each packet on its own.  See PakUDP_IO::SetCoalescing().
+        //! WARNING: Not negotiated.  A receiver that does not unpack coalesced datagrams silently
+        //! drops every packet but the first of each, so every receiver of the target must support it.
+        size_t _coalesceBytes;
+        //! The longest time in seconds a packet waits for others to fill its datagram
+        double _coalesceDelay;
     };
     typedef std::pair<int, int> SenderAddress;
     typedef std::vector<NXXIO_Connection*> ConnectionList;
@@ -63,6 +91,49 @@ public:
 
     void init(int port);
     void unInit();
+    //! Must be called before init()
+    void setCoreLoopMode(CoreLoopMode mode) { _coreLoopMode = mode; }
+    CoreLoopMode getCoreLoopMode() const { return _coreLoopMode; }
+    //! Must be called before init().  With PakThreadedIO::cQUEUED_SEND a slow TCP peer
+    //! stalls neither send() nor the core loop.  See PakThreadedIO::SetSendOptions().
+    void setSendOptions(PakThreadedIO::SendMode mode, size_t highWatermark, size_t lowWatermark) { _threadedIO.SetSendOptions(mode, highWatermark, lowWatermark); }
+    //! Must be called before init().  Spreads connections over several receive threads.
+    //! See PakThreadedIO::SetShardOptions().
+    void setShardOptions(size_t shardCount, PakThreadedIO::ShardPolicy policy) { _threadedIO.SetShardOptions(shardCount, policy); }
+    //! Must be called before init().  When enabled, a TCP connection to an application on the same
+    //! host switches to a shared memory ring of ringBytes per direction once connected.
+    //! The TCP connection stays open to detect the disconnect.  Enabled with 4 MB rings by default.
+    void setSharedMemoryOptions(bool enabled, size_t ringBytes)
+    {
+        _sharedMemoryEnabled = enabled;
+        _sharedMemoryRingBytes = ringBytes;
+    }
+    //! Must be called before init().  When enabled, each connected peer is told which packet types
+    //! have a callback here, and sendToAll() and sendToAllTCP() skip peers without one for the packet.
+    //! Coroutines waiting in Receive() count as callbacks.  Disabled by default.
+    void setSubscriptionFiltering(bool enabled) { _subscriptionFiltering = enabled; }
+    //! Must be called before init().  Buffers the packets sent on each TCP connection until
+    //! flushBytes are waiting or the oldest waited maximumDelay seconds, instead of writing each
+    //! one at once.  0 bytes disables it, the default.  See PakTCP_IO::SetFlushPolicy().
+    void setTcpFlushPolicy(size_t flushBytes, double maximumDelay)
+    {
+        _tcpFlushBytes = flushBytes;
+        _tcpFlushDelay = maximumDelay;
+    }
+    //! Must be called before init().  Seconds between the exchanges with each TCP peer that estimate
+    //! its round trip time and clock offset, 0 disables them.  1 second by default.
+    //! See NXXIO_Connection::getClockOffset().
+    void setTimeSyncInterval(double interval) { _timeSyncInterval = interval; }
+    //! Must be called before init(), and every peer must use the same setting.  When enabled, the
+    //! bodies of packet types registered with PakProcessor::cCOMPRESSIBLE are compressed once they
+    //! reach threshold bytes, on TCP connections and UDP targets.  Disabled by default.
+    //! See PakCompressedHeader.
+    void setCompressionOptions(bool enabled, size_t threshold)
+    {
+        _compressionEnabled = enabled;
+        _compressionThreshold = threshold;
+    }
+    PakThreadedIO& getThreadedIO() { return _threadedIO; }
     void addCallback(std::unique_ptr<UtCallback> callback);
 
     void send(NXXIO_Packet& packet, NXXIO_Connection* connection);
@@ -72,6 +143,9 @@ public:
     void sendToAllTCP(NXXIO_Packet& packet);
 
     NXXIO_Connection* getSender(PakPacket& packet);
+    //! Returns when packet was received on the clock its base time is stamped with.  For a packet
+    //! from a socket this is when the kernel received it, or when the receive thread read it.
+    double getReceiveTime(const PakPacket& packet);
 
     UtCallbackListN<void(NXXIO_Connection*)> OnConnected;
     UtCallbackListN<void(NXXIO_Connection*)> OnDisconnected;
@@ -94,28 +168,43 @@ public:
 
 private:
     void _executeCoreProcessor();
+    double _getTimeToNextDeadline();
     void _sendHeartbeat();
     bool _checkForDuplicateConnection(NXXIO_Connection* checkedConnection);
     NXXIO_Connection* _getSendConnection(NXXIO_Connection* connectionPtr);
     void _processMessages();
     void _handleHeartbeat(NXXIO_HeartbeatPkt& pkt);
     void _handleInit(NXXIO_InitializePkt& pkt);
+    bool _isLocalPeer(NXXIO_Connection* connection);
+    void _offerSharedMemory(NXXIO_Connection* connection);
+    void _handleSharedMemory(NXXIO_SharedMemoryPkt& pkt);
+    void _handleSubscription(NXXIO_SubscriptionPkt& pkt);
+    void _advertiseSubscriptions();
+    void _sendTimeSync(NXXIO_Connection* connection);
+    void _handleTimeSync(NXXIO_TimeSyncPkt& pkt);
+    void _sendTCP(NXXIO_Packet& packet, NXXIO_Connection* connection);
     void _handleDisconnect(PakSocketIO* socketIO, PakConnection* aConnectionPtr);
     void _addConnection(NXXIO_Connection* connection);
+    void _setApplication(NXXIO_Connection* connection, GenUniqueId applicationId, std::string applicationName);
+    void _removeApplication(NXXIO_Connection* connection);
     void _acceptConnections();
     bool _connectToTarget(UDP_Target& aTarget);
-    struct HeartbeatInfo {
-        HeartbeatInfo(GenUniqueId id)
-            : mUniqueId(id)
-        {
-        }
-        bool operator<(const HeartbeatInfo& aInfo) const { return mUniqueId < aInfo.mUniqueId; }
-        GenUniqueId mUniqueId;
-        NXXIO_Connection* mConnectionPtr;
+    PakHeader* _compressHeader(PakHeader* header) const;
+    struct UniqueIdHash
+    {
+        size_t operator()(const GenUniqueId& aId) const { return aId.GetData(0) ^ (size_t)aId.GetData(1) * 31 ^ (size_t)aId.GetData(2) * 961; }
+    };
+    struct SenderAddressHash
+    {
+        size_t operator()(const SenderAddress& aAddress) const { return (size_t)(unsigned int)aAddress.first * 65599 ^ (unsigned int)aAddress.second; }
     };
     using ConnectionCallbackMap = std::map<NXXIO_Connection*, UtCallbackListN<void(NXXIO_Connection*)>*>;
-    using SenderConnectionMap = std::map<SenderAddress, NXXIO_Connection*>;
-    using ConnectionIdMap = std::map<int, NXXIO_Connection*>;
+    using HeartbeatMap = UtHashMap<GenUniqueId, NXXIO_Connection*, UniqueIdHash>;
+    using SenderConnectionMap = UtHashMap<SenderAddress, NXXIO_Connection*, SenderAddressHash>;
+    using ConnectionIdMap = UtHashMap<int, NXXIO_Connection*>;
+    using ApplicationIdMap = UtHashMap<GenUniqueId, ConnectionList, UniqueIdHash>;
+    using ApplicationNameMap = UtHashMap<std::string, ConnectionList>;
+    using ConnectionSenderMap = UtHashMap<NXXIO_Connection*, SenderAddress>;
     UtCallbackHolder _callbacks;
     UtCallbackHolder _userCallbacks;
     GenUniqueId _applicationId; //!< The application's unique ID
@@ -127,17 +216,23 @@ private:
     double mCurrentTime;
     double mPreviousHeartbeatTime;
     double mPreviousConnectionUpdateTime;
+    double mPreviousTimeSyncTime;
     double mConnectionUpdateInterval;
-    //! Set of application ID's that have already had a connection-chance
-    std::set<HeartbeatInfo> mProcessedHeartbeats;
+    //! Application ID's that have already had a connection-chance, and the connection their heartbeat arrived on
+    HeartbeatMap mProcessedHeartbeats;
     //! Maintains a mapping between UDP sender address and the related reliable connection
     SenderConnectionMap mSenderConnections;
+    //! Every current connection, and its UDP sender address once it is connected
+    ConnectionSenderMap mConnectionSenders;
     //! List of all current connections
     ConnectionList mConnections;
     //! List of current reliable connections
     ConnectionList mConnectedConnections;
     //! Map from connection id to connection
     ConnectionIdMap mConnectionsById;
+    //! Connections by the ID and name the application sent in its NXXIO_InitializePkt
+    ApplicationIdMap mConnectionsByApplicationId;
+    ApplicationNameMap mConnectionsByApplicationName;
     PakThreadedIO _threadedIO;
     ConnectionCallbackMap mDisconnectCallbacks;
     std::map<std::string, std::string> mAvailableServices;
@@ -152,6 +247,21 @@ private:
     double mHeartbeatInterval; // 心跳包发送间隔
     bool mShowTransferRate;
     bool _isInit;
+    CoreLoopMode _coreLoopMode;
+    bool _sharedMemoryEnabled;
+    size_t _sharedMemoryRingBytes;
+    bool _subscriptionFiltering;
+    size_t _tcpFlushBytes;
+    double _tcpFlushDelay;
+    double _timeSyncInterval;
+    bool _compressionEnabled;
+    size_t _compressionThreshold;
+    //! Set when a callback is connected or disconnected, the core loop then tells the peers
+    std::atomic<bool> _subscriptionsChanged;
+    //! The subscriptions every connected peer has been told
+    std::vector<uint32_t> _advertisedSubscriptions;
+    //! Declared after _threadedIO, so it is disconnected before _threadedIO is destroyed
+    std::unique_ptr<UtCallback> _subscriptionCallback;
     std::vector<UDP_Target> mUDP_Targets;
     std::thread _updateThread;
     UtWallClock _clock;
@@ -13,13 +13,32 @@ int NXXIO_PacketRegistry::sPacketVersion = 0;
     aProcessor.RegisterPacket(#Z, new (Z)); \
     assert(VALID_ID_RANGE(Z::cPACKET_ID));
 
+// Received packets of these types are recycled rather than deleted
+#define REGISTER_POOLED_PACKET(Z)                                             \
+    aProcessor.RegisterPacket(#Z, new (Z), PakProcessor::cPOOLED_ALLOCATION); \
+    assert(VALID_ID_RANGE(Z::cPACKET_ID));
+
+// Control packets that must not wait behind bulk traffic
+#define REGISTER_PRIORITY_PACKET(Z, OPTIONS)                                          \
+    aProcessor.RegisterPacket(#Z, new (Z), PakProcessor::cHIGH_PRIORITY | (OPTIONS)); \
+    assert(VALID_ID_RANGE(Z::cPACKET_ID));
+
+// Large packets whose bodies may be compressed, see NXXIO_Interface::setCompressionOptions()
+#define REGISTER_COMPRESSIBLE_PACKET(Z, OPTIONS)                                     \
+    aProcessor.RegisterPacket(#Z, new (Z), PakProcessor::cCOMPRESSIBLE | (OPTIONS)); \
+    assert(VALID_ID_RANGE(Z::cPACKET_ID));
+
 void NXXIO_PacketRegistry::registerPackets(PakProcessor& aProcessor)
 {
     registerClasses();
-    REGISTER_PACKET(NXXIO_HeartbeatPkt);
-    REGISTER_PACKET(NXXIO_InitializePkt);
-    REGISTER_PACKET(NXXIO_ExamplePkt);
-    REGISTER_PACKET(NXXIO_ScreenPkt);
+    REGISTER_PRIORITY_PACKET(NXXIO_HeartbeatPkt, PakProcessor::cPOOLED_ALLOCATION);
+    REGISTER_PRIORITY_PACKET(NXXIO_InitializePkt, 0);
+    REGISTER_PRIORITY_PACKET(NXXIO_SubscriptionPkt, 0);
+    REGISTER_PRIORITY_PACKET(NXXIO_TimeSyncPkt, PakProcessor::cPOOLED_ALLOCATION);
+    // Not high priority: the switch to shared memory must stay behind the TCP packets sent before it
+    REGISTER_PACKET(NXXIO_SharedMemoryPkt);
+    REGISTER_COMPRESSIBLE_PACKET(NXXIO_ExamplePkt, 0);
+    REGISTER_POOLED_PACKET(NXXIO_ScreenPkt);
 }
 
 void NXXIO_PacketRegistry::registerClasses()
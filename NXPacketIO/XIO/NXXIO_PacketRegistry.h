@@ -9,6 +9,7 @@
 #include "GenIO/GenUniqueId.h"
 class PakProcessor;
 #include "XIO/NXXIO_Packet.h"
+#include "PacketIO/PakFixedLayout.h"
 #include "PacketIO/PakSerializeFwd.h"
 
 class NX_PACKETIO_EXPORT NXXIO_PacketRegistry
@@ -48,6 +49,57 @@ public:
     std::string _applicationName;
 };
 
+// 同一主机上的对端之间协商共享内存传输 TCP连接保留用于检测断开
+class NX_PACKETIO_EXPORT NXXIO_SharedMemoryPkt : public NXXIO_Packet
+{
+public:
+    enum Stage
+    {
+        cOFFER,  // 发起方已创建共享内存段
+        cACCEPT, // 接收方已打开共享内存段 之后的包经共享内存发送
+        cREJECT, // 接收方无法打开共享内存段 继续使用TCP
+        cSWITCH  // 发起方在此包之后经共享内存发送
+    };
+    XIO_DEFINE_PACKET(NXXIO_SharedMemoryPkt, NXXIO_Packet, 5)
+    {
+        using namespace PakSerialization;
+        serializeBuf & _stage & _segmentName & _nonce & _doorbellPort;
+    }
+    int32_t _stage;
+    std::string _segmentName;
+    uint64_t _nonce;
+    int32_t _doorbellPort;
+};
+
+// 对端处理的包类型 连接时发送完整集合 之后回调连接或断开时只发送变化 用于跳过对端不处理的包
+class NX_PACKETIO_EXPORT NXXIO_SubscriptionPkt : public NXXIO_Packet
+{
+public:
+    XIO_DEFINE_PACKET(NXXIO_SubscriptionPkt, NXXIO_Packet, 6)
+    {
+        using namespace PakSerialization;
+        serializeBuf & _isComplete & _packetBits & _subscribed & _unsubscribed;
+    }
+    int32_t _isComplete;               // 非0时_packetBits为完整集合 否则_subscribed和_unsubscribed为变化
+    std::vector<uint32_t> _packetBits; // 包ID N对应第N/32个元素的第N%32位
+    std::vector<int32_t> _subscribed;
+    std::vector<int32_t> _unsubscribed;
+};
+
+// 用于估计对端的往返时间和时钟偏差 请求的_baseTime为其发送时间 应答回传该时间及收到请求的时间 应答的_baseTime为其发送时间
+class NX_PACKETIO_EXPORT NXXIO_TimeSyncPkt : public NXXIO_Packet
+{
+public:
+    XIO_DEFINE_PACKET(NXXIO_TimeSyncPkt, NXXIO_Packet, 7)
+    {
+        using namespace PakSerialization;
+        serializeBuf & _isResponse & _requestSendTime & _requestReceiveTime;
+    }
+    int32_t _isResponse;
+    double _requestSendTime;    // 仅应答 请求的发送时间 请求方时钟
+    double _requestReceiveTime; // 仅应答 收到请求的时间 应答方时钟
+};
+
 class NX_PACKETIO_EXPORT NXXIO_ExamplePkt : public NXXIO_Packet
 {
 public:
@@ -86,12 +138,12 @@ public:
 class NX_PACKETIO_EXPORT NXXIO_ScreenPkt : public NXXIO_Packet
 {
 public:
-    // 包定义及序列化
-    XIO_DEFINE_PACKET(NXXIO_ScreenPkt, NXXIO_Packet, 4)
+    // 包定义 定长包 以PakFixedLayout整包一次读写 线格式与逐字段序列化相同
+    XIO_DEFINE_PACKET_CTOR(NXXIO_ScreenPkt, NXXIO_Packet, 4) {}
+    template <typename T>
+    void Serialize(T& serializeBuf)
     {
-        using namespace PakSerialization;
-        serializeBuf & _imageWidth & _imageHeight & _dataOffset & _dataTotalLen
-            & _currentDataLen & _currentDataLen & _dataID& Array(_data, 1024);
+        FixedLayout::Serialize(serializeBuf, *this);
     }
     int _imageWidth;     // 图像宽度
     int _imageHeight;    // 图像高度
@@ -100,5 +152,12 @@ public:
     int _currentDataLen; // 当前数据包大小
     int _dataID;         // 数据ID 每包从0开始 依次递增 _dataOffset / 1024 = _dataID
     char _data[1024];    // 数据包
+
+    // 含基类字段 _currentDataLen按原格式发送两次
+    typedef PakFixedLayout<NXXIO_ScreenPkt, &NXXIO_ScreenPkt::_applicationId, &NXXIO_ScreenPkt::_baseTime,
+                           &NXXIO_ScreenPkt::_imageWidth, &NXXIO_ScreenPkt::_imageHeight, &NXXIO_ScreenPkt::_dataOffset,
+                           &NXXIO_ScreenPkt::_dataTotalLen, &NXXIO_ScreenPkt::_currentDataLen, &NXXIO_ScreenPkt::_currentDataLen,
+                           &NXXIO_ScreenPkt::_dataID, &NXXIO_ScreenPkt::_data>
+        FixedLayout;
 };
 #endif
@@ -0,0 +1,79 @@
+﻿#include "NXBench.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "GenIO/GenIP.h"
+#include "GenIO/GenInternetSocketAddress.h"
+#include "PacketIO/PakTCP_Connector.h"
+#include "Util/UtWallClock.h"
+
+namespace NXBench
+{
+double GetTime()
+{
+    return UtWallClock::GetMonotonicClock();
+}
+
+double GetCpuTime()
+{
+#ifdef _WIN32
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime))
+    {
+        return 0.0;
+    }
+    ULARGE_INTEGER kernel, user;
+    kernel.LowPart = kernelTime.dwLowDateTime;
+    kernel.HighPart = kernelTime.dwHighDateTime;
+    user.LowPart = userTime.dwLowDateTime;
+    user.HighPart = userTime.dwHighDateTime;
+    // FILETIME counts 100 ns intervals
+    return static_cast<double>(kernel.QuadPart + user.QuadPart) * 1.0E-7;
+#else
+    timespec current;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &current);
+    return static_cast<double>(current.tv_sec) + static_cast<double>(current.tv_nsec) * 1.0E-9;
+#endif
+}
+
+bool ConnectTCP(PakTCP_Connector& aConnector, PakTCP_IO*& aClientPtr, PakTCP_IO*& aServerPtr)
+{
+    GenSockets::GenInternetSocketAddress address(GenSockets::GenIP(127, 0, 0, 1), aConnector.GetBoundPort());
+    aClientPtr = nullptr;
+    aServerPtr = nullptr;
+    aConnector.BeginConnect(address, 5.0f);
+    return WaitFor(
+        [&]()
+        {
+            if (aClientPtr == nullptr)
+            {
+                GenSockets::GenInternetSocketAddress connectedAddress;
+                aConnector.CompleteConnect(connectedAddress, aClientPtr);
+            }
+            if (aServerPtr == nullptr)
+            {
+                aServerPtr = aConnector.Accept(0);
+            }
+            return aClientPtr != nullptr && aServerPtr != nullptr;
+        },
+        5.0);
+}
+
+void Report(const char* aScenario, const std::string& aCase, double aValue, const char* aUnit)
+{
+    std::printf("%-12s %-44s %12.3f %s\n", aScenario, aCase.c_str(), aValue, aUnit);
+    std::fflush(stdout);
+}
+
+void ReportFailure(const char* aScenario, const std::string& aCase, const char* aReason)
+{
+    std::printf("%-12s %-44s %12s %s\n", aScenario, aCase.c_str(), "-", aReason);
+    std::fflush(stdout);
+}
+} // namespace NXBench
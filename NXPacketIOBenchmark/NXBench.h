@@ -0,0 +1,71 @@
+﻿#ifndef NXBENCH_H
+#define NXBENCH_H
+
+/**
+   NXPacketIO benchmark scenarios.
+   Each scenario runs its cases over loopback or in memory and prints one line per measurement.
+   Run the executable with scenario names to run only those, or --list to show them.
+*/
+
+#include <string>
+#include <thread>
+
+class PakTCP_Connector;
+class PakTCP_IO;
+
+namespace NXBench
+{
+//! A scenario that can be selected by name on the command line
+struct Scenario
+{
+    const char* mName;
+    const char* mDescription;
+    void (*mRunFn)();
+};
+
+// Scenarios, one per NXBench_*.cpp
+void RunReactorBenchmark();
+void RunCoreLoopBenchmark();
+void RunGatherBenchmark();
+void RunFanOutBenchmark();
+void RunLayoutBenchmark();
+void RunDispatchBenchmark();
+void RunReliableUDPBenchmark();
+void RunLookupBenchmark();
+void RunCompressionBenchmark();
+
+//! Returns seconds on the monotonic clock
+double GetTime();
+
+//! Returns the CPU time in seconds used by every thread of the process
+double GetCpuTime();
+
+//! Calls aCondition until it returns 'true' or aTimeout seconds have passed, yielding in between.
+//! @return 'false' on timeout.
+template <class F>
+bool WaitFor(F aCondition, double aTimeout)
+{
+    double endTime = GetTime() + aTimeout;
+    while (!aCondition())
+    {
+        if (GetTime() > endTime)
+        {
+            return false;
+        }
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+//! Connects a TCP client to the port aConnector listens on, and accepts it.
+//! @return 'true' if both ends were created.  The caller owns them.
+bool ConnectTCP(PakTCP_Connector& aConnector, PakTCP_IO*& aClientPtr, PakTCP_IO*& aServerPtr);
+
+//! Prints a measurement as one aligned line
+void Report(const char* aScenario, const std::string& aCase, double aValue, const char* aUnit);
+
+//! Prints a case that could not be measured
+void ReportFailure(const char* aScenario, const std::string& aCase, const char* aReason);
+} // namespace NXBench
+
+#endif
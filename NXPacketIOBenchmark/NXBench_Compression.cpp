@@ -0,0 +1,101 @@
+﻿#include "NXBench.h"
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Util/UtLZ_Codec.h"
+
+namespace
+{
+const char* cSCENARIO = "compress";
+const size_t cTOTAL_BYTES = 200 << 20;
+
+enum PayloadKind
+{
+    cZEROS,
+    cTEXT_PAYLOAD,
+    cRANDOM
+};
+
+//! Fills aPayload with zeros, with text reports of tracks whose values vary, or with random bytes
+void FillPayload(PayloadKind aKind, std::vector<char>& aPayload)
+{
+    std::mt19937 random(1);
+    std::string text;
+    while (aKind == cTEXT_PAYLOAD && text.size() < aPayload.size())
+    {
+        char line[128];
+        std::snprintf(line, sizeof(line), "Track %u heading %.1f speed %.1f altitude %u status NOMINAL sensor RADAR-%u; ",
+                      static_cast<unsigned>(random() % 10000), (random() % 3600) * 0.1, (random() % 5000) * 0.1,
+                      static_cast<unsigned>(random() % 20000), static_cast<unsigned>(random() % 4));
+        text += line;
+    }
+    for (size_t i = 0; i < aPayload.size(); ++i)
+    {
+        switch (aKind)
+        {
+        case cZEROS:
+            aPayload[i] = 0;
+            break;
+        case cTEXT_PAYLOAD:
+            aPayload[i] = text[i];
+            break;
+        case cRANDOM:
+            aPayload[i] = static_cast<char>(random());
+            break;
+        }
+    }
+}
+
+//! Compresses and decompresses a packet body of aBodySize bytes with UtLZ_Codec, as
+//! PakCompressedHeader does for each packet registered with PakProcessor::cCOMPRESSIBLE.
+void RunCase(PayloadKind aKind, const char* aKindName, size_t aBodySize)
+{
+    std::string caseName = std::string(aKindName) + ", " + std::to_string(aBodySize >> 10) + " KB bodies";
+    std::vector<char> body(aBodySize);
+    FillPayload(aKind, body);
+    std::vector<char> compressed(UtLZ_Codec::GetMaximumCompressedSize(aBodySize));
+    std::vector<char> decompressed(aBodySize);
+    const int cREPEAT_COUNT = static_cast<int>(cTOTAL_BYTES / aBodySize);
+
+    size_t compressedSize = 0;
+    double start = NXBench::GetTime();
+    for (int i = 0; i < cREPEAT_COUNT; ++i)
+    {
+        compressedSize = UtLZ_Codec::Compress(body.data(), aBodySize, compressed.data(), compressed.size());
+    }
+    double compressTime = (NXBench::GetTime() - start) / cREPEAT_COUNT;
+
+    bool valid = true;
+    start = NXBench::GetTime();
+    for (int i = 0; i < cREPEAT_COUNT; ++i)
+    {
+        valid = UtLZ_Codec::Decompress(compressed.data(), compressedSize, decompressed.data(), aBodySize) && valid;
+    }
+    double decompressTime = (NXBench::GetTime() - start) / cREPEAT_COUNT;
+
+    if (!valid || decompressed != body)
+    {
+        NXBench::ReportFailure(cSCENARIO, caseName, "body did not survive the round trip");
+        return;
+    }
+    NXBench::Report(cSCENARIO, caseName + ", ratio", static_cast<double>(aBodySize) / compressedSize, ": 1");
+    NXBench::Report(cSCENARIO, caseName + ", compress", compressTime * 1.0E6, "us/body");
+    NXBench::Report(cSCENARIO, caseName + ", decompress", decompressTime * 1.0E6, "us/body");
+}
+} // namespace
+
+void NXBench::RunCompressionBenchmark()
+{
+    // Random bodies do not compress.  PakCompressedHeader then sends them as they are, after
+    // paying for the attempt.
+    const size_t cBODY_SIZES[] = {1 << 10, 64 << 10};
+    for (size_t bodySize : cBODY_SIZES)
+    {
+        RunCase(cZEROS, "zeros", bodySize);
+        RunCase(cTEXT_PAYLOAD, "text", bodySize);
+        RunCase(cRANDOM, "random", bodySize);
+    }
+}
@@ -0,0 +1,120 @@
+﻿#include "NXBench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "NXBench_Packets.h"
+#include "PacketIO/PakSerializeImpl.h"
+#include "XIO/NXXIO_Connection.h"
+#include "XIO/NXXIO_Interface.h"
+
+namespace
+{
+const char* cSCENARIO = "coreloop";
+const int cROUND_TRIPS = 2000;
+
+//! An NXXIO interface that discovers its peer through a multicast target on loopback
+class Node
+{
+public:
+    Node(const char* aName, NXXIO_Interface::CoreLoopMode aMode, int aPort, bool aEcho)
+        : mInterfacePtr(new NXXIO_Interface), mConnectionPtr(nullptr), mReceivedCount(0), mEcho(aEcho)
+    {
+        mInterfacePtr->setApplicationName(aName);
+        mInterfacePtr->setCoreLoopMode(aMode);
+        // Both interfaces run on this host; keep them on TCP so only the core loop differs
+        mInterfacePtr->setSharedMemoryOptions(false, 0);
+        mInterfacePtr->RegisterPacket("EchoPkt", new NXBench::EchoPkt);
+        NXXIO_Interface::UDP_Target target;
+        target._type = NXXIO_Interface::Multicast;
+        target._address = "239.1.1.9";
+        target._interfaceIP = "127.0.0.1";
+        target._sendPort = aPort;
+        target._recvPort = aPort;
+        mInterfacePtr->addUDP_Target(target);
+        mInterfacePtr->addCallback(mInterfacePtr->OnConnected.Connect(&Node::HandleConnected, this));
+        mInterfacePtr->addCallback(mInterfacePtr->Connect(&Node::HandleEcho, this));
+        mInterfacePtr->init(0);
+    }
+
+    ~Node() { delete mInterfacePtr; }
+
+    NXXIO_Interface* mInterfacePtr;
+    std::atomic<NXXIO_Connection*> mConnectionPtr;
+    std::atomic<int> mReceivedCount;
+
+private:
+    void HandleConnected(NXXIO_Connection* aConnectionPtr)
+    {
+        if (aConnectionPtr->isReliable())
+        {
+            mConnectionPtr = aConnectionPtr;
+        }
+    }
+
+    void HandleEcho(NXBench::EchoPkt& aPkt)
+    {
+        ++mReceivedCount;
+        if (mEcho)
+        {
+            NXBench::EchoPkt reply;
+            reply.mSequence = aPkt.mSequence;
+            mInterfacePtr->send(reply, static_cast<NXXIO_Connection*>(aPkt.GetSender()));
+        }
+    }
+
+    bool mEcho;
+};
+
+//! Measures the CPU the two interfaces use while idle, then the time for a packet to be echoed back.
+//! The polling loop wakes every 30 us whether or not anything arrived.
+void RunCase(NXXIO_Interface::CoreLoopMode aMode, const char* aModeName, int aPort)
+{
+    Node client("BenchClient", aMode, aPort, false);
+    Node server("BenchServer", aMode, aPort, true);
+    if (!NXBench::WaitFor([&]() { return client.mConnectionPtr != nullptr && server.mConnectionPtr != nullptr; }, 15.0))
+    {
+        NXBench::ReportFailure(cSCENARIO, aModeName, "interfaces did not connect");
+        return;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    double cpuStart = NXBench::GetCpuTime();
+    double start = NXBench::GetTime();
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    double idleCpu = (NXBench::GetCpuTime() - cpuStart) / (NXBench::GetTime() - start);
+
+    std::vector<double> roundTrips;
+    roundTrips.reserve(cROUND_TRIPS);
+    for (int i = 0; i < cROUND_TRIPS; ++i)
+    {
+        int receivedCount = client.mReceivedCount;
+        double sendTime = NXBench::GetTime();
+        NXBench::EchoPkt request;
+        request.mSequence = i;
+        client.mInterfacePtr->send(request, client.mConnectionPtr);
+        if (!NXBench::WaitFor([&]() { return client.mReceivedCount > receivedCount; }, 5.0))
+        {
+            NXBench::ReportFailure(cSCENARIO, aModeName, "echo not received");
+            return;
+        }
+        roundTrips.push_back(NXBench::GetTime() - sendTime);
+    }
+    std::sort(roundTrips.begin(), roundTrips.end());
+
+    std::string caseName = aModeName;
+    NXBench::Report(cSCENARIO, caseName + ", idle cpu", idleCpu * 100.0, "% of a core");
+    NXBench::Report(cSCENARIO, caseName + ", round trip p50", roundTrips[cROUND_TRIPS / 2] * 1.0E6, "us");
+    NXBench::Report(cSCENARIO, caseName + ", round trip p99", roundTrips[cROUND_TRIPS * 99 / 100] * 1.0E6, "us");
+}
+} // namespace
+
+void NXBench::RunCoreLoopBenchmark()
+{
+    // Each case gets its own port, so heartbeats of the previous pair are not picked up
+    RunCase(NXXIO_Interface::Polling, "polling", 39311);
+    RunCase(NXXIO_Interface::EventDriven, "event driven", 39312);
+}
@@ -0,0 +1,70 @@
+﻿#include "NXBench.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "NXBench_Packets.h"
+#include "PacketIO/PakProcessor.h"
+#include "PacketIO/PakSerializeImpl.h"
+#include "Util/UtCallback.h"
+
+namespace
+{
+const char* cSCENARIO = "dispatch";
+const int cCALL_COUNT = 20000000;
+
+struct Subscriber
+{
+    void HandlePing(NXBench::PingPkt& aPkt) { mSum += aPkt.mSequence; }
+
+    long long mSum{0};
+};
+
+//! Hands one packet to PakProcessor::ProcessPacket(), which calls every subscriber of its type
+//! through the type's UtCallbackList.  The same number of subscriber calls is made in each case.
+void RunCase(int aSubscriberCount)
+{
+    std::string caseName = std::to_string(aSubscriberCount) + " subscribers";
+    PakProcessor processor;
+    processor.RegisterPacket("PingPkt", new NXBench::PingPkt);
+    std::vector<Subscriber> subscribers(aSubscriberCount);
+    std::vector<std::unique_ptr<UtCallback>> callbacks;
+    for (Subscriber& subscriber : subscribers)
+    {
+        callbacks.emplace_back(processor.Connect(&Subscriber::HandlePing, &subscriber));
+    }
+
+    NXBench::PingPkt ping;
+    ping.mSequence = 1;
+    const int cPACKET_COUNT = cCALL_COUNT / aSubscriberCount;
+    double start = NXBench::GetTime();
+    for (int i = 0; i < cPACKET_COUNT; ++i)
+    {
+        processor.ProcessPacket(&ping, false);
+    }
+    double elapsed = NXBench::GetTime() - start;
+
+    long long total = 0;
+    for (const Subscriber& subscriber : subscribers)
+    {
+        total += subscriber.mSum;
+    }
+    if (total != static_cast<long long>(cPACKET_COUNT) * aSubscriberCount)
+    {
+        NXBench::ReportFailure(cSCENARIO, caseName, "subscribers missed packets");
+        return;
+    }
+    NXBench::Report(cSCENARIO, caseName + ", per packet", elapsed / cPACKET_COUNT * 1.0E9, "ns");
+    NXBench::Report(cSCENARIO, caseName + ", per subscriber", elapsed / cCALL_COUNT * 1.0E9, "ns");
+}
+} // namespace
+
+void NXBench::RunDispatchBenchmark()
+{
+    const int cSUBSCRIBER_COUNTS[] = {1, 8, 64};
+    for (int subscriberCount : cSUBSCRIBER_COUNTS)
+    {
+        RunCase(subscriberCount);
+    }
+}
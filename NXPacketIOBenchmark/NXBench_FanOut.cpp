@@ -0,0 +1,179 @@
+﻿#include "NXBench.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "NXBench_Packets.h"
+#include "PacketIO/PakEncodedPacket.h"
+#include "PacketIO/PakProcessor.h"
+#include "PacketIO/PakSerializeImpl.h"
+#include "PacketIO/PakTCP_Connector.h"
+#include "PacketIO/PakTCP_IO.h"
+#include "PacketIO/PakThreadedIO.h"
+#include "Util/UtCallbackHolder.h"
+
+namespace
+{
+const char* cSCENARIO = "fanout";
+const int cSEND_COUNT = 32768;
+//! Broadcasts timed between two flushes.  The send buffer of a PakTCP_IO holds about 60 state
+//! packets before BeginManualFlush() gives way to a flush.
+const int cBATCH_SIZE = 32;
+//! Each case runs several rounds and reports the fastest
+const int cROUND_COUNT = 3;
+
+std::atomic<int> sReceivedCount(0);
+
+void HandleState(NXBench::StatePkt& /*aPkt*/)
+{
+    ++sReceivedCount;
+}
+
+//! Publishes one state packet to aPeerCount TCP peers, first with a Send() per peer, which
+//! serializes the packet once for each, then with PakThreadedIO::SendToAll(), which serializes
+//! it once for all of them.  The peers are held in BeginManualFlush(), so the time measured is
+//! serializing and copying into the send buffers; the buffers are flushed and the receivers
+//! drained between batches, outside the timed region.  The encoding SendToAll() shares is also
+//! timed on its own and divided by the peer count.
+void RunCase(int aPeerCount)
+{
+    std::string caseName = std::to_string(aPeerCount) + " peers";
+    PakProcessor processor;
+    processor.RegisterPacket("StatePkt", new NXBench::StatePkt);
+    UtCallbackHolder callbacks;
+    callbacks += processor.Connect(&HandleState);
+    PakTCP_Connector connector(&processor);
+    if (!connector.Listen(0))
+    {
+        NXBench::ReportFailure(cSCENARIO, caseName, "could not listen");
+        return;
+    }
+
+    // Declared before the threaded IOs, which must be destroyed first
+    std::vector<std::unique_ptr<PakTCP_IO>> clients;
+    std::vector<std::unique_ptr<PakTCP_IO>> servers;
+    PakThreadedIO senderIO;
+    PakThreadedIO receiverIO(PakSocketReactor::cEPOLL_BACKEND);
+    for (int i = 0; i < aPeerCount; ++i)
+    {
+        PakTCP_IO* clientPtr;
+        PakTCP_IO* serverPtr;
+        if (!NXBench::ConnectTCP(connector, clientPtr, serverPtr))
+        {
+            NXBench::ReportFailure(cSCENARIO, caseName, "could not connect");
+            return;
+        }
+        clients.emplace_back(clientPtr);
+        servers.emplace_back(serverPtr);
+        clientPtr->BeginManualFlush();
+        senderIO.AddIO(clientPtr);
+        receiverIO.AddIO(serverPtr);
+    }
+    receiverIO.Start();
+    std::atomic<bool> done(false);
+    std::thread receiver(
+        [&]()
+        {
+            while (!done)
+            {
+                receiverIO.WaitForPackets(0.1);
+                receiverIO.Process();
+            }
+        });
+
+    NXBench::StatePkt state;
+    state.mValues.assign(100, 1.5);
+    state.mName.assign(200, 'x');
+    state.mAttributes.assign(32, "attribute");
+    const int cBATCH_COUNT = cSEND_COUNT / aPeerCount / cBATCH_SIZE + 1;
+    const int cEXPECTED_COUNT = cBATCH_COUNT * cBATCH_SIZE * aPeerCount;
+
+    // Times cBATCH_COUNT batches of aBroadcast(), flushing and waiting for delivery after each.
+    // Returns the fastest round in seconds, or a negative value if packets were lost.
+    auto timeBroadcasts = [&](auto aBroadcast)
+    {
+        double best = 0.0;
+        for (int round = 0; round < cROUND_COUNT; ++round)
+        {
+            sReceivedCount = 0;
+            double elapsed = 0.0;
+            for (int batch = 0; batch < cBATCH_COUNT; ++batch)
+            {
+                double start = NXBench::GetTime();
+                for (int i = 0; i < cBATCH_SIZE; ++i)
+                {
+                    aBroadcast();
+                }
+                elapsed += NXBench::GetTime() - start;
+                for (std::unique_ptr<PakTCP_IO>& client : clients)
+                {
+                    client->EndManualFlush();
+                    client->BeginManualFlush();
+                }
+            }
+            if (!NXBench::WaitFor([&]() { return sReceivedCount == cEXPECTED_COUNT; }, 30.0))
+            {
+                return -1.0;
+            }
+            if (round == 0 || elapsed < best)
+            {
+                best = elapsed;
+            }
+        }
+        return best;
+    };
+
+    double perPeer = timeBroadcasts(
+        [&]()
+        {
+            for (std::unique_ptr<PakTCP_IO>& client : clients)
+            {
+                client->Send(state);
+            }
+        });
+    double shared = perPeer < 0.0 ? perPeer : timeBroadcasts([&]() { senderIO.SendToAll(state); });
+
+    // SendToAll() to a single IO calls its Send() and does not encode at all
+    double encode = 0.0;
+    for (int round = 0; round < cROUND_COUNT; ++round)
+    {
+        double start = NXBench::GetTime();
+        for (int i = 0; i < cSEND_COUNT; ++i)
+        {
+            PakEncodedPacket encoded(state);
+            encoded.GetFrame(clients[0]->GetHeaderType(), &processor);
+        }
+        double elapsed = (NXBench::GetTime() - start) / cSEND_COUNT;
+        if (round == 0 || elapsed < encode)
+        {
+            encode = elapsed;
+        }
+    }
+
+    done = true;
+    receiver.join();
+    receiverIO.Stop();
+    receiverIO.Join();
+
+    if (perPeer < 0.0 || shared < 0.0)
+    {
+        NXBench::ReportFailure(cSCENARIO, caseName, "packets not delivered");
+        return;
+    }
+    const double cSENDS = static_cast<double>(cBATCH_COUNT) * cBATCH_SIZE * aPeerCount;
+    NXBench::Report(cSCENARIO, caseName + ", Send() per peer", perPeer / cSENDS * 1.0E9, "ns/peer");
+    NXBench::Report(cSCENARIO, caseName + ", SendToAll()", shared / cSENDS * 1.0E9, "ns/peer");
+    NXBench::Report(cSCENARIO, caseName + ", SendToAll(), encoding", encode / aPeerCount * 1.0E9, "ns/peer");
+}
+} // namespace
+
+void NXBench::RunFanOutBenchmark()
+{
+    const int cPEER_COUNTS[] = {1, 16, 128};
+    for (int peerCount : cPEER_COUNTS)
+    {
+        RunCase(peerCount);
+    }
+}
@@ -0,0 +1,116 @@
+﻿#include "NXBench.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "GenIO/GenUniqueId.h"
+#include "Util/UtHashMap.h"
+
+namespace
+{
+const char* cSCENARIO = "lookup";
+const int cLOOKUP_COUNT = 2000000;
+
+//! Stands in for an NXXIO_Connection
+struct Peer
+{
+    GenUniqueId mApplicationId;
+    std::string mApplicationName;
+};
+
+//! The hash NXXIO_Interface uses for application IDs
+struct UniqueIdHash
+{
+    size_t operator()(const GenUniqueId& aId) const { return aId.GetData(0) ^ (size_t)aId.GetData(1) * 31 ^ (size_t)aId.GetData(2) * 961; }
+};
+
+//! Keeps the compiler from dropping the loops below
+volatile size_t sSink = 0;
+
+//! Finds peers by application ID and by application name, as NXXIO_Interface does for every
+//! heartbeat and FindConnection() call: first by scanning the list of peers, then with the
+//! UtHashMap indexes the interface keeps.
+void RunCase(int aPeerCount)
+{
+    std::string caseName = std::to_string(aPeerCount) + " peers";
+    std::mt19937 random(1);
+    std::vector<Peer> peers(aPeerCount);
+    std::vector<Peer*> peerList;
+    UtHashMap<GenUniqueId, Peer*, UniqueIdHash> peersById;
+    UtHashMap<std::string, Peer*> peersByName;
+    for (int i = 0; i < aPeerCount; ++i)
+    {
+        peers[i].mApplicationId = GenUniqueId(random(), random(), random());
+        peers[i].mApplicationName = "Application" + std::to_string(i);
+        peerList.push_back(&peers[i]);
+        peersById.Insert(peers[i].mApplicationId, &peers[i]);
+        peersByName.Insert(peers[i].mApplicationName, &peers[i]);
+    }
+    std::vector<int> order(cLOOKUP_COUNT);
+    for (int& index : order)
+    {
+        index = static_cast<int>(random() % aPeerCount);
+    }
+
+    // A scan costs aPeerCount / 2 comparisons on average, so it gets fewer lookups
+    const int cSCAN_COUNT = cLOOKUP_COUNT / aPeerCount;
+    double start = NXBench::GetTime();
+    for (int i = 0; i < cSCAN_COUNT; ++i)
+    {
+        const GenUniqueId& id = peers[order[i]].mApplicationId;
+        for (Peer* peerPtr : peerList)
+        {
+            if (peerPtr->mApplicationId == id)
+            {
+                sSink = sSink + (size_t)peerPtr;
+                break;
+            }
+        }
+    }
+    double idScan = (NXBench::GetTime() - start) / cSCAN_COUNT;
+
+    start = NXBench::GetTime();
+    for (int i = 0; i < cSCAN_COUNT; ++i)
+    {
+        const std::string& name = peers[order[i]].mApplicationName;
+        for (Peer* peerPtr : peerList)
+        {
+            if (peerPtr->mApplicationName == name)
+            {
+                sSink = sSink + (size_t)peerPtr;
+                break;
+            }
+        }
+    }
+    double nameScan = (NXBench::GetTime() - start) / cSCAN_COUNT;
+
+    start = NXBench::GetTime();
+    for (int i = 0; i < cLOOKUP_COUNT; ++i)
+    {
+        sSink = sSink + (size_t)*peersById.Find(peers[order[i]].mApplicationId);
+    }
+    double idHash = (NXBench::GetTime() - start) / cLOOKUP_COUNT;
+
+    start = NXBench::GetTime();
+    for (int i = 0; i < cLOOKUP_COUNT; ++i)
+    {
+        sSink = sSink + (size_t)*peersByName.Find(peers[order[i]].mApplicationName);
+    }
+    double nameHash = (NXBench::GetTime() - start) / cLOOKUP_COUNT;
+
+    NXBench::Report(cSCENARIO, caseName + ", by ID, list scan", idScan * 1.0E9, "ns");
+    NXBench::Report(cSCENARIO, caseName + ", by ID, UtHashMap", idHash * 1.0E9, "ns");
+    NXBench::Report(cSCENARIO, caseName + ", by name, list scan", nameScan * 1.0E9, "ns");
+    NXBench::Report(cSCENARIO, caseName + ", by name, UtHashMap", nameHash * 1.0E9, "ns");
+}
+} // namespace
+
+void NXBench::RunLookupBenchmark()
+{
+    const int cPEER_COUNTS[] = {10, 100, 1000};
+    for (int peerCount : cPEER_COUNTS)
+    {
+        RunCase(peerCount);
+    }
+}
@@ -0,0 +1,133 @@
+﻿#ifndef NXBENCH_PACKETS_H
+#define NXBENCH_PACKETS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "PacketIO/PakPacket.h"
+#include "PacketIO/PakSerializeFwd.h"
+#include "XIO/NXXIO_Packet.h"
+
+namespace NXBench
+{
+//! A small packet, as sent by latency sensitive traffic
+class PingPkt : public PakPacket
+{
+public:
+    typedef bool BaseType;
+    static const int cPACKET_ID = 1;
+
+    PingPkt()
+        : PakPacket(cPACKET_ID)
+    {
+    }
+
+    template <typename T>
+    void Serialize(T& aBuff)
+    {
+        aBuff & mSequence & mSendTime;
+    }
+
+    int32_t mSequence{0};
+    double mSendTime{0.0};
+};
+
+//! A state update of about a kilobyte, as published to every peer.  The attributes are
+//! serialized one by one, as the fields of most packets are.
+class StatePkt : public PakPacket
+{
+public:
+    typedef bool BaseType;
+    static const int cPACKET_ID = 4;
+
+    StatePkt()
+        : PakPacket(cPACKET_ID)
+    {
+    }
+
+    template <typename T>
+    void Serialize(T& aBuff)
+    {
+        aBuff & mEntityId & mValues & mName & mAttributes;
+    }
+
+    int32_t mEntityId{0};
+    std::vector<double> mValues;
+    std::string mName;
+    std::vector<std::string> mAttributes;
+};
+
+//! A bulk transfer of a few hundred kilobytes, such as a snapshot of a scenario
+class SnapshotPkt : public PakPacket
+{
+public:
+    typedef bool BaseType;
+    static const int cPACKET_ID = 5;
+
+    SnapshotPkt()
+        : PakPacket(cPACKET_ID)
+    {
+    }
+
+    template <typename T>
+    void Serialize(T& aBuff)
+    {
+        aBuff & mSequence & mData;
+    }
+
+    int32_t mSequence{0};
+    std::vector<char> mData;
+};
+
+//! A large opaque payload.  With REFERENCE set the payload is serialized with RawDataRef(),
+//! which PakTCP_IO writes straight from mData instead of copying it into its send buffer.
+template <int PACKET_ID, bool REFERENCE>
+class BlobPkt : public PakPacket
+{
+public:
+    typedef bool BaseType;
+    static const int cPACKET_ID = PACKET_ID;
+
+    BlobPkt()
+        : PakPacket(cPACKET_ID)
+    {
+    }
+
+    template <typename T>
+    void Serialize(T& aBuff)
+    {
+        aBuff & mSize;
+        if (!T::cIS_OUTPUT)
+        {
+            mData.resize(mSize);
+        }
+        if (REFERENCE)
+        {
+            aBuff & PakSerialization::RawDataRef(mData.data(), mSize);
+        }
+        else
+        {
+            aBuff & PakSerialization::RawData(mData.data(), mSize);
+        }
+    }
+
+    int32_t mSize{0};
+    std::vector<char> mData;
+};
+typedef BlobPkt<2, false> CopyBlobPkt;
+typedef BlobPkt<3, true> RefBlobPkt;
+
+//! A small NXXIO packet, echoed back by its receiver
+class EchoPkt : public NXXIO_Packet
+{
+public:
+    XIO_DEFINE_PACKET(EchoPkt, NXXIO_Packet, 100)
+    {
+        serializeBuf & mSequence;
+    }
+    int32_t mSequence{0};
+};
+} // namespace NXBench
+
+#endif
@@ -0,0 +1,176 @@
+﻿#include "NXBench.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "NXBench_Packets.h"
+#include "PacketIO/PakProcessor.h"
+#include "PacketIO/PakSerializeImpl.h"
+#include "PacketIO/PakTCP_Connector.h"
+#include "PacketIO/PakTCP_IO.h"
+#include "PacketIO/PakThreadedIO.h"
+#include "Util/UtCallbackHolder.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/select.h>
+#endif
+
+namespace
+{
+const char* cSCENARIO = "reactor";
+const int cPACKET_COUNT = 2000;
+
+int sReceivedCount = 0;
+
+void HandlePing(NXBench::PingPkt& /*aPkt*/)
+{
+    ++sReceivedCount;
+}
+
+//! Sends one packet at a time on one connection and waits for the reactor to deliver it, while
+//! aIdleCount other connections are read by the same reactor.  select() visits every socket on
+//! each wakeup, epoll only the ready one.
+void RunCase(PakSocketReactor::Backend aBackend, const char* aBackendName, int aIdleCount)
+{
+    std::string caseName = std::string(aBackendName) + ", " + std::to_string(aIdleCount) + " idle connections";
+    PakProcessor processor;
+    processor.RegisterPacket("PingPkt", new NXBench::PingPkt);
+    UtCallbackHolder callbacks;
+    callbacks += processor.Connect(&HandlePing);
+    PakTCP_Connector connector(&processor);
+    if (!connector.Listen(0))
+    {
+        NXBench::ReportFailure(cSCENARIO, caseName, "could not listen");
+        return;
+    }
+
+    // Declared before the threaded IO, which must be destroyed first
+    std::vector<std::unique_ptr<PakTCP_IO>> ios;
+    PakTCP_IO* activePtr = nullptr;
+    PakThreadedIO threadedIO(aBackend);
+    for (int i = 0; i <= aIdleCount; ++i)
+    {
+        PakTCP_IO* clientPtr;
+        PakTCP_IO* serverPtr;
+        if (!NXBench::ConnectTCP(connector, clientPtr, serverPtr))
+        {
+            NXBench::ReportFailure(cSCENARIO, caseName, "could not connect");
+            return;
+        }
+        ios.emplace_back(clientPtr);
+        ios.emplace_back(serverPtr);
+        threadedIO.AddIO(serverPtr);
+        if (activePtr == nullptr)
+        {
+            activePtr = clientPtr;
+        }
+    }
+    threadedIO.Start();
+
+    sReceivedCount = 0;
+    double start = NXBench::GetTime();
+    bool delivered = true;
+    for (int i = 0; i < cPACKET_COUNT && delivered; ++i)
+    {
+        NXBench::PingPkt ping;
+        ping.mSequence = i;
+        activePtr->Send(ping);
+        delivered = NXBench::WaitFor(
+            [&]()
+            {
+                threadedIO.WaitForPackets(0.1);
+                threadedIO.Process();
+                return sReceivedCount > i;
+            },
+            5.0);
+    }
+    double elapsed = NXBench::GetTime() - start;
+    threadedIO.Stop();
+    threadedIO.Join();
+
+    if (!delivered)
+    {
+        NXBench::ReportFailure(cSCENARIO, caseName, "packet not delivered");
+        return;
+    }
+    NXBench::Report(cSCENARIO, caseName, elapsed / cPACKET_COUNT * 1.0E6, "us/packet");
+}
+
+//! Returns 'true' if select() can wait on the sockets of aIdleCount + 1 connections.  Both ends of
+//! each connection, the listen socket and a few descriptors opened before the benchmark have to
+//! stay below FD_SETSIZE.
+bool SelectCanWaitOn(int aIdleCount)
+{
+#ifdef _WIN32
+    // A Windows fd_set holds 64 sockets by default, whatever their handles, and the reactor only
+    // waits on the server ends
+    return aIdleCount + 1 < 64;
+#else
+    const int cOTHER_DESCRIPTORS = 16;
+    return 2 * (aIdleCount + 1) + cOTHER_DESCRIPTORS < FD_SETSIZE;
+#endif
+}
+
+//! Raises the soft limit on open descriptors to aCount, or as far as the hard limit allows.
+//! @return 'true' if aCount descriptors may be open.
+bool RaiseDescriptorLimit(int aCount)
+{
+#ifdef _WIN32
+    return true;
+#else
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+    {
+        return false;
+    }
+    if (limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < static_cast<rlim_t>(aCount))
+    {
+        limit.rlim_cur = (limit.rlim_max == RLIM_INFINITY || limit.rlim_max > static_cast<rlim_t>(aCount)) ? aCount : limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        getrlimit(RLIMIT_NOFILE, &limit);
+    }
+    return limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur >= static_cast<rlim_t>(aCount);
+#endif
+}
+} // namespace
+
+void NXBench::RunReactorBenchmark()
+{
+    const int cIDLE_COUNTS[] = {0, 10, 100, 1000};
+    for (int idleCount : cIDLE_COUNTS)
+    {
+        if (!RaiseDescriptorLimit(2 * (idleCount + 1) + 64))
+        {
+            ReportFailure(cSCENARIO, std::to_string(idleCount) + " idle connections", "too few descriptors allowed");
+            continue;
+        }
+        if (SelectCanWaitOn(idleCount))
+        {
+            RunCase(PakSocketReactor::cSELECT_BACKEND, "select", idleCount);
+        }
+        else
+        {
+            ReportFailure(cSCENARIO, "select, " + std::to_string(idleCount) + " idle connections", "descriptors above FD_SETSIZE");
+        }
+#ifndef _WIN32
+        // cEPOLL_BACKEND falls back to select() on Windows
+        RunCase(PakSocketReactor::cEPOLL_BACKEND, "epoll", idleCount);
+#endif
+    }
+
+#ifndef _WIN32
+    // Only epoll can wait on this many sockets.  PakThreadedIO::Process() still visits every
+    // connection's queue, which is most of the time per packet here.
+    const int cLARGE_IDLE_COUNT = 4000;
+    if (RaiseDescriptorLimit(2 * (cLARGE_IDLE_COUNT + 1) + 64))
+    {
+        RunCase(PakSocketReactor::cEPOLL_BACKEND, "epoll", cLARGE_IDLE_COUNT);
+    }
+    else
+    {
+        ReportFailure(cSCENARIO, "epoll, " + std::to_string(cLARGE_IDLE_COUNT) + " idle connections", "too few descriptors allowed");
+    }
+#endif
+}
@@ -0,0 +1,211 @@
+﻿#include "NXBench.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "GenIO/GenUDP_IO.h"
+#include "NXBench_Packets.h"
+#include "PacketIO/PakProcessor.h"
+#include "PacketIO/PakReliableUDP.h"
+#include "PacketIO/PakSerializeImpl.h"
+#include "PacketIO/PakTCP_Connector.h"
+#include "PacketIO/PakTCP_IO.h"
+#include "PacketIO/PakThreadedIO.h"
+#include "PacketIO/PakUDP_IO.h"
+#include "Util/UtHistogram.h"
+
+namespace
+{
+const char* cSCENARIO = "rudp";
+const int cSNAPSHOT_COUNT = 100;
+const int cSNAPSHOT_SIZE = 256 << 10;
+//! Stream of the reliable UDP layer that carries pings, delivered as soon as they arrive
+const int cPING_STREAM = 1;
+
+void RegisterPackets(PakProcessor& aProcessor)
+{
+    aProcessor.RegisterPacket("PingPkt", new NXBench::PingPkt);
+    aProcessor.RegisterPacket("SnapshotPkt", new NXBench::SnapshotPkt);
+}
+
+//! Sends cSNAPSHOT_COUNT snapshots through aSenderPtr while another thread sends a ping every
+//! 2 ms, and extracts both from aReceiverIO.  Reports the snapshot throughput and how long the
+//! pings took to arrive.  A ping sent over TCP waits behind the snapshot being written.
+void RunTransfer(const std::string& aCaseName, PakSocketIO* aSenderPtr, PakThreadedIO& aReceiverIO)
+{
+    std::mutex sendMutex;
+    std::atomic<bool> done(false);
+    std::thread pinger(
+        [&]()
+        {
+            for (int i = 0; !done; ++i)
+            {
+                NXBench::PingPkt ping;
+                ping.mSequence = i;
+                ping.mSendTime = NXBench::GetTime();
+                {
+                    std::lock_guard<std::mutex> lock(sendMutex);
+                    aSenderPtr->Send(ping);
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+        });
+
+    double start = NXBench::GetTime();
+    std::thread sender(
+        [&]()
+        {
+            NXBench::SnapshotPkt snapshot;
+            snapshot.mData.assign(cSNAPSHOT_SIZE, 'x');
+            for (int i = 0; i < cSNAPSHOT_COUNT && !done; ++i)
+            {
+                snapshot.mSequence = i;
+                // The reliable UDP layer refuses frames while its queue is full
+                while (!done)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(sendMutex);
+                        if (aSenderPtr->Send(snapshot))
+                        {
+                            break;
+                        }
+                    }
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                }
+            }
+        });
+
+    UtHistogram pingLatency;
+    int receivedCount = 0;
+    bool ordered = true;
+    bool delivered = NXBench::WaitFor(
+        [&]()
+        {
+            aReceiverIO.WaitForPackets(0.01);
+            PakThreadedIO::PacketList packets;
+            aReceiverIO.Extract(packets);
+            double now = NXBench::GetTime();
+            for (PakPacket* pktPtr : packets)
+            {
+                if (pktPtr->ID() == NXBench::SnapshotPkt::cPACKET_ID)
+                {
+                    ordered = ordered && static_cast<NXBench::SnapshotPkt*>(pktPtr)->mSequence == receivedCount;
+                    ++receivedCount;
+                }
+                else
+                {
+                    pingLatency.Record(static_cast<uint64_t>((now - static_cast<NXBench::PingPkt*>(pktPtr)->mSendTime) * 1.0E9));
+                }
+                delete pktPtr;
+            }
+            return receivedCount == cSNAPSHOT_COUNT;
+        },
+        60.0);
+    double elapsed = NXBench::GetTime() - start;
+    done = true;
+    pinger.join();
+    sender.join();
+
+    if (!delivered || !ordered)
+    {
+        NXBench::ReportFailure(cSCENARIO, aCaseName, delivered ? "snapshots out of order" : "snapshots not delivered");
+        return;
+    }
+    UtHistogram::Snapshot latency;
+    pingLatency.GetSnapshot(latency);
+    NXBench::Report(cSCENARIO, aCaseName + ", throughput", static_cast<double>(cSNAPSHOT_COUNT) * cSNAPSHOT_SIZE / elapsed / (1 << 20), "MB/s");
+    NXBench::Report(cSCENARIO, aCaseName + ", ping p50", latency.GetPercentile(50) * 1.0E-6, "ms");
+    NXBench::Report(cSCENARIO, aCaseName + ", ping p99", latency.GetPercentile(99) * 1.0E-6, "ms");
+}
+
+//! Loopback TCP loses nothing and the stream cannot be made to drop bytes without the kernel's
+//! help, so this is a lossless baseline and is named so in the output
+void RunTCP()
+{
+    const char* cCASE = "tcp, lossless baseline";
+    PakProcessor processor;
+    RegisterPackets(processor);
+    PakTCP_Connector connector(&processor);
+    PakTCP_IO* clientPtr;
+    PakTCP_IO* serverPtr;
+    if (!connector.Listen(0) || !NXBench::ConnectTCP(connector, clientPtr, serverPtr))
+    {
+        NXBench::ReportFailure(cSCENARIO, cCASE, "could not connect");
+        return;
+    }
+    // Declared before the threaded IO, which must be destroyed first
+    std::unique_ptr<PakTCP_IO> client(clientPtr);
+    std::unique_ptr<PakTCP_IO> server(serverPtr);
+    PakThreadedIO threadedIO(PakSocketReactor::cEPOLL_BACKEND);
+    threadedIO.AddIO(serverPtr);
+    threadedIO.Start();
+    RunTransfer(cCASE, clientPtr, threadedIO);
+    threadedIO.Stop();
+    threadedIO.Join();
+}
+
+//! Two reliable UDP peers on loopback that each drop aLossRate of the datagrams they send
+void RunReliableUDP(double aLossRate, int aPort)
+{
+    std::string caseName = "reliable udp, " + std::to_string(static_cast<int>(aLossRate * 100.0 + 0.5)) + "% loss";
+    PakProcessor processor;
+    RegisterPackets(processor);
+    PakReliableUDP::Options options;
+    options.mPacketStreams[NXBench::PingPkt::cPACKET_ID] = cPING_STREAM;
+    options.mUnorderedStreams.insert(cPING_STREAM);
+    options.mTestLossRate = aLossRate;
+
+    GenUDP_IO* senderUDP_Ptr = new GenUDP_IO;
+    GenUDP_IO* receiverUDP_Ptr = new GenUDP_IO;
+    if (!senderUDP_Ptr->Init("127.0.0.1", aPort + 1, aPort) || !receiverUDP_Ptr->Init("127.0.0.1", aPort, aPort + 1))
+    {
+        delete senderUDP_Ptr;
+        delete receiverUDP_Ptr;
+        NXBench::ReportFailure(cSCENARIO, caseName, "could not bind");
+        return;
+    }
+    // Declared before the threaded IO, which must be destroyed first
+    std::unique_ptr<PakUDP_IO> sender(new PakUDP_IO(senderUDP_Ptr, &processor));
+    std::unique_ptr<PakUDP_IO> receiver(new PakUDP_IO(receiverUDP_Ptr, &processor));
+    sender->SetReliable(options);
+    receiver->SetReliable(options);
+    PakThreadedIO senderIO(PakSocketReactor::cEPOLL_BACKEND);
+    PakThreadedIO receiverIO(PakSocketReactor::cEPOLL_BACKEND);
+    // The sender's thread reads acknowledgements and retransmits
+    senderIO.AddIO(sender.get());
+    receiverIO.AddIO(receiver.get());
+    senderIO.Start();
+    receiverIO.Start();
+    if (NXBench::WaitFor([&]() { return sender->GetReliable()->IsEstablished() && receiver->GetReliable()->IsEstablished(); }, 5.0))
+    {
+        RunTransfer(caseName, sender.get(), receiverIO);
+        PakReliableUDP::Stats stats;
+        sender->GetReliable()->GetStats(stats);
+        NXBench::Report(cSCENARIO, caseName + ", resent", static_cast<double>(stats.mRetransmits + stats.mTimeouts), "datagrams");
+    }
+    else
+    {
+        NXBench::ReportFailure(cSCENARIO, caseName, "peers did not connect");
+    }
+    senderIO.Stop();
+    receiverIO.Stop();
+    senderIO.Join();
+    receiverIO.Join();
+}
+} // namespace
+
+void NXBench::RunReliableUDPBenchmark()
+{
+    RunTCP();
+    const double cLOSS_RATES[] = {0.0, 0.01, 0.05};
+    int port = 39330;
+    for (double lossRate : cLOSS_RATES)
+    {
+        // Each case gets its own ports, so datagrams of the previous pair are not picked up
+        RunReliableUDP(lossRate, port);
+        port += 2;
+    }
+}
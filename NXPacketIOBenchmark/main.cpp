@@ -0,0 +1,52 @@
+﻿#include <cstdio>
+#include <cstring>
+
+#include "NXBench.h"
+
+namespace
+{
+const NXBench::Scenario cSCENARIOS[] = {
+    {"reactor", "Delivery latency on one connection while idle ones share the reactor, select vs epoll", &NXBench::RunReactorBenchmark},
+    {"coreloop", "Idle CPU and round trip time of two NXXIO interfaces, polling vs event driven", &NXBench::RunCoreLoopBenchmark},
+    {"gather", "Sending large blobs copied into the send buffer vs written from the packet with RawDataRef", &NXBench::RunGatherBenchmark},
+    {"fanout", "Serializing one packet for many buffered TCP peers, a Send() per peer vs SendToAll", &NXBench::RunFanOutBenchmark},
+    {"layout", "Writing and reading NXXIO_ScreenPkt one field at a time vs with its PakFixedLayout", &NXBench::RunLayoutBenchmark},
+    {"dispatch", "Calling the subscribers of a processed packet, 1 to 64 subscribers", &NXBench::RunDispatchBenchmark},
+    {"rudp", "Bulk transfer and ping latency over lossless TCP vs reliable UDP with 0 to 5% loss", &NXBench::RunReliableUDPBenchmark},
+    {"lookup", "Finding a connection by application ID or name, list scan vs UtHashMap", &NXBench::RunLookupBenchmark},
+    {"compress", "Ratio and cost of compressing zero, text and random packet bodies with UtLZ_Codec", &NXBench::RunCompressionBenchmark},
+};
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && std::strcmp(argv[1], "--list") == 0)
+    {
+        for (const NXBench::Scenario& scenario : cSCENARIOS)
+        {
+            std::printf("%-12s %s\n", scenario.mName, scenario.mDescription);
+        }
+        return 0;
+    }
+
+    int runCount = 0;
+    for (const NXBench::Scenario& scenario : cSCENARIOS)
+    {
+        bool selected = (argc <= 1);
+        for (int i = 1; i < argc && !selected; ++i)
+        {
+            selected = (std::strcmp(argv[i], scenario.mName) == 0);
+        }
+        if (selected)
+        {
+            scenario.mRunFn();
+            ++runCount;
+        }
+    }
+    if (runCount == 0)
+    {
+        std::printf("No scenario matched.  Use --list to show them.\n");
+        return 1;
+    }
+    return 0;
+}